@@ -0,0 +1,104 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Linear (bump pointer) arena for transient allocations
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_ARENA_H
+#define AP_ARENA_H
+
+#include <stddef.h>
+
+#ifndef AP_ARENA_BLOCK_SIZE
+#define AP_ARENA_BLOCK_SIZE (256 * 1024)
+#endif
+
+#ifndef AP_ARENA_ALIGN
+#define AP_ARENA_ALIGN 16
+#endif
+
+struct AP_Arena_Block;
+
+struct AP_Arena {
+        // the block allocating from, older blocks are linked by prev
+        struct AP_Arena_Block *block;
+        // default size of a new block
+        size_t block_size;
+        // bytes allocated since last reset
+        size_t used;
+        // high-water mark of used
+        size_t peak;
+};
+
+/**
+ * Position of the arena, used to release allocations of a scope
+ */
+struct AP_Arena_Marker {
+        struct AP_Arena_Block *block;
+        size_t offset;
+        size_t used;
+};
+
+/**
+ * @brief Initialize an arena
+ *
+ * @param arena
+ * @param block_size default block size, 0 to use AP_ARENA_BLOCK_SIZE
+ * @return int AP_Types
+ */
+int ap_arena_init(struct AP_Arena *arena, size_t block_size);
+
+/**
+ * @brief Allocate memory from arena, the memory is aligned to
+ * AP_ARENA_ALIGN and is valid until the arena is reset or rewound.
+ *
+ * @param arena
+ * @param size size of memory (byte)
+ * @return pointer points to the memory, NULL on error
+ */
+void *ap_arena_alloc(struct AP_Arena *arena, size_t size);
+
+/**
+ * @brief Release all of the allocations of arena,
+ * the blocks are kept and merged into one for reuse.
+ *
+ * @param arena
+ * @return int AP_Types
+ */
+int ap_arena_reset(struct AP_Arena *arena);
+
+/**
+ * @brief Release all of the memory of arena
+ *
+ * @param arena
+ * @return int AP_Types
+ */
+int ap_arena_free(struct AP_Arena *arena);
+
+/**
+ * @brief Begin a scope, scopes can be nested
+ *
+ * @param arena
+ * @return struct AP_Arena_Marker pass it to ap_arena_rewind
+ */
+struct AP_Arena_Marker ap_arena_mark(struct AP_Arena *arena);
+
+/**
+ * @brief End a scope, release the allocations after the marker
+ *
+ * @param arena
+ * @param marker returned by ap_arena_mark
+ * @return int AP_Types
+ */
+int ap_arena_rewind(struct AP_Arena *arena, struct AP_Arena_Marker marker);
+
+/**
+ * @brief Get the frame arena of the calling thread.
+ * The frame arena of the render thread is reset by ap_render_flush,
+ * other threads should only use it inside a mark/rewind scope.
+ *
+ * @return struct AP_Arena*
+ */
+struct AP_Arena *ap_arena_frame();
+
+#endif // AP_ARENA_H
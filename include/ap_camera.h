@@ -15,7 +15,7 @@
 #include "cglm/call.h"
 
 struct AP_Camera {
-        int id;
+        unsigned int id;
 
         vec3 position;
         vec3 front;
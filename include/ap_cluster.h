@@ -0,0 +1,148 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Binning point lights into the clusters of the view frustum
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_CLUSTER_H
+#define AP_CLUSTER_H
+
+#include <stddef.h>
+
+// number of clusters on the x, y axis of screen and the z slices of depth
+#ifndef AP_CLUSTER_X
+#define AP_CLUSTER_X 16
+#endif
+#ifndef AP_CLUSTER_Y
+#define AP_CLUSTER_Y 9
+#endif
+#ifndef AP_CLUSTER_Z
+#define AP_CLUSTER_Z 24
+#endif
+
+#define AP_CLUSTER_NUM (AP_CLUSTER_X * AP_CLUSTER_Y * AP_CLUSTER_Z)
+
+// the lights after the first AP_CLUSTER_MAX_LIGHTS of a cluster are dropped
+#ifndef AP_CLUSTER_MAX_LIGHTS
+#define AP_CLUSTER_MAX_LIGHTS 128
+#endif
+
+/**
+ * Sphere of the space lit by a light
+ */
+struct AP_Cluster_Light {
+        float position[3];
+        float radius;
+};
+
+/**
+ * The view frustum is split into AP_CLUSTER_X * AP_CLUSTER_Y tiles on
+ * screen and AP_CLUSTER_Z slices of depth, the slices are exponential so
+ * the clusters near the camera are thin. Cluster (x, y, z) has index
+ * x + y * AP_CLUSTER_X + z * AP_CLUSTER_X * AP_CLUSTER_Y.
+ * Depth d (distance along -z of view space) is in slice
+ * floor(log(d) * slice_scale - slice_bias).
+ */
+struct AP_Cluster_Grid {
+        float near;
+        float far;
+        float slice_scale;
+        float slice_bias;
+        // view space AABB of clusters, min xyz and max xyz
+        float *aabb;
+        // offset and number of the lights of clusters in indices
+        unsigned int *clusters;
+        // light indices of clusters, AP_CLUSTER_MAX_LIGHTS for each
+        // cluster while binning and packed after binning
+        unsigned int *indices;
+        size_t index_num;
+
+        // view space lights and their first and last slices while binning
+        struct AP_Cluster_Light *view_lights;
+        int *light_slices;
+        int light_capacity;
+        int light_num;
+};
+
+/**
+ * @brief Initialize the grid, the memory of clusters is allocated
+ *
+ * @param grid
+ * @return int AP_Types
+ */
+int ap_cluster_init(struct AP_Cluster_Grid *grid);
+
+/**
+ * @brief Release the memory of grid
+ *
+ * @param grid
+ * @return int AP_Types
+ */
+int ap_cluster_free(struct AP_Cluster_Grid *grid);
+
+/**
+ * @brief Compute the clusters of a perspective projection,
+ * call it again only when the projection changes.
+ *
+ * @param grid
+ * @param projection perspective projection matrix (column major)
+ * @param near distance to the near plane
+ * @param far distance to the far plane
+ * @return int AP_Types
+ */
+int ap_cluster_setup(
+        struct AP_Cluster_Grid *grid,
+        const float *projection,
+        float near,
+        float far
+);
+
+/**
+ * @brief Find the lights touching each cluster, the slices of depth are
+ * binned in parallel by the job system.
+ * The result is in grid->clusters and grid->indices.
+ *
+ * @param grid
+ * @param view view matrix (column major)
+ * @param lights world space lights
+ * @param light_num number of lights
+ * @return int AP_Types
+ */
+int ap_cluster_bin(
+        struct AP_Cluster_Grid *grid,
+        const float *view,
+        const struct AP_Cluster_Light *lights,
+        int light_num
+);
+
+/**
+ * @brief Slice of view space depth, clamped to [0, AP_CLUSTER_Z)
+ */
+int ap_cluster_slice(struct AP_Cluster_Grid *grid, float depth);
+
+/**
+ * @brief Index of cluster (x, y, z)
+ */
+static inline int ap_cluster_index(int x, int y, int z)
+{
+        return x + y * AP_CLUSTER_X + z * AP_CLUSTER_X * AP_CLUSTER_Y;
+}
+
+/**
+ * @brief Distance where the light attenuation drops the brightest
+ * component of a light under 1/256, -1 if the light never fades out
+ *
+ * @param intensity brightest color component of the light
+ * @param constant
+ * @param linear
+ * @param quadratic
+ * @return float radius
+ */
+float ap_cluster_light_radius(
+        float intensity,
+        float constant,
+        float linear,
+        float quadratic
+);
+
+#endif // AP_CLUSTER_H
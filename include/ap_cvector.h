@@ -34,13 +34,15 @@ typedef enum {
 
 struct AP_Vector {
         // number of elements
-        int length;
+        size_t length;
         // total capacity
-        int capacity;
+        size_t capacity;
         // vector type
         int type;
         // pointer points to data
         char* data;
+        // size of one element (byte), set by ap_vector_init
+        size_t elem_size;
 };
 
 /**
@@ -51,6 +53,15 @@ struct AP_Vector {
  */
 int ap_vector_init(struct AP_Vector *vector, int vector_type);
 
+/**
+ * @brief vector initialize with the size of element,
+ * used for the element types not listed in AP_VECTOR_Types.
+ * @param vector pointer points to vector struct object
+ * @param elem_size size of one element (byte)
+ * @return int AP_Types
+ */
+int ap_vector_init_size(struct AP_Vector *vector, size_t elem_size);
+
 /**
  * @brief Release the memory allocated by vector
  * @param vector
@@ -58,6 +69,52 @@ int ap_vector_init(struct AP_Vector *vector, int vector_type);
  */
 int ap_vector_free(struct AP_Vector *vector);
 
+/**
+ * @brief Make the capacity of vector at least capacity elements
+ * @param vector
+ * @param capacity number of elements
+ * @return int AP_Types
+ */
+int ap_vector_reserve(struct AP_Vector *vector, size_t capacity);
+
+/**
+ * @brief Make room for count more elements, the capacity grows to
+ * the smallest power of two which holds them with a single realloc.
+ * @param vector
+ * @param count number of elements to be appended
+ * @return int AP_Types
+ */
+int ap_vector_grow(struct AP_Vector *vector, size_t count);
+
+/**
+ * @brief Release the unused capacity of vector,
+ * the capacity becomes the length (at least one element).
+ * @param vector
+ * @return int AP_Types
+ */
+int ap_vector_shrink_to_fit(struct AP_Vector *vector);
+
+/**
+ * @brief Change the length of vector, new elements are zero filled
+ * @param vector
+ * @param length number of elements
+ * @return int AP_Types
+ */
+int ap_vector_resize(struct AP_Vector *vector, size_t length);
+
+/**
+ * @brief Append count elements to the back of the vector
+ * @param vector
+ * @param data pointer points to the first element
+ * @param count number of elements
+ * @return int AP_Types
+ */
+int ap_vector_append(
+        struct AP_Vector *vector,
+        const void *data,
+        size_t count
+);
+
 /**
  * @brief Append one data to the back of the vector.
  * @param vector
@@ -80,17 +137,59 @@ int ap_vector_insert_back(
 );
 
 /**
- * Remove data from vector data
+ * Remove data from vector data, the data after end is moved forward
  * @param start pointer points to the data to be removed
  * @param end pointer points to the next data
- * @param size size of data to be removed,
+ * @param size size of data to be removed (end - start),
  *             should be divisible by `ap_vector_data_type_size()`
  */
 int ap_vector_remove_data(
         struct AP_Vector *vector,
         char *start,
         char *end,
-        int size
+        size_t size
 );
 
+/**
+ * @brief Size of one element of vector (byte)
+ */
+size_t ap_vector_data_type_size(struct AP_Vector *vector);
+
+/**
+ * Define type specialized inline functions for vector of T:
+ *   int ap_vector_<name>_push_back(struct AP_Vector *vector, T value)
+ *   T  *ap_vector_<name>_data(struct AP_Vector *vector)
+ *   T  *ap_vector_<name>_at(struct AP_Vector *vector, size_t i)
+ * Element copies are plain assignments of T instead of memcpy
+ * with a size read at run time.
+ * The vector should be initialized with sizeof(T) elements.
+ */
+#define AP_VECTOR_DEFINE(name, T)                                       \
+static inline int ap_vector_##name##_push_back(                         \
+        struct AP_Vector *vector, T value)                              \
+{                                                                       \
+        if (vector->length == vector->capacity) {                       \
+                int ret = ap_vector_grow(vector, 1);                    \
+                if (ret != 0) {                                         \
+                        return ret;                                     \
+                }                                                       \
+        }                                                               \
+        ((T*) vector->data)[vector->length++] = value;                  \
+        return 0;                                                       \
+}                                                                       \
+static inline T *ap_vector_##name##_data(struct AP_Vector *vector)      \
+{                                                                       \
+        return (T*) vector->data;                                       \
+}                                                                       \
+static inline T *ap_vector_##name##_at(                                 \
+        struct AP_Vector *vector, size_t i)                             \
+{                                                                       \
+        return (T*) vector->data + i;                                   \
+}
+
+AP_VECTOR_DEFINE(int, int)
+AP_VECTOR_DEFINE(uint, unsigned int)
+AP_VECTOR_DEFINE(float, float)
+AP_VECTOR_DEFINE(ptr, void*)
+
 #endif // AP_CVECTOR_H
\ No newline at end of file
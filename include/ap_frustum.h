@@ -0,0 +1,111 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief View frustum and the visibility tests of bounding volumes
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_FRUSTUM_H
+#define AP_FRUSTUM_H
+
+#include <stdbool.h>
+
+enum AP_Frustum_Plane {
+        AP_FRUSTUM_LEFT = 0,
+        AP_FRUSTUM_RIGHT,
+        AP_FRUSTUM_BOTTOM,
+        AP_FRUSTUM_TOP,
+        AP_FRUSTUM_NEAR,
+        AP_FRUSTUM_FAR,
+        AP_FRUSTUM_PLANE_NUM
+};
+
+/**
+ * Planes (a, b, c, d) with normalized normals pointing inside,
+ * a point p is inside a plane if a * x + b * y + c * z + d >= 0
+ */
+struct AP_Frustum {
+        float planes[AP_FRUSTUM_PLANE_NUM][4];
+};
+
+/**
+ * Number of the bounding volumes tested and found visible
+ */
+struct AP_Cull_Stats {
+        int tested;
+        int visible;
+};
+
+/**
+ * @brief Extract the planes of a view projection matrix
+ * (Gribb & Hartmann), the planes are in the space before the matrix,
+ * world space for projection * view.
+ *
+ * @param frustum [out]
+ * @param matrix 4x4 matrix (column major)
+ * @return int AP_Types
+ */
+int ap_frustum_extract(struct AP_Frustum *frustum, const float *matrix);
+
+/**
+ * @brief Test one sphere
+ *
+ * @param frustum
+ * @param sphere center xyz and radius
+ * @return true if the sphere is inside or crosses the frustum
+ */
+bool ap_frustum_test_sphere(
+        const struct AP_Frustum *frustum,
+        const float *sphere
+);
+
+/**
+ * @brief Test one axis aligned box
+ *
+ * @param frustum
+ * @param aabb min xyz and max xyz
+ * @return true if the box is inside or crosses the frustum
+ */
+bool ap_frustum_test_aabb(
+        const struct AP_Frustum *frustum,
+        const float *aabb
+);
+
+/**
+ * @brief Test spheres in batch, four spheres at once with SSE
+ *
+ * @param frustum
+ * @param spheres center xyz and radius of each sphere
+ * @param num number of spheres
+ * @param visible [out] result of each sphere
+ * @param stats [out] added with the number of tested and visible spheres,
+ *        can be NULL
+ * @return int AP_Types
+ */
+int ap_frustum_test_spheres(
+        const struct AP_Frustum *frustum,
+        const float *spheres,
+        int num,
+        bool *visible,
+        struct AP_Cull_Stats *stats
+);
+
+/**
+ * @brief Transform the bounds of a mesh by a model matrix,
+ * the results still bound the transformed mesh
+ *
+ * @param mat 4x4 matrix (column major)
+ * @param aabb min xyz and max xyz
+ * @param sphere center xyz and radius
+ * @param aabb_out [out] can be NULL
+ * @param sphere_out [out] can be NULL
+ * @return int AP_Types
+ */
+int ap_frustum_transform_bounds(
+        const float *mat,
+        const float *aabb,
+        const float *sphere,
+        float *aabb_out,
+        float *sphere_out
+);
+
+#endif // AP_FRUSTUM_H
@@ -0,0 +1,99 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Hash map of unsigned int keys with open addressing
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_HASHMAP_H
+#define AP_HASHMAP_H
+
+#include "ap_cvector.h"
+
+#ifndef AP_HASHMAP_DEFAULT_CAPACITY
+#define AP_HASHMAP_DEFAULT_CAPACITY 16
+#endif
+
+/**
+ * Robin hood hashing with linear probing: an element which is further from
+ * its home bucket takes the bucket of a closer one, so the probe lengths
+ * stay short and a lookup stops at the first element closer to its home
+ * than the key would be. Removing shifts the following elements back
+ * instead of leaving tombstones.
+ * The capacity is a power of two and grows at 3/4 load, the value
+ * pointers are only valid until the next insert or remove.
+ */
+struct AP_Hashmap {
+        // struct AP_Hashmap_Bucket, capacity buckets
+        struct AP_Vector buckets;
+        // values, same index as buckets
+        struct AP_Vector values;
+        // number of elements
+        size_t length;
+};
+
+/**
+ * @brief Initialize a hash map
+ *
+ * @param map
+ * @param elem_size size of one value (byte)
+ * @return int AP_Types
+ */
+int ap_hashmap_init(struct AP_Hashmap *map, size_t elem_size);
+
+/**
+ * @brief Release the memory of hash map
+ *
+ * @param map
+ * @return int AP_Types
+ */
+int ap_hashmap_free(struct AP_Hashmap *map);
+
+/**
+ * @brief Insert a copy of value, the value of an existing key is replaced
+ *
+ * @param map
+ * @param key
+ * @param value pointer points to the value, NULL to insert zero filled
+ * @return int AP_Types
+ */
+int ap_hashmap_insert(
+        struct AP_Hashmap *map,
+        unsigned int key,
+        const void *value
+);
+
+/**
+ * @brief Get the value of key
+ *
+ * @param map
+ * @param key
+ * @return pointer points to the value, NULL if key is not found
+ */
+void *ap_hashmap_get(struct AP_Hashmap *map, unsigned int key);
+
+/**
+ * @brief Remove key and its value
+ *
+ * @param map
+ * @param key
+ * @return int AP_Types, AP_ERROR_INVALID_PARAMETER if key is not found
+ */
+int ap_hashmap_remove(struct AP_Hashmap *map, unsigned int key);
+
+/**
+ * @brief Remove all of the elements, the capacity is kept
+ *
+ * @param map
+ * @return int AP_Types
+ */
+int ap_hashmap_clear(struct AP_Hashmap *map);
+
+/**
+ * @brief Number of elements in hash map
+ */
+static inline size_t ap_hashmap_length(struct AP_Hashmap *map)
+{
+        return map->length;
+}
+
+#endif // AP_HASHMAP_H
@@ -0,0 +1,74 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Instanced drawing of the models placed many times
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_INSTANCE_H
+#define AP_INSTANCE_H
+
+/**
+ * A batch draws every mesh of a model once for all of its instances,
+ * the model matrices of the instances are in one buffer read as a per
+ * instance attribute, and each mesh has a vertex array sharing its
+ * vertices and indices with the model.
+ */
+struct AP_Instance_Batch {
+        unsigned int model_id;
+        unsigned int VBO;       // model matrices, 16 floats each
+        unsigned int *VAOs;     // one vertex array for each mesh
+        int mesh_num;
+        int capacity;           // number of matrices VBO can hold
+        int instance_num;
+};
+
+/**
+ * @brief Register a model for instanced drawing, the model must be
+ * generated and not be freed before the batch.
+ *
+ * @param model_id
+ * @param batch_id [out] id of the batch
+ * @return int AP_Types
+ */
+int ap_instance_register(unsigned int model_id, unsigned int *batch_id);
+
+/**
+ * @brief Upload the model matrices of the instances, they are kept
+ * until this is called again.
+ *
+ * @param batch_id
+ * @param matrices 4x4 matrices (column major), 16 floats each
+ * @param num number of instances
+ * @return int AP_Types
+ */
+int ap_instance_set_transforms(
+        unsigned int batch_id,
+        const float *matrices,
+        int num
+);
+
+/**
+ * @brief Draw all the instances of batch, each mesh is recorded as one
+ * instanced command of the render queue
+ *
+ * @param batch_id
+ * @return int AP_Types
+ */
+int ap_instance_draw(unsigned int batch_id);
+
+/**
+ * @brief Release a batch, the model is not released
+ *
+ * @param batch_id
+ * @return int AP_Types
+ */
+int ap_instance_release(unsigned int batch_id);
+
+/**
+ * @brief Release all the batches, called by ap_render_finish
+ *
+ * @return int AP_Types
+ */
+int ap_instance_free();
+
+#endif // AP_INSTANCE_H
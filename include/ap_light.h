@@ -10,10 +10,16 @@
 
 #include "cglm/cglm.h"
 
+// point lights are culled by clusters, see ap_cluster.h
 #ifndef AP_LIGHT_POINT_NUM
-#define AP_LIGHT_POINT_NUM 128
+#define AP_LIGHT_POINT_NUM 4096
 #endif // AP_LIGHT_POINT_NUM
 
+// uniform buffer binding point of the light uniform block
+#ifndef AP_LIGHT_UBO_BINDING
+#define AP_LIGHT_UBO_BINDING 0
+#endif // AP_LIGHT_UBO_BINDING
+
 #ifndef AP_LIGHT_PARAM_NUM
 #define AP_LIGHT_PARAM_NUM 8
 #endif  // AP_LIGHT_PARAM_NUM
@@ -69,7 +75,7 @@ static inline const char* ap_light_type_2_str(int type)
 
 /**
  * @brief Setup and generate a point light struct object
- * and store its data into vector.
+ * and store it in slot map.
  *
  * @param light_id [out] ID of the point light
  * @param position
@@ -88,6 +94,32 @@ int ap_light_generate_point(
         float param[AP_LIGHT_PARAM_NUM]
 );
 
+/**
+ * @brief Get the pointer of point light in O(1),
+ * call ap_light_mark_dirty after changing the light through it.
+ *
+ * @param light_id ID given by ap_light_generate_point
+ * @return struct AP_Light*, NULL when not found
+ */
+struct AP_Light *ap_light_get_point_ptr(unsigned int light_id);
+
+/**
+ * @brief Mark a point light as changed, the lights are uploaded again
+ * by the next ap_light_send_data
+ *
+ * @param light_id ID given by ap_light_generate_point
+ * @return int AP_Types
+ */
+int ap_light_mark_dirty(unsigned int light_id);
+
+/**
+ * @brief Remove a point light, its ID becomes invalid
+ *
+ * @param light_id ID given by ap_light_generate_point
+ * @return int AP_Types
+ */
+int ap_light_remove_point(unsigned int light_id);
+
 int ap_light_setup_spot(
         float ambient[3],
         float diffuse[3],
@@ -103,13 +135,31 @@ int ap_light_setup_directional(
 );
 
 /**
- * @brief Send all of the data to the GPU after we generated
- * all of the light struct objects
+ * @brief Send the lights to the GPU, they are packed into a uniform buffer
+ * and uploaded at once only if they were changed since last time
  *
- * @return int
+ * @return int AP_Types
  */
 int ap_light_send_data();
 
+/**
+ * @brief Bin the point lights into the clusters of the view frustum and
+ * upload them, called by the renderer every frame.
+ * The lights are sent by ap_light_send_data first if they changed.
+ *
+ * @param view view matrix
+ * @param projection perspective projection matrix
+ * @param near distance to the near plane
+ * @param far distance to the far plane
+ * @return int AP_Types
+ */
+int ap_light_update_clusters(
+        float *view,
+        float *projection,
+        float near,
+        float far
+);
+
 int ap_light_set_material_shininess(float shininess);
 
 int ap_light_free();
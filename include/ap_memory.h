@@ -1,11 +1,115 @@
 #ifndef AP_MEMORY_H
 #define AP_MEMORY_H
 
-void *AP_MALLOC(int size);
+#include <stddef.h>
+
+/**
+ * Tags used for memory accounting, every allocation belongs to one tag
+ */
+typedef enum {
+        AP_MEMORY_TAG_UNKNOWN = 0,      // untagged allocations
+        AP_MEMORY_TAG_VECTOR,           // data of struct AP_Vector
+        AP_MEMORY_TAG_MESH,             // vertices, indices of meshes
+        AP_MEMORY_TAG_MODEL,            // model struct objects
+        AP_MEMORY_TAG_TEXTURE,          // texture paths, image data
+        AP_MEMORY_TAG_AUDIO,            // decoded PCM data, audio objects
+        AP_MEMORY_TAG_FONT,             // font files, glyphs
+        AP_MEMORY_TAG_SHADER,           // shader sources, logs
+        AP_MEMORY_TAG_PHYSIC,           // creatures, barriers
+        AP_MEMORY_TAG_LIGHT,            // light struct objects
+        AP_MEMORY_TAG_ARENA,            // blocks of struct AP_Arena
+        AP_MEMORY_TAG_LENGTH
+} AP_Memory_tags;
+
+extern const char *AP_MEMORY_TAG_NAME[];
+
+/**
+ * Allocation statistics of one tag
+ */
+struct AP_Memory_Stat {
+        size_t live_bytes;              // bytes currently allocated
+        size_t peak_bytes;              // high-water mark of live_bytes
+        int live_count;                 // allocations currently alive
+        unsigned long long total_count; // allocations since startup
+        size_t budget;                  // live bytes budget, 0 is unlimited
+};
+
+/**
+ * AP_MALLOC, AP_FREE and the other functions below are thread safe,
+ * memory can be freed by a thread other than the one allocated it.
+ */
+void *AP_MALLOC(size_t size);
 
 void AP_FREE(void* ptr);
 
-void* AP_REALLOC(void *ptr, int size);
+void* AP_REALLOC(void *ptr, size_t size);
+
+/**
+ * @brief Allocate memory and account it to a tag
+ *
+ * @param size size of memory (byte)
+ * @param tag AP_Memory_tags
+ * @return pointer points to the memory, NULL on error
+ */
+void *AP_MALLOC_TAG(size_t size, int tag);
+
+/**
+ * @brief Realloc memory and account it to a tag,
+ * AP_REALLOC keeps the tag of the old pointer.
+ *
+ * @see AP_MALLOC_TAG
+ */
+void *AP_REALLOC_TAG(void *ptr, size_t size, int tag);
+
+/**
+ * @brief Move an allocated memory to another tag
+ *
+ * @param ptr pointer allocated by AP_MALLOC
+ * @param tag AP_Memory_tags
+ * @return int AP_Types
+ */
+int ap_memory_set_tag(void *ptr, int tag);
+
+/**
+ * @brief Get the allocation statistics of one tag
+ *
+ * @param tag AP_Memory_tags
+ * @param stat [out]
+ * @return int AP_Types
+ */
+int ap_memory_get_stat(int tag, struct AP_Memory_Stat *stat);
+
+/**
+ * @brief Set the live bytes budget of one tag,
+ * a warning will be printed when the budget is exceeded.
+ *
+ * @param tag AP_Memory_tags
+ * @param budget bytes, 0 is unlimited
+ * @return int AP_Types
+ */
+int ap_memory_set_budget(int tag, size_t budget);
+
+/**
+ * @brief Print the statistics of all tags
+ *
+ * @return int AP_Types
+ */
+int ap_memory_print_stat();
+
+/**
+ * @brief Print the statistics every interval seconds,
+ * it is called by ap_render_flush each frame.
+ *
+ * @param interval seconds, 0 to disable (default)
+ * @return int AP_Types
+ */
+int ap_memory_set_dump_interval(double interval);
+
+/**
+ * @param time current time (second)
+ * @see ap_memory_set_dump_interval
+ */
+int ap_memory_dump_periodic(double time);
 
 int ap_memory_unreleased_num();
 
@@ -13,4 +117,4 @@ int ap_memory_print_unreleased();
 
 int ap_memory_release();
 
-#endif
\ No newline at end of file
+#endif
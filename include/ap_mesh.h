@@ -4,7 +4,14 @@
 #include "ap_texture.h"
 #include <stdbool.h>
 
+// location of the model matrix attribute, it takes 4 locations (3 to 6)
+#define AP_MESH_MODEL_ATTRIB 3
+// meshes of up to this number of vertices use 16 bits indices
+#define AP_MESH_SHORT_INDEX_MAX 0x10000
+
 struct AP_Mesh {
+        // NULL for the meshes loaded from the model cache,
+        // their data is uploaded from the cache file directly
         struct AP_Vertex* vertices;   // array, use malloc, need free.
         int vertices_length;
         unsigned int *indices;     // array, use malloc, need free.
@@ -15,6 +22,14 @@ struct AP_Mesh {
         unsigned int VAO;
         unsigned int VBO;
         unsigned int EBO;
+        // enum AP_Vertex_Format of the vertices uploaded to VBO
+        int vertex_format;
+        // GL type of the indices in EBO, set by ap_mesh_setup
+        unsigned int index_type;
+
+        // bounds of the vertices in model space for culling
+        float aabb[6];          // min xyz and max xyz
+        float sphere[4];        // center xyz and radius
 };
 
 int ap_mesh_init(
@@ -27,12 +42,98 @@ int ap_mesh_init(
         int texture_length
 );
 
+/**
+ * @brief Copy the data to mesh without creating the GL buffers,
+ * can be called by any thread, call ap_mesh_setup on the render
+ * thread before drawing.
+ * @return int AP_Types, nothing is kept in mesh on error
+ */
+int ap_mesh_init_data(
+        struct AP_Mesh *mesh,
+        struct AP_Vertex* vertices,
+        int vertices_length,
+        unsigned int *indices,
+        int indices_length,
+        struct AP_Texture *texture,
+        int texture_length
+);
+
+/**
+ * @brief Initialize mesh with the arrays instead of copies of them,
+ * the arrays must be allocated by AP_MALLOC and are freed by ap_mesh_free.
+ * The GL buffers are not created, see ap_mesh_init_data.
+ * @return int AP_Types
+ */
+int ap_mesh_init_move(
+        struct AP_Mesh *mesh,
+        struct AP_Vertex* vertices,
+        int vertices_length,
+        unsigned int *indices,
+        int indices_length,
+        struct AP_Texture *texture,
+        int texture_length
+);
+
 int ap_mesh_free(struct AP_Mesh *mesh);
 
+/**
+ * @brief Delete the GL buffers of mesh, on the render thread,
+ * the copies of mesh share the buffers
+ * @return int AP_Types
+ */
+int ap_mesh_delete_buffers(struct AP_Mesh *mesh);
+
+/**
+ * @brief Compute the bounding box and sphere of the vertices,
+ * called by ap_mesh_init_data.
+ * @return int AP_Types
+ */
+int ap_mesh_compute_bounds(struct AP_Mesh *mesh);
+
 int ap_mesh_copy(struct AP_Mesh *mesh_new, const struct AP_Mesh *mesh_old);
 
+/**
+ * @brief Create the GL buffers of mesh, the vertices are converted to
+ * mesh->vertex_format, the indices are 16 bits if the number of vertices
+ * fits.
+ * @return int AP_Types
+ */
 int ap_mesh_setup(struct AP_Mesh *mesh);
 
+/**
+ * @brief Create the GL buffers of mesh from data already in the GPU
+ * layout, e.g. mapped from a model cache file, mesh->vertices and
+ * mesh->indices are not used and can be NULL.
+ *
+ * @param mesh with vertices_length, indices_length and vertex_format set
+ * @param vertices vertices_length vertices of mesh->vertex_format
+ * @param indices indices_length indices of index_size bytes
+ * @param index_size 2 or 4
+ * @return int AP_Types
+ */
+int ap_mesh_setup_data(
+        struct AP_Mesh *mesh,
+        const void *vertices,
+        const void *indices,
+        int index_size
+);
+
+/**
+ * @brief Create a vertex array drawing mesh with the model matrices
+ * of instance_VBO (16 floats for each instance), the buffers of mesh
+ * are shared and must be setup.
+ *
+ * @param mesh
+ * @param instance_VBO buffer of the model matrices
+ * @param VAO [out] the vertex array
+ * @return int AP_Types
+ */
+int ap_mesh_setup_instanced(
+        struct AP_Mesh *mesh,
+        unsigned int instance_VBO,
+        unsigned int *VAO
+);
+
 int ap_mesh_draw(struct AP_Mesh *mesh, unsigned int shader);
 
 #endif // AP_MESH_H
\ No newline at end of file
@@ -13,28 +13,77 @@
 #define AP_MODEL_BALL_PATH "res/ball/ball.obj"
 #endif
 
+// directory of the model cache files, relative to the working directory
+#ifndef AP_MODEL_CACHE_DIR
+#define AP_MODEL_CACHE_DIR "cache"
+#endif
+
+/**
+ * Meshes and textures imported from a model file, shared by the models
+ * generated from the same path and released with the last of them
+ */
+struct AP_Model_Resource {
+        char *path;
+        char *directory;
+        struct AP_Texture *texture;
+        int texture_length;
+        struct AP_Mesh *mesh;
+        int mesh_length;
+        // enum AP_Vertex_Format of the meshes
+        int vertex_format;
+        int ref_count;
+        // next resource of the same path hash
+        struct AP_Model_Resource *next;
+};
+
+/**
+ * Placement of a model resource, the transform is the only data
+ * owned by each model
+ */
 struct AP_Model {
-        int id;
+        unsigned int id;
         float pos[3];       // position of the model
         float scale[3];     // scale of the model
         float rotate_angle;   // rotate degree
         float rotate_axis[3]; // rotate axis
 
-        struct AP_Texture *texture;
-        int texture_length;
-        struct AP_Mesh *mesh;
-        int mesh_length;
-        char *directory;
+        struct AP_Model_Resource *resource;
 };
 
 /**
- * @brief Generate a model
+ * Parameter of the callback of ap_model_generate_async,
+ * only valid while the callback is running.
+ */
+struct AP_Model_Thread_Param {
+        const char *path;
+        unsigned int id;        // model id, 0 on error
+};
+
+/**
+ * @brief Generate a model, the models of the same path and vertex format
+ * share the meshes and textures, the file is only imported by the first
+ * of them.
  * @param path [in] path to the model file
  * @param model_id [out] model id
  * @return int AP_Types
  */
 int ap_model_generate(const char *path, unsigned int *model_id);
 
+/**
+ * @brief Generate a model without blocking the render thread.
+ * The file is imported and its images are decoded by the job system,
+ * the textures and meshes are uploaded in ap_render_flush within
+ * the upload budget of each frame.
+ * The callback is called on the render thread after the model is
+ * generated, with struct AP_Model_Thread_Param and the AP_Types result.
+ * A path already generated is not imported again.
+ *
+ * @param path [in] path to the model file
+ * @param cb [in] callback, can be NULL
+ * @return int AP_Types
+ */
+int ap_model_generate_async(const char *path, ap_callback_func_t cb);
+
 /**
  * @brief Use model
  *
@@ -44,12 +93,54 @@ int ap_model_generate(const char *path, unsigned int *model_id);
 int ap_model_use(unsigned int id);
 
 /**
- * @brief Draw current model
+ * @brief Set the format of the vertices uploaded to GL for the models
+ * generated after, AP_VERTEX_FORMAT_FLOAT by default.
+ * AP_VERTEX_FORMAT_PACKED takes half of the memory, for the models of
+ * small coordinates.
  *
- * @return int
+ * @param format enum AP_Vertex_Format
+ * @return int AP_Types
+ */
+int ap_model_set_vertex_format(int format);
+
+/**
+ * @brief Set the directory of the model cache, AP_MODEL_CACHE_DIR by
+ * default. The meshes of imported models are written to a cache file
+ * and mapped from it when the model is generated again, until the model
+ * file or the import settings are changed.
+ * Models not readable by stat (e.g. android assets) are not cached.
+ *
+ * @param dir NULL to disable the cache
+ * @return int AP_Types
+ */
+int ap_model_set_cache_dir(const char *dir);
+
+/**
+ * @brief Get the pointer of model, only valid until the model is freed
+ *
+ * @param model_id
+ * @param ptr [out]
+ * @return int AP_Types
+ */
+int ap_model_get_ptr(unsigned int model_id, struct AP_Model **ptr);
+
+/**
+ * @brief Draw current model, the meshes are recorded in the render queue
+ * and drawn by ap_render_draw_queue
+ *
+ * @return int AP_Types
  */
 int ap_model_draw();
 
+/**
+ * @brief Release a model, the meshes and textures are released with
+ * the last model of their path
+ *
+ * @param model_id
+ * @return int AP_Types
+ */
+int ap_model_release(unsigned int model_id);
+
 int ap_model_set_scale(float scale[3]);
 int ap_model_set_pos(float pos[3]);
 int ap_model_set_rotate(float axis[3], float angle);
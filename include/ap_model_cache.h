@@ -0,0 +1,191 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Binary cache of the imported models, mapped to memory when loaded
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_MODEL_CACHE_H
+#define AP_MODEL_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ap_mesh.h"
+
+#define AP_MODEL_CACHE_MAGIC    "APMC"
+#define AP_MODEL_CACHE_VERSION  1
+#define AP_MODEL_CACHE_SUFFIX   ".apmc"
+// alignment of the blobs in file
+#define AP_MODEL_CACHE_ALIGN    64
+// path of the textures generated from material color
+#define AP_MODEL_CACHE_NO_PATH  0xFFFFFFFFu
+// max length of the cache file paths
+#define AP_MODEL_CACHE_PATH_LENGTH 512
+
+/**
+ * The cache is valid for the source file and the import settings
+ * it was written with, it is imported again if any of them changed
+ */
+struct AP_Model_Cache_Key {
+        int64_t mtime;          // modification time of source
+        int64_t size;           // size of source
+        uint32_t import_flags;  // assimp post processing flags
+        uint32_t vertex_format; // enum AP_Vertex_Format
+};
+
+/**
+ * File layout, all the offsets are from the start of file:
+ *   header
+ *   mesh table, struct AP_Model_Cache_Mesh
+ *   texture table, struct AP_Model_Cache_Texture
+ *   strings, NUL terminated, the source path first
+ *   vertex and index blobs, aligned to AP_MODEL_CACHE_ALIGN
+ * The blobs are in the layout of GL buffers and passed to glBufferData
+ * from the mapped file.
+ */
+struct AP_Model_Cache_Header {
+        char magic[4];
+        uint32_t version;
+        struct AP_Model_Cache_Key key;
+        uint64_t file_size;
+        uint32_t mesh_num;
+        uint32_t texture_num;
+        uint64_t mesh_offset;
+        uint64_t texture_offset;
+        uint64_t string_offset;
+        uint64_t string_size;
+};
+
+struct AP_Model_Cache_Mesh {
+        uint64_t vertex_offset;
+        uint64_t index_offset;
+        uint32_t vertex_num;
+        uint32_t index_num;
+        uint32_t vertex_format; // enum AP_Vertex_Format
+        uint32_t index_size;    // 2 or 4 bytes
+        uint32_t texture_first; // in texture table
+        uint32_t texture_num;
+        float aabb[6];
+        float sphere[4];
+};
+
+struct AP_Model_Cache_Texture {
+        int32_t type;           // AP_TEXTURE_TYPE
+        uint32_t path;          // in strings, or AP_MODEL_CACHE_NO_PATH
+        float RGBA[4];
+};
+
+/**
+ * A cache file mapped to memory
+ */
+struct AP_Model_Cache {
+        void *data;
+        size_t size;
+        const struct AP_Model_Cache_Header *header;
+        const struct AP_Model_Cache_Mesh *meshes;
+        const struct AP_Model_Cache_Texture *textures;
+        const char *strings;
+};
+
+/**
+ * @brief Get the key of a model file
+ *
+ * @param path model file
+ * @param import_flags
+ * @param vertex_format
+ * @param key [out]
+ * @return int AP_Types, AP_ERROR_ASSET_OPEN_FAILED if the file
+ *         can not be stat
+ */
+int ap_model_cache_key(
+        const char *path,
+        uint32_t import_flags,
+        int vertex_format,
+        struct AP_Model_Cache_Key *key
+);
+
+/**
+ * @brief Get the path of the cache file of a model file,
+ * named by the hash of the model path
+ *
+ * @param dir directory of cache files
+ * @param path model file
+ * @param out [out]
+ * @param size size of out
+ * @return int AP_Types
+ */
+int ap_model_cache_path(
+        const char *dir,
+        const char *path,
+        char *out,
+        size_t size
+);
+
+/**
+ * @brief Map a cache file and check it is written for source and key,
+ * the cache is unmapped by ap_model_cache_close.
+ *
+ * @param cache_path
+ * @param source path of the model file
+ * @param key
+ * @param cache [out]
+ * @return int AP_Types, not 0 if the file does not exist or is stale
+ */
+int ap_model_cache_open(
+        const char *cache_path,
+        const char *source,
+        const struct AP_Model_Cache_Key *key,
+        struct AP_Model_Cache *cache
+);
+
+/**
+ * @brief Unmap the cache file
+ *
+ * @param cache
+ * @return int AP_Types
+ */
+int ap_model_cache_close(struct AP_Model_Cache *cache);
+
+/**
+ * @brief Write the meshes of a model to a cache file, the vertices are
+ * packed to the vertex_format of meshes. The file is written to a
+ * temporary file and renamed, the readers never see a partial file.
+ *
+ * @param cache_path
+ * @param source path of the model file
+ * @param key
+ * @param meshes with vertices and indices in memory
+ * @param mesh_num
+ * @return int AP_Types
+ */
+int ap_model_cache_write(
+        const char *cache_path,
+        const char *source,
+        const struct AP_Model_Cache_Key *key,
+        const struct AP_Mesh *meshes,
+        int mesh_num
+);
+
+/**
+ * @brief Pointer to data at offset of the mapped file
+ */
+static inline const void *ap_model_cache_blob(
+        const struct AP_Model_Cache *cache, uint64_t offset)
+{
+        return (const char *) cache->data + offset;
+}
+
+/**
+ * @brief Path of a texture record, NULL for material color
+ */
+static inline const char *ap_model_cache_texture_path(
+        const struct AP_Model_Cache *cache,
+        const struct AP_Model_Cache_Texture *texture)
+{
+        if (texture->path == AP_MODEL_CACHE_NO_PATH) {
+                return NULL;
+        }
+        return cache->strings + texture->path;
+}
+
+#endif // AP_MODEL_CACHE_H
@@ -0,0 +1,69 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Triangle and vertex ordering for the GPU vertex caches
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_OPTIMIZE_H
+#define AP_OPTIMIZE_H
+
+#include "ap_vertex.h"
+
+// size of the LRU cache modeled by the triangle ordering
+#define AP_OPTIMIZE_CACHE_SIZE 32
+
+// size of the FIFO cache simulated for ACMR, close to the
+// post-transform cache of most GPUs
+#define AP_OPTIMIZE_FIFO_SIZE 16
+
+/**
+ * @brief Reorder the triangles for the post-transform vertex cache
+ * (Tom Forsyth, Linear-Speed Vertex Cache Optimisation)
+ *
+ * @param indices triangle list, reordered in place
+ * @param index_num number of indices, multiple of 3
+ * @param vertex_num number of vertices
+ * @return int AP_Types
+ */
+int ap_optimize_vertex_cache(
+        unsigned int *indices,
+        int index_num,
+        int vertex_num
+);
+
+/**
+ * @brief Reorder the vertices by their first use in indices, so the
+ * vertices are fetched in order. Indices are remapped, the vertices
+ * not used are moved to the end.
+ *
+ * @param vertices reordered in place
+ * @param indices remapped in place
+ * @param index_num number of indices
+ * @param vertex_num number of vertices
+ * @return int AP_Types
+ */
+int ap_optimize_vertex_fetch(
+        struct AP_Vertex *vertices,
+        unsigned int *indices,
+        int index_num,
+        int vertex_num
+);
+
+/**
+ * @brief Average cache miss ratio: vertices transformed per triangle
+ * with a FIFO cache of cache_size, between 0.5 and 3, lower is better
+ *
+ * @param indices triangle list
+ * @param index_num number of indices
+ * @param vertex_num number of vertices
+ * @param cache_size
+ * @return float ACMR, 0 if there is no triangle
+ */
+float ap_optimize_acmr(
+        const unsigned int *indices,
+        int index_num,
+        int vertex_num,
+        int cache_size
+);
+
+#endif // AP_OPTIMIZE_H
@@ -65,7 +65,7 @@ struct AP_PBall {
  * The barriar, invisible, used for collision detection
  */
 struct AP_PBarrier {
-        int id;
+        unsigned int id;
         int type;
         struct AP_PBox box;
         struct AP_PBall ball;
@@ -92,6 +92,13 @@ struct AP_PCreature {
 
 int ap_physic_init();
 
+/**
+ * @brief Release all creatures and barriers
+ *
+ * @return int AP_Types
+ */
+int ap_physic_free();
+
 int ap_physic_generate_creature(unsigned int *id, float size[3]);
 
 int ap_creature_set_camera_offset(float offset[3]);
@@ -0,0 +1,77 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Fixed-size object pool with stable addresses
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_POOL_H
+#define AP_POOL_H
+
+#include <stddef.h>
+
+#ifndef AP_POOL_CHUNK_LENGTH
+#define AP_POOL_CHUNK_LENGTH 64
+#endif
+
+/**
+ * Objects are allocated from chunks which are never moved or reallocated,
+ * so the pointers stay valid until the object is released.
+ * Released objects are linked into a free list and reused first.
+ */
+struct AP_Pool {
+        // size of one object, aligned to 16 bytes
+        size_t elem_size;
+        // number of objects of one chunk
+        int chunk_length;
+        // number of objects in use
+        int length;
+        // number of objects of all chunks
+        int capacity;
+        // AP_Memory_tags of chunks
+        int tag;
+        // released objects, linked through their first bytes
+        void *free_list;
+        // allocated chunks, linked through their header
+        void *chunks;
+};
+
+/**
+ * @brief Initialize an object pool
+ *
+ * @param pool
+ * @param elem_size size of object (byte)
+ * @param chunk_length objects of one chunk, 0 to use AP_POOL_CHUNK_LENGTH
+ * @param tag AP_Memory_tags the chunks are accounted to
+ * @return int AP_Types
+ */
+int ap_pool_init(struct AP_Pool *pool, size_t elem_size,
+        int chunk_length, int tag);
+
+/**
+ * @brief Get a zero filled object from pool in O(1)
+ *
+ * @param pool
+ * @return pointer points to the object, NULL on error
+ */
+void *ap_pool_alloc(struct AP_Pool *pool);
+
+/**
+ * @brief Give the object back to pool, the memory is reused
+ * by the next ap_pool_alloc.
+ *
+ * @param pool
+ * @param ptr pointer returned by ap_pool_alloc
+ * @return int AP_Types
+ */
+int ap_pool_release(struct AP_Pool *pool, void *ptr);
+
+/**
+ * @brief Release all chunks of pool,
+ * every object allocated from it becomes invalid.
+ *
+ * @param pool
+ * @return int AP_Types
+ */
+int ap_pool_free(struct AP_Pool *pool);
+
+#endif // AP_POOL_H
@@ -13,12 +13,31 @@
 #define AP_FONT_SIZE 32
 #endif
 
+// width and height of the glyph atlas, glyphs are rendered into it when
+// first used and the least recently used glyph is replaced when it is full
+#ifndef AP_FONT_ATLAS_SIZE
+#define AP_FONT_ATLAS_SIZE 1024
+#endif
+
+// time (second) spent on the queued GPU uploads of one frame
+#ifndef AP_RENDER_UPLOAD_BUDGET
+#define AP_RENDER_UPLOAD_BUDGET 0.004
+#endif
+
+/**
+ * Upload task running on the render thread, does one step of the upload
+ * (such as one texture or one mesh) each time it is called.
+ * @return true when the task finished, false to be called again
+ */
+typedef bool (*ap_upload_func_t)(void *param);
+
 struct AP_Character {
-        unsigned int texture_id;   // id handle of the glyph texture
+        unsigned int texture_id;   // id handle of the glyph atlas texture
         int size[2];               // size of glyph
         int bearing[2];            // offset from baseline to left/top glyph
         unsigned int advance;      // offset to advance to next glyph
-        char c;           // unsigned char code
+        float uv[4];               // left, top, right, bottom in atlas
+        unsigned int c;            // unicode code point
 };
 
 int ap_render_general_initialize();
@@ -36,25 +55,10 @@ int ap_render_resize_buffer(int width, int height);
 int ap_render_init_font(const char *path, int size);
 
 /**
- * @brief Charactor to texture
- *
- * @param c   char code
- * @param tid [out] texture ID
- * @param w   [out] bitmap width
- * @param h   [out] bitmap height
- * @param l   [out] offset from baseline to left of glypt
- * @param t   [out] offset from baseline to right of glypt
- * @param a   [out] offset to advance to next glyph
- * @return int AP_Types
- */
-int ap_render_char_2_texture(
-        char c, unsigned int *tid, int *w, int *h, int *l, int *t, int *a
-);
-
-/**
- * @brief Render one line text
+ * @brief Render one line text, all glyphs of the line are sent in
+ * one vertex buffer and drawn by one draw call
  *
- * @param text  string
+ * @param text  UTF-8 string
  * @param x     position of the string (x)
  * @param y     position of the string (y)
  * @param scale scale
@@ -66,11 +70,60 @@ int ap_render_text_line(
 
 /**
  * @brief Flush FPS, ortho matrix, etc...
+ * and run the queued uploads for AP_RENDER_UPLOAD_BUDGET.
  *
  * @return int AP_Types
  */
 int ap_render_flush();
 
+/**
+ * @brief Queue an upload task for the render thread, thread safe.
+ * The tasks run in order in ap_render_flush, limited by the budget
+ * of each frame.
+ *
+ * @param func upload task
+ * @param param parameter of func
+ * @return int AP_Types
+ */
+int ap_render_queue_upload(ap_upload_func_t func, void *param);
+
+/**
+ * @brief Reserve the room of one upload task, so that the task can be
+ * queued later by ap_render_queue_upload_reserved without failing,
+ * thread safe. Used by the loaders before they start the jobs which
+ * queue the upload, their callbacks are always called then.
+ *
+ * @return int AP_Types
+ */
+int ap_render_reserve_upload();
+
+/**
+ * @brief Give back a reservation not used, thread safe
+ *
+ * @return int AP_Types
+ */
+int ap_render_cancel_upload();
+
+/**
+ * @brief Queue an upload task with a reservation made by
+ * ap_render_reserve_upload, thread safe. Never fails if a reservation
+ * was made.
+ *
+ * @param func upload task
+ * @param param parameter of func
+ * @return int AP_Types
+ */
+int ap_render_queue_upload_reserved(ap_upload_func_t func, void *param);
+
+/**
+ * @brief Run the queued upload tasks until budget is used up,
+ * at least one step runs so that uploads always make progress.
+ *
+ * @param budget time (second), negative to run all of the tasks
+ * @return int AP_Types
+ */
+int ap_render_process_uploads(double budget);
+
 /**
  * @brief Render aiming points
  *
@@ -79,7 +132,15 @@ int ap_render_flush();
 int ap_render_aim_cross();
 int ap_render_aim_dot();
 
-int ap_render_get_font_ptr(char c, struct AP_Character **ptr);
+/**
+ * @brief Get the glyph of a code point, the glyph is rendered into the atlas
+ * if it is not cached.
+ *
+ * @param code unicode code point
+ * @param ptr [out] valid until the next glyph is rendered
+ * @return int AP_Types
+ */
+int ap_render_get_font_ptr(unsigned int code, struct AP_Character **ptr);
 int ap_render_get_fps(float *p);
 
 int ap_render_get_persp_matrix(float **mat);
@@ -99,6 +160,67 @@ int ap_render_get_view_distance(int *p);
  */
 int ap_render_set_model_mat(float *mat);
 
+struct AP_Mesh;
+struct AP_Cull_Stats;
+
+/**
+ * @brief Record the draw commands of meshes with the perspective shader,
+ * they are drawn sorted by their state by ap_render_draw_queue.
+ * The meshes out of the view frustum are skipped.
+ *
+ * @param meshes
+ * @param mesh_num
+ * @param mat model matrix shared by the meshes
+ * @return int AP_Types
+ */
+int ap_render_submit_meshes(struct AP_Mesh *meshes, int mesh_num, float *mat);
+
+/**
+ * @brief Record one instanced draw command for each mesh,
+ * the meshes are drawn with the vertex arrays of the instances.
+ *
+ * @param meshes
+ * @param VAOs vertex arrays with the model matrices of instances
+ * @param mesh_num
+ * @param instance_num
+ * @return int AP_Types
+ */
+int ap_render_submit_instanced(
+        struct AP_Mesh *meshes,
+        unsigned int *VAOs,
+        int mesh_num,
+        int instance_num
+);
+
+/**
+ * @brief Draw the recorded commands of the frame. It is called before the
+ * first orthographic draw of the frame (so the 3D scene is under the text
+ * and images), call it before swapping buffers if nothing is drawn after
+ * the scene.
+ *
+ * @return int AP_Types
+ */
+int ap_render_draw_queue();
+
+/**
+ * @brief Get the number of meshes tested against the view frustum
+ * and found visible in the last frame
+ *
+ * @param stats [out]
+ * @return int AP_Types
+ */
+int ap_render_get_cull_stats(struct AP_Cull_Stats *stats);
+
+/**
+ * @brief Get the number of draw calls and state changes made by the last
+ * ap_render_draw_queue
+ *
+ * @param draw_calls [out] can be NULL
+ * @param state_changes [out] can be NULL
+ * @return int AP_Types
+ */
+int ap_render_get_queue_stats(int *draw_calls, int *state_changes);
+
 /**
  * @brief Set light enabled or not
  *
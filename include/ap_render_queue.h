@@ -0,0 +1,179 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Deferred draw commands sorted by render state
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_RENDER_QUEUE_H
+#define AP_RENDER_QUEUE_H
+
+#include <stdint.h>
+
+#include "ap_cvector.h"
+#include "ap_texture.h"
+
+// state of the backend not known by the queue
+#define AP_RENDER_STATE_UNKNOWN 0xFFFFFFFFu
+
+/**
+ * Sort key of commands, the most expensive state change is in the
+ * highest bits so the commands sharing it are drawn together:
+ *   bits 56-63: program
+ *   bits 32-55: hash of the textures (material)
+ *   bits 16-31: vertex array
+ *   bits  0-15: depth, front to back
+ */
+#define AP_RENDER_KEY_PROGRAM_SHIFT     56
+#define AP_RENDER_KEY_MATERIAL_SHIFT    32
+#define AP_RENDER_KEY_VAO_SHIFT         16
+
+/**
+ * One draw call, commands are compact: the model matrix is stored once
+ * in the queue and shared by the commands of a model.
+ * Instanced commands take the matrices from the vertex array.
+ */
+struct AP_Render_Command {
+        uint64_t key;           // set by ap_render_queue_submit
+        unsigned int program;
+        unsigned int vao;
+        int model_location;     // location of the model matrix attribute
+        unsigned int matrix;    // index given by ap_render_queue_push_matrix
+        unsigned int index_type;        // GL type of indices
+        int index_count;
+        int instance_count;     // 0 for a draw with matrix
+        int texture_num;
+        unsigned int textures[AP_TEXTURE_UNIT_MAX_NUM];
+};
+
+/**
+ * Element sorted instead of the commands, index is in queue->commands
+ */
+struct AP_Render_Sort_Item {
+        uint64_t key;
+        unsigned int index;
+};
+
+/**
+ * Functions making the state changes and draw calls, the GL backend
+ * calls GL, tests record the calls without a GPU
+ */
+struct AP_Render_Backend {
+        void (*use_program)(unsigned int program);
+        void (*bind_texture)(int unit, unsigned int texture);
+        void (*bind_vertex_array)(unsigned int vao);
+        void (*set_matrix)(int location, const float *mat);
+        // instance_count is 0 for the commands not instanced
+        void (*draw_elements)(unsigned int index_type, int index_count,
+                int instance_count);
+        // called after the commands were executed, can be NULL
+        void (*finish)();
+};
+
+struct AP_Render_Queue {
+        // struct AP_Render_Command
+        struct AP_Vector commands;
+        // model matrices, 16 floats each
+        struct AP_Vector matrices;
+        // struct AP_Render_Sort_Item, sorted by ap_render_queue_sort
+        struct AP_Vector items;
+        struct AP_Vector scratch;
+
+        // state set through the backend during execute,
+        // redundant changes are skipped
+        unsigned int program;
+        unsigned int vao;
+        unsigned int matrix;
+        unsigned int textures[AP_TEXTURE_UNIT_MAX_NUM];
+
+        // statistics of the last execute
+        int state_changes;
+        int draw_calls;
+};
+
+/**
+ * @brief Initialize a render queue
+ *
+ * @param queue
+ * @return int AP_Types
+ */
+int ap_render_queue_init(struct AP_Render_Queue *queue);
+
+/**
+ * @brief Release the memory of render queue
+ *
+ * @param queue
+ * @return int AP_Types
+ */
+int ap_render_queue_free(struct AP_Render_Queue *queue);
+
+/**
+ * @brief Store a model matrix for the commands submitted after it
+ *
+ * @param queue
+ * @param mat 4x4 matrix (column major)
+ * @param index [out] index of the matrix for struct AP_Render_Command
+ * @return int AP_Types
+ */
+int ap_render_queue_push_matrix(
+        struct AP_Render_Queue *queue,
+        const float *mat,
+        unsigned int *index
+);
+
+/**
+ * @brief Record a copy of command, its sort key is made of its state
+ *
+ * @param queue
+ * @param command
+ * @param depth distance to the camera, not negative
+ * @return int AP_Types
+ */
+int ap_render_queue_submit(
+        struct AP_Render_Queue *queue,
+        const struct AP_Render_Command *command,
+        float depth
+);
+
+/**
+ * @brief Sort the commands by their keys (LSD radix sort),
+ * the sorted order is in queue->items
+ *
+ * @param queue
+ * @return int AP_Types
+ */
+int ap_render_queue_sort(struct AP_Render_Queue *queue);
+
+/**
+ * @brief Sort and execute the commands, the queue is cleared after
+ *
+ * @param queue
+ * @param backend
+ * @return int AP_Types
+ */
+int ap_render_queue_execute(
+        struct AP_Render_Queue *queue,
+        const struct AP_Render_Backend *backend
+);
+
+/**
+ * @brief Remove the commands and matrices without executing them
+ *
+ * @param queue
+ * @return int AP_Types
+ */
+int ap_render_queue_clear(struct AP_Render_Queue *queue);
+
+/**
+ * @brief Backend calling GL on the render thread
+ */
+const struct AP_Render_Backend *ap_render_queue_gl_backend();
+
+/**
+ * @brief Number of commands in queue
+ */
+static inline size_t ap_render_queue_length(struct AP_Render_Queue *queue)
+{
+        return queue->commands.length;
+}
+
+#endif // AP_RENDER_QUEUE_H
@@ -15,7 +15,6 @@
 #endif
 
 // Perspective vertex shader uniform variables
-#define AP_SP_MODEL             "model"
 #define AP_SP_VIEW              "view"
 #define AP_SP_PROJECTION        "projection"
 #define AP_SP_VIEW_DISTANCE     "view_distance"
@@ -29,33 +28,16 @@
 #define AP_SP_MT_HEIGHT         "material_%d.height"
 #define AP_SP_MT_SHININESS      "material_%d.shininess"
 
-// AP_LIGHT_POINT_NUM = 128
-#define AP_SP_POINT_LIGHT       "point_light"
-#define AP_SP_PL_POSITION       "point_light[%d].position"
-#define AP_SP_PL_CONSTANT       "point_light[%d].constant"
-#define AP_SP_PL_LINEAR         "point_light[%d].linear"
-#define AP_SP_PL_QUADRATIC      "point_light[%d].quadratic"
-#define AP_SP_PL_AMBIENT        "point_light[%d].ambient"
-#define AP_SP_PL_DIFFUSE        "point_light[%d].diffuse"
-#define AP_SP_PL_SPECULAR       "point_light[%d].specular"
-
-#define AP_SP_DIRECT_LIGHT      "direct_light"
-#define AP_SP_DL_DIRECTION      "direct_light.direction"
-#define AP_SP_DL_AMBIENT        "direct_light.ambient"
-#define AP_SP_DL_DIFFUSE        "direct_light.diffuse"
-#define AP_SP_DL_SPECULAR       "direct_light.specular"
-
-#define AP_SP_SPOT_LIGHT        "spot_light"
-#define AP_SP_SL_POSITION       "spot_light.position"
-#define AP_SP_SL_DIRECTION      "spot_light.direction"
-#define AP_SP_SL_CUTOFF         "spot_light.cut_off"
-#define AP_SP_SL_OUTER_CUTOFF   "spot_light.outer_cut_off"
-#define AP_SP_SL_CONSTANT       "spot_light.constant"
-#define AP_SP_SL_LINEAR         "spot_light.linear"
-#define AP_SP_SL_QUADRATIC      "spot_light.quadratic"
-#define AP_SP_SL_AMBIENT        "spot_light.ambient"
-#define AP_SP_SL_DIFFUSE        "spot_light.diffuse"
-#define AP_SP_SL_SPECULAR       "spot_light.specular"
+// uniform block of the lights, see struct AP_Light_Block in ap_light.c
+#define AP_SP_LIGHTS            "Lights"
+// the spot light follows the camera, set every frame outside the block
+#define AP_SP_SL_POSITION       "spot_light_position"
+#define AP_SP_SL_DIRECTION      "spot_light_direction"
+// point lights culled by clusters, see ap_light_update_clusters
+#define AP_SP_LIGHT_DATA        "light_data"
+#define AP_SP_LIGHT_CLUSTERS    "light_clusters"
+#define AP_SP_LIGHT_INDICES     "light_indices"
+#define AP_SP_CLUSTER_PARAM     "cluster_param"
 
 #define AP_SP_SPOT_LIGHT_ENABLED "spot_light_enabled"
 #define AP_SP_POINT_LIGHT_ENABLED "point_light_enabled"
@@ -87,6 +69,33 @@ int ap_shader_use(unsigned shader_program_id);
 
 int ap_shader_free();
 
+/**
+ * @brief Location of uniform name in program. The active uniforms are
+ * reflected when the program is linked, so no driver call is made.
+ * Look the locations up once and set the uniforms by ap_shader_set_*_loc
+ * in the loops called every frame.
+ * @param program (shader) program ID
+ * @param name uniform name, e.g. "point_light[3].position"
+ * @return int location, -1 if program has no active uniform of name
+ */
+int ap_shader_get_location(GLuint program, const char *const name);
+
+/**
+ * @brief Look up the locations of the uniforms named by format with
+ * index i in [0, count), e.g. AP_SP_MT_SHININESS
+ * @param program (shader) program ID
+ * @param format uniform name format with one %d
+ * @param count number of names
+ * @param locations [out] count locations, -1 for the inactive ones
+ * @return int AP_Types
+ */
+int ap_shader_get_locations(
+        GLuint program,
+        const char *const format,
+        int count,
+        int *locations
+);
+
 int ap_shader_set_float(GLuint program, const char *const name, float num);
 
 int ap_shader_set_int  (GLuint program, const char *const name, GLuint num);
@@ -97,6 +106,20 @@ int ap_shader_set_vec4 (GLuint program, const char *const name, float *vec);
 
 int ap_shader_set_mat4 (GLuint program, const char *const name, float *mat);
 
+/**
+ * Set the uniform at location of the program in use,
+ * AP_ERROR_RENDER_FAILED is returned for the negative locations
+ */
+int ap_shader_set_float_loc(int location, float num);
+
+int ap_shader_set_int_loc  (int location, GLuint num);
+
+int ap_shader_set_vec3_loc (int location, float *vec);
+
+int ap_shader_set_vec4_loc (int location, float *vec);
+
+int ap_shader_set_mat4_loc (int location, float *mat);
+
 unsigned int ap_get_current_shader();
 
 #endif // AP_SHADER_H
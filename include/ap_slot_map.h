@@ -0,0 +1,122 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Slot map with generation checked handles
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
+#ifndef AP_SLOT_MAP_H
+#define AP_SLOT_MAP_H
+
+#include "ap_cvector.h"
+
+/**
+ * A handle is a 32 bits unsigned int:
+ *   low  AP_SLOT_INDEX_BITS bits: index of the slot
+ *   high bits: generation of the slot, never 0
+ * so 0 is never a valid handle and can be used as "none".
+ * The generation of a slot increases when its element is removed,
+ * the handles of removed elements are rejected even if the slot is reused.
+ * A slot whose generation reaches AP_SLOT_GENERATION_MASK is retired
+ * instead of wrapping around, so a stale handle never becomes valid again.
+ */
+#ifndef AP_SLOT_INDEX_BITS
+#define AP_SLOT_INDEX_BITS 20
+#endif
+
+#define AP_SLOT_INDEX_MASK ((1u << AP_SLOT_INDEX_BITS) - 1)
+#define AP_SLOT_GENERATION_MASK (0xFFFFFFFFu >> AP_SLOT_INDEX_BITS)
+
+/**
+ * Elements are stored densely in data, so that iteration is a plain
+ * loop over an array. Removing an element moves the last element into
+ * its place, the element pointers are only valid until the next
+ * insert or remove, store pointers in the map to keep addresses stable.
+ */
+struct AP_Slot_Map {
+        // dense elements
+        struct AP_Vector data;
+        // handle of each dense element, same order as data
+        struct AP_Vector handles;
+        // struct AP_Slot, indexed by the index of handle
+        struct AP_Vector slots;
+        // index of the first free slot + 1, 0 when there is no free slot
+        unsigned int free_head;
+};
+
+/**
+ * @brief Initialize a slot map
+ *
+ * @param map
+ * @param elem_size size of one element (byte)
+ * @return int AP_Types
+ */
+int ap_slot_map_init(struct AP_Slot_Map *map, size_t elem_size);
+
+/**
+ * @brief Release the memory of slot map
+ *
+ * @param map
+ * @return int AP_Types
+ */
+int ap_slot_map_free(struct AP_Slot_Map *map);
+
+/**
+ * @brief Insert a copy of elem in O(1)
+ *
+ * @param map
+ * @param elem pointer points to the element, NULL to insert zero filled
+ * @param handle [out] handle of the new element
+ * @return int AP_Types
+ */
+int ap_slot_map_insert(
+        struct AP_Slot_Map *map,
+        const void *elem,
+        unsigned int *handle
+);
+
+/**
+ * @brief Get the element of handle in O(1)
+ *
+ * @param map
+ * @param handle
+ * @return pointer points to the element, NULL if the handle is invalid
+ *         or the element was removed
+ */
+void *ap_slot_map_get(struct AP_Slot_Map *map, unsigned int handle);
+
+/**
+ * @brief Remove the element of handle in O(1),
+ * the last element is moved into its place.
+ *
+ * @param map
+ * @param handle
+ * @return int AP_Types
+ */
+int ap_slot_map_remove(struct AP_Slot_Map *map, unsigned int handle);
+
+/**
+ * @brief Number of elements in slot map
+ */
+static inline size_t ap_slot_map_length(struct AP_Slot_Map *map)
+{
+        return map->data.length;
+}
+
+/**
+ * @brief Dense array of elements, for iteration
+ */
+static inline void *ap_slot_map_data(struct AP_Slot_Map *map)
+{
+        return map->data.data;
+}
+
+/**
+ * @brief Handle of the i-th element of the dense array
+ */
+static inline unsigned int ap_slot_map_handle_at(
+        struct AP_Slot_Map *map, size_t i)
+{
+        return ((unsigned int*) map->handles.data)[i];
+}
+
+#endif // AP_SLOT_MAP_H
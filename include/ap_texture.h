@@ -41,17 +41,41 @@ static inline const char* ap_texture_type_2_str(int t)
 }
 
 struct AP_Texture {
-        unsigned int id;
+        unsigned int id;        // OpenGL texture ID
+        unsigned int handle;    // texture ID given by ap_texture_generate
         int type;
         char *path;
         float RGBA[4];
 };
 
+/**
+ * Decoded image data in CPU memory
+ */
+struct AP_Texture_Image {
+        unsigned char *data;    // freed by ap_texture_image_free
+        int width;
+        int height;
+        int channels;
+};
+
+/**
+ * Parameter of the callback of ap_texture_generate_async,
+ * only valid while the callback is running.
+ */
+struct AP_Texture_Thread_Param {
+        const char *path;
+        unsigned int id;        // texture ID, 0 on error
+};
+
 /**
  * @brief Generate a texture from specific file and directory
- * and store its OpenGL texture ID in vector.
+ * and store it in slot map. The textures are shared by the normalized
+ * absolute path of their files, the reference of the texture is
+ * increased if the file is generated already.
+ * Every texture ID given out holds a reference, see ap_texture_release.
  *
- * @param texture_id [out] pointer points to the ID of texture generated
+ * @param texture_id [out] pointer points to the ID of texture generated,
+ *        which is not the OpenGL texture ID, use ap_texture_get_ptr
  * @param type [in] the type of the texture (AP_Texture_types)
  * @param path [in] name of the image (PNG or JPG)
  * @param directory [in] directory to the image file (UNIX format)
@@ -66,9 +90,48 @@ int ap_texture_generate(
         bool gamma
 );
 
+/**
+ * @brief Generate a texture on the worker threads, the image is decoded by
+ * the job system and uploaded in ap_render_flush of the render thread.
+ * The callback is called on the render thread after the texture is
+ * generated, with struct AP_Texture_Thread_Param and the AP_Types result.
+ *
+ * @param path [in] name of the image (PNG or JPG)
+ * @param directory [in] directory to the image file (UNIX format)
+ * @param type [in] the type of the texture (AP_Texture_types)
+ * @param cb [in] callback, can be NULL
+ * @return int AP_Types
+ */
+int ap_texture_generate_async(
+        const char *path,
+        const char *directory,
+        int type,
+        ap_callback_func_t cb
+);
+
+/**
+ * @brief Generate a texture from decoded image and store it in slot map,
+ * must be called on the render thread. Shared like ap_texture_generate.
+ *
+ * @param texture_id [out] ID of the texture generated
+ * @param type [in] the type of the texture (AP_Texture_types)
+ * @param path [in] name of the image
+ * @param directory [in] directory to the image file
+ * @param image [in] image given by ap_texture_image_load
+ * @return int AP_Types
+ */
+int ap_texture_generate_image(
+        unsigned int *texture_id,
+        int type,
+        const char *path,
+        const char *directory,
+        const struct AP_Texture_Image *image
+);
+
 /**
  * @brief Genrerate a texture from a single RGBA color value,
- * and store its OpenGL Texture ID in vector.
+ * and store it in slot map. The colors of the same 8 bit RGBA
+ * share a texture like ap_texture_generate.
  *
  * @param texture_id
  * @param type
@@ -82,23 +145,46 @@ int ap_texture_generate_RGBA(
 );
 
 /**
- * @brief Get the pointer of struct AP_Texture in vector
+ * @brief Get the pointer of struct AP_Texture by its file in O(1),
+ * the reference is not increased
  *
  * @param path name of the image file (PNG or JPG)
+ * @param directory directory to the image file
  * @return struct AP_Texture*, NULL when not found
  */
-struct AP_Texture *ap_texture_get_ptr_by_path(const char *path);
+struct AP_Texture *ap_texture_get_ptr_by_path(
+        const char *path,
+        const char *directory
+);
 
 /**
+ * @brief Get the texture of color quantized to 8 bit RGBA
  * @see ap_texture_get_ptr_by_path
  */
 struct AP_Texture *ap_texture_get_ptr_by_RGBA(float color[4]);
 
 /**
- * @brief Get the pointer of struct AP_Texture by OpenGL texture ID
+ * @brief Increase the reference of texture
+ *
+ * @param id texture ID
+ * @return int AP_Types
+ */
+int ap_texture_ref(unsigned int id);
+
+/**
+ * @brief Drop a reference of texture, the texture is deleted and
+ * its ID becomes invalid after the last reference is dropped
+ *
+ * @param id texture ID
+ * @return int AP_Types
+ */
+int ap_texture_release(unsigned int id);
+
+/**
+ * @brief Get the pointer of struct AP_Texture by texture ID in O(1)
  *
- * @param id
- * @return struct AP_Texture*
+ * @param id texture ID given by ap_texture_generate
+ * @return struct AP_Texture*, NULL when not found
  */
 struct AP_Texture *ap_texture_get_ptr(unsigned int id);
 
@@ -115,6 +201,35 @@ unsigned int ap_texture_from_file(
         bool gamma
 );
 
+/**
+ * @brief Decode image file to CPU memory without OpenGL calls,
+ * can be called by any thread.
+ *
+ * @param path file name
+ * @param directory path name
+ * @param image [out] decoded image, release by ap_texture_image_free
+ * @return int AP_Types
+ */
+int ap_texture_image_load(
+        const char *path,
+        const char *directory,
+        struct AP_Texture_Image *image
+);
+
+/**
+ * @brief Release the data of image
+ * @return int AP_Types
+ */
+int ap_texture_image_free(struct AP_Texture_Image *image);
+
+/**
+ * @brief Upload decoded image to OpenGL
+ *
+ * @param image
+ * @return OpenGL texture id, 0 on error
+ */
+unsigned int ap_texture_from_image(const struct AP_Texture_Image *image);
+
 /**
  * @brief Generate RGBA color to OpenGL Texture ID
  *
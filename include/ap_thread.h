@@ -1,6 +1,146 @@
+/**
+ * @author STARRY-S (hxstarrys@gmail.com)
+ * @brief Job system with work-stealing worker threads
+ *
+ * @copyright Apache 2.0 - Copyright (c) 2022
+ */
 #ifndef AP_THREAD_H
 #define AP_THREAD_H
 
-void* ap_thread_func(void* param);
+#include <stdatomic.h>
+#include <pthread.h>
 
-#endif
\ No newline at end of file
+#ifndef AP_THREAD_MAX_NUM
+#define AP_THREAD_MAX_NUM 64
+#endif
+
+// initial capacity of the deque of each worker, grows when full
+#ifndef AP_THREAD_DEQUE_CAPACITY
+#define AP_THREAD_DEQUE_CAPACITY 256
+#endif
+
+typedef void (*ap_job_func_t)(void *param);
+
+/**
+ * Function of ap_thread_parallel_for, called with [begin, end)
+ */
+typedef void (*ap_job_range_func_t)(void *param, int begin, int end);
+
+struct AP_Job_Continuation;
+
+/**
+ * Counts the unfinished jobs it is attached to,
+ * jobs depend on it start after it reaches zero.
+ */
+struct AP_Job_Counter {
+        atomic_int value;
+        // threads releasing the waiting jobs after value reached zero,
+        // the counter can not be freed until it is zero as well
+        atomic_int releasing;
+        pthread_mutex_t lock;
+        // jobs waiting for the counter, started when it reaches zero
+        struct AP_Job_Continuation *waiting;
+};
+
+/**
+ * @brief Start the worker threads, every worker has its own deque,
+ * idle workers steal jobs from the others.
+ *
+ * @param thread_num number of workers, 0 to use the number of cores
+ * @return int AP_Types
+ */
+int ap_thread_init(int thread_num);
+
+/**
+ * @brief Stop the worker threads, the queued jobs are finished first
+ *
+ * @return int AP_Types
+ */
+int ap_thread_free();
+
+/**
+ * @brief Number of worker threads, 0 when the job system is not started
+ */
+int ap_thread_num();
+
+/**
+ * @brief Index of the worker thread which calls this function,
+ * -1 if the caller is not a worker
+ */
+int ap_thread_worker_index();
+
+/**
+ * @brief Initialize a job counter with zero
+ *
+ * @param counter
+ * @return int AP_Types
+ */
+int ap_job_counter_init(struct AP_Job_Counter *counter);
+
+/**
+ * @brief Release a job counter, wait for it by ap_thread_wait first
+ *
+ * @param counter
+ * @return int AP_Types
+ */
+int ap_job_counter_free(struct AP_Job_Counter *counter);
+
+/**
+ * @brief Queue a job, jobs queued by a worker are pushed to its own deque.
+ * If the job system is not started the job runs on the calling thread.
+ *
+ * @param func job function
+ * @param param parameter of func
+ * @param counter [in,out] increased now and decreased after the job
+ *        finished, can be NULL
+ * @return int AP_Types
+ */
+int ap_thread_run(
+        ap_job_func_t func,
+        void *param,
+        struct AP_Job_Counter *counter
+);
+
+/**
+ * @brief Queue a job which starts after the jobs of dependency finished
+ *
+ * @param dependency counter the job waits for
+ * @param func job function
+ * @param param parameter of func
+ * @param counter see ap_thread_run, can be NULL
+ * @return int AP_Types
+ */
+int ap_thread_run_after(
+        struct AP_Job_Counter *dependency,
+        ap_job_func_t func,
+        void *param,
+        struct AP_Job_Counter *counter
+);
+
+/**
+ * @brief Wait until counter reaches zero,
+ * the calling thread runs the queued jobs while waiting.
+ *
+ * @param counter
+ * @return int AP_Types
+ */
+int ap_thread_wait(struct AP_Job_Counter *counter);
+
+/**
+ * @brief Split [0, length) into batches of batch_size and run func
+ * on them in parallel, returns after all batches finished.
+ *
+ * @param length number of items
+ * @param batch_size items of one job, 0 to split by the number of workers
+ * @param func called with the range [begin, end) of each batch
+ * @param param parameter of func
+ * @return int AP_Types
+ */
+int ap_thread_parallel_for(
+        int length,
+        int batch_size,
+        ap_job_range_func_t func,
+        void *param
+);
+
+#endif // AP_THREAD_H
@@ -173,4 +173,24 @@ int ap_get_default_cube_vertices_length();
 
 double ap_get_time();
 
+// code point of the replacement character for invalid UTF-8
+#define AP_UTF8_REPLACEMENT 0xFFFD
+
+/**
+ * @brief Decode one character of UTF-8 string
+ *
+ * @param text [in] UTF-8 string, not at the terminating zero
+ * @param code [out] unicode code point, AP_UTF8_REPLACEMENT for invalid bytes
+ * @return number of bytes decoded, at least 1
+ */
+int ap_utf8_decode(const char *text, unsigned int *code);
+
+/**
+ * @brief 32 bit FNV-1a hash of string
+ *
+ * @param str string terminated by zero
+ * @return hash value
+ */
+unsigned int ap_hash_str(const char *str);
+
 #endif // AP_UTILS_H
@@ -3,6 +3,9 @@
 
 #define MAX_BONE_INFLUENCE 4
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "cglm/cglm.h"
 
 struct AP_Vertex {
@@ -20,4 +23,80 @@ struct AP_Vertex {
         float weights[MAX_BONE_INFLUENCE];
 };
 
-#endif // AP_VERTEX_H
\ No newline at end of file
+/**
+ * Formats of the vertices uploaded to GL, struct AP_Vertex is only kept
+ * in memory, the VBO has the attributes drawn by the shader only:
+ *   FLOAT:  position 3 floats, normal 3 floats, UV 2 floats (32 bytes)
+ *   PACKED: position 3 half floats + 1 pad, normal octahedral encoded in
+ *           4 bytes, UV 2 half floats (16 bytes). Half floats have 11
+ *           significant bits, for the models of small coordinates.
+ */
+enum AP_Vertex_Format {
+        AP_VERTEX_FORMAT_FLOAT = 0,
+        AP_VERTEX_FORMAT_PACKED,
+        AP_VERTEX_FORMAT_LENGTH
+};
+
+#define AP_VERTEX_ATTRIBUTE_MAX 8
+
+/**
+ * One glVertexAttribPointer call
+ */
+struct AP_Vertex_Attribute {
+        unsigned int location;
+        int size;               // number of components
+        unsigned int type;      // GL type of components
+        bool normalized;
+        int offset;             // offset in a vertex (byte)
+};
+
+struct AP_Vertex_Layout {
+        int stride;             // size of a vertex (byte)
+        int attribute_num;
+        struct AP_Vertex_Attribute attributes[AP_VERTEX_ATTRIBUTE_MAX];
+};
+
+/**
+ * @brief Layout of format, NULL if format is invalid
+ */
+const struct AP_Vertex_Layout *ap_vertex_get_layout(int format);
+
+/**
+ * @brief Convert vertices to format
+ *
+ * @param format enum AP_Vertex_Format
+ * @param vertices
+ * @param num number of vertices
+ * @param out [out] stride of the layout * num bytes
+ * @return int AP_Types
+ */
+int ap_vertex_pack(
+        int format,
+        const struct AP_Vertex *vertices,
+        int num,
+        void *out
+);
+
+/**
+ * @brief Convert float to half float (IEEE 754 binary16),
+ * rounded to nearest even
+ */
+uint16_t ap_vertex_float_to_half(float f);
+
+/**
+ * @brief Convert half float to float
+ */
+float ap_vertex_half_to_float(uint16_t h);
+
+/**
+ * @brief Octahedral encoding of a unit vector in two signed bytes
+ * (normalized to [-1, 1])
+ */
+void ap_vertex_oct_encode(const float *normal, int8_t *oct);
+
+/**
+ * @brief Decode the octahedral encoded unit vector
+ */
+void ap_vertex_oct_decode(const int8_t *oct, float *normal);
+
+#endif // AP_VERTEX_H
@@ -0,0 +1,165 @@
+#include <stdint.h>
+
+#include "ap_utils.h"
+#include "ap_arena.h"
+
+struct AP_Arena_Block {
+        struct AP_Arena_Block *prev;
+        size_t capacity;        // size of data
+        size_t offset;          // offset of the next allocation
+        char *data;
+};
+
+// header of block is padded so that data is aligned as well
+#define AP_ARENA_HEADER_SIZE \
+        ((sizeof(struct AP_Arena_Block) + AP_ARENA_ALIGN - 1) \
+        & ~((size_t) AP_ARENA_ALIGN - 1))
+
+static _Thread_local struct AP_Arena frame_arena = { NULL, 0, 0, 0 };
+
+static inline size_t ap_arena_align(size_t size)
+{
+        return (size + AP_ARENA_ALIGN - 1) & ~((size_t) AP_ARENA_ALIGN - 1);
+}
+
+static struct AP_Arena_Block *ap_arena_block_new(size_t capacity)
+{
+        struct AP_Arena_Block *block = AP_MALLOC_TAG(
+                AP_ARENA_HEADER_SIZE + capacity, AP_MEMORY_TAG_ARENA);
+        if (block == NULL) {
+                LOGE("ap_arena: malloc failed");
+                return NULL;
+        }
+        block->prev = NULL;
+        block->capacity = capacity;
+        block->offset = 0;
+        block->data = (char*) block + AP_ARENA_HEADER_SIZE;
+        return block;
+}
+
+static void ap_arena_free_blocks(struct AP_Arena_Block *block)
+{
+        while (block) {
+                struct AP_Arena_Block *prev = block->prev;
+                AP_FREE(block);
+                block = prev;
+        }
+}
+
+int ap_arena_init(struct AP_Arena *arena, size_t block_size)
+{
+        if (arena == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        arena->block = NULL;
+        arena->block_size = block_size ? block_size : AP_ARENA_BLOCK_SIZE;
+        arena->used = 0;
+        arena->peak = 0;
+        return 0;
+}
+
+void *ap_arena_alloc(struct AP_Arena *arena, size_t size)
+{
+        if (arena == NULL) {
+                return NULL;
+        }
+        // zero size allocation returns an unique pointer like malloc
+        size = ap_arena_align(size ? size : 1);
+        struct AP_Arena_Block *block = arena->block;
+        if (block == NULL || block->offset + size > block->capacity) {
+                // the rest of the current block is wasted until reset
+                size_t capacity = arena->block_size;
+                if (capacity < size) {
+                        capacity = size;
+                }
+                block = ap_arena_block_new(capacity);
+                if (block == NULL) {
+                        return NULL;
+                }
+                block->prev = arena->block;
+                arena->block = block;
+        }
+        void *ptr = block->data + block->offset;
+        block->offset += size;
+        arena->used += size;
+        if (arena->used > arena->peak) {
+                arena->peak = arena->used;
+        }
+        return ptr;
+}
+
+int ap_arena_reset(struct AP_Arena *arena)
+{
+        if (arena == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (arena->block && arena->block->prev) {
+                // the arena overflowed its first block, replace the blocks
+                // by a single one which holds the peak usage
+                ap_arena_free_blocks(arena->block);
+                arena->block = NULL;
+                if (arena->block_size < arena->peak) {
+                        arena->block_size = ap_arena_align(arena->peak);
+                }
+                arena->block = ap_arena_block_new(arena->block_size);
+        }
+        if (arena->block) {
+                arena->block->offset = 0;
+        }
+        arena->used = 0;
+        return 0;
+}
+
+int ap_arena_free(struct AP_Arena *arena)
+{
+        if (arena == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        ap_arena_free_blocks(arena->block);
+        arena->block = NULL;
+        arena->used = 0;
+        return 0;
+}
+
+struct AP_Arena_Marker ap_arena_mark(struct AP_Arena *arena)
+{
+        struct AP_Arena_Marker marker = { NULL, 0, 0 };
+        if (arena == NULL) {
+                return marker;
+        }
+        marker.block = arena->block;
+        marker.offset = arena->block ? arena->block->offset : 0;
+        marker.used = arena->used;
+        return marker;
+}
+
+int ap_arena_rewind(struct AP_Arena *arena, struct AP_Arena_Marker marker)
+{
+        if (arena == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        while (arena->block && arena->block != marker.block) {
+                struct AP_Arena_Block *prev = arena->block->prev;
+                if (prev == NULL) {
+                        // the scope began on an empty arena,
+                        // keep the first block for reuse
+                        marker.offset = 0;
+                        break;
+                }
+                AP_FREE(arena->block);
+                arena->block = prev;
+        }
+        if (arena->block) {
+                arena->block->offset = marker.offset;
+        }
+        arena->used = marker.used;
+        return 0;
+}
+
+struct AP_Arena *ap_arena_frame()
+{
+        if (frame_arena.block_size == 0) {
+                ap_arena_init(&frame_arena, 0);
+        }
+        return &frame_arena;
+}
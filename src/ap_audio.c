@@ -326,7 +326,8 @@ static inline int ap_audio_play_ptr(
         }
 
         pthread_t pid = 0;
-        struct AP_Audio *tmp_audio = AP_MALLOC(sizeof(struct AP_Audio));
+        struct AP_Audio *tmp_audio = AP_MALLOC_TAG(
+                sizeof(struct AP_Audio), AP_MEMORY_TAG_AUDIO);
         memcpy(tmp_audio, audio, sizeof(struct AP_Audio));
         tmp_audio->cb = (cb) ? cb : NULL;
         pthread_create(&pid, NULL, ap_audio_play_thread_func, tmp_audio);
@@ -384,7 +385,8 @@ static inline int ap_audio_open_file_WAV_ptr(
 #else
         struct AP_Audio *out_audio = *out_audio_p;
         if (out_audio == NULL) {
-                out_audio = *out_audio_p = AP_MALLOC(sizeof(struct AP_Audio));
+                out_audio = *out_audio_p = AP_MALLOC_TAG(
+                        sizeof(struct AP_Audio), AP_MEMORY_TAG_AUDIO);
                 if (out_audio == NULL) {
                         return AP_ERROR_MALLOC_FAILED;
                 }
@@ -397,7 +399,8 @@ static inline int ap_audio_open_file_WAV_ptr(
         ALvoid* data = alutLoadMemoryFromFile(
                 filename, &format, &size, &frequency);
         ap_audio_check_alut("alutLoadMemoryFromFile");
-        out_audio->name = AP_MALLOC((strlen(filename) + 1) * sizeof(char));
+        out_audio->name = AP_MALLOC_TAG(
+                (strlen(filename) + 1) * sizeof(char), AP_MEMORY_TAG_AUDIO);
         strcpy(out_audio->name, filename);
         out_audio->data = data;
         out_audio->data_size = size;
@@ -452,7 +455,8 @@ static inline int ap_audio_open_file_MP3_ptr(
 {
         struct AP_Audio *out_audio = *out_audio_p;
         if (out_audio == NULL) {
-                out_audio = *out_audio_p = AP_MALLOC(sizeof(struct AP_Audio));
+                out_audio = *out_audio_p = AP_MALLOC_TAG(
+                        sizeof(struct AP_Audio), AP_MEMORY_TAG_AUDIO);
                 if (out_audio == NULL) {
                         return AP_ERROR_MALLOC_FAILED;
                 }
@@ -467,7 +471,8 @@ static inline int ap_audio_open_file_MP3_ptr(
                 return AP_ERROR_DECODE_FAILED;
         }
 
-        out_audio->name = AP_MALLOC((strlen(filename) + 1) * sizeof(char));
+        out_audio->name = AP_MALLOC_TAG(
+                (strlen(filename) + 1) * sizeof(char), AP_MEMORY_TAG_AUDIO);
         strcpy(out_audio->name, filename);
         out_audio->data = tmp_vec->data;
         out_audio->data_size = tmp_vec->length;
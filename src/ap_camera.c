@@ -3,8 +3,14 @@
 #include "ap_render.h"
 #include "ap_utils.h"
 #include "ap_physic.h"
-
-static struct AP_Vector camera_vector = { 0, 0, 0, 0 };
+#include "ap_pool.h"
+#include "ap_slot_map.h"
+
+// cameras are stored in pool so camera_using stays valid,
+// the slot map holds their pointers, the IDs are the slot map handles
+static struct AP_Pool camera_pool;
+static struct AP_Slot_Map camera_map;
+static bool camera_initialized = false;
 static struct AP_Camera *camera_using = NULL;
 
 int ap_camera_init_ptr(struct AP_Camera *camera);
@@ -12,40 +18,47 @@ int ap_camera_update_vectors();
 
 int ap_camera_generate(unsigned int *camera_id)
 {
-        // initialize camera vector when first use
-        if (camera_vector.data == NULL) {
-                ap_vector_init(&camera_vector, AP_VECTOR_CAMERA);
+        if (camera_id == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        // initialize camera pool and slot map when first use
+        if (!camera_initialized) {
+                ap_pool_init(&camera_pool, sizeof(struct AP_Camera),
+                        0, AP_MEMORY_TAG_UNKNOWN);
+                ap_slot_map_init(&camera_map, sizeof(struct AP_Camera*));
+                camera_initialized = true;
         }
 
-        struct AP_Camera camera;
-        ap_camera_init_ptr(&camera);
-        camera.id = camera_vector.length + 1;
-        ap_vector_push_back(&camera_vector, (const char*) &camera);
-        *camera_id = camera.id;
+        *camera_id = 0;
+        struct AP_Camera *camera = ap_pool_alloc(&camera_pool);
+        if (camera == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        ap_camera_init_ptr(camera);
+        int ret = ap_slot_map_insert(&camera_map, &camera, &camera->id);
+        if (ret != 0) {
+                ap_pool_release(&camera_pool, camera);
+                return ret;
+        }
+        *camera_id = camera->id;
 
         return AP_ERROR_SUCCESS;
 }
 
 int ap_camera_use(unsigned int camera_id)
 {
-        if (camera_id > camera_vector.length) {
-                return AP_ERROR_INVALID_PARAMETER;
-        }
-
         if (camera_id == 0) {
                 camera_using = NULL;
                 return 0;
         }
 
-        struct AP_Camera *tmp_cam = (struct AP_Camera*) camera_vector.data;
-        for (int i = 0; i < camera_vector.length; ++i) {
-                if (tmp_cam[i].id == camera_id) {
-                        camera_using = tmp_cam + i;
-                        return 0;
-                }
+        struct AP_Camera **camera = ap_slot_map_get(&camera_map, camera_id);
+        if (camera == NULL) {
+                LOGW("failed to use camera: id %u not found", camera_id);
+                return AP_ERROR_INVALID_PARAMETER;
         }
+        camera_using = *camera;
 
-        LOGW("failed to use camera: id %u not found", camera_id);
         return 0;
 }
 
@@ -89,7 +102,11 @@ int ap_camera_init_ptr(struct AP_Camera *camera)
 int ap_camera_free()
 {
         camera_using = NULL;    // for safety purpose
-        ap_vector_free(&camera_vector);
+        if (camera_initialized) {
+                ap_slot_map_free(&camera_map);
+                ap_pool_free(&camera_pool);
+                camera_initialized = false;
+        }
 
         return 0;
 }
@@ -0,0 +1,303 @@
+#include <math.h>
+#include <float.h>
+
+#include "ap_utils.h"
+#include "ap_cluster.h"
+#include "ap_thread.h"
+
+#define AP_CLUSTER_TILE_NUM (AP_CLUSTER_X * AP_CLUSTER_Y)
+
+int ap_cluster_init(struct AP_Cluster_Grid *grid)
+{
+        if (grid == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        memset(grid, 0, sizeof(struct AP_Cluster_Grid));
+
+        grid->aabb = AP_MALLOC_TAG(sizeof(float) * 6 * AP_CLUSTER_NUM,
+                AP_MEMORY_TAG_LIGHT);
+        grid->clusters = AP_MALLOC_TAG(
+                sizeof(unsigned int) * 2 * AP_CLUSTER_NUM,
+                AP_MEMORY_TAG_LIGHT);
+        grid->indices = AP_MALLOC_TAG(sizeof(unsigned int)
+                * AP_CLUSTER_NUM * AP_CLUSTER_MAX_LIGHTS,
+                AP_MEMORY_TAG_LIGHT);
+        if (!grid->aabb || !grid->clusters || !grid->indices) {
+                LOGE("failed to init clusters: malloc failed");
+                ap_cluster_free(grid);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        memset(grid->clusters, 0, sizeof(unsigned int) * 2 * AP_CLUSTER_NUM);
+
+        return 0;
+}
+
+int ap_cluster_free(struct AP_Cluster_Grid *grid)
+{
+        if (grid == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        AP_FREE(grid->aabb);
+        AP_FREE(grid->clusters);
+        AP_FREE(grid->indices);
+        AP_FREE(grid->view_lights);
+        AP_FREE(grid->light_slices);
+        memset(grid, 0, sizeof(struct AP_Cluster_Grid));
+
+        return 0;
+}
+
+/**
+ * Range of view space coordinate of the NDC range [ndc0, ndc1]
+ * between depth d0 and d1, scale and offset are the projection terms
+ */
+static void ap_cluster_axis_range(
+        float ndc0, float ndc1, float d0, float d1,
+        float scale, float offset, float *min, float *max)
+{
+        float v[4] = {
+                d0 * (ndc0 + offset) / scale,
+                d0 * (ndc1 + offset) / scale,
+                d1 * (ndc0 + offset) / scale,
+                d1 * (ndc1 + offset) / scale,
+        };
+        *min = v[0];
+        *max = v[0];
+        for (int i = 1; i < 4; ++i) {
+                *min = v[i] < *min ? v[i] : *min;
+                *max = v[i] > *max ? v[i] : *max;
+        }
+}
+
+int ap_cluster_setup(
+        struct AP_Cluster_Grid *grid,
+        const float *projection,
+        float near,
+        float far)
+{
+        if (grid == NULL || projection == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (near <= 0.0f || far <= near
+                || projection[0] == 0.0f || projection[5] == 0.0f)
+        {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        grid->near = near;
+        grid->far = far;
+        float log_ratio = logf(far / near);
+        grid->slice_scale = AP_CLUSTER_Z / log_ratio;
+        grid->slice_bias = AP_CLUSTER_Z * logf(near) / log_ratio;
+
+        // view space x = depth * (ndc x + P[2][0]) / P[0][0],
+        // y is the same with P[2][1] and P[1][1]
+        for (int z = 0; z < AP_CLUSTER_Z; ++z) {
+                float d0 = near * powf(far / near, (float) z / AP_CLUSTER_Z);
+                float d1 = near * powf(far / near,
+                        (float) (z + 1) / AP_CLUSTER_Z);
+                for (int y = 0; y < AP_CLUSTER_Y; ++y) {
+                        float ny0 = -1.0f + 2.0f * y / AP_CLUSTER_Y;
+                        float ny1 = -1.0f + 2.0f * (y + 1) / AP_CLUSTER_Y;
+                        for (int x = 0; x < AP_CLUSTER_X; ++x) {
+                                float nx0 = -1.0f + 2.0f * x / AP_CLUSTER_X;
+                                float nx1 = -1.0f
+                                        + 2.0f * (x + 1) / AP_CLUSTER_X;
+                                float *aabb = grid->aabb
+                                        + 6 * ap_cluster_index(x, y, z);
+                                ap_cluster_axis_range(nx0, nx1, d0, d1,
+                                        projection[0], projection[8],
+                                        &aabb[0], &aabb[3]);
+                                ap_cluster_axis_range(ny0, ny1, d0, d1,
+                                        projection[5], projection[9],
+                                        &aabb[1], &aabb[4]);
+                                aabb[2] = -d1;
+                                aabb[5] = -d0;
+                        }
+                }
+        }
+
+        return 0;
+}
+
+int ap_cluster_slice(struct AP_Cluster_Grid *grid, float depth)
+{
+        if (depth <= grid->near) {
+                return 0;
+        }
+        int slice = (int) floorf(
+                logf(depth) * grid->slice_scale - grid->slice_bias);
+        if (slice < 0) {
+                return 0;
+        }
+        if (slice >= AP_CLUSTER_Z) {
+                return AP_CLUSTER_Z - 1;
+        }
+        return slice;
+}
+
+static bool ap_cluster_sphere_aabb(
+        const struct AP_Cluster_Light *light, const float *aabb)
+{
+        float distance = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+                float p = light->position[i];
+                if (p < aabb[i]) {
+                        distance += (aabb[i] - p) * (aabb[i] - p);
+                } else if (p > aabb[i + 3]) {
+                        distance += (p - aabb[i + 3]) * (p - aabb[i + 3]);
+                }
+        }
+        return distance <= light->radius * light->radius;
+}
+
+/**
+ * Bin the lights of the slices [begin, end),
+ * the jobs write the clusters of their own slices only
+ */
+static void ap_cluster_bin_slices(void *param, int begin, int end)
+{
+        struct AP_Cluster_Grid *grid = param;
+        for (int z = begin; z < end; ++z) {
+                unsigned int *counts = grid->clusters
+                        + 2 * ap_cluster_index(0, 0, z);
+                for (int i = 0; i < AP_CLUSTER_TILE_NUM; ++i) {
+                        counts[2 * i + 1] = 0;
+                }
+                for (int l = 0; l < grid->light_num; ++l) {
+                        if (z < grid->light_slices[2 * l]
+                                || z > grid->light_slices[2 * l + 1])
+                        {
+                                continue;
+                        }
+                        struct AP_Cluster_Light *light =
+                                &grid->view_lights[l];
+                        for (int i = 0; i < AP_CLUSTER_TILE_NUM; ++i) {
+                                int c = ap_cluster_index(0, 0, z) + i;
+                                unsigned int *count = &counts[2 * i + 1];
+                                if (*count >= AP_CLUSTER_MAX_LIGHTS
+                                        || !ap_cluster_sphere_aabb(light,
+                                                grid->aabb + 6 * c))
+                                {
+                                        continue;
+                                }
+                                grid->indices[c * AP_CLUSTER_MAX_LIGHTS
+                                        + *count] = l;
+                                ++(*count);
+                        }
+                }
+        }
+}
+
+static int ap_cluster_reserve_lights(struct AP_Cluster_Grid *grid, int num)
+{
+        if (num <= grid->light_capacity) {
+                return 0;
+        }
+        int capacity = grid->light_capacity ? grid->light_capacity : 64;
+        while (capacity < num) {
+                capacity *= 2;
+        }
+        struct AP_Cluster_Light *lights = AP_MALLOC_TAG(
+                sizeof(struct AP_Cluster_Light) * capacity,
+                AP_MEMORY_TAG_LIGHT);
+        int *slices = AP_MALLOC_TAG(sizeof(int) * 2 * capacity,
+                AP_MEMORY_TAG_LIGHT);
+        if (lights == NULL || slices == NULL) {
+                AP_FREE(lights);
+                AP_FREE(slices);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        AP_FREE(grid->view_lights);
+        AP_FREE(grid->light_slices);
+        grid->view_lights = lights;
+        grid->light_slices = slices;
+        grid->light_capacity = capacity;
+
+        return 0;
+}
+
+int ap_cluster_bin(
+        struct AP_Cluster_Grid *grid,
+        const float *view,
+        const struct AP_Cluster_Light *lights,
+        int light_num)
+{
+        if (grid == NULL || view == NULL || (light_num && lights == NULL)) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (grid->far <= 0.0f) {
+                LOGE("failed to bin lights: clusters not setup");
+                return AP_ERROR_INIT_FAILED;
+        }
+        int ret = ap_cluster_reserve_lights(grid, light_num);
+        if (ret != 0) {
+                return ret;
+        }
+
+        // transform the lights to view space and find their slices
+        for (int i = 0; i < light_num; ++i) {
+                const float *p = lights[i].position;
+                struct AP_Cluster_Light *v = &grid->view_lights[i];
+                for (int j = 0; j < 3; ++j) {
+                        v->position[j] = view[j] * p[0] + view[4 + j] * p[1]
+                                + view[8 + j] * p[2] + view[12 + j];
+                }
+                v->radius = lights[i].radius < 0.0f
+                        ? FLT_MAX : lights[i].radius;
+                float depth = -v->position[2];
+                int *slices = &grid->light_slices[2 * i];
+                if (depth + v->radius < grid->near
+                        || depth - v->radius > grid->far)
+                {
+                        // out of the frustum, no slice
+                        slices[0] = 1;
+                        slices[1] = 0;
+                        continue;
+                }
+                slices[0] = ap_cluster_slice(grid, depth - v->radius);
+                slices[1] = ap_cluster_slice(grid, depth + v->radius);
+        }
+        grid->light_num = light_num;
+
+        ret = ap_thread_parallel_for(AP_CLUSTER_Z, 1,
+                ap_cluster_bin_slices, grid);
+        if (ret != 0) {
+                return ret;
+        }
+
+        // pack the indices, a cluster is never moved backward
+        size_t offset = 0;
+        for (int c = 0; c < AP_CLUSTER_NUM; ++c) {
+                unsigned int count = grid->clusters[2 * c + 1];
+                memmove(grid->indices + offset,
+                        grid->indices + (size_t) c * AP_CLUSTER_MAX_LIGHTS,
+                        sizeof(unsigned int) * count);
+                grid->clusters[2 * c] = offset;
+                offset += count;
+        }
+        grid->index_num = offset;
+
+        return 0;
+}
+
+float ap_cluster_light_radius(
+        float intensity,
+        float constant,
+        float linear,
+        float quadratic)
+{
+        // solve constant + linear * d + quadratic * d^2 = 256 * intensity
+        float c = constant - 256.0f * intensity;
+        if (c >= 0.0f) {
+                return 0.0f;
+        }
+        if (quadratic > 0.0f) {
+                return (-linear + sqrtf(linear * linear - 4 * quadratic * c))
+                        / (2.0f * quadratic);
+        }
+        if (linear > 0.0f) {
+                return -c / linear;
+        }
+        return -1.0f;
+}
@@ -1,3 +1,5 @@
+#include <stdint.h>
+
 #include "ap_cvector.h"
 #include "ap_utils.h"
 #include "ap_render.h"
@@ -17,13 +19,13 @@
  */
 bool ap_is_valid_vector(struct AP_Vector *vector);
 
-int ap_vector_data_type_size(struct AP_Vector *vector)
+/**
+ * Size of the element of AP_VECTOR_Types, only used by ap_vector_init
+ */
+static size_t ap_vector_type_size(int type)
 {
-        if (vector == NULL) {
-                return 0;
-        }
-        int size = 0;
-        switch (vector->type) {
+        size_t size = 0;
+        switch (type) {
         case AP_VECTOR_INT:
                 size = sizeof(int);
                 break;
@@ -71,27 +73,56 @@ int ap_vector_data_type_size(struct AP_Vector *vector)
                 break;
         case AP_VECTOR_UNDEFINED:
         default:
-                LOGW("unknow vector type: %d", vector->type);
+                LOGW("unknow vector type: %d", type);
                 return size;
         }
         return size;
 }
 
+size_t ap_vector_data_type_size(struct AP_Vector *vector)
+{
+        if (vector == NULL) {
+                return 0;
+        }
+        return vector->elem_size;
+}
+
 int ap_vector_init(struct AP_Vector *vector, int vector_type)
 {
         if (vector == NULL) {
                 return AP_ERROR_INVALID_POINTER;
         }
 
+        size_t size = ap_vector_type_size(vector_type);
+        if (size == 0) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        int ret = ap_vector_init_size(vector, size);
         vector->type = vector_type;
-        int size = ap_vector_data_type_size(vector);
+
+        return ret;
+}
+
+int ap_vector_init_size(struct AP_Vector *vector, size_t elem_size)
+{
+        if (vector == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (elem_size == 0) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        vector->type = AP_VECTOR_UNDEFINED;
+        vector->elem_size = elem_size;
         vector->capacity = AP_VECTOR_DEFAULT_CAPACITY;
-        vector->data = AP_MALLOC(size * AP_VECTOR_DEFAULT_CAPACITY);
+        vector->data = AP_MALLOC_TAG(
+                elem_size * AP_VECTOR_DEFAULT_CAPACITY, AP_MEMORY_TAG_VECTOR);
         if (vector->data == NULL) {
                 LOGE("malloc failed for vector.");
+                vector->capacity = 0;
                 return AP_ERROR_MALLOC_FAILED;
         }
-        memset(vector->data, 0, size * AP_VECTOR_DEFAULT_CAPACITY);
+        memset(vector->data, 0, elem_size * AP_VECTOR_DEFAULT_CAPACITY);
         vector->length = 0;
 
         return AP_ERROR_SUCCESS;
@@ -107,6 +138,7 @@ int ap_vector_free(struct AP_Vector *vector)
         vector->capacity = 0;
         vector->length = 0;
         vector->type = AP_VECTOR_UNDEFINED;
+        vector->elem_size = 0;
         return 0;
 }
 
@@ -116,79 +148,150 @@ bool ap_is_valid_vector(struct AP_Vector *vector)
                 return false;
         }
 
-        if (vector->data == NULL) {
+        if (vector->data == NULL || vector->elem_size == 0) {
                 return false;
         }
 
         return true;
 }
 
-int ap_vector_push_back(struct AP_Vector *vector, const char* data)
+/**
+ * Realloc the data of vector to hold exactly capacity elements
+ */
+static int ap_vector_realloc(struct AP_Vector *vector, size_t capacity)
 {
-        if (!ap_is_valid_vector(vector) || data == NULL) {
+        if (capacity > SIZE_MAX / vector->elem_size) {
+                LOGE("vector capacity %zu overflows", capacity);
                 return AP_ERROR_INVALID_PARAMETER;
         }
+        char *data = AP_REALLOC(vector->data, vector->elem_size * capacity);
+        if (data == NULL) {
+                LOGE("failed to realloc vector memory.");
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        vector->data = data;
+        vector->capacity = capacity;
 
-        int size = ap_vector_data_type_size(vector);
-        if (size == 0) {
+        return 0;
+}
+
+int ap_vector_reserve(struct AP_Vector *vector, size_t capacity)
+{
+        if (!ap_is_valid_vector(vector)) {
                 return AP_ERROR_INVALID_PARAMETER;
         }
-
-        if (vector->length == vector->capacity) {
-                vector->data = AP_REALLOC(
-                        vector->data,
-                        size * vector->capacity * 2
-                );
-                if (vector->data == NULL) {
-                        LOGE("failed to realloc vector memory.");
-                        return AP_ERROR_MALLOC_FAILED;
-                }
-                vector->capacity *= 2;
+        if (capacity <= vector->capacity) {
+                return 0;
         }
-        int offset = size * (vector->length) / (int) sizeof(char);
-        char *new_data = vector->data + offset;
-        memcpy(new_data, data, size);
-        vector->length++;
 
-        return 0;
+        return ap_vector_realloc(vector, capacity);
 }
 
-int ap_vector_insert_back(struct AP_Vector *vector, char *start, size_t size)
+int ap_vector_grow(struct AP_Vector *vector, size_t count)
 {
-        if (vector == NULL || start == NULL || size <= 0) {
+        if (!ap_is_valid_vector(vector)) {
                 return AP_ERROR_INVALID_PARAMETER;
         }
-        int type_size = ap_vector_data_type_size(vector);
-        if (type_size == 0) {
+        if (count > SIZE_MAX - vector->length) {
                 return AP_ERROR_INVALID_PARAMETER;
         }
+        size_t need = vector->length + count;
+        if (need <= vector->capacity) {
+                return 0;
+        }
+        // round up to the next power of two, so appending n elements
+        // one by one only reallocates log(n) times, and a bulk append
+        // reallocates once instead of doubling step by step
+        size_t capacity = need - 1;
+        for (size_t shift = 1; shift < sizeof(size_t) * 8; shift <<= 1) {
+                capacity |= capacity >> shift;
+        }
+        capacity++;
+        if (capacity < need) {
+                // no power of two left, use the exact size
+                capacity = need;
+        }
+        return ap_vector_realloc(vector, capacity);
+}
+
+int ap_vector_shrink_to_fit(struct AP_Vector *vector)
+{
+        if (!ap_is_valid_vector(vector)) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        // keep one element so that data is never NULL
+        size_t capacity = vector->length ? vector->length : 1;
+        if (capacity == vector->capacity) {
+                return 0;
+        }
 
-        while (vector->length + (size / type_size) > vector->capacity) {
-                vector->data = AP_REALLOC(
-                        vector->data,
-                        size * vector->capacity * 2
-                );
-                if (vector->data == NULL) {
-                        LOGE("failed to realloc vector memory.");
-                        return AP_ERROR_MALLOC_FAILED;
+        return ap_vector_realloc(vector, capacity);
+}
+
+int ap_vector_resize(struct AP_Vector *vector, size_t length)
+{
+        if (!ap_is_valid_vector(vector)) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        if (length > vector->length) {
+                int ret = ap_vector_grow(vector, length - vector->length);
+                if (ret != 0) {
+                        return ret;
                 }
-                vector->capacity *= 2;
+                memset(vector->data + vector->elem_size * vector->length, 0,
+                        vector->elem_size * (length - vector->length));
+        }
+        vector->length = length;
+
+        return 0;
+}
+
+int ap_vector_append(
+        struct AP_Vector *vector,
+        const void *data,
+        size_t count)
+{
+        if (!ap_is_valid_vector(vector) || data == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        int ret = ap_vector_grow(vector, count);
+        if (ret != 0) {
+                return ret;
         }
-        int offset = type_size * (vector->length) / (int) sizeof(char);
-        char *new_data = vector->data + offset;
-        memcpy(new_data, start, size);
-        vector->length += (int) size / ap_vector_data_type_size(vector);
+        memcpy(vector->data + vector->elem_size * vector->length,
+                data, vector->elem_size * count);
+        vector->length += count;
 
         return 0;
 }
 
+int ap_vector_push_back(struct AP_Vector *vector, const char* data)
+{
+        return ap_vector_append(vector, data, 1);
+}
+
+int ap_vector_insert_back(struct AP_Vector *vector, char *start, size_t size)
+{
+        if (!ap_is_valid_vector(vector) || start == NULL || size == 0) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        if (size % vector->elem_size != 0) {
+                LOGE("vector insert data failed with invalid memory size");
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        return ap_vector_append(vector, start, size / vector->elem_size);
+}
+
 int ap_vector_remove_data(
         struct AP_Vector *vector,
         char *start,
         char *end,
-        int size)
+        size_t size)
 {
-        if (vector == NULL || start == NULL || end == NULL || size <= 0) {
+        if (!ap_is_valid_vector(vector) || start == NULL || end == NULL
+                || size == 0)
+        {
                 LOGE("vector remove data failed with null pointer");
                 return AP_ERROR_INVALID_PARAMETER;
         }
@@ -196,21 +299,17 @@ int ap_vector_remove_data(
                 LOGE("vector remove data failed with invalid pointer position");
                 return AP_ERROR_INVALID_POINTER;
         }
-        unsigned long long start_ull = (unsigned long long) start;
-        unsigned long long end_ull   = (unsigned long long)   end;
-        if ((end_ull - start_ull) % size != 0) {
+        char *data_end = vector->data + vector->elem_size * vector->length;
+        if (start < vector->data || end > data_end
+                || (size_t) (end - start) != size
+                || size % vector->elem_size != 0)
+        {
                 LOGE("vector remove data failed with invalid memory size");
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
-        // dest, src, n
-        int tmp = vector->length - (size / ap_vector_data_type_size(vector));
-        if (tmp < 0) {
-                LOGE("vector remove data failed with invalid size");
-                return AP_ERROR_INVALID_PARAMETER;
-        }
-        LOGD("start: %p, end: %p, size: %d", start, end, size);
-        memmove(start, end, size);
-        vector->length = tmp;
+        // dest, src, n: move the elements after end forward
+        memmove(start, end, data_end - end);
+        vector->length -= size / vector->elem_size;
         return 0;
-}
\ No newline at end of file
+}
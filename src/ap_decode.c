@@ -88,15 +88,27 @@ static inline int ap_decode_frame_packet(
         data_size = av_get_bytes_per_sample(cdc_ctx->sample_fmt);
 
         while ((ret = avcodec_receive_frame(cdc_ctx, frame)) >= 0) {
+                int channels = cdc_ctx->ch_layout.nb_channels;
+                // resize once per frame, then interleave samples in place
+                char *dst = NULL;
+                if (out_vec) {
+                        size_t offset = out_vec->length;
+                        size_t frame_size = (size_t) frame->nb_samples
+                                * channels * data_size;
+                        if (ap_vector_resize(out_vec, offset + frame_size)) {
+                                return AP_ERROR_MALLOC_FAILED;
+                        }
+                        dst = out_vec->data + offset;
+                }
                 for (i = 0; i < frame->nb_samples; i++) {
-                        for (ch = 0; ch < cdc_ctx->ch_layout.nb_channels; ch++) {
+                        for (ch = 0; ch < channels; ch++) {
                                 uint8_t *ptr = frame->data[ch] + data_size * i;
                                 if (fp_out) {
                                         fwrite(ptr, 1, data_size, fp_out);
                                 }
-                                if (out_vec) {
-                                        ap_vector_insert_back(out_vec,
-                                                (char*) ptr, data_size);
+                                if (dst) {
+                                        memcpy(dst, ptr, data_size);
+                                        dst += data_size;
                                 }
                         }
                 }
@@ -109,6 +121,35 @@ static inline int ap_decode_frame_packet(
         return 0;
 }
 
+/**
+ * @brief Reserve the PCM buffer from the duration of the input,
+ * so that decoding a long track does not reallocate and copy
+ * the whole buffer again and again.
+ */
+static inline void ap_decode_reserve(
+        AVFormatContext *fmt_ctx,
+        AVCodecContext *cdc_ctx,
+        struct AP_Vector *out_vec)
+{
+        if (fmt_ctx->duration == AV_NOPTS_VALUE || fmt_ctx->duration <= 0) {
+                return;
+        }
+        int64_t samples = av_rescale(fmt_ctx->duration,
+                cdc_ctx->sample_rate, AV_TIME_BASE);
+        int64_t size = samples * cdc_ctx->ch_layout.nb_channels
+                * av_get_bytes_per_sample(cdc_ctx->sample_fmt);
+        if (size <= 0) {
+                return;
+        }
+        // the duration is estimated from bitrate for some mp3 files,
+        // leave a little margin to avoid a last reallocation
+        size += size / 64;
+        if (ap_vector_reserve(out_vec, (size_t) size) != 0) {
+                LOGW("ap_decode: failed to reserve %.2lfM for PCM data",
+                        (double) size / 1024 / 1024);
+        }
+}
+
 static inline void ap_decode_audio_exit(
         AVFrame *frame,
         AVPacket *packet,
@@ -238,6 +279,10 @@ static int ap_decode_audio(
                 }
         }
 
+        if (out_vec) {
+                ap_decode_reserve(fmt_ctx, cdc_ctx, out_vec);
+        }
+
         while ((ret = av_read_frame(fmt_ctx, packet)) == 0) {
                 if (packet->size > 0) {
                         ap_decode_frame_packet(
@@ -245,6 +290,10 @@ static int ap_decode_audio(
                 }
         }
         ap_decode_frame_packet(cdc_ctx, frame, NULL, fp_out, out_vec);
+        if (out_vec) {
+                // give back the over estimated capacity
+                ap_vector_shrink_to_fit(out_vec);
+        }
 
         *format = ap_audio_fmt_av_2_ap(cdc_ctx->sample_fmt, fmt);
         *frequency = (float) cdc_ctx->sample_rate;
@@ -293,7 +342,8 @@ int ap_decode_to_memory(
 
         struct AP_Vector *out_vec = *out_vec_p;
         if (out_vec == NULL) {
-                *out_vec_p = out_vec = AP_MALLOC(sizeof(struct AP_Vector));
+                *out_vec_p = out_vec = AP_MALLOC_TAG(
+                        sizeof(struct AP_Vector), AP_MEMORY_TAG_AUDIO);
                 if (out_vec == NULL) {
                         return AP_ERROR_MALLOC_FAILED;
                 }
@@ -302,6 +352,8 @@ int ap_decode_to_memory(
 
         int ret = ap_vector_init(out_vec, AP_VECTOR_CHAR);
         AP_CHECK(ret);
+        // account the decoded PCM data to audio
+        ap_memory_set_tag(out_vec->data, AP_MEMORY_TAG_AUDIO);
         ret = ap_decode_audio(
                 filename, NULL, out_vec, ap_format, frequency, channels
         );
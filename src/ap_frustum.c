@@ -0,0 +1,179 @@
+#include <math.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "ap_utils.h"
+#include "ap_frustum.h"
+
+int ap_frustum_extract(struct AP_Frustum *frustum, const float *matrix)
+{
+        if (frustum == NULL || matrix == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        // row r of the column major matrix is m[r], m[4 + r], ...
+        // the planes are row 3 plus or minus row 0, 1, 2
+        for (int i = 0; i < AP_FRUSTUM_PLANE_NUM; ++i) {
+                int row = i / 2;
+                float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+                float *plane = frustum->planes[i];
+                for (int j = 0; j < 4; ++j) {
+                        plane[j] = matrix[4 * j + 3]
+                                + sign * matrix[4 * j + row];
+                }
+                float length = sqrtf(plane[0] * plane[0]
+                        + plane[1] * plane[1] + plane[2] * plane[2]);
+                if (length == 0.0f) {
+                        return AP_ERROR_INVALID_PARAMETER;
+                }
+                for (int j = 0; j < 4; ++j) {
+                        plane[j] /= length;
+                }
+        }
+
+        return 0;
+}
+
+bool ap_frustum_test_sphere(
+        const struct AP_Frustum *frustum,
+        const float *sphere)
+{
+        for (int i = 0; i < AP_FRUSTUM_PLANE_NUM; ++i) {
+                const float *p = frustum->planes[i];
+                float distance = p[0] * sphere[0] + p[1] * sphere[1]
+                        + p[2] * sphere[2] + p[3];
+                if (distance < -sphere[3]) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+bool ap_frustum_test_aabb(
+        const struct AP_Frustum *frustum,
+        const float *aabb)
+{
+        for (int i = 0; i < AP_FRUSTUM_PLANE_NUM; ++i) {
+                const float *p = frustum->planes[i];
+                // the corner furthest along the normal
+                float distance = p[3];
+                for (int j = 0; j < 3; ++j) {
+                        distance += p[j] * (p[j] >= 0.0f
+                                ? aabb[j + 3] : aabb[j]);
+                }
+                if (distance < 0.0f) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+int ap_frustum_test_spheres(
+        const struct AP_Frustum *frustum,
+        const float *spheres,
+        int num,
+        bool *visible,
+        struct AP_Cull_Stats *stats)
+{
+        if (frustum == NULL || (num > 0 && (!spheres || !visible))) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        int i = 0;
+#if defined(__SSE__)
+        // transpose four spheres to x, y, z, radius vectors
+        // and test them against a plane at once
+        for (; i + 4 <= num; i += 4) {
+                __m128 x = _mm_loadu_ps(spheres + 4 * i);
+                __m128 y = _mm_loadu_ps(spheres + 4 * i + 4);
+                __m128 z = _mm_loadu_ps(spheres + 4 * i + 8);
+                __m128 r = _mm_loadu_ps(spheres + 4 * i + 12);
+                _MM_TRANSPOSE4_PS(x, y, z, r);
+                __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+                __m128 outside = _mm_setzero_ps();
+                for (int p = 0; p < AP_FRUSTUM_PLANE_NUM; ++p) {
+                        const float *plane = frustum->planes[p];
+                        __m128 d = _mm_add_ps(
+                                _mm_mul_ps(x, _mm_set1_ps(plane[0])),
+                                _mm_mul_ps(y, _mm_set1_ps(plane[1])));
+                        d = _mm_add_ps(d,
+                                _mm_mul_ps(z, _mm_set1_ps(plane[2])));
+                        d = _mm_add_ps(d, _mm_set1_ps(plane[3]));
+                        // the lanes outside of any plane are set
+                        outside = _mm_or_ps(outside, _mm_cmplt_ps(d, neg_r));
+                }
+                int mask = _mm_movemask_ps(outside);
+                for (int j = 0; j < 4; ++j) {
+                        visible[i + j] = !((mask >> j) & 1);
+                }
+        }
+#endif
+        for (; i < num; ++i) {
+                visible[i] = ap_frustum_test_sphere(frustum, spheres + 4 * i);
+        }
+
+        if (stats) {
+                stats->tested += num;
+                for (i = 0; i < num; ++i) {
+                        stats->visible += visible[i];
+                }
+        }
+
+        return 0;
+}
+
+int ap_frustum_transform_bounds(
+        const float *mat,
+        const float *aabb,
+        const float *sphere,
+        float *aabb_out,
+        float *sphere_out)
+{
+        if (mat == NULL || aabb == NULL || sphere == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        if (aabb_out) {
+                // center is transformed, the half extent of axis i is
+                // the sum of |m[j][i]| * extent j (Arvo)
+                float center[3];
+                float extent[3];
+                for (int i = 0; i < 3; ++i) {
+                        center[i] = (aabb[i] + aabb[i + 3]) * 0.5f;
+                        extent[i] = (aabb[i + 3] - aabb[i]) * 0.5f;
+                }
+                for (int i = 0; i < 3; ++i) {
+                        float c = mat[12 + i];
+                        float e = 0.0f;
+                        for (int j = 0; j < 3; ++j) {
+                                c += mat[4 * j + i] * center[j];
+                                e += fabsf(mat[4 * j + i]) * extent[j];
+                        }
+                        aabb_out[i] = c - e;
+                        aabb_out[i + 3] = c + e;
+                }
+        }
+
+        if (sphere_out) {
+                // the radius is scaled by the longest axis
+                float scale = 0.0f;
+                float center[3];
+                for (int i = 0; i < 3; ++i) {
+                        const float *axis = mat + 4 * i;
+                        float s = axis[0] * axis[0] + axis[1] * axis[1]
+                                + axis[2] * axis[2];
+                        scale = s > scale ? s : scale;
+                        center[i] = mat[12 + i] + mat[i] * sphere[0]
+                                + mat[4 + i] * sphere[1]
+                                + mat[8 + i] * sphere[2];
+                }
+                sphere_out[0] = center[0];
+                sphere_out[1] = center[1];
+                sphere_out[2] = center[2];
+                sphere_out[3] = sphere[3] * sqrtf(scale);
+        }
+
+        return 0;
+}
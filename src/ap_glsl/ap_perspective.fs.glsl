@@ -10,6 +10,8 @@ struct Material {
     float shininess;
 };
 
+// the directional and spot light are in the uniform block Lights with
+// std140 layout, the members are ordered to pack the floats after the vec3s
 struct DirectLight {
     vec3 direction;
 
@@ -18,40 +20,42 @@ struct DirectLight {
     vec3 specular;
 };
 
+// point lights are 4 texels of light_data with the same layout
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
 
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
 
-// flashlight
+// flashlight, the position and direction follow the camera
 struct SpotLight {
-    vec3 position;
-    vec3 direction;
+    vec3 ambient;
     float cut_off;
+    vec3 diffuse;
     float outer_cut_off;
+    vec3 specular;
 
     float constant;
     float linear;
     float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
 };
 
-#define NR_POINT_LIGHTS 128
+// see ap_cluster.h and ap_light.c
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define LIGHT_TEXTURE_WIDTH 1024
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 in vec4 FragParam;
+in highp float ViewDepth;
 
 in float flogz;
 in float Fcoef;
@@ -63,9 +67,20 @@ uniform Material material_1;
 uniform Material material_2;
 uniform Material material_3;
 
-uniform PointLight point_light[NR_POINT_LIGHTS];
-uniform SpotLight spot_light;
-uniform DirectLight direct_light;
+layout (std140) uniform Lights {
+    DirectLight direct_light;
+    SpotLight spot_light;
+};
+uniform vec3 spot_light_position;
+uniform vec3 spot_light_direction;
+
+// point lights, offset and number of the lights of clusters
+// and the indices of the lights of clusters
+uniform highp sampler2D light_data;
+uniform highp usampler2D light_clusters;
+uniform highp usampler2D light_indices;
+// buffer width, height, scale and bias of the depth slices
+uniform highp vec4 cluster_param;
 
 uniform bool spot_light_enabled;
 uniform bool point_light_enabled;
@@ -76,6 +91,8 @@ vec3 calc_dir_light(DirectLight light, vec3 normal, vec3 viewDir);
 vec3 calc_point_light(
     PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 calc_spot_light(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+PointLight fetch_point_light(uint index);
+uvec2 fetch_cluster();
 
 vec4 material_diffuse;
 vec4 material_specular;
@@ -118,9 +135,14 @@ void main()
         FragColor = material_diffuse;
         return;
     }
-    // point lights
-    for(int i = 0; point_light_enabled && i < NR_POINT_LIGHTS; i++) {
-        result += calc_point_light(point_light[i], norm, FragPos, viewDir);
+    // point lights of the cluster
+    uvec2 cluster = point_light_enabled ? fetch_cluster() : uvec2(0u);
+    for (uint i = 0u; i < cluster.y; i++) {
+        int t = int(cluster.x + i);
+        ivec2 p = ivec2(t % LIGHT_TEXTURE_WIDTH, t / LIGHT_TEXTURE_WIDTH);
+        uint index = texelFetch(light_indices, p, 0).r;
+        result += calc_point_light(
+            fetch_point_light(index), norm, FragPos, viewDir);
     }
     // spot light
     if (spot_light_enabled) {
@@ -130,6 +152,40 @@ void main()
     FragColor = vec4(result, material_diffuse.a);
 }
 
+// offset and number of the lights of the cluster of fragment
+uvec2 fetch_cluster()
+{
+    ivec2 tile = ivec2(gl_FragCoord.xy / cluster_param.xy
+        * vec2(CLUSTER_X, CLUSTER_Y));
+    tile = clamp(tile, ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    int slice = int(floor(
+        log(max(ViewDepth, 0.0001)) * cluster_param.z - cluster_param.w));
+    slice = clamp(slice, 0, CLUSTER_Z - 1);
+    return texelFetch(light_clusters,
+        ivec2(tile.x + tile.y * CLUSTER_X, slice), 0).xy;
+}
+
+PointLight fetch_point_light(uint index)
+{
+    // the 4 texels of a light are in the same row
+    int t = int(index) * 4;
+    ivec2 p = ivec2(t % LIGHT_TEXTURE_WIDTH, t / LIGHT_TEXTURE_WIDTH);
+    highp vec4 v0 = texelFetch(light_data, p, 0);
+    highp vec4 v1 = texelFetch(light_data, p + ivec2(1, 0), 0);
+    highp vec4 v2 = texelFetch(light_data, p + ivec2(2, 0), 0);
+    highp vec4 v3 = texelFetch(light_data, p + ivec2(3, 0), 0);
+
+    PointLight light;
+    light.position = v0.xyz;
+    light.constant = v0.w;
+    light.ambient = v1.xyz;
+    light.linear = v1.w;
+    light.diffuse = v2.xyz;
+    light.quadratic = v2.w;
+    light.specular = v3.xyz;
+    return light;
+}
+
 // calculates the color when using a directional light.
 vec3 calc_dir_light(DirectLight light, vec3 normal, vec3 viewDir)
 {
@@ -181,18 +237,18 @@ vec3 calc_point_light(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 // calculates the color when using a spot light.
 vec3 calc_spot_light(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
-    vec3 light_direction = normalize(light.position - fragPos);
+    vec3 light_direction = normalize(spot_light_position - fragPos);
     // diffuse shading
     float diff = max(dot(normal, light_direction), 0.0);
     // specular shading
     vec3 reflectDir = reflect(-light_direction, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
     // attenuation
-    float distance = length(light.position - fragPos);
+    float distance = length(spot_light_position - fragPos);
     float attenuation = 1.0 / (light.constant
         + light.linear * distance + light.quadratic * (distance * distance));
     // spotlight intensity
-    float theta = dot(light_direction, normalize(-light.direction));
+    float theta = dot(light_direction, normalize(-spot_light_direction));
     float epsilon = light.cut_off - light.outer_cut_off;
     float intensity = clamp((theta - light.outer_cut_off) / epsilon, 0.0, 1.0);
 
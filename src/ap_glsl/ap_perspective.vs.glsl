@@ -2,31 +2,52 @@
 precision mediump float;
 
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+// w is 1 (default) for the float normals and 0 for the octahedral
+// encoded normals of packed vertices
+layout (location = 1) in vec4 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// model matrix, per instance for the instanced meshes and
+// a constant attribute value for the others
+layout (location = 3) in mat4 aModel;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+// view space depth, selects the cluster of point lights
+out highp float ViewDepth;
 
 // optimize_zdepth
 out float flogz;
 out float Fcoef;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 uniform float view_distance;
 
 float far = 100.0;
 
+vec3 decode_normal(vec4 n)
+{
+    if (n.w > 0.5) {
+        return n.xyz;
+    }
+    vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+    if (v.z < 0.0) {
+        vec2 s = vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+        v.xy = (1.0 - abs(v.yx)) * s;
+    }
+    return normalize(v);
+}
+
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = vec3(aModel * vec4(aPos, 1.0));
+    Normal = mat3(transpose(inverse(aModel))) * decode_normal(aNormal);
     TexCoords = aTexCoords;
 
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    vec4 view_position = view * vec4(FragPos, 1.0);
+    ViewDepth = -view_position.z;
+    gl_Position = projection * view_position;
 
     // refer: http://sirlis.cn/depth-buffer-and-z-fighting/
     Fcoef = 2.0 / log2(view_distance + 1.0);
@@ -0,0 +1,273 @@
+#include "ap_utils.h"
+#include "ap_hashmap.h"
+
+struct AP_Hashmap_Bucket {
+        unsigned int key;
+        // distance to the home bucket + 1, 0 when the bucket is empty
+        unsigned int probe;
+};
+
+AP_VECTOR_DEFINE(bucket, struct AP_Hashmap_Bucket)
+
+// the two values after the buckets are scratch space for swapping
+#define AP_HASHMAP_SCRATCH_NUM 2
+
+static inline size_t ap_hashmap_capacity(struct AP_Hashmap *map)
+{
+        return map->buckets.length;
+}
+
+static inline void *ap_hashmap_value_at(struct AP_Hashmap *map, size_t i)
+{
+        return map->values.data + map->values.elem_size * i;
+}
+
+/**
+ * Mix the bits of key (finalizer of MurmurHash3),
+ * sequential keys such as code points spread over the buckets
+ */
+static inline unsigned int ap_hashmap_hash(unsigned int key)
+{
+        key ^= key >> 16;
+        key *= 0x85ebca6bu;
+        key ^= key >> 13;
+        key *= 0xc2b2ae35u;
+        key ^= key >> 16;
+        return key;
+}
+
+/**
+ * Index of the bucket of key, -1 if not found
+ */
+static long ap_hashmap_find(struct AP_Hashmap *map, unsigned int key)
+{
+        if (ap_hashmap_capacity(map) == 0) {
+                // freed
+                return -1;
+        }
+        size_t mask = ap_hashmap_capacity(map) - 1;
+        struct AP_Hashmap_Bucket *buckets =
+                ap_vector_bucket_data(&map->buckets);
+        size_t pos = ap_hashmap_hash(key) & mask;
+        // the elements closer to their home than key would be
+        // are never placed before key
+        for (unsigned int probe = 1; buckets[pos].probe >= probe; ++probe) {
+                if (buckets[pos].key == key) {
+                        return (long) pos;
+                }
+                pos = (pos + 1) & mask;
+        }
+        return -1;
+}
+
+/**
+ * Place key and the value in scratch 0, key must not be in map
+ */
+static void ap_hashmap_place(struct AP_Hashmap *map, unsigned int key)
+{
+        size_t capacity = ap_hashmap_capacity(map);
+        size_t mask = capacity - 1;
+        size_t elem_size = map->values.elem_size;
+        struct AP_Hashmap_Bucket *buckets =
+                ap_vector_bucket_data(&map->buckets);
+        void *carry = ap_hashmap_value_at(map, capacity);
+        void *swap = ap_hashmap_value_at(map, capacity + 1);
+
+        struct AP_Hashmap_Bucket bucket = { key, 1 };
+        size_t pos = ap_hashmap_hash(key) & mask;
+        while (buckets[pos].probe != 0) {
+                if (buckets[pos].probe < bucket.probe) {
+                        // take the bucket, carry on with the one moved out
+                        struct AP_Hashmap_Bucket tmp = buckets[pos];
+                        buckets[pos] = bucket;
+                        bucket = tmp;
+                        void *value = ap_hashmap_value_at(map, pos);
+                        memcpy(swap, value, elem_size);
+                        memcpy(value, carry, elem_size);
+                        memcpy(carry, swap, elem_size);
+                }
+                pos = (pos + 1) & mask;
+                bucket.probe++;
+        }
+        buckets[pos] = bucket;
+        memcpy(ap_hashmap_value_at(map, pos), carry, elem_size);
+        map->length++;
+}
+
+/**
+ * Allocate capacity empty buckets
+ */
+static int ap_hashmap_alloc(struct AP_Hashmap *map, size_t capacity)
+{
+        size_t elem_size = map->values.elem_size;
+        int ret = ap_vector_init_size(
+                &map->buckets, sizeof(struct AP_Hashmap_Bucket));
+        if (ret != 0) {
+                return ret;
+        }
+        ret = ap_vector_init_size(&map->values, elem_size);
+        if (ret == 0) {
+                ret = ap_vector_resize(&map->buckets, capacity);
+        }
+        if (ret == 0) {
+                ret = ap_vector_resize(&map->values,
+                        capacity + AP_HASHMAP_SCRATCH_NUM);
+        }
+        if (ret != 0) {
+                ap_vector_free(&map->buckets);
+                ap_vector_free(&map->values);
+                map->values.elem_size = elem_size;
+                return ret;
+        }
+        map->length = 0;
+
+        return 0;
+}
+
+static int ap_hashmap_grow(struct AP_Hashmap *map)
+{
+        struct AP_Hashmap old = *map;
+        size_t old_capacity = ap_hashmap_capacity(&old);
+        size_t capacity = old_capacity ? old_capacity * 2
+                : AP_HASHMAP_DEFAULT_CAPACITY;
+        int ret = ap_hashmap_alloc(map, capacity);
+        if (ret != 0) {
+                *map = old;
+                return ret;
+        }
+
+        size_t elem_size = map->values.elem_size;
+        void *carry = ap_hashmap_value_at(map, ap_hashmap_capacity(map));
+        struct AP_Hashmap_Bucket *buckets =
+                ap_vector_bucket_data(&old.buckets);
+        for (size_t i = 0; i < old_capacity; ++i) {
+                if (buckets[i].probe == 0) {
+                        continue;
+                }
+                memcpy(carry, ap_hashmap_value_at(&old, i), elem_size);
+                ap_hashmap_place(map, buckets[i].key);
+        }
+        ap_vector_free(&old.buckets);
+        ap_vector_free(&old.values);
+
+        return 0;
+}
+
+int ap_hashmap_init(struct AP_Hashmap *map, size_t elem_size)
+{
+        if (map == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (elem_size == 0) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        map->values.elem_size = elem_size;
+
+        return ap_hashmap_alloc(map, AP_HASHMAP_DEFAULT_CAPACITY);
+}
+
+int ap_hashmap_free(struct AP_Hashmap *map)
+{
+        if (map == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        ap_vector_free(&map->buckets);
+        ap_vector_free(&map->values);
+        map->length = 0;
+
+        return 0;
+}
+
+int ap_hashmap_insert(
+        struct AP_Hashmap *map,
+        unsigned int key,
+        const void *value)
+{
+        if (map == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        size_t elem_size = map->values.elem_size;
+        long pos = ap_hashmap_find(map, key);
+        if (pos >= 0) {
+                void *p = ap_hashmap_value_at(map, pos);
+                if (value) {
+                        memcpy(p, value, elem_size);
+                } else {
+                        memset(p, 0, elem_size);
+                }
+                return 0;
+        }
+
+        if ((map->length + 1) * 4 > ap_hashmap_capacity(map) * 3) {
+                int ret = ap_hashmap_grow(map);
+                if (ret != 0) {
+                        return ret;
+                }
+        }
+        void *carry = ap_hashmap_value_at(map, ap_hashmap_capacity(map));
+        if (value) {
+                memcpy(carry, value, elem_size);
+        } else {
+                memset(carry, 0, elem_size);
+        }
+        ap_hashmap_place(map, key);
+
+        return 0;
+}
+
+void *ap_hashmap_get(struct AP_Hashmap *map, unsigned int key)
+{
+        if (map == NULL) {
+                return NULL;
+        }
+        long pos = ap_hashmap_find(map, key);
+        if (pos < 0) {
+                return NULL;
+        }
+        return ap_hashmap_value_at(map, pos);
+}
+
+int ap_hashmap_remove(struct AP_Hashmap *map, unsigned int key)
+{
+        if (map == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        long found = ap_hashmap_find(map, key);
+        if (found < 0) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        // shift the following elements back until one is at its home
+        size_t mask = ap_hashmap_capacity(map) - 1;
+        size_t elem_size = map->values.elem_size;
+        struct AP_Hashmap_Bucket *buckets =
+                ap_vector_bucket_data(&map->buckets);
+        size_t pos = found;
+        size_t next = (pos + 1) & mask;
+        while (buckets[next].probe > 1) {
+                buckets[pos] = buckets[next];
+                buckets[pos].probe--;
+                memcpy(ap_hashmap_value_at(map, pos),
+                        ap_hashmap_value_at(map, next), elem_size);
+                pos = next;
+                next = (pos + 1) & mask;
+        }
+        buckets[pos].probe = 0;
+        map->length--;
+
+        return 0;
+}
+
+int ap_hashmap_clear(struct AP_Hashmap *map)
+{
+        if (map == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        memset(map->buckets.data, 0,
+                sizeof(struct AP_Hashmap_Bucket) * ap_hashmap_capacity(map));
+        map->length = 0;
+
+        return 0;
+}
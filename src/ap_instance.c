@@ -0,0 +1,163 @@
+#if AP_PLATFORM_ANDROID
+#include <GLES3/gl3.h>
+#else
+#include "glad/glad.h"
+#endif
+
+#include "ap_utils.h"
+#include "ap_instance.h"
+#include "ap_model.h"
+#include "ap_render.h"
+#include "ap_slot_map.h"
+
+#define AP_INSTANCE_MATRIX_SIZE (sizeof(float) * 16)
+
+// batches are stored in slot map, the IDs are the slot map handles
+static struct AP_Slot_Map batch_map;
+static bool batch_initialized = false;
+
+static int ap_instance_release_ptr(struct AP_Instance_Batch *batch)
+{
+        if (batch->mesh_num > 0) {
+                glDeleteVertexArrays(batch->mesh_num, batch->VAOs);
+        }
+        AP_FREE(batch->VAOs);
+        batch->VAOs = NULL;
+        batch->mesh_num = 0;
+        if (batch->VBO) {
+                glDeleteBuffers(1, &batch->VBO);
+                batch->VBO = 0;
+        }
+
+        return 0;
+}
+
+int ap_instance_register(unsigned int model_id, unsigned int *batch_id)
+{
+        if (batch_id == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        struct AP_Model *model = NULL;
+        int ret = ap_model_get_ptr(model_id, &model);
+        if (ret != 0) {
+                return ret;
+        }
+        if (!batch_initialized) {
+                ap_slot_map_init(&batch_map, sizeof(struct AP_Instance_Batch));
+                batch_initialized = true;
+        }
+        struct AP_Model_Resource *resource = model->resource;
+
+        struct AP_Instance_Batch batch = {
+                .model_id = model_id,
+        };
+        if (resource->mesh_length > 0) {
+                batch.VAOs = AP_MALLOC_TAG(
+                        sizeof(unsigned int) * resource->mesh_length,
+                        AP_MEMORY_TAG_MODEL);
+                if (batch.VAOs == NULL) {
+                        return AP_ERROR_MALLOC_FAILED;
+                }
+        }
+        glGenBuffers(1, &batch.VBO);
+        for (int i = 0; i < resource->mesh_length; ++i) {
+                ret = ap_mesh_setup_instanced(
+                        &resource->mesh[i], batch.VBO, &batch.VAOs[i]);
+                if (ret != 0) {
+                        ap_instance_release_ptr(&batch);
+                        return ret;
+                }
+                batch.mesh_num++;
+        }
+
+        ret = ap_slot_map_insert(&batch_map, &batch, batch_id);
+        if (ret != 0) {
+                ap_instance_release_ptr(&batch);
+                return ret;
+        }
+
+        return 0;
+}
+
+int ap_instance_set_transforms(
+        unsigned int batch_id,
+        const float *matrices,
+        int num)
+{
+        if (num < 0 || (num > 0 && matrices == NULL)) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        struct AP_Instance_Batch *batch = batch_initialized
+                ? ap_slot_map_get(&batch_map, batch_id) : NULL;
+        if (batch == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, batch->VBO);
+        if (num > batch->capacity) {
+                glBufferData(GL_ARRAY_BUFFER, AP_INSTANCE_MATRIX_SIZE * num,
+                        matrices, GL_DYNAMIC_DRAW);
+                batch->capacity = num;
+        } else if (num > 0) {
+                // orphan the buffer, the instances drawn last frame
+                // may still be read by GPU
+                glBufferData(GL_ARRAY_BUFFER,
+                        AP_INSTANCE_MATRIX_SIZE * batch->capacity,
+                        NULL, GL_DYNAMIC_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0,
+                        AP_INSTANCE_MATRIX_SIZE * num, matrices);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        batch->instance_num = num;
+
+        return 0;
+}
+
+int ap_instance_draw(unsigned int batch_id)
+{
+        struct AP_Instance_Batch *batch = batch_initialized
+                ? ap_slot_map_get(&batch_map, batch_id) : NULL;
+        if (batch == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        if (batch->instance_num == 0) {
+                return 0;
+        }
+        struct AP_Model *model = NULL;
+        int ret = ap_model_get_ptr(batch->model_id, &model);
+        if (ret != 0) {
+                LOGE("failed to draw instances: model %u released",
+                        batch->model_id);
+                return ret;
+        }
+
+        return ap_render_submit_instanced(model->resource->mesh, batch->VAOs,
+                batch->mesh_num, batch->instance_num);
+}
+
+int ap_instance_release(unsigned int batch_id)
+{
+        struct AP_Instance_Batch *batch = batch_initialized
+                ? ap_slot_map_get(&batch_map, batch_id) : NULL;
+        if (batch == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        ap_instance_release_ptr(batch);
+
+        return ap_slot_map_remove(&batch_map, batch_id);
+}
+
+int ap_instance_free()
+{
+        if (!batch_initialized) {
+                return 0;
+        }
+        struct AP_Instance_Batch *batches = ap_slot_map_data(&batch_map);
+        for (size_t i = 0; i < ap_slot_map_length(&batch_map); ++i) {
+                ap_instance_release_ptr(&batches[i]);
+        }
+        ap_slot_map_free(&batch_map);
+        batch_initialized = false;
+
+        return 0;
+}
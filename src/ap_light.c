@@ -1,17 +1,102 @@
+#include <math.h>
+
 #include "ap_utils.h"
 #include "ap_light.h"
 #include "ap_render.h"
 #include "ap_shader.h"
 #include "ap_cvector.h"
 #include "ap_texture.h"
+#include "ap_pool.h"
+#include "ap_slot_map.h"
+#include "ap_cluster.h"
 
 #define FLOAT_SIZE sizeof(float)
 #define LIGHT_SIZE sizeof(struct AP_Light)
 
-static struct AP_Vector point_light_vector = { 0, 0, 0, 0 };
+// point lights are stored in pool, the slot map holds their pointers,
+// the IDs are the slot map handles
+static struct AP_Pool point_light_pool;
+static struct AP_Slot_Map point_light_map;
+static bool point_light_initialized = false;
 static struct AP_Light direct_light;
 static struct AP_Light spot_light;
 
+// light data in the std140 layout of the uniform block AP_SP_LIGHTS,
+// a float follows each vec3 in the 16 byte slot the vec3 is aligned to.
+// The point lights have the same layout in the texels of light data.
+struct AP_Light_Direct_Block {
+        float direction[3];
+        float padding_0;
+        float ambient[3];
+        float padding_1;
+        float diffuse[3];
+        float padding_2;
+        float specular[3];
+        float padding_3;
+};
+
+struct AP_Light_Spot_Block {
+        float ambient[3];
+        float cut_off;
+        float diffuse[3];
+        float outer_cut_off;
+        float specular[3];
+        float constant;
+        float linear;
+        float quadratic;
+        float padding[2];
+};
+
+struct AP_Light_Point_Block {
+        float position[3];
+        float constant;
+        float ambient[3];
+        float linear;
+        float diffuse[3];
+        float quadratic;
+        float specular[3];
+        float padding;
+};
+
+struct AP_Light_Block {
+        struct AP_Light_Direct_Block direct_light;
+        struct AP_Light_Spot_Block spot_light;
+};
+
+_Static_assert(sizeof(struct AP_Light_Block) == 128,
+        "struct AP_Light_Block does not match the std140 layout");
+_Static_assert(sizeof(struct AP_Light_Point_Block) == 64,
+        "struct AP_Light_Point_Block is not 4 RGBA texels");
+
+// width of the light data and index textures,
+// same as LIGHT_TEXTURE_WIDTH of the perspective shader
+#define AP_LIGHT_TEXTURE_WIDTH 1024
+// the light textures use the units after the ones of materials
+#define AP_LIGHT_TEXTURE_UNIT AP_TEXTURE_UNIT_MAX_NUM
+
+// rebuilt and uploaded by ap_light_send_data when the lights changed
+static struct AP_Light_Block light_block;
+static bool light_dirty = true;
+static unsigned int light_ubo = 0;
+// point lights which light something, in the order of light data,
+// their spheres are binned into clusters every frame
+static struct AP_Light_Point_Block *point_data = NULL;
+static struct AP_Cluster_Light *point_spheres = NULL;
+static int point_num = 0;
+static struct AP_Cluster_Grid light_grid;
+// textures of light data, offset and count of clusters and light indices
+static unsigned int light_data_texture = 0;
+static unsigned int light_cluster_texture = 0;
+static unsigned int light_index_texture = 0;
+// projection the clusters are computed for
+static float grid_projection[16];
+static float grid_near = 0.0f;
+static float grid_far = 0.0f;
+// program the uniform block is bound and the locations are looked up for
+static unsigned int light_shader = 0;
+static int shininess_loc[AP_TEXTURE_UNIT_MAX_NUM];
+static int cluster_param_loc = -1;
+
 bool ap_light_is_valid_type(int t)
 {
         switch (t)
@@ -36,6 +121,7 @@ int ap_light_setup_spot(
         memcpy(spot_light.diffuse, diffuse, 3 * FLOAT_SIZE);
         memcpy(spot_light.specular, specular, 3 * FLOAT_SIZE);
         memcpy(spot_light.param, param, AP_LIGHT_PARAM_NUM * FLOAT_SIZE);
+        light_dirty = true;
         return 0;
 }
 
@@ -51,6 +137,7 @@ int ap_light_setup_directional(
         memcpy(direct_light.ambient, ambient, 3 * FLOAT_SIZE);
         memcpy(direct_light.diffuse, diffuse, 3 * FLOAT_SIZE);
         memcpy(direct_light.specular, specular, 3 * FLOAT_SIZE);
+        light_dirty = true;
         return 0;
 }
 
@@ -66,49 +153,282 @@ int ap_light_generate_point(
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
-        if (!point_light_vector.data) {
-                ap_vector_init(&point_light_vector, AP_VECTOR_LIGHT);
+        if (!point_light_initialized) {
+                ap_pool_init(&point_light_pool, LIGHT_SIZE,
+                        0, AP_MEMORY_TAG_LIGHT);
+                ap_slot_map_init(&point_light_map, sizeof(struct AP_Light*));
+                point_light_initialized = true;
         }
 
-        if (point_light_vector.length >= AP_LIGHT_POINT_NUM) {
+        if (ap_slot_map_length(&point_light_map) >= AP_LIGHT_POINT_NUM) {
                 LOGE("unable to generate new spot lights");
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
-        struct AP_Light light;
-        memset(&light, 0, sizeof(light));
+        struct AP_Light *light = ap_pool_alloc(&point_light_pool);
+        if (light == NULL) {
+                LOGE("failed to generate light");
+                return AP_ERROR_MALLOC_FAILED;
+        }
 
-        light.type = AP_LIGHT_POINT;
-        memcpy(light.position, position, sizeof(float) * 3);
-        memcpy(light.ambient, ambient, sizeof(float) * 3);
-        memcpy(light.diffuse, diffuse, sizeof(float) * 3);
-        memcpy(light.specular, specular, sizeof(float) * 3);
+        light->type = AP_LIGHT_POINT;
+        memcpy(light->position, position, sizeof(float) * 3);
+        memcpy(light->ambient, ambient, sizeof(float) * 3);
+        memcpy(light->diffuse, diffuse, sizeof(float) * 3);
+        memcpy(light->specular, specular, sizeof(float) * 3);
 
         size_t param_size = FLOAT_SIZE * AP_LIGHT_PARAM_NUM;
-        memcpy(light.param, param, param_size);
+        memcpy(light->param, param, param_size);
 
-        unsigned id = point_light_vector.length + 1;
-        light.id = id;
-        int ret = ap_vector_push_back(&point_light_vector, (char*) &light);
+        int ret = ap_slot_map_insert(&point_light_map, &light, &light->id);
         if (ret) {
                 LOGE("failed to generate light");
+                ap_pool_release(&point_light_pool, light);
                 AP_CHECK(ret);
                 return AP_ERROR_INIT_FAILED;
         }
-        *light_id = id;
+        *light_id = light->id;
+        light_dirty = true;
 
         return 0;
 }
 
-int ap_light_send_data()
+struct AP_Light *ap_light_get_point_ptr(unsigned int light_id)
 {
-        if (!point_light_vector.data) {
-                LOGE("failed to render lights: not initialized");
-                return AP_ERROR_INIT_FAILED;
+        if (!point_light_initialized) {
+                return NULL;
+        }
+        struct AP_Light **light = ap_slot_map_get(&point_light_map, light_id);
+        if (light == NULL) {
+                return NULL;
         }
-        char buffer[AP_DEFAULT_BUFFER_SIZE] = { 0 };
+        return *light;
+}
+
+int ap_light_mark_dirty(unsigned int light_id)
+{
+        if (ap_light_get_point_ptr(light_id) == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        light_dirty = true;
+        return 0;
+}
+
+int ap_light_remove_point(unsigned int light_id)
+{
+        struct AP_Light *light = ap_light_get_point_ptr(light_id);
+        if (light == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        ap_slot_map_remove(&point_light_map, light_id);
+        ap_pool_release(&point_light_pool, light);
+        light_dirty = true;
+
+        return 0;
+}
+
+static unsigned int ap_light_texture_new(
+        GLint format, int width, int height, GLenum data_format, GLenum type)
+{
+        unsigned int texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0,
+                data_format, type, NULL);
+        // integer and 32 bit float textures are not filterable
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+}
+
+/**
+ * Upload texel_num texels to the rows of texture from the top left
+ */
+static void ap_light_texture_upload(
+        unsigned int texture, size_t texel_num, size_t texel_size,
+        GLenum data_format, GLenum type, const void *data)
+{
+        int rows = texel_num / AP_LIGHT_TEXTURE_WIDTH;
+        int rest = texel_num % AP_LIGHT_TEXTURE_WIDTH;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (rows > 0) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                        AP_LIGHT_TEXTURE_WIDTH, rows, data_format, type, data);
+        }
+        if (rest > 0) {
+                const char *p = (const char*) data
+                        + texel_size * AP_LIGHT_TEXTURE_WIDTH * rows;
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, rows, rest, 1,
+                        data_format, type, p);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/**
+ * Allocate the memory and the GL objects of the lights
+ */
+static int ap_light_init_buffers()
+{
+        if (light_ubo != 0) {
+                return 0;
+        }
+        point_data = AP_MALLOC_TAG(
+                sizeof(struct AP_Light_Point_Block) * AP_LIGHT_POINT_NUM,
+                AP_MEMORY_TAG_LIGHT);
+        point_spheres = AP_MALLOC_TAG(
+                sizeof(struct AP_Cluster_Light) * AP_LIGHT_POINT_NUM,
+                AP_MEMORY_TAG_LIGHT);
+        if (point_data == NULL || point_spheres == NULL) {
+                LOGE("failed to init lights: malloc failed");
+                AP_FREE(point_data);
+                AP_FREE(point_spheres);
+                point_data = NULL;
+                point_spheres = NULL;
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        int ret = ap_cluster_init(&light_grid);
+        if (ret != 0) {
+                AP_FREE(point_data);
+                AP_FREE(point_spheres);
+                point_data = NULL;
+                point_spheres = NULL;
+                return ret;
+        }
+
+        glGenBuffers(1, &light_ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, light_ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(struct AP_Light_Block),
+                NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        // a point light is 4 RGBA texels
+        int rows = (AP_LIGHT_POINT_NUM * 4 + AP_LIGHT_TEXTURE_WIDTH - 1)
+                / AP_LIGHT_TEXTURE_WIDTH;
+        light_data_texture = ap_light_texture_new(GL_RGBA32F,
+                AP_LIGHT_TEXTURE_WIDTH, rows, GL_RGBA, GL_FLOAT);
+        light_cluster_texture = ap_light_texture_new(GL_RG32UI,
+                AP_CLUSTER_X * AP_CLUSTER_Y, AP_CLUSTER_Z,
+                GL_RG_INTEGER, GL_UNSIGNED_INT);
+        rows = (AP_CLUSTER_NUM * AP_CLUSTER_MAX_LIGHTS
+                + AP_LIGHT_TEXTURE_WIDTH - 1) / AP_LIGHT_TEXTURE_WIDTH;
+        light_index_texture = ap_light_texture_new(GL_R32UI,
+                AP_LIGHT_TEXTURE_WIDTH, rows, GL_RED_INTEGER, GL_UNSIGNED_INT);
+
+        return 0;
+}
+
+/**
+ * Bind the uniform buffer and the textures of lights to shader
+ */
+static int ap_light_setup_shader(unsigned int shader)
+{
+        if (light_shader == shader) {
+                return 0;
+        }
+        int ret = ap_light_init_buffers();
+        if (ret != 0) {
+                return ret;
+        }
+        unsigned int index = glGetUniformBlockIndex(shader, AP_SP_LIGHTS);
+        if (index == GL_INVALID_INDEX) {
+                LOGE("failed to render lights: no uniform block %s",
+                        AP_SP_LIGHTS);
+                return AP_ERROR_RENDER_FAILED;
+        }
+        glUniformBlockBinding(shader, index, AP_LIGHT_UBO_BINDING);
+        glBindBufferBase(GL_UNIFORM_BUFFER, AP_LIGHT_UBO_BINDING, light_ubo);
 
         unsigned int old_shader = ap_get_current_shader();
+        ap_shader_use(shader);
+        ap_shader_set_int(shader, AP_SP_LIGHT_DATA, AP_LIGHT_TEXTURE_UNIT);
+        ap_shader_set_int(shader, AP_SP_LIGHT_CLUSTERS,
+                AP_LIGHT_TEXTURE_UNIT + 1);
+        ap_shader_set_int(shader, AP_SP_LIGHT_INDICES,
+                AP_LIGHT_TEXTURE_UNIT + 2);
+        ap_shader_use(old_shader);
+
+        ap_shader_get_locations(shader, AP_SP_MT_SHININESS,
+                AP_TEXTURE_UNIT_MAX_NUM, shininess_loc);
+        cluster_param_loc = ap_shader_get_location(shader,
+                AP_SP_CLUSTER_PARAM);
+        light_shader = shader;
+        light_dirty = true;
+
+        return 0;
+}
+
+static void ap_light_copy_vec3(float *dst, const float *src)
+{
+        memcpy(dst, src, 3 * FLOAT_SIZE);
+}
+
+/**
+ * Pack the lights into light_block, point_data and point_spheres
+ */
+static void ap_light_build_data()
+{
+        memset(&light_block, 0, sizeof(struct AP_Light_Block));
+        if (direct_light.type == AP_LIGHT_DIRECTIONAL) {
+                struct AP_Light_Direct_Block *d = &light_block.direct_light;
+                ap_light_copy_vec3(d->direction, direct_light.direction);
+                ap_light_copy_vec3(d->ambient, direct_light.ambient);
+                ap_light_copy_vec3(d->diffuse, direct_light.diffuse);
+                ap_light_copy_vec3(d->specular, direct_light.specular);
+        }
+        if (spot_light.type == AP_LIGHT_SPOT) {
+                struct AP_Light_Spot_Block *s = &light_block.spot_light;
+                ap_light_copy_vec3(s->ambient, spot_light.ambient);
+                ap_light_copy_vec3(s->diffuse, spot_light.diffuse);
+                ap_light_copy_vec3(s->specular, spot_light.specular);
+                s->constant = spot_light.param[0];
+                s->linear = spot_light.param[1];
+                s->quadratic = spot_light.param[2];
+                s->cut_off = spot_light.param[3];
+                s->outer_cut_off = spot_light.param[4];
+        }
+        point_num = 0;
+        if (!point_light_initialized) {
+                return;
+        }
+
+        struct AP_Light **light = ap_slot_map_data(&point_light_map);
+        int length = ap_slot_map_length(&point_light_map);
+        for (int i = 0; i < length && point_num < AP_LIGHT_POINT_NUM; ++i) {
+                struct AP_Light *p = light[i];
+                if (p->type != AP_LIGHT_POINT) {
+                        continue;
+                }
+                float intensity = 0.0f;
+                for (int j = 0; j < 3; ++j) {
+                        intensity = fmaxf(intensity, p->ambient[j]);
+                        intensity = fmaxf(intensity, p->diffuse[j]);
+                        intensity = fmaxf(intensity, p->specular[j]);
+                }
+                float radius = ap_cluster_light_radius(intensity,
+                        p->param[0], p->param[1], p->param[2]);
+                if (radius == 0.0f) {
+                        // lights nothing
+                        continue;
+                }
+                struct AP_Light_Point_Block *b = &point_data[point_num];
+                memset(b, 0, sizeof(struct AP_Light_Point_Block));
+                ap_light_copy_vec3(b->position, p->position);
+                ap_light_copy_vec3(b->ambient, p->ambient);
+                ap_light_copy_vec3(b->diffuse, p->diffuse);
+                ap_light_copy_vec3(b->specular, p->specular);
+                b->constant = p->param[0];
+                b->linear = p->param[1];
+                b->quadratic = p->param[2];
+                ap_light_copy_vec3(point_spheres[point_num].position,
+                        p->position);
+                point_spheres[point_num].radius = radius;
+                ++point_num;
+        }
+}
+
+int ap_light_send_data()
+{
         unsigned int shader = 0;
         ap_render_get_persp_shader(&shader);
         if (shader == 0) {
@@ -116,86 +436,85 @@ int ap_light_send_data()
                 return AP_ERROR_INIT_FAILED;
         }
 
-        ap_shader_use(shader);
-        struct AP_Light *light = (struct AP_Light*) point_light_vector.data;
-        int point_nr = 0;
-        // send point lights data
-        for (int i = 0; i < point_light_vector.length
-                && point_nr < AP_LIGHT_POINT_NUM; ++i)
-        {
-                struct AP_Light *p = light + i;
+        int ret = ap_light_setup_shader(shader);
+        if (ret != 0) {
+                return ret;
+        }
+        if (!light_dirty) {
+                return 0;
+        }
 
-                if (p->type != AP_LIGHT_POINT) {
-                        continue;
+        ap_light_build_data();
+        glBindBuffer(GL_UNIFORM_BUFFER, light_ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0,
+                sizeof(struct AP_Light_Block), &light_block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        ap_light_texture_upload(light_data_texture, point_num * 4,
+                sizeof(float) * 4, GL_RGBA, GL_FLOAT, point_data);
+        light_dirty = false;
+
+        return 0;
+}
+
+int ap_light_update_clusters(
+        float *view,
+        float *projection,
+        float near,
+        float far)
+{
+        if (view == NULL || projection == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        int ret = ap_light_send_data();
+        if (ret != 0) {
+                return ret;
+        }
+
+        if (grid_near != near || grid_far != far
+                || memcmp(grid_projection, projection, sizeof(float) * 16))
+        {
+                ret = ap_cluster_setup(&light_grid, projection, near, far);
+                if (ret != 0) {
+                        return ret;
                 }
-                // position
-                sprintf(buffer, AP_SP_PL_POSITION, i);
-                ap_shader_set_vec3(shader, buffer, p->position);
-                // ambient
-                sprintf(buffer, AP_SP_PL_AMBIENT, i);
-                ap_shader_set_vec3(shader, buffer, p->ambient);
-                // diffuse
-                sprintf(buffer, AP_SP_PL_DIFFUSE, i);
-                ap_shader_set_vec3(shader, buffer, p->diffuse);
-                // specular
-                sprintf(buffer, AP_SP_PL_SPECULAR, i);
-                ap_shader_set_vec3(shader, buffer, p->specular);
-                // constant
-                sprintf(buffer, AP_SP_PL_CONSTANT, i);
-                ap_shader_set_float(shader, buffer, p->param[0]);
-                // linear
-                sprintf(buffer, AP_SP_PL_LINEAR, i);
-                ap_shader_set_float(shader, buffer, p->param[1]);
-                // quadratic
-                sprintf(buffer, AP_SP_PL_QUADRATIC, i);
-                ap_shader_set_float(shader, buffer, p->param[2]);
-        }
-
-        // send directional light data
-        if (direct_light.type == AP_LIGHT_DIRECTIONAL) {
-                // direction
-                ap_shader_set_vec3(shader, AP_SP_DL_DIRECTION,
-                        direct_light.direction);
-                // ambient
-                ap_shader_set_vec3(shader, AP_SP_DL_AMBIENT,
-                        direct_light.ambient);
-                // diffuse
-                ap_shader_set_vec3(shader, AP_SP_DL_DIFFUSE,
-                        direct_light.diffuse);
-                // specular
-                ap_shader_set_vec3(shader, AP_SP_DL_SPECULAR,
-                        direct_light.specular);
-        }
-
-        // send spot light data
-        if (spot_light.type == AP_LIGHT_SPOT) {
-                // ambient
-                ap_shader_set_vec3(shader, AP_SP_SL_AMBIENT,
-                        spot_light.ambient);
-                // diffuse
-                ap_shader_set_vec3(shader, AP_SP_SL_AMBIENT,
-                        spot_light.diffuse);
-                // specular
-                ap_shader_set_vec3(shader, AP_SP_SL_SPECULAR,
-                        spot_light.specular);
-                // constant
-                ap_shader_set_float(shader, AP_SP_SL_CONSTANT,
-                        spot_light.param[0]);
-                // linear
-                ap_shader_set_float(shader, AP_SP_SL_LINEAR,
-                        spot_light.param[1]);
-                // quadratic
-                ap_shader_set_float(shader, AP_SP_SL_QUADRATIC,
-                        spot_light.param[2]);
-                // cut_off
-                ap_shader_set_float(shader, AP_SP_SL_CUTOFF,
-                        spot_light.param[3]);
-                // outer_cut_off
-                ap_shader_set_float(shader,
-                        AP_SP_SL_OUTER_CUTOFF,
-                        spot_light.param[4]
-                );
+                memcpy(grid_projection, projection, sizeof(float) * 16);
+                grid_near = near;
+                grid_far = far;
+        }
+        ret = ap_cluster_bin(&light_grid, view, point_spheres, point_num);
+        if (ret != 0) {
+                return ret;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, light_cluster_texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                AP_CLUSTER_X * AP_CLUSTER_Y, AP_CLUSTER_Z,
+                GL_RG_INTEGER, GL_UNSIGNED_INT, light_grid.clusters);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        ap_light_texture_upload(light_index_texture, light_grid.index_num,
+                sizeof(unsigned int), GL_RED_INTEGER, GL_UNSIGNED_INT,
+                light_grid.indices);
+
+        unsigned int textures[3] = {
+                light_data_texture,
+                light_cluster_texture,
+                light_index_texture,
+        };
+        for (int i = 0; i < 3; ++i) {
+                glActiveTexture(GL_TEXTURE0 + AP_LIGHT_TEXTURE_UNIT + i);
+                glBindTexture(GL_TEXTURE_2D, textures[i]);
         }
+        glActiveTexture(GL_TEXTURE0);
+
+        unsigned int old_shader = ap_get_current_shader();
+        ap_shader_use(light_shader);
+        float param[4] = {
+                (float) ap_get_buffer_width(),
+                (float) ap_get_buffer_height(),
+                light_grid.slice_scale,
+                light_grid.slice_bias,
+        };
+        ap_shader_set_vec4_loc(cluster_param_loc, param);
         ap_shader_use(old_shader);
 
         return 0;
@@ -208,13 +527,16 @@ int ap_light_set_material_shininess(float shininess)
         ap_render_get_persp_shader(&shader);
         if (shader == 0) {
                 LOGE("failed to render lights: renderer not initialized");
+                return AP_ERROR_INIT_FAILED;
         }
 
+        int ret = ap_light_setup_shader(shader);
+        if (ret != 0) {
+                return ret;
+        }
         ap_shader_use(shader);
-        char buffer[AP_DEFAULT_BUFFER_SIZE] = {0};
         for (int i = 0; i < AP_TEXTURE_UNIT_MAX_NUM; ++i) {
-                sprintf(buffer, AP_SP_MT_SHININESS, i);
-                ap_shader_set_float(shader, buffer, shininess);
+                ap_shader_set_float_loc(shininess_loc[i], shininess);
         }
         ap_shader_use(old_shader);
 
@@ -223,6 +545,34 @@ int ap_light_set_material_shininess(float shininess)
 
 int ap_light_free()
 {
-        ap_vector_free(&point_light_vector);
+        if (light_ubo != 0) {
+                glDeleteBuffers(1, &light_ubo);
+                unsigned int textures[3] = {
+                        light_data_texture,
+                        light_cluster_texture,
+                        light_index_texture,
+                };
+                glDeleteTextures(3, textures);
+                ap_cluster_free(&light_grid);
+                AP_FREE(point_data);
+                AP_FREE(point_spheres);
+                point_data = NULL;
+                point_spheres = NULL;
+                point_num = 0;
+                light_ubo = 0;
+                light_data_texture = 0;
+                light_cluster_texture = 0;
+                light_index_texture = 0;
+                grid_near = grid_far = 0.0f;
+        }
+        // the program ID may be reused by a new renderer
+        light_shader = 0;
+        light_dirty = true;
+        if (!point_light_initialized) {
+                return 0;
+        }
+        ap_slot_map_free(&point_light_map);
+        ap_pool_free(&point_light_pool);
+        point_light_initialized = false;
         return 0;
 }
\ No newline at end of file
@@ -1,129 +1,505 @@
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #include "ap_utils.h"
 #include "ap_memory.h"
 
-#ifndef AP_MEM_VEC_CAP
-#define AP_MEM_VEC_CAP 32
+/**
+ * Initial slot number of one pointer table, must be power of two
+ */
+#ifndef AP_MEM_TABLE_CAP
+#define AP_MEM_TABLE_CAP 256
 #endif
 
-struct AP_Pointer_Vector {
+/**
+ * Number of pointer tables, must be power of two.
+ * Pointers are spread over the tables by hash and every table has its
+ * own lock, so threads rarely wait for each other.
+ */
+#ifndef AP_MEM_SHARD_NUM
+#define AP_MEM_SHARD_NUM 16
+#endif
+
+const char *AP_MEMORY_TAG_NAME[AP_MEMORY_TAG_LENGTH] = {
+        "UNKNOWN",
+        "VECTOR",
+        "MESH",
+        "MODEL",
+        "TEXTURE",
+        "AUDIO",
+        "FONT",
+        "SHADER",
+        "PHYSIC",
+        "LIGHT",
+        "ARENA",
+};
+
+/**
+ * One allocation tracked by the pointer table
+ */
+struct AP_Pointer_Entry {
+        char *ptr;      // NULL means the slot is empty
+        size_t size;
+        int tag;
+};
+
+/**
+ * Open addressing hash table (linear probing) stores the pointers
+ * allocated by AP_MALLOC / AP_REALLOC, which belong to this shard.
+ */
+struct AP_Pointer_Table {
+        // protects the table, hold it when accessing the fields below
+        pthread_mutex_t lock;
+        // number of pointers stored
         int length;
+        // number of slots, always power of two
         int capacity;
-        char *data;
+        // slots
+        struct AP_Pointer_Entry *data;
+};
+
+/**
+ * Statistics of one tag, updated by atomic operations
+ * so that they can be shared by all shards.
+ */
+struct AP_Memory_Counter {
+        atomic_size_t live_bytes;
+        atomic_size_t peak_bytes;
+        atomic_int live_count;
+        atomic_ullong total_count;
+        atomic_size_t budget;
 };
 
-static struct AP_Pointer_Vector pointer_vector = { 0, 0, 0 };
+static struct AP_Pointer_Table pointer_tables[AP_MEM_SHARD_NUM];
+static pthread_once_t pointer_tables_once = PTHREAD_ONCE_INIT;
+static struct AP_Memory_Counter memory_stat[AP_MEMORY_TAG_LENGTH];
+static double dump_interval = 0.0;
+static double dump_last_time = 0.0;
+
+static void ap_memory_init_tables()
+{
+        for (int i = 0; i < AP_MEM_SHARD_NUM; ++i) {
+                pthread_mutex_init(&pointer_tables[i].lock, NULL);
+        }
+}
+
+static inline uint64_t ap_memory_hash(const char *ptr)
+{
+        uint64_t key = (uint64_t) (uintptr_t) ptr;
+        // fibonacci hashing, the lower bits of malloc pointer are aligned
+        key ^= key >> 33;
+        key *= 0x9E3779B97F4A7C15ull;
+        key ^= key >> 29;
+        return key;
+}
+
+static inline unsigned int ap_memory_slot(const char *ptr, int capacity)
+{
+        return (unsigned int) (ap_memory_hash(ptr) & (uint64_t) (capacity - 1));
+}
+
+/**
+ * Get the locked table which the pointer belongs to,
+ * unlock it by ap_memory_table_unlock after use.
+ */
+static struct AP_Pointer_Table *ap_memory_table_lock(const char *ptr)
+{
+        pthread_once(&pointer_tables_once, ap_memory_init_tables);
+        // the high bits select the shard, the low bits select the slot
+        unsigned int shard = (unsigned int) (ap_memory_hash(ptr) >> 56)
+                & (AP_MEM_SHARD_NUM - 1);
+        struct AP_Pointer_Table *table = &pointer_tables[shard];
+        pthread_mutex_lock(&table->lock);
+        return table;
+}
+
+static inline void ap_memory_table_unlock(struct AP_Pointer_Table *table)
+{
+        pthread_mutex_unlock(&table->lock);
+}
+
+static inline bool ap_memory_is_valid_tag(int tag)
+{
+        return tag >= 0 && tag < AP_MEMORY_TAG_LENGTH;
+}
+
+/**
+ * Account size bytes to tag
+ * @param fresh a new allocation, false for the bytes moved from another
+ *        block or tag, which are not counted in total_count again
+ */
+static void ap_memory_stat_add(int tag, size_t size, bool fresh)
+{
+        struct AP_Memory_Counter *stat = &memory_stat[tag];
+        size_t old = atomic_fetch_add(&stat->live_bytes, size);
+        size_t live = old + size;
+        atomic_fetch_add(&stat->live_count, 1);
+        if (fresh) {
+                atomic_fetch_add(&stat->total_count, 1);
+        }
+        size_t peak = atomic_load(&stat->peak_bytes);
+        while (live > peak && !atomic_compare_exchange_weak(
+                &stat->peak_bytes, &peak, live))
+        {
+                // peak is reloaded by the failed compare exchange
+        }
+        size_t budget = atomic_load(&stat->budget);
+        // only the allocation crossing the budget prints the warning
+        if (budget && old <= budget && live > budget) {
+                LOGW("ap_memory: %s exceeded budget: %zu > %zu bytes",
+                        AP_MEMORY_TAG_NAME[tag], live, budget);
+        }
+}
+
+static void ap_memory_stat_sub(int tag, size_t size)
+{
+        struct AP_Memory_Counter *stat = &memory_stat[tag];
+        atomic_fetch_sub(&stat->live_bytes, size);
+        atomic_fetch_sub(&stat->live_count, 1);
+}
 
-int ap_memory_vector_push(char *ptr)
+static int ap_memory_table_insert(
+        struct AP_Pointer_Table *table, char *ptr, size_t size, int tag);
+
+static int ap_memory_table_resize(struct AP_Pointer_Table *table, int capacity)
+{
+        struct AP_Pointer_Entry *old_data = table->data;
+        int old_capacity = table->capacity;
+
+        table->data = calloc(capacity, sizeof(struct AP_Pointer_Entry));
+        if (table->data == NULL) {
+                LOGE("ap_memory: table malloc failed");
+                exit(1);
+        }
+        table->capacity = capacity;
+        table->length = 0;
+
+        for (int i = 0; i < old_capacity; ++i) {
+                struct AP_Pointer_Entry *entry = &old_data[i];
+                if (entry->ptr != NULL) {
+                        ap_memory_table_insert(table,
+                                entry->ptr, entry->size, entry->tag);
+                }
+        }
+        free(old_data);
+
+        return 0;
+}
+
+/**
+ * Find the slot of the pointer, return -1 if not found
+ */
+static int ap_memory_table_find(
+        struct AP_Pointer_Table *table, const char *ptr)
+{
+        if (ptr == NULL || table->length == 0) {
+                return -1;
+        }
+
+        struct AP_Pointer_Entry *slots = table->data;
+        unsigned int mask = table->capacity - 1;
+        unsigned int i = ap_memory_slot(ptr, table->capacity);
+        while (slots[i].ptr != ptr) {
+                if (slots[i].ptr == NULL) {
+                        return -1;
+                }
+                i = (i + 1) & mask;
+        }
+        return (int) i;
+}
+
+static int ap_memory_table_insert(
+        struct AP_Pointer_Table *table, char *ptr, size_t size, int tag)
 {
         if (ptr == NULL) {
                 return 0;
         }
 
-        if (pointer_vector.data == NULL) {
-                // initialize vector
-                pointer_vector.capacity = AP_MEM_VEC_CAP;
-                pointer_vector.data =  malloc(
-                        sizeof(char*) * AP_MEM_VEC_CAP);
-                if (pointer_vector.data == NULL) {
-                        AP_CHECK(AP_ERROR_MALLOC_FAILED);
-                        exit(1);
-                }
-                pointer_vector.length = 0;
-        }
-        if (pointer_vector.length >= pointer_vector.capacity) {
-                pointer_vector.capacity *= 2;
-                pointer_vector.data = (char*) realloc(
-                        pointer_vector.data,
-                        pointer_vector.capacity * sizeof(char*)
-                );
-                if (pointer_vector.data == NULL) {
-                        LOGE("ap_memory: vector realloc failed");
-                        exit(1);
+        if (table->data == NULL) {
+                // initialize table
+                ap_memory_table_resize(table, AP_MEM_TABLE_CAP);
+        }
+        // keep the load factor under 0.5
+        if ((table->length + 1) * 2 > table->capacity) {
+                ap_memory_table_resize(table, table->capacity * 2);
+        }
+
+        struct AP_Pointer_Entry *slots = table->data;
+        unsigned int mask = table->capacity - 1;
+        unsigned int i = ap_memory_slot(ptr, table->capacity);
+        while (slots[i].ptr != NULL) {
+                if (slots[i].ptr == ptr) {
+                        LOGW("ap_memory: pointer %p already tracked", ptr);
+                        return 0;
                 }
+                i = (i + 1) & mask;
         }
-        // pointer array
-        char **ptr_array = (char**) pointer_vector.data;
-        ptr_array[pointer_vector.length++] = ptr;
+        slots[i].ptr = ptr;
+        slots[i].size = size;
+        slots[i].tag = tag;
+        table->length++;
         // LOGD("ap_memory: push pointer %p", ptr);
 
         return 0;
 }
 
-int ap_memory_vector_popup(char* dst_ptr)
+/**
+ * Remove the pointer from table
+ * @param dst_ptr
+ * @param entry [out] the removed entry, can be NULL
+ * @return true when found
+ */
+static bool ap_memory_table_remove(struct AP_Pointer_Table *table,
+        char *dst_ptr, struct AP_Pointer_Entry *entry)
 {
         if (dst_ptr == NULL) {
-                return 0;
+                return false;
         }
 
-        if (pointer_vector.length == 0) {
-                LOGW("unable to popup from zero size vector");
-                return 0;
+        if (table->length == 0) {
+                LOGW("unable to popup from zero size table");
+                return false;
         }
 
-        char **ptr_arr = (char**) pointer_vector.data;
-        for (int i = 0; i < pointer_vector.length; ++i) {
-                if (ptr_arr[i] != dst_ptr) {
-                        continue;
-                }
-                // LOGD("ap_memory: free pointer %p", dst_ptr);
-                for (int j = i; j < pointer_vector.length - 1; j++) {
-                        ptr_arr[j] = ptr_arr[j + 1];
-                }
-                pointer_vector.length--;
-                return 0;
+        int found = ap_memory_table_find(table, dst_ptr);
+        if (found < 0) {
+                LOGW("ap_memory: unable to find ptr %p", dst_ptr);
+                return false;
         }
+        // LOGD("ap_memory: free pointer %p", dst_ptr);
 
-        char *tmp = ptr_arr[pointer_vector.length - 1];
-        if (tmp == dst_ptr) {
-                pointer_vector.length--;
-                // LOGD("ap_memory: free pointer %p", tmp);
-                return 0;
+        struct AP_Pointer_Entry *slots = table->data;
+        unsigned int mask = table->capacity - 1;
+        unsigned int i = (unsigned int) found;
+        if (entry) {
+                *entry = slots[i];
         }
 
-        LOGW("ap_memory: unable to find ptr %p", dst_ptr);
-        return 0;
+        // backward shift deletion, no tombstones are needed
+        unsigned int j = i;
+        while (true) {
+                slots[i].ptr = NULL;
+                while (true) {
+                        j = (j + 1) & mask;
+                        if (slots[j].ptr == NULL) {
+                                table->length--;
+                                return true;
+                        }
+                        unsigned int k = ap_memory_slot(
+                                slots[j].ptr, table->capacity);
+                        // move slots[j] to i only if its home slot k
+                        // is not cyclically in (i, j]
+                        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+                                continue;
+                        }
+                        break;
+                }
+                slots[i] = slots[j];
+                i = j;
+        }
 }
 
-void *AP_MALLOC(int size)
+void *AP_MALLOC_TAG(size_t size, int tag)
 {
+        if (!ap_memory_is_valid_tag(tag)) {
+                tag = AP_MEMORY_TAG_UNKNOWN;
+        }
         char* ptr = malloc(size);
-        ap_memory_vector_push(ptr);
+        if (ptr != NULL) {
+                struct AP_Pointer_Table *table = ap_memory_table_lock(ptr);
+                ap_memory_table_insert(table, ptr, size, tag);
+                ap_memory_table_unlock(table);
+                ap_memory_stat_add(tag, size, true);
+        }
         return ptr;
 }
 
+void *AP_REALLOC_TAG(void *ptr, size_t size, int tag)
+{
+        struct AP_Pointer_Entry old = { NULL, 0, AP_MEMORY_TAG_UNKNOWN };
+        bool tracked = false;
+        struct AP_Pointer_Table *table = NULL;
+        if (ptr != NULL) {
+                table = ap_memory_table_lock(ptr);
+                tracked = ap_memory_table_remove(table, ptr, &old);
+                ap_memory_table_unlock(table);
+        }
+        if (!ap_memory_is_valid_tag(tag)) {
+                tag = old.tag;
+        }
+        char* ptr_new = realloc(ptr, size);
+        if (ptr_new == NULL) {
+                // the old pointer is still valid, keep tracking it
+                if (tracked) {
+                        table = ap_memory_table_lock(ptr);
+                        ap_memory_table_insert(table, ptr, old.size, old.tag);
+                        ap_memory_table_unlock(table);
+                }
+                return NULL;
+        }
+        if (tracked) {
+                ap_memory_stat_sub(old.tag, old.size);
+        }
+        table = ap_memory_table_lock(ptr_new);
+        ap_memory_table_insert(table, ptr_new, size, tag);
+        ap_memory_table_unlock(table);
+        // resizing a block is not a new allocation
+        ap_memory_stat_add(tag, size, !tracked);
+        return ptr_new;
+}
+
+void *AP_MALLOC(size_t size)
+{
+        return AP_MALLOC_TAG(size, AP_MEMORY_TAG_UNKNOWN);
+}
+
 void AP_FREE(void* ptr)
 {
         if (ptr == NULL) {
                 return;
         }
-        ap_memory_vector_popup(ptr);
+        struct AP_Pointer_Entry entry;
+        struct AP_Pointer_Table *table = ap_memory_table_lock(ptr);
+        bool tracked = ap_memory_table_remove(table, ptr, &entry);
+        ap_memory_table_unlock(table);
+        if (tracked) {
+                ap_memory_stat_sub(entry.tag, entry.size);
+        }
         free(ptr);
 }
 
-void* AP_REALLOC(void *ptr, int size)
+void* AP_REALLOC(void *ptr, size_t size)
 {
-        if (ptr != NULL) {
-                ap_memory_vector_popup(ptr);
+        // -1 means keeps the tag of the old pointer
+        return AP_REALLOC_TAG(ptr, size, -1);
+}
+
+int ap_memory_set_tag(void *ptr, int tag)
+{
+        if (!ap_memory_is_valid_tag(tag)) {
+                return AP_ERROR_INVALID_PARAMETER;
         }
-        char* ptr_new = realloc(ptr, size);
-        ap_memory_vector_push(ptr_new);
-        return ptr_new;
+        if (ptr == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        struct AP_Pointer_Table *table = ap_memory_table_lock(ptr);
+        int i = ap_memory_table_find(table, ptr);
+        if (i < 0) {
+                ap_memory_table_unlock(table);
+                return AP_ERROR_INVALID_POINTER;
+        }
+        struct AP_Pointer_Entry *entry = &table->data[i];
+        if (entry->tag != tag) {
+                ap_memory_stat_sub(entry->tag, entry->size);
+                ap_memory_stat_add(tag, entry->size, false);
+                entry->tag = tag;
+        }
+        ap_memory_table_unlock(table);
+
+        return 0;
+}
+
+int ap_memory_get_stat(int tag, struct AP_Memory_Stat *stat)
+{
+        if (!ap_memory_is_valid_tag(tag) || stat == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        struct AP_Memory_Counter *counter = &memory_stat[tag];
+        stat->live_bytes = atomic_load(&counter->live_bytes);
+        stat->peak_bytes = atomic_load(&counter->peak_bytes);
+        stat->live_count = atomic_load(&counter->live_count);
+        stat->total_count = atomic_load(&counter->total_count);
+        stat->budget = atomic_load(&counter->budget);
+        return 0;
+}
+
+int ap_memory_set_budget(int tag, size_t budget)
+{
+        if (!ap_memory_is_valid_tag(tag)) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        atomic_store(&memory_stat[tag].budget, budget);
+        return 0;
+}
+
+int ap_memory_print_stat()
+{
+        size_t live_bytes = 0;
+        int live_count = 0;
+        for (int i = 0; i < AP_MEMORY_TAG_LENGTH; ++i) {
+                struct AP_Memory_Stat stat;
+                ap_memory_get_stat(i, &stat);
+                live_bytes += stat.live_bytes;
+                live_count += stat.live_count;
+                if (stat.peak_bytes == 0) {
+                        continue;
+                }
+                LOGI("ap_memory: %-8s live %10zu bytes (%d), "
+                        "peak %10zu bytes, total %llu allocs",
+                        AP_MEMORY_TAG_NAME[i],
+                        stat.live_bytes, stat.live_count,
+                        stat.peak_bytes, stat.total_count);
+        }
+        LOGI("ap_memory: %-8s live %10zu bytes (%d)",
+                "TOTAL", live_bytes, live_count);
+        return 0;
+}
+
+int ap_memory_set_dump_interval(double interval)
+{
+        if (interval < 0.0) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        dump_interval = interval;
+        return 0;
+}
+
+int ap_memory_dump_periodic(double time)
+{
+        if (dump_interval <= 0.0) {
+                return 0;
+        }
+        if (time - dump_last_time < dump_interval) {
+                return 0;
+        }
+        dump_last_time = time;
+        return ap_memory_print_stat();
 }
 
 int ap_memory_unreleased_num()
 {
-        return pointer_vector.length;
+        pthread_once(&pointer_tables_once, ap_memory_init_tables);
+        int num = 0;
+        for (int s = 0; s < AP_MEM_SHARD_NUM; ++s) {
+                struct AP_Pointer_Table *table = &pointer_tables[s];
+                pthread_mutex_lock(&table->lock);
+                num += table->length;
+                pthread_mutex_unlock(&table->lock);
+        }
+        return num;
 }
 
 int ap_memory_print_unreleased()
 {
-        char **ptr_arr = (char**) pointer_vector.data;
-        for (int i = 0; i < pointer_vector.length; ++i) {
-                LOGI("ap_memory: unreleased ptr %p", ptr_arr[i]);
+        pthread_once(&pointer_tables_once, ap_memory_init_tables);
+        for (int s = 0; s < AP_MEM_SHARD_NUM; ++s) {
+                struct AP_Pointer_Table *table = &pointer_tables[s];
+                pthread_mutex_lock(&table->lock);
+                struct AP_Pointer_Entry *slots = table->data;
+                for (int i = 0; i < table->capacity; ++i) {
+                        if (slots[i].ptr == NULL) {
+                                continue;
+                        }
+                        LOGI("ap_memory: unreleased ptr %p (%s, %zu bytes)",
+                                slots[i].ptr,
+                                AP_MEMORY_TAG_NAME[slots[i].tag],
+                                slots[i].size);
+                }
+                pthread_mutex_unlock(&table->lock);
         }
         return 0;
 }
@@ -132,11 +508,23 @@ int ap_memory_release()
 {
         LOGI("ap_memory: there are %d pointers unreleased",
                 ap_memory_unreleased_num());
-        char **ptr_arr = (char**) pointer_vector.data;
-        for (int i = 0; i < pointer_vector.length; ++i) {
-                AP_FREE(ptr_arr[i]);
+        for (int s = 0; s < AP_MEM_SHARD_NUM; ++s) {
+                struct AP_Pointer_Table *table = &pointer_tables[s];
+                pthread_mutex_lock(&table->lock);
+                struct AP_Pointer_Entry *slots = table->data;
+                for (int i = 0; i < table->capacity; ++i) {
+                        if (slots[i].ptr != NULL) {
+                                ap_memory_stat_sub(
+                                        slots[i].tag, slots[i].size);
+                                free(slots[i].ptr);
+                        }
+                }
+                free(table->data);
+                table->data = NULL;
+                table->capacity = 0;
+                table->length = 0;
+                pthread_mutex_unlock(&table->lock);
         }
-        free(pointer_vector.data);
         LOGI("ap_memory: all memory released");
         return 0;
-}
\ No newline at end of file
+}
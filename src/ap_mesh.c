@@ -1,12 +1,14 @@
 #include <assimp/cimport.h>        // Plain-C interface
 #include <assimp/scene.h>          // Output data structure
 #include <assimp/postprocess.h>    // Post processing flags
+#include <math.h>
 
 #include "ap_utils.h"
 #include "ap_mesh.h"
 #include "ap_shader.h"
 #include "ap_texture.h"
 #include "ap_vertex.h"
+#include "ap_arena.h"
 
 /**
  * private, setup mesh, generate GL buffers.
@@ -15,7 +17,7 @@
  */
 int ap_mesh_setup(struct AP_Mesh *mesh);
 
-int ap_mesh_init(
+int ap_mesh_init_data(
         struct AP_Mesh *mesh,
         struct AP_Vertex* vertices,
         int vertices_length,
@@ -32,8 +34,9 @@ int ap_mesh_init(
 
         struct AP_Vertex *vertex_new = NULL;
         if (vertices_length > 0) {
-                vertex_new = (struct AP_Vertex *) AP_MALLOC(
-                                sizeof(struct AP_Vertex) * vertices_length);
+                vertex_new = (struct AP_Vertex *) AP_MALLOC_TAG(
+                                sizeof(struct AP_Vertex) * vertices_length,
+                                AP_MEMORY_TAG_MESH);
                 if (vertex_new == NULL) {
                         LOGE("MALLOC FAILED");
                         return AP_ERROR_MALLOC_FAILED;
@@ -46,9 +49,12 @@ int ap_mesh_init(
 
         unsigned int *indices_new = NULL;
         if (indices_length > 0) {
-                indices_new = (unsigned int *) AP_MALLOC(
-                        sizeof(unsigned int) * indices_length);
+                indices_new = (unsigned int *) AP_MALLOC_TAG(
+                        sizeof(unsigned int) * indices_length,
+                        AP_MEMORY_TAG_MESH);
                 if (indices_new == NULL) {
+                        LOGE("MALLOC FAILED");
+                        ap_mesh_free(mesh);
                         return AP_ERROR_MALLOC_FAILED;
                 }
                 memcpy(indices_new, indices,
@@ -59,9 +65,12 @@ int ap_mesh_init(
 
         struct AP_Texture *texture_new = NULL;
         if (texture_length > 0) {
-                texture_new = (struct AP_Texture *) AP_MALLOC(
-                        sizeof(struct AP_Texture) * texture_length);
+                texture_new = (struct AP_Texture *) AP_MALLOC_TAG(
+                        sizeof(struct AP_Texture) * texture_length,
+                        AP_MEMORY_TAG_MESH);
                 if (texture_new == NULL) {
+                        LOGE("MALLOC FAILED");
+                        ap_mesh_free(mesh);
                         return AP_ERROR_MALLOC_FAILED;
                 }
                 memcpy(texture_new, texture,
@@ -70,8 +79,53 @@ int ap_mesh_init(
         mesh->texture_length = texture_length;
         mesh->textures = texture_new;
 
-        ap_mesh_setup(mesh);
-        return 0;
+        return ap_mesh_compute_bounds(mesh);
+}
+
+int ap_mesh_init_move(
+        struct AP_Mesh *mesh,
+        struct AP_Vertex* vertices,
+        int vertices_length,
+        unsigned int *indices,
+        int indices_length,
+        struct AP_Texture *texture,
+        int texture_length)
+{
+        if (!mesh) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        memset(mesh, 0, sizeof(struct AP_Mesh));
+        mesh->vertices = vertices;
+        mesh->vertices_length = vertices_length;
+        mesh->indices = indices;
+        mesh->indices_length = indices_length;
+        mesh->textures = texture;
+        mesh->texture_length = texture_length;
+
+        return ap_mesh_compute_bounds(mesh);
+}
+
+int ap_mesh_init(
+        struct AP_Mesh *mesh,
+        struct AP_Vertex* vertices,
+        int vertices_length,
+        unsigned int *indices,
+        int indices_length,
+        struct AP_Texture *texture,
+        int texture_length)
+{
+        int ret = ap_mesh_init_data(mesh, vertices, vertices_length,
+                indices, indices_length, texture, texture_length);
+        if (ret != 0) {
+                return ret;
+        }
+        ret = ap_mesh_setup(mesh);
+        if (ret != 0) {
+                ap_mesh_delete_buffers(mesh);
+                ap_mesh_free(mesh);
+        }
+        return ret;
 }
 
 int ap_mesh_free(struct AP_Mesh *mesh)
@@ -101,6 +155,68 @@ int ap_mesh_free(struct AP_Mesh *mesh)
         return 0;
 }
 
+int ap_mesh_delete_buffers(struct AP_Mesh *mesh)
+{
+        if (mesh == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (mesh->VAO) {
+                glDeleteVertexArrays(1, &mesh->VAO);
+        }
+        if (mesh->VBO) {
+                glDeleteBuffers(1, &mesh->VBO);
+        }
+        if (mesh->EBO) {
+                glDeleteBuffers(1, &mesh->EBO);
+        }
+        mesh->VAO = mesh->VBO = mesh->EBO = 0;
+
+        return 0;
+}
+
+int ap_mesh_compute_bounds(struct AP_Mesh *mesh)
+{
+        if (mesh == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        memset(mesh->aabb, 0, sizeof(mesh->aabb));
+        memset(mesh->sphere, 0, sizeof(mesh->sphere));
+        if (mesh->vertices_length == 0 || mesh->vertices == NULL) {
+                return 0;
+        }
+
+        float *aabb = mesh->aabb;
+        for (int i = 0; i < 3; ++i) {
+                aabb[i] = aabb[i + 3] = mesh->vertices[0].position[i];
+        }
+        for (int v = 1; v < mesh->vertices_length; ++v) {
+                float *pos = mesh->vertices[v].position;
+                for (int i = 0; i < 3; ++i) {
+                        aabb[i] = pos[i] < aabb[i] ? pos[i] : aabb[i];
+                        aabb[i + 3] = pos[i] > aabb[i + 3]
+                                ? pos[i] : aabb[i + 3];
+                }
+        }
+
+        // the sphere around the center of box, tighter than the sphere
+        // around the box when the vertices are not at the corners
+        float *sphere = mesh->sphere;
+        float radius = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+                sphere[i] = (aabb[i] + aabb[i + 3]) * 0.5f;
+        }
+        for (int v = 0; v < mesh->vertices_length; ++v) {
+                float *pos = mesh->vertices[v].position;
+                float d = (pos[0] - sphere[0]) * (pos[0] - sphere[0])
+                        + (pos[1] - sphere[1]) * (pos[1] - sphere[1])
+                        + (pos[2] - sphere[2]) * (pos[2] - sphere[2]);
+                radius = d > radius ? d : radius;
+        }
+        sphere[3] = sqrtf(radius);
+
+        return 0;
+}
+
 int ap_mesh_copy(struct AP_Mesh *mesh_new, const struct AP_Mesh *mesh_old)
 {
         if (mesh_new == NULL || mesh_old == NULL) {
@@ -111,24 +227,27 @@ int ap_mesh_copy(struct AP_Mesh *mesh_new, const struct AP_Mesh *mesh_old)
 
         mesh_new->texture_length = mesh_old->texture_length;
         if (mesh_old->texture_length > 0) {
-                mesh_new->textures = AP_MALLOC(
-                        mesh_new->texture_length * sizeof(struct AP_Texture));
+                mesh_new->textures = AP_MALLOC_TAG(
+                        mesh_new->texture_length * sizeof(struct AP_Texture),
+                        AP_MEMORY_TAG_MESH);
                 memcpy(mesh_new->textures, mesh_old->textures,
                         mesh_new->texture_length * sizeof(struct AP_Texture));
         }
 
         mesh_new->indices_length = mesh_old->indices_length;
-        if (mesh_old->indices_length > 0) {
-                mesh_new->indices = AP_MALLOC(
-                        mesh_new->indices_length * sizeof(unsigned int));
+        if (mesh_old->indices_length > 0 && mesh_old->indices) {
+                mesh_new->indices = AP_MALLOC_TAG(
+                        mesh_new->indices_length * sizeof(unsigned int),
+                        AP_MEMORY_TAG_MESH);
                 memcpy(mesh_new->indices, mesh_old->indices,
                         mesh_new->indices_length * sizeof(unsigned int));
         }
 
         mesh_new->vertices_length = mesh_old->vertices_length;
-        if (mesh_old->vertices_length > 0) {
-                mesh_new->vertices = AP_MALLOC(
-                        mesh_new->vertices_length * sizeof(struct AP_Vertex));
+        if (mesh_old->vertices_length > 0 && mesh_old->vertices) {
+                mesh_new->vertices = AP_MALLOC_TAG(
+                        mesh_new->vertices_length * sizeof(struct AP_Vertex),
+                        AP_MEMORY_TAG_MESH);
                 memcpy(mesh_new->vertices, mesh_old->vertices,
                         mesh_new->vertices_length * sizeof(struct AP_Vertex));
         }
@@ -136,15 +255,100 @@ int ap_mesh_copy(struct AP_Mesh *mesh_new, const struct AP_Mesh *mesh_old)
         mesh_new->VAO = mesh_old->VAO;
         mesh_new->VBO = mesh_old->VBO;
         mesh_new->EBO = mesh_old->EBO;
+        mesh_new->vertex_format = mesh_old->vertex_format;
+        mesh_new->index_type = mesh_old->index_type;
+        memcpy(mesh_new->aabb, mesh_old->aabb, sizeof(mesh_new->aabb));
+        memcpy(mesh_new->sphere, mesh_old->sphere, sizeof(mesh_new->sphere));
 
         return 0;
 }
 
+/**
+ * Set the vertex attributes of layout in the bound vertex array,
+ * the VBO of vertices must be bound
+ */
+static void ap_mesh_set_attributes(const struct AP_Vertex_Layout *layout)
+{
+        for (int i = 0; i < layout->attribute_num; ++i) {
+                const struct AP_Vertex_Attribute *a = &layout->attributes[i];
+                glEnableVertexAttribArray(a->location);
+                glVertexAttribPointer(
+                        a->location,
+                        a->size,
+                        a->type,
+                        a->normalized ? GL_TRUE : GL_FALSE,
+                        layout->stride,
+                        (void*) (size_t) a->offset
+                );
+        }
+}
+
 int ap_mesh_setup(struct AP_Mesh *mesh)
 {
         if (!mesh) {
                 return AP_ERROR_INVALID_POINTER;
         }
+        const struct AP_Vertex_Layout *layout =
+                ap_vertex_get_layout(mesh->vertex_format);
+        if (layout == NULL) {
+                LOGE("failed to setup mesh: unknown vertex format %d",
+                        mesh->vertex_format);
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        // only the attributes drawn by the shader are uploaded
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        void *vertices = ap_arena_alloc(
+                arena, (size_t) mesh->vertices_length * layout->stride);
+        if (vertices == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        ap_vertex_pack(mesh->vertex_format, mesh->vertices,
+                mesh->vertices_length, vertices);
+
+        // 16 bits indices when all the vertices can be indexed
+        int index_size = sizeof(unsigned int);
+        const void *indices = mesh->indices;
+        uint16_t *short_indices = NULL;
+        if (mesh->vertices_length <= AP_MESH_SHORT_INDEX_MAX) {
+                short_indices = ap_arena_alloc(arena,
+                        sizeof(uint16_t) * mesh->indices_length);
+        }
+        if (short_indices) {
+                for (int i = 0; i < mesh->indices_length; ++i) {
+                        short_indices[i] = (uint16_t) mesh->indices[i];
+                }
+                index_size = sizeof(uint16_t);
+                indices = short_indices;
+        }
+
+        int ret = ap_mesh_setup_data(mesh, vertices, indices, index_size);
+        ap_arena_rewind(arena, marker);
+
+        return ret;
+}
+
+int ap_mesh_setup_data(
+        struct AP_Mesh *mesh,
+        const void *vertices,
+        const void *indices,
+        int index_size)
+{
+        if (mesh == NULL || vertices == NULL || indices == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        const struct AP_Vertex_Layout *layout =
+                ap_vertex_get_layout(mesh->vertex_format);
+        if (layout == NULL || (index_size != sizeof(uint16_t)
+                && index_size != sizeof(unsigned int)))
+        {
+                LOGE("failed to setup mesh: format %d, index size %d",
+                        mesh->vertex_format, index_size);
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        mesh->index_type = index_size == sizeof(uint16_t)
+                ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
         glGenVertexArrays(1, &mesh->VAO);
         glGenBuffers(1, &mesh->VBO);
         glGenBuffers(1, &mesh->EBO);
@@ -153,60 +357,57 @@ int ap_mesh_setup(struct AP_Mesh *mesh)
         glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
         glBufferData(
                 GL_ARRAY_BUFFER,
-                mesh->vertices_length * sizeof(struct AP_Vertex),
-                mesh->vertices,
+                (size_t) mesh->vertices_length * layout->stride,
+                vertices,
                 GL_STATIC_DRAW
         );
-
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
         glBufferData(
                 GL_ELEMENT_ARRAY_BUFFER,
-                mesh->indices_length * sizeof(unsigned int),
-                mesh->indices,
+                (size_t) mesh->indices_length * index_size,
+                indices,
                 GL_STATIC_DRAW
         );
 
-        // position (顶点位置)
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(
-                0,
-                3,
-                GL_FLOAT,
-                GL_FALSE,
-                sizeof(struct AP_Vertex),
-                (void*)0
-        );
-        // normal (顶点法线)
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(
-                1,
-                3,
-                GL_FLOAT,
-                GL_FALSE,
-                sizeof(struct AP_Vertex),
-                (void*) offsetof(struct AP_Vertex, normal)
-        );
-        // texture coords (顶点纹理坐标)
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(
-                2,
-                2,
-                GL_FLOAT,
-                GL_FALSE,
-                sizeof(struct AP_Vertex),
-                (void*) offsetof(struct AP_Vertex, tex_coords)
-        );
+        ap_mesh_set_attributes(layout);
+
+        glBindVertexArray(0);
+        return 0;
+}
+
+int ap_mesh_setup_instanced(
+        struct AP_Mesh *mesh,
+        unsigned int instance_VBO,
+        unsigned int *VAO)
+{
+        if (mesh == NULL || VAO == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (mesh->VBO == 0 || mesh->EBO == 0) {
+                LOGE("failed to setup instanced mesh: mesh not setup");
+                return AP_ERROR_INIT_FAILED;
+        }
 
-        // // vertex tangent
-        // glEnableVertexAttribArray(3);
-        // glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE,
-        //                 sizeof(struct AP_Vertex),
-        //                 (void*)offsetof(struct AP_Vertex, tangent));
-        // // vertex big tangent
-        // glEnableVertexAttribArray(4);
-        // glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE,
-        //                 sizeof(struct AP_Vertex),
-        //                 (void*)offsetof(struct AP_Vertex, big_tangent));
+        glGenVertexArrays(1, VAO);
+        glBindVertexArray(*VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh->VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
+        ap_mesh_set_attributes(ap_vertex_get_layout(mesh->vertex_format));
+
+        // model matrix of instances, one column for each location
+        glBindBuffer(GL_ARRAY_BUFFER, instance_VBO);
+        for (int i = 0; i < 4; ++i) {
+                glEnableVertexAttribArray(AP_MESH_MODEL_ATTRIB + i);
+                glVertexAttribPointer(
+                        AP_MESH_MODEL_ATTRIB + i,
+                        4,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        sizeof(float) * 16,
+                        (void*) (sizeof(float) * 4 * i)
+                );
+                glVertexAttribDivisor(AP_MESH_MODEL_ATTRIB + i, 1);
+        }
 
         glBindVertexArray(0);
         return 0;
@@ -218,38 +419,19 @@ int ap_mesh_draw(struct AP_Mesh *mesh, unsigned int shader)
                 return AP_ERROR_INVALID_POINTER;
         }
 
-        // bind appropriate texture
-        unsigned int diffuse_nr  = 0;
-        unsigned int specular_nr = 0;
-        unsigned int normal_nr   = 0;
-        unsigned int height_nr   = 0;
-        static char buffer[AP_DEFAULT_BUFFER_SIZE];
-
+        // bind the textures to their units, the samplers of the materials
+        // are set to the units once when the renderer is initialized
         for(int i = 0; i < mesh->texture_length
                 && i < AP_TEXTURE_UNIT_MAX_NUM; i++)
         {
-                // active proper texture before binding
                 glActiveTexture(GL_TEXTURE0 + i);
-                // retrieve texture number
-                int texture_num = 0;
-                int ap_type = mesh->textures[i].type;
-                if (ap_type == AP_TEXTURE_TYPE_DIFFUSE) {
-                        texture_num = diffuse_nr++;
-                } else if (ap_type == AP_TEXTURE_TYPE_SPECULAR) {
-                        texture_num = specular_nr++;
-                } else if (ap_type == AP_TEXTURE_TYPE_NORMAL) {
-                        texture_num = normal_nr++;
-                } else if (ap_type == AP_TEXTURE_TYPE_HEIGHT) {
-                        texture_num = height_nr++;
-                }
-                const char* name = ap_texture_type_2_str(ap_type);
-                sprintf(buffer, name, texture_num);
                 glBindTexture(GL_TEXTURE_2D, mesh->textures[i].id);
         }
 
         // draw mesh
         glBindVertexArray(mesh->VAO);
-        glDrawElements(GL_TRIANGLES, mesh->indices_length, GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, mesh->indices_length,
+                mesh->index_type, 0);
         glBindVertexArray(0);
 
         glActiveTexture(GL_TEXTURE0);
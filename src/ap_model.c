@@ -4,8 +4,14 @@
 #include "ap_custom_io.h"
 #include "ap_texture.h"
 #include "ap_vertex.h"
+#include "ap_optimize.h"
+#include "ap_model_cache.h"
 #include "ap_shader.h"
 #include "ap_render.h"
+#include "ap_pool.h"
+#include "ap_slot_map.h"
+#include "ap_hashmap.h"
+#include "ap_thread.h"
 
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
@@ -13,144 +19,723 @@
 #include <assimp/cfileio.h>
 #include <pthread.h>
 
+// post processing of the imported models, a part of the cache key
+#define AP_MODEL_IMPORT_FLAGS (aiProcess_Triangulate \
+        | aiProcess_GenSmoothNormals | aiProcess_FlipUVs \
+        | aiProcess_CalcTangentSpace)
+
+/**
+ * Texture used by a model being imported, the image is decoded by a worker
+ * and the texture is generated on the render thread
+ */
+struct AP_Model_Texture_Request {
+        char *path;             // NULL for the texture of material color
+        const char *directory;
+        float RGBA[4];
+        int type;
+        struct AP_Texture_Image image;
+        struct AP_Texture *texture;     // NULL until generated
+};
+
+AP_VECTOR_DEFINE(texture_request, struct AP_Model_Texture_Request)
+
+/**
+ * Mesh of the scene converted by a job, the jobs are in the order
+ * the node tree is walked
+ */
+struct AP_Model_Mesh_Job {
+        struct aiMesh *mesh;
+        struct AP_Mesh converted;
+        int ret;
+};
+
+AP_VECTOR_DEFINE(mesh_job, struct AP_Model_Mesh_Job)
+
+/**
+ * Model generated by ap_model_generate_async
+ */
+struct AP_Model_Import {
+        struct AP_Model_Resource resource;
+        // resource of the path already generated, not imported again
+        struct AP_Model_Resource *shared;
+        struct AP_Model_Thread_Param param;
+        ap_callback_func_t cb;
+        int ret;
+        // textures of the model, the IDs of the textures in model and
+        // meshes are index + 1 of this vector until uploaded
+        struct AP_Vector requests;
+        // counts the image decoding jobs
+        struct AP_Job_Counter counter;
+        // requests uploaded first, then the meshes
+        size_t step;
+        // vertex format when the import started
+        int vertex_format;
+        // mapped until the meshes are uploaded if loaded from cache
+        struct AP_Model_Cache cache;
+};
+
 /**
- * @brief init a model struct object with its pointer
- * @param model pointer points to a new model
+ * @brief Import a model file to resource
+ * @param resource pointer points to a new resource
  * @param path model path
  * @param gamma reserve, default false
+ * @param import NULL to generate the textures and GL buffers now
  * @return int AP_Types
  */
-static int ap_model_init_ptr(
-        struct AP_Model *model, const char *path, bool gamma
+static int ap_model_resource_init(
+        struct AP_Model_Resource *resource,
+        const char *path,
+        bool gamma,
+        struct AP_Model_Import *import
 );
 
 /**
- * @brief Draw model with specific OpenGL shader ID and model pointer.
- *
- * @param model pointer points to the AP_Model struct object
- * @param shader OpenGL shader program ID
- * @return int
+ * @brief Release the meshes, textures, path and directory of resource
  */
-static int ap_model_draw_ptr_shader(
-        struct AP_Model *model, unsigned int shader
-);
-
-static struct AP_Vector model_vector = { 0, 0, 0, 0 };
+static int ap_model_resource_release(struct AP_Model_Resource *resource);
+
+// models are stored in pool, the slot map holds their pointers,
+// the IDs are the slot map handles
+static struct AP_Pool model_pool;
+static struct AP_Slot_Map model_map;
+// hash of path to the first struct AP_Model_Resource pointer of the hash,
+// the resources of the same hash are chained by next
+static struct AP_Hashmap resource_map;
+static bool model_initialized = false;
 static struct AP_Model *model_using = NULL;
+// enum AP_Vertex_Format of the models generated
+static int model_vertex_format = AP_VERTEX_FORMAT_FLOAT;
+// empty if the cache is disabled
+static char model_cache_dir[AP_MODEL_CACHE_PATH_LENGTH] = AP_MODEL_CACHE_DIR;
 
 /**
  * Load model from android asset manager.
- * @param model
+ * @param resource
  * @param path file path
- * @param format can be null or empty string
+ * @param import see ap_model_resource_init
  * @return AP_Types
  */
-int ap_model_load_ptr(struct AP_Model *model, const char *path);
+int ap_model_load_ptr(
+        struct AP_Model_Resource *resource,
+        const char *path,
+        struct AP_Model_Import *import
+);
 
 /**
- * Process node
- * @param model
+ * Process the meshes of node and its children, the meshes are converted
+ * in parallel and pushed to resource in the order of the node tree
+ * @param resource
  * @param node
  * @param scene
- * @return AP_Types
+ * @param import see ap_model_resource_init
+ * @return AP_Types, the error of the first mesh failed
  */
 int ap_model_process_node(
-        struct AP_Model *model,
+        struct AP_Model_Resource *resource,
         struct aiNode *node,
-        const struct aiScene *scene
+        const struct aiScene *scene,
+        struct AP_Model_Import *import
 );
 
 /**
- * Push a new texture struct object into model
- * @param model
+ * Push a new texture struct object into resource
+ * @param resource
  * @param texture
  * @return AP_Types
  */
 int ap_model_texture_loaded_push_back(
-        struct AP_Model *model,
+        struct AP_Model_Resource *resource,
         struct AP_Texture *texture
 );
 
 /**
- * Process mesh,
- * @param model
+ * Convert the vertices, indices and bounds of mesh, thread safe
+ * @param mesh
+ * @param mesh_new [out] mesh without textures, need ap_mesh_free
+ * @return AP_Types
+ */
+static int ap_model_convert_mesh(
+        const struct aiMesh *mesh,
+        struct AP_Mesh *mesh_new
+);
+
+/**
+ * Process mesh, resolve the textures of its material for the mesh
+ * converted by ap_model_convert_mesh and setup the mesh
+ * @param resource
  * @param mesh
  * @param scene
- * @return Points to static mesh struct object, need ap_mesh_free after use.
+ * @param import see ap_model_resource_init
+ * @param mesh_new [in,out] need ap_mesh_free unless it is pushed.
+ * @return AP_Types
  */
-struct AP_Mesh *ap_model_process_mesh(
-        struct AP_Model *model,
+int ap_model_process_mesh(
+        struct AP_Model_Resource *resource,
         struct aiMesh *mesh,
-        const struct aiScene *scene
+        const struct aiScene *scene,
+        struct AP_Model_Import *import,
+        struct AP_Mesh *mesh_new
 );
 
 /**
- * Push a new mesh struct object to model
- * @param model
- * @param mesh
+ * Push a new mesh struct object to resource
+ * @param resource
+ * @param mesh [in] its data is moved to resource, emptied after pushed
  * @return AP_Types
  */
-int ap_model_mesh_push_back(struct AP_Model *model, struct AP_Mesh *mesh);
+int ap_model_mesh_push_back(
+        struct AP_Model_Resource *resource,
+        struct AP_Mesh *mesh);
 
 /**
  * checks all material textures of a given type and loads the textures if
  * they're not loaded yet. The required info is returned as a Texture struct.
- * @param model
+ * @param resource
  * @param mat
  * @param type
  * @param ap_type
- * @return Pointer points to a static vector,
- *         need use ap_vector_free to free its data after use.
+ * @param textures [out] array to append the textures to, must have space for
+ *        aiGetMaterialTextureCount(mat, type) + 1 more textures
+ * @param length [in,out] length of textures
+ * @param import see ap_model_resource_init
+ * @return AP_Types
  */
-struct AP_Vector *ap_model_load_material_textures(
-    struct AP_Model *model,
+int ap_model_load_material_textures(
+    struct AP_Model_Resource *resource,
     struct aiMaterial *mat,
     enum aiTextureType type,
-    int ap_type
+    int ap_type,
+    struct AP_Texture *textures,
+    int *length,
+    struct AP_Model_Import *import
+);
+
+/**
+ * Get a texture of resource and append it to textures, the texture is
+ * generated if it is not generated yet.
+ * @param resource
+ * @param path name of the image, NULL for material color
+ * @param color material color, used when path is NULL
+ * @param ap_type
+ * @param import see ap_model_resource_init
+ * @param textures [out] array to append the texture to
+ * @param length [in,out] length of textures
+ * @return AP_Types
+ */
+static int ap_model_load_texture(
+        struct AP_Model_Resource *resource,
+        const char *path,
+        float color[4],
+        int ap_type,
+        struct AP_Model_Import *import,
+        struct AP_Texture *textures,
+        int *length
 );
 
+/**
+ * Get a texture of the imported model, the texture is requested to be
+ * generated on the render thread when the model does not use it yet.
+ * @param import
+ * @param path name of the image, NULL for material color
+ * @param color material color, used when path is NULL
+ * @param ap_type
+ * @param texture [out] texture with request index + 1 as ID
+ * @return AP_Types
+ */
+static int ap_model_import_texture(
+        struct AP_Model_Import *import,
+        const char *path,
+        float color[4],
+        int ap_type,
+        struct AP_Texture *texture
+);
+
+static void ap_model_initialize()
+{
+        // initialize pool, slot map and hash map when first use
+        if (!model_initialized) {
+                ap_pool_init(&model_pool, sizeof(struct AP_Model),
+                        0, AP_MEMORY_TAG_MODEL);
+                ap_slot_map_init(&model_map, sizeof(struct AP_Model*));
+                ap_hashmap_init(&resource_map,
+                        sizeof(struct AP_Model_Resource*));
+                model_initialized = true;
+        }
+}
+
+/**
+ * Find the resource of path imported in vertex_format,
+ * NULL if it is not generated
+ */
+static struct AP_Model_Resource *ap_model_resource_find(
+        const char *path,
+        int vertex_format)
+{
+        ap_model_initialize();
+        struct AP_Model_Resource **head =
+                ap_hashmap_get(&resource_map, ap_hash_str(path));
+        struct AP_Model_Resource *resource = head ? *head : NULL;
+        while (resource && (resource->vertex_format != vertex_format
+                || strcmp(resource->path, path) != 0))
+        {
+                resource = resource->next;
+        }
+        return resource;
+}
+
+/**
+ * Move an imported resource to heap and share it by its path
+ * @param resource [in] emptied after moved
+ * @return the new resource with 1 reference, NULL if malloc failed
+ */
+static struct AP_Model_Resource *ap_model_resource_store(
+        struct AP_Model_Resource *resource)
+{
+        struct AP_Model_Resource *stored = AP_MALLOC_TAG(
+                sizeof(struct AP_Model_Resource), AP_MEMORY_TAG_MODEL);
+        if (stored == NULL) {
+                return NULL;
+        }
+        memcpy(stored, resource, sizeof(struct AP_Model_Resource));
+        memset(resource, 0, sizeof(struct AP_Model_Resource));
+        stored->ref_count = 1;
+
+        ap_model_initialize();
+        unsigned int hash = ap_hash_str(stored->path);
+        struct AP_Model_Resource **head = ap_hashmap_get(&resource_map, hash);
+        stored->next = head ? *head : NULL;
+        if (ap_hashmap_insert(&resource_map, hash, &stored) != 0) {
+                // not shared, but still a valid resource
+                LOGW("failed to share model %s", stored->path);
+                stored->next = NULL;
+        }
+        return stored;
+}
+
+/**
+ * Drop a reference of resource, released with the last reference
+ */
+static void ap_model_resource_unref(struct AP_Model_Resource *resource)
+{
+        if (--resource->ref_count > 0) {
+                return;
+        }
+        unsigned int hash = ap_hash_str(resource->path);
+        struct AP_Model_Resource **head = ap_hashmap_get(&resource_map, hash);
+        if (head && *head == resource) {
+                if (resource->next) {
+                        *head = resource->next;
+                } else {
+                        ap_hashmap_remove(&resource_map, hash);
+                }
+        } else if (head) {
+                struct AP_Model_Resource *prev = *head;
+                while (prev && prev->next != resource) {
+                        prev = prev->next;
+                }
+                if (prev) {
+                        prev->next = resource->next;
+                }
+        }
+        ap_model_resource_release(resource);
+        AP_FREE(resource);
+}
+
+/**
+ * Get a new model from pool and store it in slot map
+ * @param model_id [out] handle of the model
+ * @param resource its reference is taken by the model
+ */
+static struct AP_Model *ap_model_new(
+        unsigned int *model_id,
+        struct AP_Model_Resource *resource)
+{
+        ap_model_initialize();
+        struct AP_Model *model = ap_pool_alloc(&model_pool);
+        if (model == NULL) {
+                return NULL;
+        }
+        if (ap_slot_map_insert(&model_map, &model, model_id) != 0) {
+                ap_pool_release(&model_pool, model);
+                return NULL;
+        }
+
+        memset(model, 0, sizeof(struct AP_Model));
+        model->id = *model_id;
+        model->scale[0] = model->scale[1] = model->scale[2] = 1.0f;
+        model->resource = resource;
+        return model;
+}
+
 int ap_model_generate(const char *path, unsigned int *model_id)
 {
         if (!path || !model_id) {
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
-        // initialize vector when first use
-        if (model_vector.data == NULL) {
-                ap_vector_init(&model_vector, AP_VECTOR_MODEL);
+        struct AP_Model_Resource *resource =
+                ap_model_resource_find(path, model_vertex_format);
+        if (resource) {
+                resource->ref_count++;
+        } else {
+                struct AP_Model_Resource imported;
+                int ret = ap_model_resource_init(
+                        &imported, path, false, NULL);
+                if (ret == 0) {
+                        resource = ap_model_resource_store(&imported);
+                }
+                if (resource == NULL) {
+                        ap_model_resource_release(&imported);
+                        return ret ? ret : AP_ERROR_MALLOC_FAILED;
+                }
+        }
+
+        unsigned int id = 0;
+        if (ap_model_new(&id, resource) == NULL) {
+                ap_model_resource_unref(resource);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        *model_id = id;
+        LOGD("generated model %s id %u, %d models share it",
+                path, *model_id, resource->ref_count);
+
+        return 0;
+}
+
+static int ap_model_import_free(struct AP_Model_Import *import)
+{
+        struct AP_Model_Texture_Request *requests =
+                ap_vector_texture_request_data(&import->requests);
+        for (size_t i = 0; i < import->requests.length; ++i) {
+                // the textures used by the model are referenced by it
+                if (requests[i].texture) {
+                        ap_texture_release(requests[i].texture->handle);
+                }
+                AP_FREE(requests[i].path);
+                ap_texture_image_free(&requests[i].image);
+        }
+        ap_vector_free(&import->requests);
+        ap_job_counter_free(&import->counter);
+        ap_model_cache_close(&import->cache);
+        AP_FREE((char *) import->param.path);
+        AP_FREE(import);
+
+        return 0;
+}
+
+/**
+ * Render thread, generate the texture of request
+ */
+static int ap_model_upload_texture(
+        struct AP_Model_Texture_Request *request)
+{
+        // the textures generated already are shared with a reference
+        // instead of being uploaded again
+        unsigned int id = 0;
+        if (request->path) {
+                ap_texture_generate_image(&id, request->type,
+                        request->path, request->directory, &request->image);
+                ap_texture_image_free(&request->image);
+        } else {
+                ap_texture_generate_RGBA(&id, request->RGBA,
+                        16, AP_TEXTURE_TYPE_DIFFUSE);
         }
+        request->texture = ap_texture_get_ptr(id);
 
-        struct AP_Model model;
-        AP_CHECK( ap_model_init_ptr(&model, path, false) );
+        return 0;
+}
 
-        model.id = model_vector.length + 1;
-        ap_vector_push_back(&model_vector, (const char*) &model);
-        *model_id = model.id;
-        LOGD("generated model %s id %d", path, *model_id);
+/**
+ * Replace the request index of textures by the generated textures,
+ * the textures failed to generate are removed like ap_model_generate does.
+ * @param own_path the paths of textures are owned by them, the textures
+ *        of resource, which hold a reference of the generated textures
+ */
+static int ap_model_patch_textures(
+        struct AP_Model_Import *import,
+        struct AP_Texture *textures,
+        int *length,
+        bool own_path)
+{
+        struct AP_Model_Texture_Request *requests =
+                ap_vector_texture_request_data(&import->requests);
+        int patched = 0;
+        for (int i = 0; i < *length; ++i) {
+                struct AP_Texture *generated =
+                        requests[textures[i].id - 1].texture;
+                if (generated == NULL) {
+                        if (own_path) {
+                                AP_FREE(textures[i].path);
+                        }
+                        continue;
+                }
+                textures[patched] = textures[i];
+                textures[patched].id = generated->id;
+                textures[patched].handle = generated->handle;
+                textures[patched].type = generated->type;
+                if (own_path) {
+                        ap_texture_ref(generated->handle);
+                } else {
+                        textures[patched].path = generated->path;
+                }
+                ++patched;
+        }
+        *length = patched;
 
         return 0;
 }
 
-int ap_model_use(unsigned int model_id)
+/**
+ * Render thread, store the model in slot map and report the result
+ */
+static bool ap_model_import_finish(struct AP_Model_Import *import)
 {
-        if (model_id > model_vector.length) {
+        struct AP_Model_Resource *resource = import->shared;
+        if (import->ret == 0 && resource == NULL) {
+                // the path may be generated again during the import
+                resource = ap_model_resource_find(
+                        import->param.path, import->vertex_format);
+                if (resource) {
+                        resource->ref_count++;
+                        ap_model_resource_release(&import->resource);
+                } else {
+                        resource = ap_model_resource_store(
+                                &import->resource);
+                }
+                if (resource == NULL) {
+                        import->ret = AP_ERROR_MALLOC_FAILED;
+                }
+        }
+        if (import->ret == 0) {
+                unsigned int id = 0;
+                if (ap_model_new(&id, resource)) {
+                        import->param.id = id;
+                } else {
+                        ap_model_resource_unref(resource);
+                        import->ret = AP_ERROR_MALLOC_FAILED;
+                }
+        }
+        if (import->ret != 0) {
+                LOGE("failed to generate model %s", import->param.path);
+                ap_model_resource_release(&import->resource);
+        } else {
+                LOGD("generated model %s id %u",
+                        import->param.path, import->param.id);
+        }
+        if (import->cb) {
+                import->cb(&import->param, import->ret);
+        }
+        ap_model_import_free(import);
+
+        return true;
+}
+
+/**
+ * Render thread, uploads one texture or one mesh of the model each time
+ */
+static bool ap_model_upload_func(void *param)
+{
+        struct AP_Model_Import *import = param;
+        struct AP_Model_Resource *resource = &import->resource;
+        if (import->ret != 0 || import->shared) {
+                return ap_model_import_finish(import);
+        }
+
+        size_t requests_length = import->requests.length;
+        if (import->step < requests_length) {
+                ap_model_upload_texture(ap_vector_texture_request_at(
+                        &import->requests, import->step++));
+                return false;
+        }
+        size_t mesh_index = import->step - requests_length;
+        if (mesh_index < resource->mesh_length) {
+                struct AP_Mesh *mesh = &resource->mesh[mesh_index];
+                ap_model_patch_textures(import, mesh->textures,
+                        &mesh->texture_length, false);
+                if (import->cache.data) {
+                        const struct AP_Model_Cache_Mesh *m =
+                                &import->cache.meshes[mesh_index];
+                        ap_mesh_setup_data(mesh,
+                                ap_model_cache_blob(&import->cache,
+                                        m->vertex_offset),
+                                ap_model_cache_blob(&import->cache,
+                                        m->index_offset),
+                                m->index_size);
+                } else {
+                        ap_mesh_setup(mesh);
+                }
+                import->step++;
+                return false;
+        }
+        ap_model_patch_textures(import, resource->texture,
+                &resource->texture_length, true);
+
+        return ap_model_import_finish(import);
+}
+
+/**
+ * Worker thread, decode the image of texture request
+ */
+static void ap_model_decode_job(void *param)
+{
+        struct AP_Model_Texture_Request *request = param;
+        ap_texture_image_load(
+                request->path, request->directory, &request->image);
+}
+
+/**
+ * Worker thread, queue the upload after the images are decoded,
+ * the errors of import are reported by the upload on render thread
+ */
+static void ap_model_queue_job(void *param)
+{
+        // reserved by ap_model_generate_async, does not fail
+        ap_render_queue_upload_reserved(ap_model_upload_func, param);
+}
+
+/**
+ * Worker thread, import the model file and start decoding its images
+ */
+static void ap_model_import_job(void *param)
+{
+        struct AP_Model_Import *import = param;
+        import->ret = ap_model_resource_init(
+                &import->resource, import->param.path, false, import);
+
+        struct AP_Model_Texture_Request *requests =
+                ap_vector_texture_request_data(&import->requests);
+        for (size_t i = 0; import->ret == 0
+                && i < import->requests.length; ++i)
+        {
+                if (requests[i].path) {
+                        requests[i].directory = import->resource.directory;
+                        ap_thread_run(ap_model_decode_job,
+                                &requests[i], &import->counter);
+                }
+        }
+
+        int ret = ap_thread_run_after(
+                &import->counter, ap_model_queue_job, import, NULL);
+        if (ret != 0) {
+                // queued here after the images, with the same reservation
+                ap_thread_wait(&import->counter);
+                ap_model_queue_job(import);
+        }
+}
+
+int ap_model_generate_async(const char *path, ap_callback_func_t cb)
+{
+        if (path == NULL) {
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
+        struct AP_Model_Import *import = AP_MALLOC_TAG(
+                sizeof(struct AP_Model_Import), AP_MEMORY_TAG_MODEL);
+        if (import == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        memset(import, 0, sizeof(struct AP_Model_Import));
+        char *path_new = AP_MALLOC_TAG(strlen(path) + 1, AP_MEMORY_TAG_MODEL);
+        int ret = ap_vector_init_size(&import->requests,
+                sizeof(struct AP_Model_Texture_Request));
+        if (path_new == NULL || ret != 0) {
+                AP_FREE(path_new);
+                if (ret == 0) {
+                        ap_vector_free(&import->requests);
+                }
+                AP_FREE(import);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        strcpy(path_new, path);
+        import->param.path = path_new;
+        import->cb = cb;
+        import->vertex_format = model_vertex_format;
+        ap_job_counter_init(&import->counter);
+
+        // the upload is queued by a worker, its room is reserved now
+        // so that the result always reaches cb on the render thread
+        ret = ap_render_reserve_upload();
+        if (ret != 0) {
+                ap_model_import_free(import);
+                return ret;
+        }
+
+        // only the model is created on the render thread
+        // if the path is generated
+        import->shared = ap_model_resource_find(path, import->vertex_format);
+        if (import->shared) {
+                import->shared->ref_count++;
+                return ap_render_queue_upload_reserved(
+                        ap_model_upload_func, import);
+        }
+
+        ret = ap_thread_run(ap_model_import_job, import, NULL);
+        if (ret != 0) {
+                ap_render_cancel_upload();
+                ap_model_import_free(import);
+        }
+        return ret;
+}
+
+int ap_model_use(unsigned int model_id)
+{
         if (model_id == 0) {
                 model_using = NULL;
                 return 0;
         }
 
-        struct AP_Model *tmp_model = (struct AP_Model*) model_vector.data;
-        model_using = tmp_model + (model_id - 1);
+        struct AP_Model **model = ap_slot_map_get(&model_map, model_id);
+        if (model == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        model_using = *model;
+
+        return 0;
+}
+
+int ap_model_set_vertex_format(int format)
+{
+        if (ap_vertex_get_layout(format) == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        model_vertex_format = format;
+
+        return 0;
+}
+
+int ap_model_set_cache_dir(const char *dir)
+{
+        if (dir == NULL) {
+                model_cache_dir[0] = '\0';
+                return 0;
+        }
+        if (strlen(dir) >= sizeof(model_cache_dir)) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        strcpy(model_cache_dir, dir);
+
+        return 0;
+}
+
+int ap_model_get_ptr(unsigned int model_id, struct AP_Model **ptr)
+{
+        if (ptr == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (!model_initialized) {
+                return AP_ERROR_INIT_FAILED;
+        }
+        struct AP_Model **model = ap_slot_map_get(&model_map, model_id);
+        if (model == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        *ptr = *model;
 
         return 0;
 }
 
 int ap_model_draw()
 {
-        unsigned int old_shader = ap_get_current_shader();
         unsigned int render_persp_shader_id = 0;
         ap_render_get_persp_shader(&render_persp_shader_id);
 
@@ -169,46 +754,87 @@ int ap_model_draw()
         glm_translate(mat_model, model_using->pos);
         glm_rotate(mat_model, model_using->rotate_angle,
                 model_using->rotate_axis);
-        ap_render_set_model_mat((float *) mat_model);
 
-        ap_shader_use(render_persp_shader_id);
-        ap_model_draw_ptr_shader(model_using, render_persp_shader_id);
-        ap_shader_use(old_shader);
+        return ap_render_submit_meshes(model_using->resource->mesh,
+                model_using->resource->mesh_length, (float *) mat_model);
+}
 
-        return 0;
+int ap_model_release(unsigned int model_id)
+{
+        struct AP_Model **model = model_initialized
+                ? ap_slot_map_get(&model_map, model_id) : NULL;
+        if (model == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        if (*model == model_using) {
+                model_using = NULL;
+        }
+        ap_model_resource_unref((*model)->resource);
+        ap_pool_release(&model_pool, *model);
+
+        return ap_slot_map_remove(&model_map, model_id);
 }
 
 int ap_model_free()
 {
         model_using = NULL;    // for safety purpose
-        struct AP_Model *model_array = (struct AP_Model*) model_vector.data;
-        for (int i = 0; i < model_vector.length; ++i) {
-                AP_FREE(model_array[i].directory);
-                model_array[i].directory = NULL;
-                AP_FREE(model_array[i].mesh);
-                model_array[i].mesh = NULL;
-                AP_FREE(model_array[i].texture);
-                model_array[i].texture = NULL;
+        if (!model_initialized) {
+                return 0;
+        }
+        struct AP_Model **model_array = ap_slot_map_data(&model_map);
+        for (size_t i = 0; i < ap_slot_map_length(&model_map); ++i) {
+                ap_model_resource_unref(model_array[i]->resource);
         }
-        ap_vector_free(&model_vector);
+        ap_slot_map_free(&model_map);
+        ap_pool_free(&model_pool);
+        ap_hashmap_free(&resource_map);
+        model_initialized = false;
 
         return 0;
 }
 
-static int ap_model_init_ptr(
-        struct AP_Model *model, const char *path, bool gamma)
+static int ap_model_resource_release(struct AP_Model_Resource *resource)
 {
-        if (model == NULL) {
+        for (int i = 0; i < resource->mesh_length; ++i) {
+                ap_mesh_delete_buffers(&resource->mesh[i]);
+                ap_mesh_free(&resource->mesh[i]);
+        }
+        AP_FREE(resource->mesh);
+        resource->mesh = NULL;
+        resource->mesh_length = 0;
+        for (int i = 0; i < resource->texture_length; ++i) {
+                ap_texture_release(resource->texture[i].handle);
+                AP_FREE(resource->texture[i].path);
+        }
+        AP_FREE(resource->texture);
+        resource->texture = NULL;
+        resource->texture_length = 0;
+        AP_FREE(resource->directory);
+        resource->directory = NULL;
+        AP_FREE(resource->path);
+        resource->path = NULL;
+
+        return 0;
+}
+
+static int ap_model_resource_init(
+        struct AP_Model_Resource *resource,
+        const char *path,
+        bool gamma,
+        struct AP_Model_Import *import)
+{
+        if (resource == NULL) {
                 return AP_ERROR_INVALID_POINTER;
         }
 
-        memset(model, 0, sizeof(struct AP_Model));
-        model->pos[0] = model->pos[1] = model->pos[2] = 0.0f;
-        model->scale[0] = model->scale[1] = model->scale[2] = 1.0f;
-        model->rotate_angle = 0.0f;
-        model->rotate_axis[0]
-                = model->rotate_axis[1]
-                = model->rotate_axis[2] = 0.0f;
+        memset(resource, 0, sizeof(struct AP_Model_Resource));
+        resource->vertex_format = import
+                ? import->vertex_format : model_vertex_format;
+        resource->path = AP_MALLOC_TAG(strlen(path) + 1, AP_MEMORY_TAG_MODEL);
+        if (resource->path == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        strcpy(resource->path, path);
 
         int dir_char_location = 0;
         for (int i = 0; i < strlen(path); ++i) {
@@ -217,21 +843,108 @@ static int ap_model_init_ptr(
                 }
         }
         if (dir_char_location >= 0) {
-                char *dir_path = AP_MALLOC(sizeof(char) * (dir_char_location + 2));
+                char *dir_path = AP_MALLOC_TAG(
+                        sizeof(char) * (dir_char_location + 2),
+                        AP_MEMORY_TAG_MODEL);
                 memcpy(dir_path, path, (dir_char_location + 1) * sizeof(char));
                 dir_path[dir_char_location + 1] = '\0';
-                model->directory = dir_path;
+                resource->directory = dir_path;
         }
 
-        return ap_model_load_ptr(model, path);
+        return ap_model_load_ptr(resource, path, import);
 }
 
-int ap_model_load_ptr(struct AP_Model *model, const char *path)
+/**
+ * Create the meshes of resource from its cache file, the GL buffers are
+ * created from the mapped file
+ */
+static int ap_model_load_cache(
+        struct AP_Model_Resource *resource,
+        const struct AP_Model_Cache *cache,
+        struct AP_Model_Import *import)
 {
-        if (model == NULL) {
+        for (uint32_t i = 0; i < cache->header->mesh_num; ++i) {
+                const struct AP_Model_Cache_Mesh *m = &cache->meshes[i];
+                struct AP_Texture *textures = AP_MALLOC_TAG(
+                        sizeof(struct AP_Texture) * (m->texture_num + 1),
+                        AP_MEMORY_TAG_MESH);
+                if (textures == NULL) {
+                        return AP_ERROR_MALLOC_FAILED;
+                }
+                int textures_length = 0;
+                for (uint32_t j = 0; j < m->texture_num; ++j) {
+                        const struct AP_Model_Cache_Texture *t =
+                                &cache->textures[m->texture_first + j];
+                        float color[4];
+                        memcpy(color, t->RGBA, sizeof(color));
+                        ap_model_load_texture(resource,
+                                ap_model_cache_texture_path(cache, t),
+                                color, t->type, import,
+                                textures, &textures_length);
+                }
+
+                // the vertices are not kept in memory
+                struct AP_Mesh mesh;
+                ap_mesh_init_move(&mesh, NULL, m->vertex_num,
+                        NULL, m->index_num, textures, textures_length);
+                mesh.vertex_format = m->vertex_format;
+                memcpy(mesh.aabb, m->aabb, sizeof(mesh.aabb));
+                memcpy(mesh.sphere, m->sphere, sizeof(mesh.sphere));
+                int ret = 0;
+                if (!import) {
+                        ret = ap_mesh_setup_data(&mesh,
+                                ap_model_cache_blob(cache, m->vertex_offset),
+                                ap_model_cache_blob(cache, m->index_offset),
+                                m->index_size);
+                }
+                if (ret == 0) {
+                        ret = ap_model_mesh_push_back(resource, &mesh);
+                }
+                if (ret != 0) {
+                        ap_mesh_delete_buffers(&mesh);
+                        ap_mesh_free(&mesh);
+                        return ret;
+                }
+        }
+        LOGD("loaded %u meshes from model cache", cache->header->mesh_num);
+
+        return 0;
+}
+
+int ap_model_load_ptr(
+        struct AP_Model_Resource *resource,
+        const char *path,
+        struct AP_Model_Import *import)
+{
+        if (resource == NULL) {
                 return AP_ERROR_INVALID_POINTER;
         }
 
+        // the cache is used when it is written for the same file,
+        // it is written again after importing the file otherwise
+        char cache_path[AP_MODEL_CACHE_PATH_LENGTH];
+        struct AP_Model_Cache_Key key;
+        int vertex_format = import
+                ? import->vertex_format : model_vertex_format;
+        bool cache_enabled = model_cache_dir[0] != '\0'
+                && ap_model_cache_path(model_cache_dir, path,
+                        cache_path, sizeof(cache_path)) == 0
+                && ap_model_cache_key(path, AP_MODEL_IMPORT_FLAGS,
+                        vertex_format, &key) == 0;
+        struct AP_Model_Cache cache;
+        if (cache_enabled
+                && ap_model_cache_open(cache_path, path, &key, &cache) == 0)
+        {
+                int ret = ap_model_load_cache(resource, &cache, import);
+                if (import && ret == 0) {
+                        // the meshes are uploaded from it later
+                        import->cache = cache;
+                } else {
+                        ap_model_cache_close(&cache);
+                }
+                return ret;
+        }
+
         // Start the import on the given file with some example postprocessing
         // Usually if speed is not the most important aspect for you
         // you'll probably to request more postprocessing
@@ -245,8 +958,7 @@ int ap_model_load_ptr(struct AP_Model *model, const char *path)
 
         const struct aiScene* scene = aiImportFileEx(
                 path,
-                aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-                aiProcess_FlipUVs | aiProcess_CalcTangentSpace,
+                AP_MODEL_IMPORT_FLAGS,
                 &fileIo
         );
 
@@ -258,115 +970,246 @@ int ap_model_load_ptr(struct AP_Model *model, const char *path)
         }
 
         // Now we can access the file's contents
-        AP_CHECK( ap_model_process_node(model, scene->mRootNode, scene) );
+        int ret = ap_model_process_node(
+                resource, scene->mRootNode, scene, import);
 
         // We're done. Release all resources associated with this import
         aiReleaseImport(scene);
+        if (ret != 0) {
+                LOGE("failed to process model %s", path);
+                return ret;
+        }
+
+        if (cache_enabled) {
+                ap_model_cache_write(cache_path, path, &key,
+                        resource->mesh, resource->mesh_length);
+        }
 
         return AP_ERROR_SUCCESS;
 }
 
-int ap_model_process_node(
-        struct AP_Model *model,
+/**
+ * Append the meshes of node and its children to jobs, depth first
+ */
+static int ap_model_collect_meshes(
         struct aiNode *node,
-        const struct aiScene *scene)
+        const struct aiScene *scene,
+        struct AP_Vector *jobs)
 {
-        if (model == NULL || node == NULL || scene == NULL) {
-                return AP_ERROR_INVALID_POINTER;
+        // the node object only contains indices to index the actual
+        // objects in the scene. the scene contains all the data,
+        // node is just to keep stuff organized
+        // (like relations between nodes).
+        for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+                struct AP_Model_Mesh_Job job;
+                memset(&job, 0, sizeof(job));
+                job.mesh = scene->mMeshes[node->mMeshes[i]];
+                AP_CHECK( ap_vector_mesh_job_push_back(jobs, job) );
         }
-        // process each mesh located at the current node
-        for (unsigned int i = 0; i < node->mNumMeshes; i++)
-        {
-                // the node object only contains indices to index the actual
-                // objects in the scene. the scene contains all the data,
-                // node is just to keep stuff organized
-                // (like relations between nodes).
-                struct aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-                struct AP_Mesh *mesh_new =
-                        ap_model_process_mesh(model, mesh, scene);
-                ap_model_mesh_push_back(model, mesh_new);
-                ap_mesh_free(mesh_new);
-        }
-
-        // after we've processed all of the meshes (if any)
-        // we then recursively process each of the children nodes
-        for (unsigned int i = 0; i < node->mNumChildren; i++)
-        {
-                ap_model_process_node(model, node->mChildren[i], scene);
+        for (unsigned int i = 0; i < node->mNumChildren; i++) {
+                AP_CHECK( ap_model_collect_meshes(
+                        node->mChildren[i], scene, jobs) );
         }
 
         return 0;
 }
 
-struct AP_Mesh *ap_model_process_mesh(struct AP_Model *model,
-                        struct aiMesh *mesh,
-                        const struct aiScene *scene)
+/**
+ * Worker thread, convert the meshes of jobs in [begin, end)
+ */
+static void ap_model_convert_range(void *param, int begin, int end)
 {
-        if (model == NULL || mesh == NULL || scene == NULL) {
-                return NULL;
+        struct AP_Model_Mesh_Job *jobs = param;
+        for (int i = begin; i < end; ++i) {
+                jobs[i].ret = ap_model_convert_mesh(
+                        jobs[i].mesh, &jobs[i].converted);
+        }
+}
+
+int ap_model_process_node(
+        struct AP_Model_Resource *resource,
+        struct aiNode *node,
+        const struct aiScene *scene,
+        struct AP_Model_Import *import)
+{
+        if (resource == NULL || node == NULL || scene == NULL) {
+                return AP_ERROR_INVALID_POINTER;
         }
-        // data to fill
-        struct AP_Vector vec_vertices;
-        struct AP_Vector vec_indices;
-        struct AP_Vector vec_textures;
 
-        ap_vector_init(&vec_vertices, AP_VECTOR_VERTEX);
-        ap_vector_init(&vec_indices, AP_VECTOR_UINT);
-        ap_vector_init(&vec_textures, AP_VECTOR_TEXTURE);
+        struct AP_Vector jobs;
+        AP_CHECK( ap_vector_init_size(
+                &jobs, sizeof(struct AP_Model_Mesh_Job)) );
+        int ret = ap_model_collect_meshes(node, scene, &jobs);
+        if (ret != 0) {
+                ap_vector_free(&jobs);
+                return ret;
+        }
 
-        // walk through each of the mesh's vertices
-        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-                struct AP_Vertex vertex;
-                // positions
-                vertex.position[0] = mesh->mVertices[i].x;
-                vertex.position[1] = mesh->mVertices[i].y;
-                vertex.position[2] = mesh->mVertices[i].z;
-
-                // normals
-                if (mesh->mNormals != NULL) {
-                        vertex.normal[0] = mesh->mNormals[i].x;
-                        vertex.normal[1] = mesh->mNormals[i].y;
-                        vertex.normal[2] = mesh->mNormals[i].z;
-                }
-                // texture coordinates
-                // does the mesh contain texture coordinates?
-                if(mesh->mTextureCoords[0]) {
-                        /** a vertex can contain up to 8 different texture coordinates.
-                         * We thus make the assumption that we won't
-                         * use models where a vertex can have multiple texture coordinates
-                         * so we always take the first set (0).
-                         */
-                        vertex.tex_coords[0] = mesh->mTextureCoords[0][i].x;
-                        vertex.tex_coords[1] = mesh->mTextureCoords[0][i].y;
-
-                        // tangent
-                        vertex.tangent[0] = mesh->mTangents[i].x;
-                        vertex.tangent[1] = mesh->mTangents[i].y;
-                        vertex.tangent[2] = mesh->mTangents[i].z;
-
-                        // big tangent
-                        vertex.big_tangent[0] = mesh->mBitangents[i].x;
-                        vertex.big_tangent[1] = mesh->mBitangents[i].y;
-                        vertex.big_tangent[2] = mesh->mBitangents[i].z;
-                } else {
-                        vertex.tex_coords[0] = 0.0f;
-                        vertex.tex_coords[1] = 0.0f;
+        // the vertices, indices and bounds of every mesh are converted
+        // by its own job, one mesh a batch as their sizes differ a lot
+        struct AP_Model_Mesh_Job *data = ap_vector_mesh_job_data(&jobs);
+        ret = ap_thread_parallel_for((int) jobs.length, 1,
+                ap_model_convert_range, data);
+
+        // the textures and GL buffers are not thread safe, the meshes
+        // are finished here in order so the model is the same every time,
+        // stop at the first mesh failed
+        for (size_t i = 0; ret == 0 && i < jobs.length; ++i) {
+                struct AP_Model_Mesh_Job *job = &data[i];
+                ret = job->ret;
+                if (ret == 0) {
+                        ret = ap_model_process_mesh(resource, job->mesh,
+                                scene, import, &job->converted);
                 }
+                if (ret == 0) {
+                        ret = ap_model_mesh_push_back(
+                                resource, &job->converted);
+                }
+        }
 
-                // vertices.push_back(vertex);
-                ap_vector_push_back(&vec_vertices, (const char *) &vertex);
+        // the pushed meshes are emptied, the others are released with
+        // the GL buffers created by ap_mesh_setup on the sync path
+        for (size_t i = 0; i < jobs.length; ++i) {
+                ap_mesh_delete_buffers(&data[i].converted);
+                ap_mesh_free(&data[i].converted);
         }
-        // now wak through each of the mesh's faces
-        // (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
-        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        ap_vector_free(&jobs);
+
+        return ret;
+}
+
+/**
+ * Reorder the triangles for the vertex cache and the vertices for
+ * fetching, only the meshes of triangles are reordered
+ */
+static void ap_model_optimize_mesh(
+        struct AP_Vertex *vertices,
+        int vertex_num,
+        unsigned int *indices,
+        int index_num,
+        bool triangles)
+{
+        if (!triangles || index_num % 3 != 0) {
+                return;
+        }
+        float acmr = ap_optimize_acmr(indices, index_num, vertex_num,
+                AP_OPTIMIZE_FIFO_SIZE);
+        if (ap_optimize_vertex_cache(indices, index_num, vertex_num) != 0
+                || ap_optimize_vertex_fetch(
+                        vertices, indices, index_num, vertex_num) != 0)
         {
-                struct aiFace face = mesh->mFaces[i];
-                // retrieve all indices of the face and store them in the indices vector
-                for(unsigned int j = 0; j < face.mNumIndices; j++) {
-                        ap_vector_push_back(&vec_indices, (const char *) &face.mIndices[j]);
+                LOGW("failed to optimize mesh of %d vertices", vertex_num);
+                return;
+        }
+        LOGD("mesh of %d vertices %d triangles: ACMR %.3f -> %.3f",
+                vertex_num, index_num / 3, acmr,
+                ap_optimize_acmr(indices, index_num, vertex_num,
+                        AP_OPTIMIZE_FIFO_SIZE));
+}
+
+/**
+ * Convert the vertices of mesh in one pass, the attributes missing in
+ * mesh are zero
+ */
+static void ap_model_extract_vertices(
+        const struct aiMesh *mesh,
+        struct AP_Vertex *vertices)
+{
+        const struct aiVector3D *positions = mesh->mVertices;
+        const struct aiVector3D *normals = mesh->mNormals;
+        // only the first set of texture coordinates is used
+        const struct aiVector3D *uvs = mesh->mTextureCoords[0];
+        const struct aiVector3D *tangents = mesh->mTangents;
+        const struct aiVector3D *bitangents = mesh->mBitangents;
+        for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
+                struct AP_Vertex *v = &vertices[i];
+                memset(v, 0, sizeof(struct AP_Vertex));
+                v->position[0] = positions[i].x;
+                v->position[1] = positions[i].y;
+                v->position[2] = positions[i].z;
+                if (normals) {
+                        v->normal[0] = normals[i].x;
+                        v->normal[1] = normals[i].y;
+                        v->normal[2] = normals[i].z;
+                }
+                if (uvs) {
+                        v->tex_coords[0] = uvs[i].x;
+                        v->tex_coords[1] = uvs[i].y;
+                }
+                // not generated for the meshes without normals or UVs
+                if (tangents) {
+                        v->tangent[0] = tangents[i].x;
+                        v->tangent[1] = tangents[i].y;
+                        v->tangent[2] = tangents[i].z;
                 }
+                if (bitangents) {
+                        v->big_tangent[0] = bitangents[i].x;
+                        v->big_tangent[1] = bitangents[i].y;
+                        v->big_tangent[2] = bitangents[i].z;
+                }
+        }
+}
+
+/**
+ * Copy the indices of the faces of mesh
+ * @return true if all of the faces are triangles
+ */
+static bool ap_model_extract_indices(
+        const struct aiMesh *mesh,
+        unsigned int *indices)
+{
+        bool triangles = true;
+        for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
+                const struct aiFace *face = &mesh->mFaces[i];
+                triangles = triangles && face->mNumIndices == 3;
+                memcpy(indices, face->mIndices,
+                        sizeof(unsigned int) * face->mNumIndices);
+                indices += face->mNumIndices;
+        }
+        return triangles;
+}
+
+static int ap_model_convert_mesh(
+        const struct aiMesh *mesh,
+        struct AP_Mesh *mesh_new)
+{
+        // the data is written to the arrays moved to mesh_new
+        // without copies between them
+        unsigned int indices_length = 0;
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+                indices_length += mesh->mFaces[i].mNumIndices;
         }
+        struct AP_Vertex *vertices = AP_MALLOC_TAG(
+                sizeof(struct AP_Vertex) * mesh->mNumVertices,
+                AP_MEMORY_TAG_MESH);
+        unsigned int *indices = AP_MALLOC_TAG(
+                sizeof(unsigned int) * indices_length, AP_MEMORY_TAG_MESH);
+        if (vertices == NULL || indices == NULL) {
+                AP_FREE(vertices);
+                AP_FREE(indices);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        ap_model_extract_vertices(mesh, vertices);
+        bool triangles = ap_model_extract_indices(mesh, indices);
+        ap_model_optimize_mesh(vertices, mesh->mNumVertices,
+                indices, indices_length, triangles);
+
+        return ap_mesh_init_move(mesh_new, vertices, mesh->mNumVertices,
+                indices, indices_length, NULL, 0);
+}
+
+int ap_model_process_mesh(struct AP_Model_Resource *resource,
+                        struct aiMesh *mesh,
+                        const struct aiScene *scene,
+                        struct AP_Model_Import *import,
+                        struct AP_Mesh *mesh_new)
+{
+        if (resource == NULL || mesh == NULL || scene == NULL
+                || mesh_new == NULL)
+        {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
         // process materials
         struct aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
         /** we assume a convention for sampler names in the shaders. Each diffuse texture should be
@@ -379,93 +1222,65 @@ struct AP_Mesh *ap_model_process_mesh(struct AP_Model *model,
          * normal: texture_normalN
          */
 
-        // 1. diffuse maps
-        size_t size = sizeof(struct AP_Texture);
-        struct AP_Vector *vec_diffuse_ptr = NULL;
-        vec_diffuse_ptr = ap_model_load_material_textures(
-                model, material,
-                aiTextureType_DIFFUSE, AP_TEXTURE_TYPE_DIFFUSE
-        );
-        if (vec_diffuse_ptr->length > 0) {
-                ap_vector_insert_back(
-                        &vec_textures,
-                        vec_diffuse_ptr->data,
-                        size * vec_diffuse_ptr->length
-                );
+        const struct {
+                enum aiTextureType type;
+                int ap_type;
+        } maps[] = {
+                // 1. diffuse maps
+                { aiTextureType_DIFFUSE, AP_TEXTURE_TYPE_DIFFUSE },
+                // 2. specular maps
+                { aiTextureType_SPECULAR, AP_TEXTURE_TYPE_SPECULAR },
+                // 3. normal maps
+                { aiTextureType_NORMALS, AP_TEXTURE_TYPE_NORMAL },
+                // 4. height maps
+                { aiTextureType_HEIGHT, AP_TEXTURE_TYPE_HEIGHT },
+        };
+        int maps_length = sizeof(maps) / sizeof(maps[0]);
+        // every type has one more texture generated from material color
+        unsigned int textures_capacity = 0;
+        for (int i = 0; i < maps_length; ++i) {
+                textures_capacity +=
+                        aiGetMaterialTextureCount(material, maps[i].type) + 1;
         }
-        ap_vector_free(vec_diffuse_ptr);
-
-        // 2. specular maps
-        struct AP_Vector *vec_specular_ptr = NULL;
-        vec_specular_ptr = ap_model_load_material_textures(
-                model, material,
-                aiTextureType_SPECULAR, AP_TEXTURE_TYPE_SPECULAR
-        );
-        if (vec_specular_ptr->length > 0) {
-                ap_vector_insert_back(
-                        &vec_textures,
-                        vec_specular_ptr->data,
-                        size * vec_specular_ptr->length
-                );
+        struct AP_Texture *textures = AP_MALLOC_TAG(
+                sizeof(struct AP_Texture) * textures_capacity,
+                AP_MEMORY_TAG_MESH);
+        if (textures == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
         }
-        ap_vector_free(vec_specular_ptr);
-
-        // 3. normal maps
-        struct AP_Vector *vec_normal_ptr = NULL;
-        vec_normal_ptr = ap_model_load_material_textures(
-                model, material,
-                aiTextureType_NORMALS, AP_TEXTURE_TYPE_NORMAL
-        );
-        if (vec_normal_ptr->length > 0) {
-                ap_vector_insert_back(
-                        &vec_textures,
-                        vec_normal_ptr->data,
-                        size * vec_normal_ptr->length
+        int textures_length = 0;
+        for (int i = 0; i < maps_length; ++i) {
+                ap_model_load_material_textures(
+                        resource, material, maps[i].type, maps[i].ap_type,
+                        textures, &textures_length, import
                 );
         }
-        ap_vector_free(vec_normal_ptr);
 
-        // 4. height maps
-        struct AP_Vector *vec_height_ptr;
-        vec_height_ptr = ap_model_load_material_textures(
-                model, material,
-                aiTextureType_HEIGHT, AP_TEXTURE_TYPE_HEIGHT
-        );
-        if (vec_height_ptr->length > 0) {
-                ap_vector_insert_back(
-                        &vec_textures,
-                        vec_height_ptr->data,
-                        size * vec_height_ptr->length
-                );
+        mesh_new->textures = textures;
+        mesh_new->texture_length = textures_length;
+        mesh_new->vertex_format = import
+                ? import->vertex_format : model_vertex_format;
+
+        // the GL buffers of imported model are created on render thread
+        if (!import) {
+                return ap_mesh_setup(mesh_new);
         }
-        ap_vector_free(vec_height_ptr);
-
-        // return a mesh object created from the extracted mesh data
-        static struct AP_Mesh mesh_buffer;
-        ap_mesh_init(
-                &mesh_buffer,
-                (struct AP_Vertex *) vec_vertices.data,
-                vec_vertices.length,
-                (unsigned int *) vec_indices.data,
-                vec_indices.length,
-                (struct AP_Texture *) vec_textures.data,
-                vec_textures.length
-        );
-        ap_vector_free(&vec_vertices);
-        ap_vector_free(&vec_indices);
-        ap_vector_free(&vec_textures);
 
-        return &mesh_buffer;
+        return 0;
 }
 
-struct AP_Vector *ap_model_load_material_textures(
-        struct AP_Model *model,
+int ap_model_load_material_textures(
+        struct AP_Model_Resource *resource,
         struct aiMaterial *mat,
         enum aiTextureType type,
-        int ap_type)
+        int ap_type,
+        struct AP_Texture *textures,
+        int *length,
+        struct AP_Model_Import *import)
 {
-        static struct AP_Vector vec_texture;
-        ap_vector_init(&vec_texture, AP_VECTOR_TEXTURE);
+        if (textures == NULL || length == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
 
         GLuint mat_texture_count = aiGetMaterialTextureCount(mat, type);
         for (GLuint i = 0; i < mat_texture_count; i++)
@@ -475,18 +1290,8 @@ struct AP_Vector *ap_model_load_material_textures(
                         mat, type, i, &str,
                         NULL, NULL, NULL, NULL, NULL, NULL
                 );
-                struct AP_Texture *ptr = NULL;
-                ptr = ap_texture_get_ptr_by_path(str.data);
-                if (ptr == NULL) {
-                        GLuint texture_id = 0;
-                        ap_texture_generate(&texture_id, ap_type,
-                                str.data, model->directory, false);
-                        ptr = ap_texture_get_ptr(texture_id);
-                }
-                if (ptr) {
-                        ap_vector_push_back(&vec_texture, (char*) ptr);
-                        ap_model_texture_loaded_push_back(model, ptr);
-                }
+                ap_model_load_texture(resource, str.data, NULL, ap_type,
+                        import, textures, length);
         }
 
         struct aiColor4D ai_color = { 0.f, 0.f, 0.f, 0.0f };
@@ -497,88 +1302,164 @@ struct AP_Vector *ap_model_load_material_textures(
         }
 
         if (!(ai_color.r || ai_color.g || ai_color.b)) {
-                return &vec_texture;
+                return 0;
         }
 
-        unsigned int id = 0;
         vec4 color = { 0.0f };
         memcpy(color, &ai_color, sizeof(float) * 4);
-        struct AP_Texture *ptr = ap_texture_get_ptr_by_RGBA(color);
-        if (ptr == NULL) {
-                ap_texture_generate_RGBA(
-                        &id, color, 16, AP_TEXTURE_TYPE_DIFFUSE
-                );
+        return ap_model_load_texture(resource, NULL, color,
+                AP_TEXTURE_TYPE_DIFFUSE, import, textures, length);
+}
+
+static int ap_model_load_texture(
+        struct AP_Model_Resource *resource,
+        const char *path,
+        float color[4],
+        int ap_type,
+        struct AP_Model_Import *import,
+        struct AP_Texture *textures,
+        int *length)
+{
+        struct AP_Texture requested;
+        struct AP_Texture *ptr = NULL;
+        if (import) {
+                if (ap_model_import_texture(import, path, color,
+                        ap_type, &requested) == 0)
+                {
+                        ptr = &requested;
+                }
+        } else {
+                // shared if generated already, the reference is held
+                // by the texture pushed to resource
+                unsigned int id = 0;
+                if (path) {
+                        ap_texture_generate(&id, ap_type,
+                                path, resource->directory, false);
+                } else {
+                        ap_texture_generate_RGBA(&id, color, 16, ap_type);
+                }
                 ptr = ap_texture_get_ptr(id);
         }
-        if (ptr) {
-                ap_vector_push_back(&vec_texture, (char*) ptr);
-                ap_model_texture_loaded_push_back(model, ptr);
+        if (ptr == NULL) {
+                return AP_ERROR_TEXTURE_FAILED;
+        }
+        textures[(*length)++] = *ptr;
+        if (ap_model_texture_loaded_push_back(resource, ptr) != 0) {
+                ap_texture_release(ptr->handle);
         }
 
-        return &vec_texture;
+        return 0;
+}
+
+static int ap_model_import_texture(
+        struct AP_Model_Import *import,
+        const char *path,
+        float color[4],
+        int ap_type,
+        struct AP_Texture *texture)
+{
+        struct AP_Model_Texture_Request *requests =
+                ap_vector_texture_request_data(&import->requests);
+        size_t index = 0;
+        for (; index < import->requests.length; ++index) {
+                struct AP_Model_Texture_Request *r = &requests[index];
+                if (path && r->path && strcmp(path, r->path) == 0) {
+                        break;
+                }
+                if (path == NULL && r->path == NULL
+                        && EQUAL(color[0], r->RGBA[0])
+                        && EQUAL(color[1], r->RGBA[1])
+                        && EQUAL(color[2], r->RGBA[2])
+                        && EQUAL(color[3], r->RGBA[3]))
+                {
+                        break;
+                }
+        }
+        if (index == import->requests.length) {
+                struct AP_Model_Texture_Request request;
+                memset(&request, 0, sizeof(request));
+                request.type = ap_type;
+                if (path) {
+                        request.path = AP_MALLOC_TAG(
+                                strlen(path) + 1, AP_MEMORY_TAG_MODEL);
+                        if (request.path == NULL) {
+                                return AP_ERROR_MALLOC_FAILED;
+                        }
+                        strcpy(request.path, path);
+                } else {
+                        memcpy(request.RGBA, color, sizeof(float) * 4);
+                }
+                int ret = ap_vector_texture_request_push_back(
+                        &import->requests, request);
+                if (ret != 0) {
+                        AP_FREE(request.path);
+                        return ret;
+                }
+        }
+
+        struct AP_Model_Texture_Request *request =
+                ap_vector_texture_request_at(&import->requests, index);
+        ap_texture_init(texture);
+        texture->id = index + 1;
+        texture->type = request->type;
+        texture->path = request->path;
+        memcpy(texture->RGBA, request->RGBA, sizeof(float) * 4);
+
+        return 0;
 }
 
 int ap_model_texture_loaded_push_back(
-        struct AP_Model *model,
+        struct AP_Model_Resource *resource,
         struct AP_Texture *texture)
 {
-        if (model == NULL || texture == NULL) {
+        if (resource == NULL || texture == NULL) {
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
         // add a new texture struct object into model
-        model->texture = AP_REALLOC(model->texture,
-                sizeof(struct AP_Texture) * (model->texture_length + 1));
-        if (model->texture == NULL) {
+        resource->texture = AP_REALLOC_TAG(resource->texture,
+                sizeof(struct AP_Texture) * (resource->texture_length + 1),
+                AP_MEMORY_TAG_MODEL);
+        if (resource->texture == NULL) {
                 LOGE("realloc error");
                 return AP_ERROR_MALLOC_FAILED;
         }
         struct AP_Texture *texture_new =
-                model->texture + (model->texture_length);
-        model->texture_length++;
+                resource->texture + (resource->texture_length);
+        resource->texture_length++;
         ap_texture_init(texture_new);
         texture_new->type = texture->type;
         ap_texture_set_path(texture_new, texture->path);
         texture_new->id = texture->id;
+        texture_new->handle = texture->handle;
         memcpy(texture_new->RGBA, texture->RGBA, sizeof(float) * 4);
 
         return 0;
 }
 
-int ap_model_mesh_push_back(struct AP_Model *model, struct AP_Mesh *mesh)
+int ap_model_mesh_push_back(
+        struct AP_Model_Resource *resource,
+        struct AP_Mesh *mesh)
 {
-        if (model == NULL || mesh == NULL) {
+        if (resource == NULL || mesh == NULL) {
                 LOGE("Model mesh push back param error.");
                 return AP_ERROR_INVALID_POINTER;
         }
 
         // add a new mesh struct object into model
-        model->mesh = AP_REALLOC(
-                model->mesh,
-                sizeof(struct AP_Mesh) * (model->mesh_length + 1)
+        struct AP_Mesh *meshes = AP_REALLOC_TAG(
+                resource->mesh,
+                sizeof(struct AP_Mesh) * (resource->mesh_length + 1),
+                AP_MEMORY_TAG_MODEL
         );
-        if (model->mesh == NULL) {
+        if (meshes == NULL) {
                 LOGE("Realloc error.");
                 return AP_ERROR_MALLOC_FAILED;
         }
-        struct AP_Mesh *mesh_ptr = &model->mesh[model->mesh_length];
-        model->mesh_length++;
-        // copy old mesh data memory to new mesh
-        ap_mesh_copy(mesh_ptr, mesh);
-
-        return 0;
-}
-
-static int ap_model_draw_ptr_shader(
-        struct AP_Model *model, unsigned int shader)
-{
-        if (model == NULL) {
-                return AP_ERROR_INVALID_POINTER;
-        }
-
-        for (int i = 0; i < model->mesh_length; ++i) {
-                ap_mesh_draw(&model->mesh[i], shader);
-        }
+        resource->mesh = meshes;
+        // move the arrays of mesh instead of copying them
+        resource->mesh[resource->mesh_length++] = *mesh;
+        memset(mesh, 0, sizeof(struct AP_Mesh));
 
         return 0;
 }
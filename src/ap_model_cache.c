@@ -0,0 +1,412 @@
+// mmap, stat and getpid are not a part of C11
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "ap_utils.h"
+#include "ap_model_cache.h"
+#include "ap_vertex.h"
+#include "ap_arena.h"
+
+#define AP_MODEL_CACHE_ALIGN_UP(x) (((x) + AP_MODEL_CACHE_ALIGN - 1) \
+        & ~(uint64_t) (AP_MODEL_CACHE_ALIGN - 1))
+
+// makes the temporary files of the writers in this process different
+static atomic_uint cache_write_count;
+
+int ap_model_cache_key(
+        const char *path,
+        uint32_t import_flags,
+        int vertex_format,
+        struct AP_Model_Cache_Key *key)
+{
+        if (path == NULL || key == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        struct stat st;
+        if (stat(path, &st) != 0) {
+                return AP_ERROR_ASSET_OPEN_FAILED;
+        }
+        memset(key, 0, sizeof(struct AP_Model_Cache_Key));
+        key->mtime = (int64_t) st.st_mtime;
+        key->size = (int64_t) st.st_size;
+        key->import_flags = import_flags;
+        key->vertex_format = vertex_format;
+
+        return 0;
+}
+
+int ap_model_cache_path(
+        const char *dir,
+        const char *path,
+        char *out,
+        size_t size)
+{
+        if (dir == NULL || path == NULL || out == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        int n = snprintf(out, size, "%s/%08x%s",
+                dir, ap_hash_str(path), AP_MODEL_CACHE_SUFFIX);
+        if (n < 0 || (size_t) n >= size) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        return 0;
+}
+
+static bool ap_model_cache_key_equal(
+        const struct AP_Model_Cache_Key *a,
+        const struct AP_Model_Cache_Key *b)
+{
+        return a->mtime == b->mtime && a->size == b->size
+                && a->import_flags == b->import_flags
+                && a->vertex_format == b->vertex_format;
+}
+
+static bool ap_model_cache_in_range(
+        const struct AP_Model_Cache *cache, uint64_t offset, uint64_t size)
+{
+        return offset <= cache->size && size <= cache->size - offset;
+}
+
+/**
+ * Check the offsets and sizes of the mapped file are in range,
+ * a truncated or corrupted file is never read out of range
+ */
+static bool ap_model_cache_valid(const struct AP_Model_Cache *cache)
+{
+        const struct AP_Model_Cache_Header *header = cache->header;
+        if (!ap_model_cache_in_range(cache, header->mesh_offset,
+                        (uint64_t) header->mesh_num
+                        * sizeof(struct AP_Model_Cache_Mesh))
+                || !ap_model_cache_in_range(cache, header->texture_offset,
+                        (uint64_t) header->texture_num
+                        * sizeof(struct AP_Model_Cache_Texture))
+                || !ap_model_cache_in_range(cache, header->string_offset,
+                        header->string_size)
+                || header->string_size == 0)
+        {
+                return false;
+        }
+        const char *strings = ap_model_cache_blob(cache,
+                header->string_offset);
+        if (strings[header->string_size - 1] != '\0') {
+                return false;
+        }
+
+        const struct AP_Model_Cache_Mesh *meshes = ap_model_cache_blob(
+                cache, header->mesh_offset);
+        for (uint32_t i = 0; i < header->mesh_num; ++i) {
+                const struct AP_Model_Cache_Mesh *m = &meshes[i];
+                const struct AP_Vertex_Layout *layout =
+                        ap_vertex_get_layout(m->vertex_format);
+                if (layout == NULL
+                        || (m->index_size != 2 && m->index_size != 4)
+                        || !ap_model_cache_in_range(cache, m->vertex_offset,
+                                (uint64_t) m->vertex_num * layout->stride)
+                        || !ap_model_cache_in_range(cache, m->index_offset,
+                                (uint64_t) m->index_num * m->index_size)
+                        || m->texture_first > header->texture_num
+                        || m->texture_num
+                                > header->texture_num - m->texture_first)
+                {
+                        return false;
+                }
+        }
+        const struct AP_Model_Cache_Texture *textures = ap_model_cache_blob(
+                cache, header->texture_offset);
+        for (uint32_t i = 0; i < header->texture_num; ++i) {
+                if (textures[i].path != AP_MODEL_CACHE_NO_PATH
+                        && textures[i].path >= header->string_size)
+                {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+int ap_model_cache_open(
+        const char *cache_path,
+        const char *source,
+        const struct AP_Model_Cache_Key *key,
+        struct AP_Model_Cache *cache)
+{
+        if (cache_path == NULL || source == NULL
+                || key == NULL || cache == NULL)
+        {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        memset(cache, 0, sizeof(struct AP_Model_Cache));
+
+        int fd = open(cache_path, O_RDONLY);
+        if (fd < 0) {
+                return AP_ERROR_ASSET_OPEN_FAILED;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0
+                || st.st_size < (off_t) sizeof(struct AP_Model_Cache_Header))
+        {
+                close(fd);
+                return AP_ERROR_ASSET_OPEN_FAILED;
+        }
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file, fd is not needed anymore
+        close(fd);
+        if (data == MAP_FAILED) {
+                LOGW("failed to map model cache %s", cache_path);
+                return AP_ERROR_ASSET_OPEN_FAILED;
+        }
+        cache->data = data;
+        cache->size = st.st_size;
+        cache->header = data;
+
+        const struct AP_Model_Cache_Header *header = cache->header;
+        if (memcmp(header->magic, AP_MODEL_CACHE_MAGIC, 4) != 0
+                || header->version != AP_MODEL_CACHE_VERSION
+                || header->file_size != cache->size
+                || !ap_model_cache_key_equal(&header->key, key)
+                || !ap_model_cache_valid(cache))
+        {
+                ap_model_cache_close(cache);
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        cache->meshes = ap_model_cache_blob(cache, header->mesh_offset);
+        cache->textures = ap_model_cache_blob(cache, header->texture_offset);
+        cache->strings = ap_model_cache_blob(cache, header->string_offset);
+        // the hash of another path may name the same file
+        if (strcmp(cache->strings, source) != 0) {
+                ap_model_cache_close(cache);
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        return 0;
+}
+
+int ap_model_cache_close(struct AP_Model_Cache *cache)
+{
+        if (cache == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (cache->data) {
+                munmap(cache->data, cache->size);
+        }
+        memset(cache, 0, sizeof(struct AP_Model_Cache));
+
+        return 0;
+}
+
+static bool ap_model_cache_write_at(FILE *fp, uint64_t offset)
+{
+        // pad the file up to offset
+        static const char zeros[AP_MODEL_CACHE_ALIGN] = { 0 };
+        long position = ftell(fp);
+        if (position < 0 || (uint64_t) position > offset) {
+                return false;
+        }
+        size_t n = offset - position;
+        return fwrite(zeros, 1, n, fp) == n;
+}
+
+static int ap_model_cache_write_meshes(
+        FILE *fp,
+        const struct AP_Mesh *meshes,
+        const struct AP_Model_Cache_Mesh *records,
+        int mesh_num)
+{
+        struct AP_Arena *arena = ap_arena_frame();
+        for (int i = 0; i < mesh_num; ++i) {
+                const struct AP_Mesh *mesh = &meshes[i];
+                const struct AP_Model_Cache_Mesh *r = &records[i];
+                const struct AP_Vertex_Layout *layout =
+                        ap_vertex_get_layout(r->vertex_format);
+                size_t vertex_size = (size_t) r->vertex_num * layout->stride;
+                size_t index_size = (size_t) r->index_num * r->index_size;
+
+                struct AP_Arena_Marker marker = ap_arena_mark(arena);
+                void *vertices = ap_arena_alloc(arena, vertex_size);
+                void *indices = ap_arena_alloc(arena, index_size);
+                if ((vertex_size && vertices == NULL)
+                        || (index_size && indices == NULL))
+                {
+                        ap_arena_rewind(arena, marker);
+                        return AP_ERROR_MALLOC_FAILED;
+                }
+                ap_vertex_pack(r->vertex_format, mesh->vertices,
+                        r->vertex_num, vertices);
+                if (r->index_size == sizeof(uint16_t)) {
+                        uint16_t *short_indices = indices;
+                        for (uint32_t j = 0; j < r->index_num; ++j) {
+                                short_indices[j] = mesh->indices[j];
+                        }
+                } else {
+                        memcpy(indices, mesh->indices, index_size);
+                }
+
+                bool ok = ap_model_cache_write_at(fp, r->vertex_offset)
+                        && fwrite(vertices, 1, vertex_size, fp) == vertex_size
+                        && ap_model_cache_write_at(fp, r->index_offset)
+                        && fwrite(indices, 1, index_size, fp) == index_size;
+                ap_arena_rewind(arena, marker);
+                if (!ok) {
+                        return AP_ERROR_UNKNOWN;
+                }
+        }
+
+        return 0;
+}
+
+int ap_model_cache_write(
+        const char *cache_path,
+        const char *source,
+        const struct AP_Model_Cache_Key *key,
+        const struct AP_Mesh *meshes,
+        int mesh_num)
+{
+        if (cache_path == NULL || source == NULL || key == NULL
+                || (mesh_num > 0 && meshes == NULL))
+        {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        for (int i = 0; i < mesh_num; ++i) {
+                if (meshes[i].vertices == NULL || meshes[i].indices == NULL
+                        || ap_vertex_get_layout(meshes[i].vertex_format)
+                                == NULL)
+                {
+                        return AP_ERROR_INVALID_PARAMETER;
+                }
+        }
+
+        struct AP_Model_Cache_Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, AP_MODEL_CACHE_MAGIC, 4);
+        header.version = AP_MODEL_CACHE_VERSION;
+        header.key = *key;
+        header.mesh_num = mesh_num;
+        header.string_size = strlen(source) + 1;
+        for (int i = 0; i < mesh_num; ++i) {
+                header.texture_num += meshes[i].texture_length;
+                for (int j = 0; j < meshes[i].texture_length; ++j) {
+                        const char *path = meshes[i].textures[j].path;
+                        header.string_size += path ? strlen(path) + 1 : 0;
+                }
+        }
+        header.mesh_offset = sizeof(header);
+        header.texture_offset = header.mesh_offset
+                + sizeof(struct AP_Model_Cache_Mesh) * header.mesh_num;
+        header.string_offset = header.texture_offset
+                + sizeof(struct AP_Model_Cache_Texture) * header.texture_num;
+
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        struct AP_Model_Cache_Mesh *records = ap_arena_alloc(arena,
+                sizeof(struct AP_Model_Cache_Mesh) * (mesh_num + 1));
+        struct AP_Model_Cache_Texture *textures = ap_arena_alloc(arena,
+                sizeof(struct AP_Model_Cache_Texture)
+                * (header.texture_num + 1));
+        char *strings = ap_arena_alloc(arena, header.string_size);
+        if (!records || !textures || !strings) {
+                ap_arena_rewind(arena, marker);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+
+        // the tables and strings, then the blobs of each mesh
+        uint64_t offset = header.string_offset + header.string_size;
+        uint32_t string_length = strlen(source) + 1;
+        uint32_t texture_index = 0;
+        memcpy(strings, source, string_length);
+        for (int i = 0; i < mesh_num; ++i) {
+                const struct AP_Mesh *mesh = &meshes[i];
+                struct AP_Model_Cache_Mesh *r = &records[i];
+                memset(r, 0, sizeof(struct AP_Model_Cache_Mesh));
+                r->vertex_num = mesh->vertices_length;
+                r->index_num = mesh->indices_length;
+                r->vertex_format = mesh->vertex_format;
+                // the same rule as ap_mesh_setup
+                r->index_size = mesh->vertices_length
+                        <= AP_MESH_SHORT_INDEX_MAX ? 2 : 4;
+                r->texture_first = texture_index;
+                r->texture_num = mesh->texture_length;
+                memcpy(r->aabb, mesh->aabb, sizeof(r->aabb));
+                memcpy(r->sphere, mesh->sphere, sizeof(r->sphere));
+                r->vertex_offset = AP_MODEL_CACHE_ALIGN_UP(offset);
+                offset = r->vertex_offset + (uint64_t) r->vertex_num
+                        * ap_vertex_get_layout(r->vertex_format)->stride;
+                r->index_offset = AP_MODEL_CACHE_ALIGN_UP(offset);
+                offset = r->index_offset
+                        + (uint64_t) r->index_num * r->index_size;
+
+                for (int j = 0; j < mesh->texture_length; ++j) {
+                        const struct AP_Texture *t = &mesh->textures[j];
+                        struct AP_Model_Cache_Texture *c =
+                                &textures[texture_index++];
+                        c->type = t->type;
+                        c->path = AP_MODEL_CACHE_NO_PATH;
+                        memcpy(c->RGBA, t->RGBA, sizeof(c->RGBA));
+                        if (t->path) {
+                                size_t n = strlen(t->path) + 1;
+                                memcpy(strings + string_length, t->path, n);
+                                c->path = string_length;
+                                string_length += n;
+                        }
+                }
+        }
+        header.file_size = offset;
+
+        // write to a temporary file and rename it,
+        // the readers see the old file or the complete new one
+        char tmp_path[AP_MODEL_CACHE_PATH_LENGTH];
+        snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.%u.tmp", cache_path,
+                (long) getpid(), atomic_fetch_add(&cache_write_count, 1));
+        char *dir_end = strrchr(tmp_path, '/');
+        if (dir_end) {
+                *dir_end = '\0';
+                if (mkdir(tmp_path, 0755) != 0 && errno != EEXIST) {
+                        LOGW("failed to create model cache dir %s",
+                                tmp_path);
+                }
+                *dir_end = '/';
+        }
+        FILE *fp = fopen(tmp_path, "wb");
+        if (fp == NULL) {
+                LOGW("failed to write model cache %s", tmp_path);
+                ap_arena_rewind(arena, marker);
+                return AP_ERROR_ASSET_OPEN_FAILED;
+        }
+        int ret = 0;
+        if (fwrite(&header, sizeof(header), 1, fp) != 1
+                || fwrite(records, sizeof(struct AP_Model_Cache_Mesh),
+                        mesh_num, fp) != (size_t) mesh_num
+                || fwrite(textures, sizeof(struct AP_Model_Cache_Texture),
+                        header.texture_num, fp) != header.texture_num
+                || fwrite(strings, 1, header.string_size, fp)
+                        != header.string_size)
+        {
+                ret = AP_ERROR_UNKNOWN;
+        }
+        if (ret == 0) {
+                ret = ap_model_cache_write_meshes(
+                        fp, meshes, records, mesh_num);
+        }
+        if (fclose(fp) != 0 && ret == 0) {
+                ret = AP_ERROR_UNKNOWN;
+        }
+        ap_arena_rewind(arena, marker);
+        if (ret == 0 && rename(tmp_path, cache_path) != 0) {
+                ret = AP_ERROR_UNKNOWN;
+        }
+        if (ret != 0) {
+                LOGW("failed to write model cache %s", cache_path);
+                remove(tmp_path);
+        }
+
+        return ret;
+}
@@ -14,11 +14,17 @@ size_t write_func_cb(char *data, size_t size, size_t count, void *arg)
 {
         size_t length = size * count;
         char *dst = (char *)arg;
-        char *src = malloc(length + 1);
-        memcpy(src, data, length);
-        src[length] = '\0';
-        strncat(dst, src, MAX_RESPONSE_LENGTH - strlen(dst) - 1);
-        free(src);
+        // append into the response buffer directly, data is not
+        // null-terminated so the length is bounded by hand
+        size_t used = strlen(dst);
+        size_t room = MAX_RESPONSE_LENGTH - used - 1;
+        size_t n = length < room ? length : room;
+        const char *end = memchr(data, '\0', n);
+        if (end) {
+                n = end - data;
+        }
+        memcpy(dst + used, data, n);
+        dst[used + n] = '\0';
         return length;
 }
 
@@ -0,0 +1,283 @@
+#include <math.h>
+
+#include "ap_utils.h"
+#include "ap_optimize.h"
+
+// the triangles whose vertices are all in cache are never more than
+// the cache entries after adding the 3 vertices of a triangle
+#define AP_OPTIMIZE_LRU_SIZE (AP_OPTIMIZE_CACHE_SIZE + 3)
+
+struct AP_Optimize_Vertex {
+        int cache_pos;          // position in LRU cache, -1 if not cached
+        int active;             // number of triangles not emitted
+        int offset;             // first triangle in adjacency
+        float score;
+};
+
+/**
+ * Score of a vertex: the vertices used recently and the vertices of few
+ * triangles left are preferred
+ */
+static float ap_optimize_score(const struct AP_Optimize_Vertex *v)
+{
+        if (v->active == 0) {
+                return -1.0f;
+        }
+        float score = 0.0f;
+        if (v->cache_pos >= 0) {
+                if (v->cache_pos < 3) {
+                        // the last triangle, fixed score so the
+                        // triangles next to it are not always taken
+                        score = 0.75f;
+                } else {
+                        float scale = 1.0f / (AP_OPTIMIZE_CACHE_SIZE - 3);
+                        score = powf(1.0f - (v->cache_pos - 3) * scale,
+                                1.5f);
+                }
+        }
+        return score + 2.0f * powf((float) v->active, -0.5f);
+}
+
+int ap_optimize_vertex_cache(
+        unsigned int *indices,
+        int index_num,
+        int vertex_num)
+{
+        if (index_num > 0 && indices == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (index_num % 3 != 0 || vertex_num < 0) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        int tri_num = index_num / 3;
+        if (tri_num == 0) {
+                return 0;
+        }
+        for (int i = 0; i < index_num; ++i) {
+                if (indices[i] >= (unsigned int) vertex_num) {
+                        return AP_ERROR_INVALID_PARAMETER;
+                }
+        }
+
+        struct AP_Optimize_Vertex *vertices = AP_MALLOC(
+                sizeof(struct AP_Optimize_Vertex) * vertex_num);
+        // triangles of each vertex, the emitted ones are removed
+        int *adjacency = AP_MALLOC(sizeof(int) * index_num);
+        float *tri_scores = AP_MALLOC(sizeof(float) * tri_num);
+        bool *emitted = AP_MALLOC(sizeof(bool) * tri_num);
+        unsigned int *output = AP_MALLOC(sizeof(unsigned int) * index_num);
+        if (!vertices || !adjacency || !tri_scores || !emitted || !output) {
+                AP_FREE(vertices);
+                AP_FREE(adjacency);
+                AP_FREE(tri_scores);
+                AP_FREE(emitted);
+                AP_FREE(output);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+
+        memset(vertices, 0, sizeof(struct AP_Optimize_Vertex) * vertex_num);
+        for (int i = 0; i < index_num; ++i) {
+                vertices[indices[i]].active++;
+        }
+        int offset = 0;
+        for (int i = 0; i < vertex_num; ++i) {
+                vertices[i].offset = offset;
+                offset += vertices[i].active;
+                vertices[i].active = 0;
+                vertices[i].cache_pos = -1;
+        }
+        for (int t = 0; t < tri_num; ++t) {
+                for (int k = 0; k < 3; ++k) {
+                        struct AP_Optimize_Vertex *v =
+                                &vertices[indices[3 * t + k]];
+                        adjacency[v->offset + v->active++] = t;
+                }
+        }
+        for (int i = 0; i < vertex_num; ++i) {
+                vertices[i].score = ap_optimize_score(&vertices[i]);
+        }
+        int best = 0;
+        for (int t = 0; t < tri_num; ++t) {
+                tri_scores[t] = vertices[indices[3 * t]].score
+                        + vertices[indices[3 * t + 1]].score
+                        + vertices[indices[3 * t + 2]].score;
+                if (tri_scores[t] > tri_scores[best]) {
+                        best = t;
+                }
+        }
+        memset(emitted, 0, sizeof(bool) * tri_num);
+
+        int cache[AP_OPTIMIZE_LRU_SIZE];
+        int cache_num = 0;
+        int scan = 0;           // triangles before scan are all emitted
+        for (int n = 0; n < tri_num; ++n) {
+                if (best < 0) {
+                        // nothing in cache has triangles left
+                        while (emitted[scan]) {
+                                ++scan;
+                        }
+                        best = scan;
+                }
+                const unsigned int *tri = &indices[3 * best];
+                memcpy(&output[3 * n], tri, sizeof(unsigned int) * 3);
+                emitted[best] = true;
+
+                // remove the triangle from its vertices
+                for (int k = 0; k < 3; ++k) {
+                        struct AP_Optimize_Vertex *v = &vertices[tri[k]];
+                        int *list = adjacency + v->offset;
+                        for (int i = 0; i < v->active; ++i) {
+                                if (list[i] == best) {
+                                        list[i] = list[--v->active];
+                                        break;
+                                }
+                        }
+                }
+
+                // move the vertices of the triangle to the front
+                int new_cache[AP_OPTIMIZE_LRU_SIZE];
+                int new_num = 0;
+                for (int k = 0; k < 3; ++k) {
+                        new_cache[new_num++] = tri[k];
+                }
+                for (int i = 0; i < cache_num; ++i) {
+                        int c = cache[i];
+                        if (c != (int) tri[0] && c != (int) tri[1]
+                                && c != (int) tri[2])
+                        {
+                                new_cache[new_num++] = c;
+                        }
+                }
+                cache_num = new_num;
+                for (int i = 0; i < new_num; ++i) {
+                        cache[i] = new_cache[i];
+                        struct AP_Optimize_Vertex *v = &vertices[cache[i]];
+                        v->cache_pos = i < AP_OPTIMIZE_CACHE_SIZE ? i : -1;
+                        v->score = ap_optimize_score(v);
+                }
+                if (cache_num > AP_OPTIMIZE_CACHE_SIZE) {
+                        cache_num = AP_OPTIMIZE_CACHE_SIZE;
+                }
+
+                // only the triangles of the vertices updated are changed,
+                // the vertices pushed out are updated above
+                best = -1;
+                float best_score = -1.0f;
+                for (int i = 0; i < new_num; ++i) {
+                        struct AP_Optimize_Vertex *v =
+                                &vertices[new_cache[i]];
+                        int *list = adjacency + v->offset;
+                        for (int j = 0; j < v->active; ++j) {
+                                int t = list[j];
+                                tri_scores[t] = vertices[indices[3 * t]].score
+                                        + vertices[indices[3 * t + 1]].score
+                                        + vertices[indices[3 * t + 2]].score;
+                                if (tri_scores[t] > best_score) {
+                                        best_score = tri_scores[t];
+                                        best = t;
+                                }
+                        }
+                }
+        }
+
+        memcpy(indices, output, sizeof(unsigned int) * index_num);
+        AP_FREE(vertices);
+        AP_FREE(adjacency);
+        AP_FREE(tri_scores);
+        AP_FREE(emitted);
+        AP_FREE(output);
+
+        return 0;
+}
+
+int ap_optimize_vertex_fetch(
+        struct AP_Vertex *vertices,
+        unsigned int *indices,
+        int index_num,
+        int vertex_num)
+{
+        if ((vertex_num > 0 && vertices == NULL)
+                || (index_num > 0 && indices == NULL))
+        {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (vertex_num <= 0) {
+                return 0;
+        }
+
+        // new index of each vertex, UINT_MAX until used
+        unsigned int *remap = AP_MALLOC(sizeof(unsigned int) * vertex_num);
+        struct AP_Vertex *copy = AP_MALLOC(
+                sizeof(struct AP_Vertex) * vertex_num);
+        if (remap == NULL || copy == NULL) {
+                AP_FREE(remap);
+                AP_FREE(copy);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        memset(remap, 0xFF, sizeof(unsigned int) * vertex_num);
+        memcpy(copy, vertices, sizeof(struct AP_Vertex) * vertex_num);
+
+        unsigned int next = 0;
+        for (int i = 0; i < index_num; ++i) {
+                unsigned int index = indices[i];
+                if (index >= (unsigned int) vertex_num) {
+                        AP_FREE(remap);
+                        AP_FREE(copy);
+                        return AP_ERROR_INVALID_PARAMETER;
+                }
+                if (remap[index] == 0xFFFFFFFFu) {
+                        remap[index] = next++;
+                }
+        }
+        for (int i = 0; i < vertex_num; ++i) {
+                if (remap[i] == 0xFFFFFFFFu) {
+                        remap[i] = next++;
+                }
+                vertices[remap[i]] = copy[i];
+        }
+        for (int i = 0; i < index_num; ++i) {
+                indices[i] = remap[indices[i]];
+        }
+
+        AP_FREE(remap);
+        AP_FREE(copy);
+
+        return 0;
+}
+
+float ap_optimize_acmr(
+        const unsigned int *indices,
+        int index_num,
+        int vertex_num,
+        int cache_size)
+{
+        if (indices == NULL || index_num < 3 || vertex_num <= 0
+                || cache_size <= 0)
+        {
+                return 0.0f;
+        }
+
+        // time a vertex entered the FIFO, a vertex is in the cache if
+        // less than cache_size misses happened after it entered
+        long *entered = AP_MALLOC(sizeof(long) * vertex_num);
+        if (entered == NULL) {
+                return 0.0f;
+        }
+        for (int i = 0; i < vertex_num; ++i) {
+                entered[i] = -1 - (long) cache_size;
+        }
+        long misses = 0;
+        for (int i = 0; i < index_num; ++i) {
+                unsigned int index = indices[i];
+                if (index >= (unsigned int) vertex_num) {
+                        continue;
+                }
+                if (misses - entered[index] > cache_size) {
+                        entered[index] = misses;
+                        misses++;
+                }
+        }
+        AP_FREE(entered);
+
+        return (float) misses / (index_num / 3);
+}
@@ -4,6 +4,8 @@
 #include "ap_camera.h"
 #include "ap_render.h"
 #include "ap_math.h"
+#include "ap_pool.h"
+#include "ap_slot_map.h"
 
 #include  "cglm/cglm.h"
 
@@ -20,17 +22,42 @@ static int ap_creature_process_barrier_ptr(
         struct AP_PBarrier *barrier,
         bool *on_top);
 
-struct AP_Vector creature_vector = { 0, 0, 0, 0 };
-struct AP_Vector barrier_vector  = { 0, 0, 0, 0 };
+// objects are stored in pools so their addresses never change,
+// the slot maps hold their pointers, the IDs are the slot map handles
+static struct AP_Pool creature_pool;
+static struct AP_Pool barrier_pool;
+static struct AP_Slot_Map creature_map;
+static struct AP_Slot_Map barrier_map;
+static bool physic_initialized = false;
 struct AP_PCreature *creature_using = NULL;
 
 int ap_physic_init()
 {
-        if (creature_vector.data && barrier_vector.data) {
+        if (physic_initialized) {
                 return 0;
         }
-        ap_vector_init(&creature_vector, AP_VECTOR_PCREATURE);
-        ap_vector_init(&barrier_vector,  AP_VECTOR_PBARRIER);
+        ap_pool_init(&creature_pool, sizeof(struct AP_PCreature),
+                0, AP_MEMORY_TAG_PHYSIC);
+        ap_pool_init(&barrier_pool, sizeof(struct AP_PBarrier),
+                0, AP_MEMORY_TAG_PHYSIC);
+        ap_slot_map_init(&creature_map, sizeof(struct AP_PCreature*));
+        ap_slot_map_init(&barrier_map,  sizeof(struct AP_PBarrier*));
+        physic_initialized = true;
+
+        return 0;
+}
+
+int ap_physic_free()
+{
+        if (!physic_initialized) {
+                return 0;
+        }
+        creature_using = NULL;
+        ap_slot_map_free(&creature_map);
+        ap_slot_map_free(&barrier_map);
+        ap_pool_free(&creature_pool);
+        ap_pool_free(&barrier_pool);
+        physic_initialized = false;
 
         return 0;
 }
@@ -41,24 +68,30 @@ int ap_physic_generate_creature(unsigned int *id, float size[3])
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
-        struct AP_PCreature creature;
-        memset(&creature, 0, sizeof(struct AP_PCreature));
-        int ret = 0;
-        creature.id = creature_vector.length + 1;
-        creature.move_speed = 5.0f;     // speed of camera movement
-        creature.jump_speed = 5.5f;
-        creature.move.acceleration[1] = -AP_G;  // gravaty
-        memcpy(creature.box.size, size, VEC3_SIZE);
+        ap_physic_init();
+        *id = 0;
         unsigned int cam_id = 0;
-        ret = ap_camera_generate(&cam_id);
+        int ret = ap_camera_generate(&cam_id);
+        if (ret != 0) {
+                return ret;
+        }
+        struct AP_PCreature *creature = ap_pool_alloc(&creature_pool);
+        if (creature == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        creature->move_speed = 5.0f;     // speed of camera movement
+        creature->jump_speed = 5.5f;
+        creature->move.acceleration[1] = -AP_G;  // gravaty
+        memcpy(creature->box.size, size, VEC3_SIZE);
+        creature->camera_id = cam_id;
+        ret = ap_slot_map_insert(&creature_map, &creature, &creature->id);
         if (ret != 0) {
+                ap_pool_release(&creature_pool, creature);
                 return ret;
         }
-        creature.camera_id = !ret ? cam_id : 0;
-        ret = ap_vector_push_back(&creature_vector, (char*) &creature);
-        *id = (!ret) ? creature.id : 0;
+        *id = creature->id;
 
-        return ret;
+        return 0;
 }
 
 int ap_creature_set_pos(float pos[3])
@@ -95,18 +128,12 @@ int ap_physic_get_creature_ptr(
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
-        if (!creature_vector.data) {
+        if (!physic_initialized) {
                 return AP_ERROR_INIT_FAILED;
         }
 
-        *ptr = NULL;
-        struct AP_PCreature *data = (struct AP_PCreature*) creature_vector.data;
-        for (int i = 0; i < creature_vector.length; ++i) {
-                if (data[i].id == id) {
-                        *ptr = data + i;
-                        return 0;
-                }
-        }
+        struct AP_PCreature **data = ap_slot_map_get(&creature_map, id);
+        *ptr = data ? *data : NULL;
 
         return 0;
 }
@@ -126,10 +153,9 @@ int ap_physic_update_creature_id(unsigned int id)
 
 int ap_physic_update_creature()
 {
-        for (int i = 0; i < creature_vector.length; ++i) {
-                struct AP_PCreature *data
-                        = (struct AP_PCreature*) creature_vector.data;
-                ap_physic_update_creature_ptr(data + i);
+        struct AP_PCreature **data = ap_slot_map_data(&creature_map);
+        for (size_t i = 0; i < ap_slot_map_length(&creature_map); ++i) {
+                ap_physic_update_creature_ptr(data[i]);
         }
 
         return 0;
@@ -322,16 +348,20 @@ int ap_physic_generate_barrier(unsigned int *id, int type)
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
+        ap_physic_init();
         *id = 0;
-        struct AP_PBarrier barrier;
-        memset(&barrier, 0, sizeof(struct AP_PBarrier));
+        struct AP_PBarrier *barrier = ap_pool_alloc(&barrier_pool);
+        if (barrier == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
 
-        barrier.type = type;
-        barrier.id = barrier_vector.length + 1;
-        int ret = ap_vector_push_back(&barrier_vector, (char*) &barrier);
-        if (ret == 0) {
-                *id = barrier.id;
+        barrier->type = type;
+        int ret = ap_slot_map_insert(&barrier_map, &barrier, &barrier->id);
+        if (ret != 0) {
+                ap_pool_release(&barrier_pool, barrier);
+                return ret;
         }
+        *id = barrier->id;
 
         return 0;
 }
@@ -341,36 +371,26 @@ int ap_barrier_get_ptr(unsigned int id, struct AP_PBarrier **ptr)
         if (!ptr) {
                 return AP_ERROR_INVALID_PARAMETER;
         }
-        if (id <= 0 || id > barrier_vector.length) {
+
+        struct AP_PBarrier **data = ap_slot_map_get(&barrier_map, id);
+        if (data == NULL) {
+                *ptr = NULL;
                 LOGE("ap_barrier_get_ptr: invalid id");
                 return AP_ERROR_INVALID_PARAMETER;
         }
-
-        *ptr = NULL;
-        struct AP_PBarrier *data = (struct AP_PBarrier*) barrier_vector.data;
-        for (int i = 0; i < barrier_vector.length; ++i) {
-                if (data[i].id == id) {
-                        *ptr = data + i;
-                        return 0;
-                }
-        }
+        *ptr = *data;
         return 0;
 }
 
 int ap_barrier_remove(unsigned int id)
 {
-        struct AP_PBarrier *start = NULL;
-        ap_barrier_get_ptr(id, &start);
-        if (start == NULL) {
+        struct AP_PBarrier **data = ap_slot_map_get(&barrier_map, id);
+        if (data == NULL) {
                 return AP_ERROR_INVALID_PARAMETER;
         }
-
-        struct AP_PBarrier *end = start + 1;
-        ap_vector_remove_data(
-                &barrier_vector,
-                (char*) start, (char*) end,
-                sizeof(struct AP_PBarrier)
-        );
+        ap_pool_release(&barrier_pool, *data);
+        // order of barriers does not matter, the last one is moved here
+        ap_slot_map_remove(&barrier_map, id);
 
         return 0;
 }
@@ -468,12 +488,12 @@ static int ap_creature_process_barrier()
                 return 0;
         }
 
-        struct AP_PBarrier *data = (struct AP_PBarrier*) barrier_vector.data;
+        struct AP_PBarrier **data = ap_slot_map_data(&barrier_map);
         bool is_standing = false;
-        for (int i = 0; i < barrier_vector.length; ++i) {
+        for (size_t i = 0; i < ap_slot_map_length(&barrier_map); ++i) {
                 bool on_top = false;
                 ap_creature_process_barrier_ptr(
-                        creature_using, data + i, &on_top);
+                        creature_using, data[i], &on_top);
                 if (on_top) {
                         is_standing = true;
                 }
@@ -0,0 +1,108 @@
+#include "ap_utils.h"
+#include "ap_pool.h"
+
+// objects are aligned as malloc does, cglm vec4 and mat4 need 16 bytes
+#define AP_POOL_ALIGN 16
+
+// chunk header only holds the next chunk, padded to keep objects aligned
+#define AP_POOL_HEADER_SIZE AP_POOL_ALIGN
+
+static int ap_pool_grow(struct AP_Pool *pool)
+{
+        char *chunk = AP_MALLOC_TAG(
+                AP_POOL_HEADER_SIZE + pool->elem_size * pool->chunk_length,
+                pool->tag);
+        if (chunk == NULL) {
+                LOGE("ap_pool: malloc failed");
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        *(void**) chunk = pool->chunks;
+        pool->chunks = chunk;
+
+        // link objects in reverse order so that they are given out
+        // from low to high address
+        char *objects = chunk + AP_POOL_HEADER_SIZE;
+        for (int i = pool->chunk_length - 1; i >= 0; --i) {
+                void *obj = objects + pool->elem_size * i;
+                *(void**) obj = pool->free_list;
+                pool->free_list = obj;
+        }
+        pool->capacity += pool->chunk_length;
+
+        return 0;
+}
+
+int ap_pool_init(struct AP_Pool *pool, size_t elem_size,
+        int chunk_length, int tag)
+{
+        if (pool == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (elem_size == 0 || chunk_length < 0) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        // the free list is stored inside the released objects,
+        // aligned size is always large enough to hold a pointer
+        pool->elem_size = (elem_size + AP_POOL_ALIGN - 1)
+                & ~((size_t) AP_POOL_ALIGN - 1);
+        pool->chunk_length = chunk_length ? chunk_length : AP_POOL_CHUNK_LENGTH;
+        pool->length = 0;
+        pool->capacity = 0;
+        pool->tag = tag;
+        pool->free_list = NULL;
+        pool->chunks = NULL;
+
+        return 0;
+}
+
+void *ap_pool_alloc(struct AP_Pool *pool)
+{
+        if (pool == NULL || pool->elem_size == 0) {
+                LOGE("ap_pool_alloc: pool uninitialized");
+                return NULL;
+        }
+        if (pool->free_list == NULL && ap_pool_grow(pool) != 0) {
+                return NULL;
+        }
+
+        void *obj = pool->free_list;
+        pool->free_list = *(void**) obj;
+        pool->length++;
+        memset(obj, 0, pool->elem_size);
+
+        return obj;
+}
+
+int ap_pool_release(struct AP_Pool *pool, void *ptr)
+{
+        if (pool == NULL || ptr == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        *(void**) ptr = pool->free_list;
+        pool->free_list = ptr;
+        pool->length--;
+
+        return 0;
+}
+
+int ap_pool_free(struct AP_Pool *pool)
+{
+        if (pool == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        void *chunk = pool->chunks;
+        while (chunk) {
+                void *next = *(void**) chunk;
+                AP_FREE(chunk);
+                chunk = next;
+        }
+        pool->chunks = NULL;
+        pool->free_list = NULL;
+        pool->length = 0;
+        pool->capacity = 0;
+
+        return 0;
+}
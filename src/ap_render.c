@@ -1,23 +1,34 @@
+#include <pthread.h>
+
 #include <assimp/cfileio.h>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
 #include "ap_render.h"
+#include "ap_render_queue.h"
+#include "ap_frustum.h"
 #include "ap_utils.h"
 #include "ap_camera.h"
 #include "ap_shader.h"
 #include "ap_texture.h"
 #include "ap_model.h"
 #include "ap_mesh.h"
+#include "ap_instance.h"
 #include "ap_custom_io.h"
 #include "ap_audio.h"
 #include "ap_light.h"
 #include "ap_physic.h"
 #include "ap_math.h"
+#include "ap_arena.h"
+#include "ap_hashmap.h"
 #include "ap_sqlite.h"
+#include "ap_thread.h"
 #include "ap_config.h"
 
+// distance to the near plane of the perspective projection
+#define AP_RENDER_PERSP_NEAR 0.1f
+
 struct AP_Renderer {
         float fps;      // frame per second
         float dt;       // delta time (cft - lft)
@@ -31,13 +42,43 @@ struct AP_Renderer {
         FT_Library ft_library;
         FT_Face    ft_face;
         bool font_initialized;
+        void *font_buffer;      // font file data of FT_New_Memory_Face
+        // glyph atlas and the buffers of text, one quad for each glyph
+        unsigned int font_atlas_texture;
+        unsigned int text_VAO;
+        unsigned int text_VBO;
+        int text_VBO_capacity;  // number of glyphs text_VBO can hold
 
         unsigned int ortho_shader; // Orthographic
         unsigned int persp_shader; // Perspective
+        // uniform locations of the shaders, looked up once after linking
+        struct {
+                int view;
+                int view_pos;
+                int projection;
+                int view_distance;
+                int spot_light_position;
+                int spot_light_direction;
+                int spot_light_enabled;
+                int point_light_enabled;
+                int env_light_enabled;
+                int material_number;
+        } persp_loc;
+        struct {
+                int projection;
+                int color;
+                int texture_num;
+        } ortho_loc;
 
         mat4 ortho_matrix;
         mat4 persp_matrix;
         mat4 view_matrix;
+        // world space frustum of persp_matrix * view_matrix
+        struct AP_Frustum frustum;
+        bool frustum_valid;
+        // meshes culled in this frame and the last frame
+        struct AP_Cull_Stats cull_stats;
+        struct AP_Cull_Stats cull_stats_last;
         bool spot_light_enabled;
         bool point_light_enabled;
         bool environment_light_enabled;
@@ -62,12 +103,85 @@ struct AP_Renderer {
 
 // Aperture engine only have one renderer as the main renderer
 static struct AP_Renderer renderer;
-static struct AP_Vector charactor_vector = { 0, 0, 0, 0 };
+// glyphs are rendered on demand into the cells of the atlas,
+// the least recently used glyph is replaced when all cells are used
+struct AP_Glyph_Cell {
+        struct AP_Character ch;
+        bool used;
+        // id of the last text line using the glyph
+        unsigned long long line;
+        // LRU list, -1 for none
+        int prev;
+        int next;
+};
+
+struct AP_Glyph_Cache {
+        struct AP_Glyph_Cell *cells;
+        int cell_num;
+        int cell_size;          // width and height of cells (pixel)
+        int cells_per_row;
+        int lru_head;           // most recently used cell
+        int lru_tail;           // least recently used cell
+        struct AP_Hashmap map;  // code point to cell index
+        unsigned long long line;        // id of the text line being built
+};
+
+static struct AP_Glyph_Cache glyph_cache;
+// draw commands of the scene, executed by ap_render_draw_queue
+static struct AP_Render_Queue render_queue;
 static bool ap_render_initialized = false;
 static void *window_context = NULL;
 static int renderer_buffer_width;
 static int renderer_buffer_height;
 
+struct AP_Upload {
+        ap_upload_func_t func;
+        void *param;
+};
+
+AP_VECTOR_DEFINE(upload, struct AP_Upload)
+
+// uploads queued by any thread, moved to upload_active by the render thread
+static pthread_mutex_t upload_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct AP_Vector upload_pending;
+static bool upload_initialized = false;
+// uploads reserved by ap_render_reserve_upload, upload_pending always
+// has room for them so that queueing them can not fail
+static size_t upload_reserved = 0;
+// uploads being run, only used by the render thread
+static struct AP_Vector upload_active;
+
+static void ap_render_get_locations()
+{
+        unsigned int persp = renderer.persp_shader;
+        renderer.persp_loc.view = ap_shader_get_location(persp, AP_SP_VIEW);
+        renderer.persp_loc.view_pos =
+                ap_shader_get_location(persp, AP_SP_VIEW_POS);
+        renderer.persp_loc.projection =
+                ap_shader_get_location(persp, AP_SP_PROJECTION);
+        renderer.persp_loc.view_distance =
+                ap_shader_get_location(persp, AP_SP_VIEW_DISTANCE);
+        renderer.persp_loc.spot_light_position =
+                ap_shader_get_location(persp, AP_SP_SL_POSITION);
+        renderer.persp_loc.spot_light_direction =
+                ap_shader_get_location(persp, AP_SP_SL_DIRECTION);
+        renderer.persp_loc.spot_light_enabled =
+                ap_shader_get_location(persp, AP_SP_SPOT_LIGHT_ENABLED);
+        renderer.persp_loc.point_light_enabled =
+                ap_shader_get_location(persp, AP_SP_POINT_LIGHT_ENABLED);
+        renderer.persp_loc.env_light_enabled =
+                ap_shader_get_location(persp, AP_SP_ENV_LIGHT_ENABLED);
+        renderer.persp_loc.material_number =
+                ap_shader_get_location(persp, AP_SP_MATERIAL_NUMBER);
+
+        unsigned int ortho = renderer.ortho_shader;
+        renderer.ortho_loc.projection =
+                ap_shader_get_location(ortho, AP_SO_PROJECTION);
+        renderer.ortho_loc.color = ap_shader_get_location(ortho, AP_SO_COLOR);
+        renderer.ortho_loc.texture_num =
+                ap_shader_get_location(ortho, AP_SO_TEXTURE_NUM);
+}
+
 int ap_render_general_initialize()
 {
         if (ap_render_initialized) {
@@ -76,6 +190,7 @@ int ap_render_general_initialize()
         memset(&renderer, 0, sizeof(struct AP_Renderer));
         // setup startup time
         ap_get_time();
+        ap_thread_init(0);
         ap_physic_init();
         ap_sqlite_init();
 
@@ -112,6 +227,8 @@ int ap_render_general_initialize()
                 LOGE("renderer failed: perspective shader compile failed");
                 exit(-1);
         }
+        ap_render_get_locations();
+        ap_render_queue_init(&render_queue);
         // default view distance is 6 chunk size
         renderer.view_distance = 16 * 6;
 
@@ -130,6 +247,196 @@ int ap_render_general_initialize()
         return EXIT_SUCCESS;
 }
 
+static void ap_render_glyph_unlink(int i)
+{
+        struct AP_Glyph_Cell *cells = glyph_cache.cells;
+        if (cells[i].prev >= 0) {
+                cells[cells[i].prev].next = cells[i].next;
+        } else {
+                glyph_cache.lru_head = cells[i].next;
+        }
+        if (cells[i].next >= 0) {
+                cells[cells[i].next].prev = cells[i].prev;
+        } else {
+                glyph_cache.lru_tail = cells[i].prev;
+        }
+}
+
+/**
+ * Mark the glyph of cell i as the most recently used
+ */
+static void ap_render_glyph_touch(int i)
+{
+        struct AP_Glyph_Cell *cells = glyph_cache.cells;
+        if (glyph_cache.lru_head == i) {
+                cells[i].line = glyph_cache.line;
+                return;
+        }
+        ap_render_glyph_unlink(i);
+        cells[i].prev = -1;
+        cells[i].next = glyph_cache.lru_head;
+        cells[glyph_cache.lru_head].prev = i;
+        glyph_cache.lru_head = i;
+        cells[i].line = glyph_cache.line;
+}
+
+/**
+ * Get the cell of code, the glyph is rendered into the least recently
+ * used cell if it is not cached
+ */
+static struct AP_Glyph_Cell *ap_render_glyph_load(unsigned int code)
+{
+        int *index = ap_hashmap_get(&glyph_cache.map, code);
+        if (index) {
+                ap_render_glyph_touch(*index);
+                return &glyph_cache.cells[*index];
+        }
+
+        int i = glyph_cache.lru_tail;
+        struct AP_Glyph_Cell *cell = &glyph_cache.cells[i];
+        if (cell->used) {
+                ap_hashmap_remove(&glyph_cache.map, cell->ch.c);
+        }
+        memset(&cell->ch, 0, sizeof(struct AP_Character));
+        cell->ch.c = code;
+        cell->ch.texture_id = renderer.font_atlas_texture;
+        cell->used = true;
+        ap_hashmap_insert(&glyph_cache.map, code, &i);
+        ap_render_glyph_touch(i);
+
+        // the glyphs failed to load are cached as empty glyphs
+        // so that they are not loaded again for every frame
+        if (FT_Load_Char(renderer.ft_face, code, FT_LOAD_RENDER)) {
+                LOGW("freetype: failed to load glyph U+%04X", code);
+                return cell;
+        }
+        FT_GlyphSlot glyph = renderer.ft_face->glyph;
+        // 1 pixel border around the glyph is kept empty so that linear
+        // filtering does not sample the neighbours
+        int size = glyph_cache.cell_size;
+        int w = glyph->bitmap.width;
+        int h = glyph->bitmap.rows;
+        if (w > size - 2 || h > size - 2) {
+                LOGW("glyph U+%04X is larger than the atlas cell", code);
+                w = w > size - 2 ? size - 2 : w;
+                h = h > size - 2 ? size - 2 : h;
+        }
+
+        // the whole cell is uploaded to clear the last glyph in it
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        unsigned char *pixels = ap_arena_alloc(arena, size * size);
+        if (pixels == NULL) {
+                return cell;
+        }
+        memset(pixels, 0, size * size);
+        for (int row = 0; row < h; ++row) {
+                memcpy(pixels + (row + 1) * size + 1,
+                        glyph->bitmap.buffer + row * glyph->bitmap.pitch, w);
+        }
+        int x = (i % glyph_cache.cells_per_row) * size;
+        int y = (i / glyph_cache.cells_per_row) * size;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glBindTexture(GL_TEXTURE_2D, renderer.font_atlas_texture);
+        glTexSubImage2D(
+                GL_TEXTURE_2D, 0, x, y, size, size,
+                GL_RED, GL_UNSIGNED_BYTE, pixels
+        );
+        ap_arena_rewind(arena, marker);
+
+        struct AP_Character *ch = &cell->ch;
+        ch->size[0] = w;
+        ch->size[1] = h;
+        ch->bearing[0] = glyph->bitmap_left;
+        ch->bearing[1] = glyph->bitmap_top;
+        ch->advance = glyph->advance.x;
+        ch->uv[0] = (float) (x + 1) / AP_FONT_ATLAS_SIZE;
+        ch->uv[1] = (float) (y + 1) / AP_FONT_ATLAS_SIZE;
+        ch->uv[2] = (float) (x + 1 + w) / AP_FONT_ATLAS_SIZE;
+        ch->uv[3] = (float) (y + 1 + h) / AP_FONT_ATLAS_SIZE;
+
+        return cell;
+}
+
+/**
+ * Loading code replaces a glyph used by the current line,
+ * which is not drawn yet
+ */
+static bool ap_render_glyph_evicts_line(unsigned int code)
+{
+        struct AP_Glyph_Cell *tail = &glyph_cache.cells[glyph_cache.lru_tail];
+        return tail->used && tail->line == glyph_cache.line
+                && ap_hashmap_get(&glyph_cache.map, code) == NULL;
+}
+
+/**
+ * Create the atlas texture and split it into square cells as large as
+ * the largest glyph of the font size, glyphs are rendered into them
+ * on demand.
+ */
+static int ap_render_init_font_atlas()
+{
+        FT_Size_Metrics *metrics = &renderer.ft_face->size->metrics;
+        int size = metrics->height > metrics->max_advance
+                ? metrics->height : metrics->max_advance;
+        size = (size >> 6) + 2;
+        int cells_per_row = AP_FONT_ATLAS_SIZE / size;
+        if (cells_per_row == 0) {
+                LOGE("font size is larger than the atlas");
+                return AP_ERROR_INIT_FAILED;
+        }
+
+        memset(&glyph_cache, 0, sizeof(struct AP_Glyph_Cache));
+        int cell_num = cells_per_row * cells_per_row;
+        glyph_cache.cells = AP_MALLOC_TAG(
+                sizeof(struct AP_Glyph_Cell) * cell_num, AP_MEMORY_TAG_FONT);
+        if (glyph_cache.cells == NULL) {
+                LOGE("malloc failed");
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        int ret = ap_hashmap_init(&glyph_cache.map, sizeof(int));
+        if (ret != 0) {
+                AP_FREE(glyph_cache.cells);
+                glyph_cache.cells = NULL;
+                return ret;
+        }
+        glyph_cache.cell_num = cell_num;
+        glyph_cache.cell_size = size;
+        glyph_cache.cells_per_row = cells_per_row;
+        // all cells are free in the beginning, in the order of the atlas
+        for (int i = 0; i < cell_num; ++i) {
+                glyph_cache.cells[i].used = false;
+                glyph_cache.cells[i].line = 0;
+                glyph_cache.cells[i].prev = i - 1;
+                glyph_cache.cells[i].next = i + 1 < cell_num ? i + 1 : -1;
+        }
+        glyph_cache.lru_head = 0;
+        glyph_cache.lru_tail = cell_num - 1;
+
+        unsigned int texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(
+                GL_TEXTURE_2D, 0, GL_RED,
+                AP_FONT_ATLAS_SIZE, AP_FONT_ATLAS_SIZE,
+                0, GL_RED, GL_UNSIGNED_BYTE, NULL
+        );
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        renderer.font_atlas_texture = texture;
+
+        // printable ASCII characters are used by almost all text
+        for (unsigned int c = ' '; c < 127; ++c) {
+                ap_render_glyph_load(c);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        LOGD("font atlas: %d cells of %dx%d", cell_num, size, size);
+
+        return 0;
+}
+
 int ap_render_init_font(const char *path, int size)
 {
         if (!path) {
@@ -163,7 +470,8 @@ int ap_render_init_font(const char *path, int size)
                     return 0;
                 }
                 length = AAsset_getLength(mAsset);
-                buffer = AP_MALLOC(sizeof(char) * length);
+                buffer = AP_MALLOC_TAG(
+                        sizeof(char) * length, AP_MEMORY_TAG_FONT);
                 if (buffer == NULL) {
                     LOGE("MALLOG FAILED.");
                     return 0;
@@ -178,7 +486,9 @@ int ap_render_init_font(const char *path, int size)
                         0,
                         &renderer.ft_face
                 );
-                AP_FREE(buffer);
+                // glyphs are loaded on demand, the face needs the buffer
+                // until it is released
+                renderer.font_buffer = buffer;
 #else
                 error = FT_New_Face(
                         renderer.ft_library,
@@ -231,23 +541,22 @@ int ap_render_init_font(const char *path, int size)
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
 
+        glGenVertexArrays(1, &renderer.text_VAO);
+        glGenBuffers(1, &renderer.text_VBO);
+        glBindVertexArray(renderer.text_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, renderer.text_VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(
+                0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        renderer.text_VBO_capacity = 0;
+
         renderer.font_initialized = true;
-        ap_vector_init(&charactor_vector, AP_VECTOR_CHARACTOR);
-        for (char c = 0; c < 127; ++c) {
-                unsigned int tid = 0;
-                int width = 0, height = 0, left = 0, top = 0, advance = 0;
-                ap_render_char_2_texture(
-                        c, &tid, &width, &height, &left, &top, &advance
-                );
-                struct AP_Character charactor;
-                charactor.texture_id = tid;
-                charactor.c = c;
-                charactor.size[0] = width;
-                charactor.size[1] = height;
-                charactor.bearing[0] = left;
-                charactor.bearing[1] = top;
-                charactor.advance = advance;
-                ap_vector_push_back(&charactor_vector, (void*) &charactor);
+        error = ap_render_init_font_atlas();
+        if (error) {
+                ap_shader_use(old_shader);
+                return error;
         }
 
         for (int i = 0; i < 2; ++i) {
@@ -261,58 +570,33 @@ int ap_render_init_font(const char *path, int size)
         return 0;
 }
 
-int ap_render_char_2_texture(
-        char c, unsigned int *tid, int *w, int *h, int *l, int *t, int *a)
+/**
+ * Upload the quads of count glyphs to text VBO and draw them
+ */
+static void ap_render_text_draw(const float *vertices, int count)
 {
-        if (!renderer.font_initialized) {
-                LOGE("failed to char_2_texture: not initialized");
-                return AP_ERROR_INIT_FAILED;
+        if (count == 0) {
+                return;
         }
-        int error = 0;
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        // load character glyph
-         error = FT_Load_Char(renderer.ft_face, c, FT_LOAD_RENDER);
-        if (error) {
-                LOGE("freetype: failed to load glyph %d", error);
-                return 0;
+        size_t glyph_size = sizeof(float) * 6 * 4;
+        glBindBuffer(GL_ARRAY_BUFFER, renderer.text_VBO);
+        if (renderer.text_VBO_capacity == 0) {
+                renderer.text_VBO_capacity = 64;
         }
-        // generate texture
-        unsigned int texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-                GL_TEXTURE_2D,
-                0,
-                GL_RED,
-                renderer.ft_face->glyph->bitmap.width,
-                renderer.ft_face->glyph->bitmap.rows,
-                0,
-                GL_RED,
-                GL_UNSIGNED_BYTE,
-                renderer.ft_face->glyph->bitmap.buffer
-        );
-        // set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        *tid = texture;
-        if (w) {
-                *w = renderer.ft_face->glyph->bitmap.width;
-        }
-        if (h) {
-                *h = renderer.ft_face->glyph->bitmap.rows;
-        }
-        if (l) {
-                *l = renderer.ft_face->glyph->bitmap_left;
+        while (renderer.text_VBO_capacity < count) {
+                renderer.text_VBO_capacity *= 2;
         }
-        if (t) {
-                *t = renderer.ft_face->glyph->bitmap_top;
-        }
-        if (a) {
-                *a = renderer.ft_face->glyph->advance.x;
-        }
-        return 0;
+        // orphan the buffer so the driver does not wait for
+        // the draw calls of the last line still using it
+        glBufferData(
+                GL_ARRAY_BUFFER,
+                glyph_size * renderer.text_VBO_capacity,
+                NULL,
+                GL_STREAM_DRAW
+        );
+        glBufferSubData(GL_ARRAY_BUFFER, 0, glyph_size * count, vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDrawArrays(GL_TRIANGLES, 0, count * 6);
 }
 
 int ap_render_text_line(
@@ -322,69 +606,80 @@ int ap_render_text_line(
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
-        if (renderer.ortho_VAO == 0 || renderer.ortho_VBO == 0) {
+        if (!renderer.font_initialized
+                || renderer.text_VAO == 0 || renderer.text_VBO == 0)
+        {
                 LOGE("failed to render font: buffer uninitialized");
                 return AP_ERROR_INIT_FAILED;
         }
+        // the scene is under the text
+        ap_render_draw_queue();
+
+        // the quads of glyphs are built in scratch memory,
+        // a character has one byte at least
+        int length = strlen(text);
+        size_t glyph_size = sizeof(float) * 6 * 4;
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        float *vertices = ap_arena_alloc(arena, glyph_size * length);
+        if (length && vertices == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
 
-        glBindVertexArray(renderer.ortho_VAO);
         unsigned int old_shader = ap_get_current_shader();
         ap_shader_use(renderer.ortho_shader);
-        ap_shader_set_vec4(renderer.ortho_shader, AP_SO_COLOR, color);
+        ap_shader_set_vec4_loc(renderer.ortho_loc.color, color);
         // set texture num to 0 for font rendering
-        ap_shader_set_int(
-                renderer.ortho_shader, AP_SO_TEXTURE_NUM, 0
-        );
+        ap_shader_set_int_loc(renderer.ortho_loc.texture_num, 0);
 
         // enable blend
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
         glActiveTexture(GL_TEXTURE0);
-        glBindVertexArray(renderer.ortho_VAO);
-        int length = strlen(text);
-        for (int i = 0; i < length; ++i) {
-                struct AP_Character *index = NULL, *p = NULL;
-                for (int j = 0; j < charactor_vector.length; ++j) {
-                        index = (struct AP_Character*) charactor_vector.data;
-                        if (index[j].c == text[i]) {
-                                p = index + j;
-                                break;
-                        }
-                }
-                if (!p) {
-                        continue;
+        glBindTexture(GL_TEXTURE_2D, renderer.font_atlas_texture);
+        glBindVertexArray(renderer.text_VAO);
+
+        glyph_cache.line++;
+        int count = 0;
+        for (int i = 0; i < length; ) {
+                unsigned int code = 0;
+                i += ap_utf8_decode(text + i, &code);
+                if (ap_render_glyph_evicts_line(code)) {
+                        // every cell holds a glyph of this line,
+                        // draw them before replacing one
+                        ap_render_text_draw(vertices, count);
+                        count = 0;
+                        glyph_cache.line++;
                 }
+                struct AP_Character *p = &ap_render_glyph_load(code)->ch;
                 float xpos = x + p->bearing[0] * scale;
                 float ypos = y - (p->size[1] - p->bearing[1]) * scale;
 
                 float w = p->size[0] * scale;
                 float h = p->size[1] * scale;
-                // update VBO for each character
-                float vertices[6][4] = {
-                        { xpos,     ypos + h, 0.0f, 0.0f },
-                        { xpos,     ypos,     0.0f, 1.0f },
-                        { xpos + w, ypos,     1.0f, 1.0f },
-
-                        { xpos,     ypos + h, 0.0f, 0.0f },
-                        { xpos + w, ypos,     1.0f, 1.0f },
-                        { xpos + w, ypos + h, 1.0f, 0.0f }
-                };
-                 // render glyph texture over quad
-                glBindTexture(GL_TEXTURE_2D, p->texture_id);
-                // update content of VBO memory
-                glBindBuffer(GL_ARRAY_BUFFER, renderer.ortho_VBO);
-                glBufferSubData(
-                        GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices
-                );
-                glBindBuffer(GL_ARRAY_BUFFER, 0);
-                // render quad
-                glDrawArrays(GL_TRIANGLES, 0, 6);
                 // now advance cursors for next glyph
                 // (note that advance is number of 1/64 pixels)
                 // bitshift by 6 to get value in pixels (2^6 = 64)
                 x += (p->advance >> 6) * scale;
+                if (p->size[0] == 0 || p->size[1] == 0) {
+                        // space has nothing to draw
+                        continue;
+                }
+                float *uv = p->uv;
+                float quad[6][4] = {
+                        { xpos,     ypos + h, uv[0], uv[1] },
+                        { xpos,     ypos,     uv[0], uv[3] },
+                        { xpos + w, ypos,     uv[2], uv[3] },
+
+                        { xpos,     ypos + h, uv[0], uv[1] },
+                        { xpos + w, ypos,     uv[2], uv[3] },
+                        { xpos + w, ypos + h, uv[2], uv[1] }
+                };
+                memcpy(vertices + count * 6 * 4, quad, glyph_size);
+                ++count;
         }
+        ap_render_text_draw(vertices, count);
+        ap_arena_rewind(arena, marker);
 
         glDisable(GL_BLEND);
         glBindVertexArray(0);
@@ -396,10 +691,15 @@ int ap_render_text_line(
 
 int ap_render_set_aim_cross(int length, int width, vec4 color)
 {
-        // generate a GL_RED format image
-        unsigned char *data = AP_MALLOC(
-                length * length * sizeof(unsigned char)
+        // generate a GL_RED format image in scratch memory
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        unsigned char *data = ap_arena_alloc(
+                arena, length * length * sizeof(unsigned char)
         );
+        if (data == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
         memset(data, 0, length * length * sizeof(unsigned char));
         int min = (length - width) / 2;
         int max = (length + width) / 2;
@@ -440,7 +740,7 @@ int ap_render_set_aim_cross(int length, int width, vec4 color)
         renderer.cross_aim_texture_id = texture;
         renderer.cross_aim_width = length;
         memcpy(renderer.cross_aim_color, color, VEC4_SIZE);
-        AP_FREE(data);
+        ap_arena_rewind(arena, marker);
 
         return 0;
 }
@@ -455,10 +755,8 @@ int ap_render_aim_cross()
         glBindVertexArray(renderer.ortho_VAO);
         unsigned int old_shader = ap_get_current_shader();
         ap_shader_use(renderer.ortho_shader);
-        ap_shader_set_vec4(
-                renderer.ortho_shader,
-                AP_SO_COLOR, renderer.cross_aim_color
-        );
+        ap_shader_set_vec4_loc(renderer.ortho_loc.color,
+                renderer.cross_aim_color);
 
         ivec2 size = {
                 renderer.cross_aim_width,
@@ -478,10 +776,15 @@ int ap_render_aim_cross()
 
 int ap_render_set_aim_dot(int size, vec4 color)
 {
-        // generate a GL_RED format image
-        unsigned char *data = AP_MALLOC(
-                size * size * sizeof(unsigned char)
+        // generate a GL_RED format image in scratch memory
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        unsigned char *data = ap_arena_alloc(
+                arena, size * size * sizeof(unsigned char)
         );
+        if (data == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
         memset(data, 0, size * size * sizeof(unsigned char));
         // draw a circle
         for (int i = 0; i < size; ++i) {
@@ -518,7 +821,7 @@ int ap_render_set_aim_dot(int size, vec4 color)
         renderer.dot_aim_texture_id = texture;
         renderer.dot_aim_size = size;
         memcpy(renderer.dot_aim_color, color, VEC4_SIZE);
-        AP_FREE(data);
+        ap_arena_rewind(arena, marker);
         return 0;
 }
 
@@ -531,10 +834,8 @@ int ap_render_aim_dot()
 
         glBindVertexArray(renderer.ortho_VAO);
         ap_shader_use(renderer.ortho_shader);
-        ap_shader_set_vec4(
-                renderer.ortho_shader,
-                AP_SO_COLOR, renderer.dot_aim_color
-        );
+        ap_shader_set_vec4_loc(renderer.ortho_loc.color,
+                renderer.dot_aim_color);
 
         // enable blend
         ivec2 size = {
@@ -563,13 +864,13 @@ int ap_render_ortho_image_texture(
                 LOGE("failed to render aim: buffer uninitialized");
                 return AP_ERROR_INIT_FAILED;
         }
+        // the scene is under the images
+        ap_render_draw_queue();
 
         glBindVertexArray(renderer.ortho_VAO);
         unsigned int old_shader = ap_get_current_shader();
         ap_shader_use(renderer.ortho_shader);
-        ap_shader_set_int(
-                renderer.ortho_shader, AP_SO_TEXTURE_NUM, tex_num
-        );
+        ap_shader_set_int_loc(renderer.ortho_loc.texture_num, tex_num);
 
         // enable blend
         glEnable(GL_BLEND);
@@ -609,20 +910,16 @@ int ap_render_ortho_image_texture(
         return 0;
 }
 
-int ap_render_get_font_ptr(char c, struct AP_Character **ptr)
+int ap_render_get_font_ptr(
+        unsigned int code, struct AP_Character **ptr)
 {
         if (!ptr) {
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
         *ptr = NULL;
-        struct AP_Character *index = NULL;
-        for (int j = 0; j < charactor_vector.length; ++j) {
-                index = (struct AP_Character*) charactor_vector.data;
-                if (index[j].c == c) {
-                        *ptr = index + j;
-                        break;
-                }
+        if (renderer.font_initialized) {
+                *ptr = &ap_render_glyph_load(code)->ch;
         }
         return 0;
 }
@@ -635,6 +932,139 @@ int ap_render_get_fps(float *p)
         return 0;
 }
 
+/**
+ * Initialize the upload queues when first use, and make room for count
+ * more uploads besides the reserved ones, called with upload_lock held
+ */
+static int ap_render_upload_grow(size_t count)
+{
+        int ret = 0;
+        if (!upload_initialized) {
+                size_t size = sizeof(struct AP_Upload);
+                ret = ap_vector_init_size(&upload_pending, size);
+                if (ret == 0) {
+                        ret = ap_vector_init_size(&upload_active, size);
+                        if (ret != 0) {
+                                ap_vector_free(&upload_pending);
+                        }
+                }
+                upload_initialized = (ret == 0);
+        }
+        if (ret == 0) {
+                ret = ap_vector_grow(&upload_pending, upload_reserved + count);
+        }
+        return ret;
+}
+
+int ap_render_queue_upload(ap_upload_func_t func, void *param)
+{
+        if (func == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        pthread_mutex_lock(&upload_lock);
+        int ret = ap_render_upload_grow(1);
+        if (ret == 0) {
+                struct AP_Upload upload = { func, param };
+                ret = ap_vector_upload_push_back(&upload_pending, upload);
+        }
+        pthread_mutex_unlock(&upload_lock);
+        if (ret != 0) {
+                LOGE("failed to queue upload");
+        }
+
+        return ret;
+}
+
+int ap_render_reserve_upload()
+{
+        pthread_mutex_lock(&upload_lock);
+        int ret = ap_render_upload_grow(1);
+        if (ret == 0) {
+                upload_reserved++;
+        }
+        pthread_mutex_unlock(&upload_lock);
+        if (ret != 0) {
+                LOGE("failed to reserve upload");
+        }
+
+        return ret;
+}
+
+int ap_render_cancel_upload()
+{
+        pthread_mutex_lock(&upload_lock);
+        int ret = upload_reserved ? 0 : AP_ERROR_INVALID_PARAMETER;
+        if (ret == 0) {
+                upload_reserved--;
+        }
+        pthread_mutex_unlock(&upload_lock);
+
+        return ret;
+}
+
+int ap_render_queue_upload_reserved(ap_upload_func_t func, void *param)
+{
+        if (func == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        pthread_mutex_lock(&upload_lock);
+        int ret = upload_reserved ? 0 : AP_ERROR_INVALID_PARAMETER;
+        if (ret == 0) {
+                // the room is kept since reserved, push back does not grow
+                struct AP_Upload upload = { func, param };
+                upload_reserved--;
+                ret = ap_vector_upload_push_back(&upload_pending, upload);
+        }
+        pthread_mutex_unlock(&upload_lock);
+        if (ret != 0) {
+                LOGE("queue upload without reservation");
+        }
+
+        return ret;
+}
+
+int ap_render_process_uploads(double budget)
+{
+        pthread_mutex_lock(&upload_lock);
+        if (!upload_initialized) {
+                pthread_mutex_unlock(&upload_lock);
+                return 0;
+        }
+        int ret = 0;
+        if (upload_pending.length) {
+                ret = ap_vector_append(&upload_active,
+                        upload_pending.data, upload_pending.length);
+                if (ret == 0) {
+                        upload_pending.length = 0;
+                }
+        }
+        pthread_mutex_unlock(&upload_lock);
+        AP_CHECK(ret);
+
+        // the tasks run in the queued order, a task which takes more than
+        // one frame keeps the ones after it waiting
+        double start = ap_get_time();
+        struct AP_Upload *uploads = ap_vector_upload_data(&upload_active);
+        size_t done = 0;
+        while (done < upload_active.length) {
+                if (uploads[done].func(uploads[done].param)) {
+                        ++done;
+                }
+                if (budget >= 0 && ap_get_time() - start >= budget) {
+                        break;
+                }
+        }
+        if (done) {
+                memmove(uploads, uploads + done, sizeof(struct AP_Upload)
+                        * (upload_active.length - done));
+                upload_active.length -= done;
+        }
+
+        return 0;
+}
+
 int ap_render_flush()
 {
         ++renderer.frame_count;
@@ -644,6 +1074,15 @@ int ap_render_flush()
                 renderer.dt = renderer.cft - renderer.lft;
         }
         renderer.lft = renderer.cft;
+        if (ap_render_queue_length(&render_queue) > 0) {
+                LOGW("draw commands of last frame are dropped, "
+                        "call ap_render_draw_queue before swapping buffers");
+                ap_render_queue_clear(&render_queue);
+        }
+        // transient allocations of the last frame are released here
+        ap_arena_reset(ap_arena_frame());
+        ap_render_process_uploads(AP_RENDER_UPLOAD_BUDGET);
+        ap_memory_dump_periodic(renderer.cft);
         static int frames = 0;
         static float since = 0.0f;
         if (since < 0.001f) {
@@ -660,55 +1099,27 @@ int ap_render_flush()
         ap_shader_use(renderer.persp_shader);
         glm_mat4_identity(renderer.view_matrix);
         ap_camera_get_view_matrix(&renderer.view_matrix);
-        ap_shader_set_mat4(
-                renderer.persp_shader,
-                AP_SP_VIEW,
-                renderer.view_matrix[0]
-        );
+        ap_shader_set_mat4_loc(renderer.persp_loc.view,
+                renderer.view_matrix[0]);
         vec3 view_pos = {0.0f};
         ap_camera_get_position(view_pos);
-        ap_shader_set_vec3(
-                renderer.persp_shader,
-                AP_SP_VIEW_POS,
-                view_pos
-        );
-        ap_shader_set_vec3(
-                renderer.persp_shader,
-                AP_SP_SL_POSITION,
-                view_pos
-        );
+        ap_shader_set_vec3_loc(renderer.persp_loc.view_pos, view_pos);
+        ap_shader_set_vec3_loc(renderer.persp_loc.spot_light_position,
+                view_pos);
         vec3 cam_direction = { 0.0f, 0.0f, 0.0f };
         ap_camera_get_front(cam_direction);
-        ap_shader_set_vec3(
-                renderer.persp_shader,
-                AP_SP_SL_DIRECTION,
-                cam_direction
-        );
-        ap_shader_set_int(
-                renderer.persp_shader,
-                AP_SP_SPOT_LIGHT_ENABLED,
-                renderer.spot_light_enabled
-        );
-        ap_shader_set_int(
-                renderer.persp_shader,
-                AP_SP_POINT_LIGHT_ENABLED,
-                renderer.point_light_enabled
-        );
-        ap_shader_set_int(
-                renderer.persp_shader,
-                AP_SP_ENV_LIGHT_ENABLED,
-                renderer.environment_light_enabled
-        );
-        ap_shader_set_int(
-                renderer.persp_shader,
-                AP_SP_MATERIAL_NUMBER,
-                renderer.material_num
-        );
-        ap_shader_set_float(
-                renderer.persp_shader,
-                AP_SP_VIEW_DISTANCE,
-                (float) renderer.view_distance
-        );
+        ap_shader_set_vec3_loc(renderer.persp_loc.spot_light_direction,
+                cam_direction);
+        ap_shader_set_int_loc(renderer.persp_loc.spot_light_enabled,
+                renderer.spot_light_enabled);
+        ap_shader_set_int_loc(renderer.persp_loc.point_light_enabled,
+                renderer.point_light_enabled);
+        ap_shader_set_int_loc(renderer.persp_loc.env_light_enabled,
+                renderer.environment_light_enabled);
+        ap_shader_set_int_loc(renderer.persp_loc.material_number,
+                renderer.material_num);
+        ap_shader_set_float_loc(renderer.persp_loc.view_distance,
+                (float) renderer.view_distance);
 
         int zoom = 0;
         ap_camera_get_zoom(&zoom);
@@ -717,14 +1128,21 @@ int ap_render_flush()
         glm_perspective(
                 glm_rad(zoom),
                 (float) ap_get_buffer_width() / ap_get_buffer_height(),
-                0.1f, (float) renderer.view_distance,
+                AP_RENDER_PERSP_NEAR, (float) renderer.view_distance,
                 renderer.persp_matrix
         );
-        ap_shader_set_mat4(
-                renderer.persp_shader,
-                AP_SP_PROJECTION,
-                renderer.persp_matrix[0]
-        );
+        ap_shader_set_mat4_loc(renderer.persp_loc.projection,
+                renderer.persp_matrix[0]);
+        mat4 view_projection;
+        glm_mat4_mul(renderer.persp_matrix, renderer.view_matrix,
+                view_projection);
+        renderer.frustum_valid = ap_frustum_extract(
+                &renderer.frustum, view_projection[0]) == 0;
+        renderer.cull_stats_last = renderer.cull_stats;
+        memset(&renderer.cull_stats, 0, sizeof(struct AP_Cull_Stats));
+        ap_light_update_clusters(renderer.view_matrix[0],
+                renderer.persp_matrix[0], AP_RENDER_PERSP_NEAR,
+                (float) renderer.view_distance);
         ap_shader_use(old_shader);
 
         return 0;
@@ -732,21 +1150,48 @@ int ap_render_flush()
 
 int ap_render_finish()
 {
-        ap_vector_free(&charactor_vector);
+        // finish the queued jobs before releasing what they use
+        ap_thread_free();
+        // finish the uploads of the loaded assets so they can be released
+        ap_render_process_uploads(-1.0);
+        pthread_mutex_lock(&upload_lock);
+        if (upload_initialized) {
+                ap_vector_free(&upload_pending);
+                ap_vector_free(&upload_active);
+                upload_initialized = false;
+                upload_reserved = 0;
+        }
+        pthread_mutex_unlock(&upload_lock);
+        ap_render_queue_free(&render_queue);
         ap_camera_free();
         ap_shader_free();
+        // batches use the buffers of models
+        ap_instance_free();
         ap_model_free();
         ap_texture_free();
         // ap_audio_free();
         ap_light_free();
+        ap_physic_free();
 
          FT_Done_Face(renderer.ft_face);
          FT_Done_FreeType(renderer.ft_library);
+        if (renderer.font_buffer) {
+                AP_FREE(renderer.font_buffer);
+                renderer.font_buffer = NULL;
+        }
 
         glDeleteBuffers(1, &renderer.ortho_VBO);
         glDeleteVertexArrays(1, &renderer.ortho_VAO);
-
+        glDeleteBuffers(1, &renderer.text_VBO);
+        glDeleteVertexArrays(1, &renderer.text_VAO);
+        glDeleteTextures(1, &renderer.font_atlas_texture);
+        ap_hashmap_free(&glyph_cache.map);
+        AP_FREE(glyph_cache.cells);
+        memset(&glyph_cache, 0, sizeof(struct AP_Glyph_Cache));
+
+        ap_arena_free(ap_arena_frame());
         ap_memory_release();
+        ap_render_initialized = false;
 
         return EXIT_SUCCESS;
 }
@@ -767,11 +1212,8 @@ int ap_render_resize_buffer(int width, int height)
                 0.0f, (float) ap_get_buffer_height(),
                 -1.0f, 1.0f, renderer.ortho_matrix
         );
-        ap_shader_set_mat4(
-                renderer.ortho_shader,
-                AP_SO_PROJECTION,
-                renderer.ortho_matrix[0]
-        );
+        ap_shader_set_mat4_loc(renderer.ortho_loc.projection,
+                renderer.ortho_matrix[0]);
         ap_shader_use(old_shader);
 
         return 0;
@@ -852,16 +1294,189 @@ int ap_render_set_model_mat(float *mat)
                 return AP_ERROR_INVALID_PARAMETER;
         }
 
+        // constant value of the attribute, used by the vertex arrays
+        // without the array of model matrix
+        for (int i = 0; i < 4; ++i) {
+                glVertexAttrib4fv(AP_MESH_MODEL_ATTRIB + i, mat + 4 * i);
+        }
+
+        return 0;
+}
+
+/**
+ * Set the index count and textures of command to draw mesh
+ */
+static void ap_render_set_command_mesh(
+        struct AP_Render_Command *command, struct AP_Mesh *mesh)
+{
+        command->index_type = mesh->index_type;
+        command->index_count = mesh->indices_length;
+        command->texture_num = mesh->texture_length;
+        if (command->texture_num > AP_TEXTURE_UNIT_MAX_NUM) {
+                command->texture_num = AP_TEXTURE_UNIT_MAX_NUM;
+        }
+        for (int t = 0; t < command->texture_num; ++t) {
+                command->textures[t] = mesh->textures[t].id;
+        }
+}
+
+/**
+ * Test the meshes of a model against the frustum, the world space spheres
+ * are tested in batch and the boxes of the meshes passed are tested then
+ */
+static int ap_render_cull_meshes(
+        struct AP_Mesh *meshes, int mesh_num, float *mat, bool *visible)
+{
+        if (!renderer.frustum_valid) {
+                memset(visible, 1, sizeof(bool) * mesh_num);
+                return 0;
+        }
+
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        float *spheres = ap_arena_alloc(arena, sizeof(float) * 4 * mesh_num);
+        if (spheres == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        for (int i = 0; i < mesh_num; ++i) {
+                ap_frustum_transform_bounds(mat, meshes[i].aabb,
+                        meshes[i].sphere, NULL, spheres + 4 * i);
+        }
+        ap_frustum_test_spheres(&renderer.frustum, spheres, mesh_num,
+                visible, NULL);
+        ap_arena_rewind(arena, marker);
+
+        for (int i = 0; i < mesh_num; ++i) {
+                if (!visible[i]) {
+                        continue;
+                }
+                float aabb[6];
+                ap_frustum_transform_bounds(mat, meshes[i].aabb,
+                        meshes[i].sphere, aabb, NULL);
+                visible[i] = ap_frustum_test_aabb(&renderer.frustum, aabb);
+        }
+
+        return 0;
+}
+
+int ap_render_submit_meshes(struct AP_Mesh *meshes, int mesh_num, float *mat)
+{
+        if (renderer.persp_shader == 0) {
+                return AP_ERROR_INIT_FAILED;
+        }
+        if (meshes == NULL || mat == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        if (mesh_num <= 0) {
+                return 0;
+        }
+
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        bool *visible = ap_arena_alloc(arena, sizeof(bool) * mesh_num);
+        if (visible == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        int ret = ap_render_cull_meshes(meshes, mesh_num, mat, visible);
+        int visible_num = 0;
+        for (int i = 0; ret == 0 && i < mesh_num; ++i) {
+                visible_num += visible[i];
+        }
+        renderer.cull_stats.tested += mesh_num;
+        renderer.cull_stats.visible += visible_num;
+        if (ret != 0 || visible_num == 0) {
+                ap_arena_rewind(arena, marker);
+                return ret;
+        }
+
+        struct AP_Render_Command command = {
+                .program = renderer.persp_shader,
+                .model_location = AP_MESH_MODEL_ATTRIB,
+        };
+        ret = ap_render_queue_push_matrix(
+                &render_queue, mat, &command.matrix);
+        // distance from the camera to the origin of the model
+        vec3 view_pos = { 0.0f };
+        ap_camera_get_position(view_pos);
+        float depth = glm_vec3_distance(view_pos, &mat[12]);
+
+        for (int i = 0; ret == 0 && i < mesh_num; ++i) {
+                if (meshes[i].VAO == 0 || !visible[i]) {
+                        continue;
+                }
+                command.vao = meshes[i].VAO;
+                ap_render_set_command_mesh(&command, &meshes[i]);
+                ret = ap_render_queue_submit(&render_queue, &command, depth);
+        }
+        ap_arena_rewind(arena, marker);
+
+        return ret;
+}
+
+int ap_render_submit_instanced(
+        struct AP_Mesh *meshes,
+        unsigned int *VAOs,
+        int mesh_num,
+        int instance_num)
+{
+        if (renderer.persp_shader == 0) {
+                return AP_ERROR_INIT_FAILED;
+        }
+        if (meshes == NULL || VAOs == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        struct AP_Render_Command command = {
+                .program = renderer.persp_shader,
+                .model_location = AP_MESH_MODEL_ATTRIB,
+                .instance_count = instance_num,
+        };
+        int ret = 0;
+        for (int i = 0; ret == 0 && i < mesh_num; ++i) {
+                if (VAOs[i] == 0) {
+                        continue;
+                }
+                command.vao = VAOs[i];
+                ap_render_set_command_mesh(&command, &meshes[i]);
+                ret = ap_render_queue_submit(&render_queue, &command, 0.0f);
+        }
+
+        return ret;
+}
+
+int ap_render_get_queue_stats(int *draw_calls, int *state_changes)
+{
+        if (draw_calls) {
+                *draw_calls = render_queue.draw_calls;
+        }
+        if (state_changes) {
+                *state_changes = render_queue.state_changes;
+        }
+
+        return 0;
+}
+
+int ap_render_get_cull_stats(struct AP_Cull_Stats *stats)
+{
+        if (stats == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        *stats = renderer.cull_stats_last;
+
+        return 0;
+}
+
+int ap_render_draw_queue()
+{
+        if (ap_render_queue_length(&render_queue) == 0) {
+                return 0;
+        }
         unsigned int old_shader = ap_get_current_shader();
-        ap_shader_use(renderer.persp_shader);
-        ap_shader_set_mat4(renderer.persp_shader,
-                // AP_RENDER_NAME_MODEL,
-                AP_SP_MODEL,
-                mat
-        );
+        int ret = ap_render_queue_execute(
+                &render_queue, ap_render_queue_gl_backend());
         ap_shader_use(old_shader);
 
-        return 0;
+        return ret;
 }
 
 int ap_render_set_spot_light_enabled(bool b)
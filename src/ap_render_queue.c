@@ -0,0 +1,320 @@
+#include <string.h>
+
+#if AP_PLATFORM_ANDROID
+#include <GLES3/gl3.h>
+#else
+#include "glad/glad.h"
+#endif
+
+#include "ap_utils.h"
+#include "ap_render_queue.h"
+#include "ap_shader.h"
+
+AP_VECTOR_DEFINE(command, struct AP_Render_Command)
+AP_VECTOR_DEFINE(sort_item, struct AP_Render_Sort_Item)
+
+#define AP_RENDER_MATRIX_SIZE (sizeof(float) * 16)
+
+int ap_render_queue_init(struct AP_Render_Queue *queue)
+{
+        if (queue == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        memset(queue, 0, sizeof(struct AP_Render_Queue));
+
+        int ret = ap_vector_init_size(&queue->commands,
+                sizeof(struct AP_Render_Command));
+        if (ret == 0) {
+                ret = ap_vector_init_size(&queue->matrices,
+                        AP_RENDER_MATRIX_SIZE);
+        }
+        if (ret == 0) {
+                ret = ap_vector_init_size(&queue->items,
+                        sizeof(struct AP_Render_Sort_Item));
+        }
+        if (ret == 0) {
+                ret = ap_vector_init_size(&queue->scratch,
+                        sizeof(struct AP_Render_Sort_Item));
+        }
+        if (ret != 0) {
+                ap_render_queue_free(queue);
+        }
+
+        return ret;
+}
+
+int ap_render_queue_free(struct AP_Render_Queue *queue)
+{
+        if (queue == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        ap_vector_free(&queue->commands);
+        ap_vector_free(&queue->matrices);
+        ap_vector_free(&queue->items);
+        ap_vector_free(&queue->scratch);
+
+        return 0;
+}
+
+int ap_render_queue_push_matrix(
+        struct AP_Render_Queue *queue,
+        const float *mat,
+        unsigned int *index)
+{
+        if (queue == NULL || mat == NULL || index == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        *index = queue->matrices.length;
+        return ap_vector_append(&queue->matrices, mat, 1);
+}
+
+/**
+ * FNV-1a hash of the textures, the commands with the same
+ * textures get the same material bits
+ */
+static unsigned int ap_render_queue_material(
+        const struct AP_Render_Command *command)
+{
+        unsigned int hash = 2166136261u;
+        for (int i = 0; i < command->texture_num; ++i) {
+                unsigned int id = command->textures[i];
+                for (int j = 0; j < 4; ++j) {
+                        hash ^= (id >> (8 * j)) & 0xFF;
+                        hash *= 16777619u;
+                }
+        }
+        return hash;
+}
+
+int ap_render_queue_submit(
+        struct AP_Render_Queue *queue,
+        const struct AP_Render_Command *command,
+        float depth)
+{
+        if (queue == NULL || command == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (command->texture_num < 0
+                || command->texture_num > AP_TEXTURE_UNIT_MAX_NUM
+                || command->instance_count < 0
+                || (command->instance_count == 0
+                        && command->matrix >= queue->matrices.length))
+        {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        // the bits of a non-negative float are ordered as the float,
+        // the high 16 bits keep the exponent and 7 bits of mantissa
+        union {
+                float f;
+                uint32_t u;
+        } d = { depth > 0.0f ? depth : 0.0f };
+
+        struct AP_Render_Command c = *command;
+        c.key = ((uint64_t) (c.program & 0xFF) << AP_RENDER_KEY_PROGRAM_SHIFT)
+                | ((uint64_t) (ap_render_queue_material(&c) & 0xFFFFFF)
+                        << AP_RENDER_KEY_MATERIAL_SHIFT)
+                | ((uint64_t) (c.vao & 0xFFFF) << AP_RENDER_KEY_VAO_SHIFT)
+                | (d.u >> 16);
+
+        return ap_vector_command_push_back(&queue->commands, c);
+}
+
+int ap_render_queue_sort(struct AP_Render_Queue *queue)
+{
+        if (queue == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        size_t length = queue->commands.length;
+        int ret = ap_vector_resize(&queue->items, length);
+        if (ret == 0) {
+                ret = ap_vector_resize(&queue->scratch, length);
+        }
+        if (ret != 0) {
+                return ret;
+        }
+
+        struct AP_Render_Command *commands =
+                ap_vector_command_data(&queue->commands);
+        struct AP_Render_Sort_Item *src =
+                ap_vector_sort_item_data(&queue->items);
+        struct AP_Render_Sort_Item *dst =
+                ap_vector_sort_item_data(&queue->scratch);
+        for (size_t i = 0; i < length; ++i) {
+                src[i].key = commands[i].key;
+                src[i].index = i;
+        }
+
+        // least significant byte first, stable passes keep the order
+        // of the lower bytes, the bytes equal in all keys are skipped
+        for (int shift = 0; shift < 64; shift += 8) {
+                size_t count[256] = { 0 };
+                for (size_t i = 0; i < length; ++i) {
+                        count[(src[i].key >> shift) & 0xFF]++;
+                }
+                if (length == 0
+                        || count[(src[0].key >> shift) & 0xFF] == length)
+                {
+                        continue;
+                }
+                size_t offset = 0;
+                for (int b = 0; b < 256; ++b) {
+                        size_t n = count[b];
+                        count[b] = offset;
+                        offset += n;
+                }
+                for (size_t i = 0; i < length; ++i) {
+                        dst[count[(src[i].key >> shift) & 0xFF]++] = src[i];
+                }
+                struct AP_Render_Sort_Item *tmp = src;
+                src = dst;
+                dst = tmp;
+        }
+        if (src != ap_vector_sort_item_data(&queue->items)) {
+                memcpy(queue->items.data, src,
+                        sizeof(struct AP_Render_Sort_Item) * length);
+        }
+
+        return 0;
+}
+
+static void ap_render_queue_reset_state(struct AP_Render_Queue *queue)
+{
+        queue->program = AP_RENDER_STATE_UNKNOWN;
+        queue->vao = AP_RENDER_STATE_UNKNOWN;
+        queue->matrix = AP_RENDER_STATE_UNKNOWN;
+        for (int i = 0; i < AP_TEXTURE_UNIT_MAX_NUM; ++i) {
+                queue->textures[i] = AP_RENDER_STATE_UNKNOWN;
+        }
+        queue->state_changes = 0;
+        queue->draw_calls = 0;
+}
+
+int ap_render_queue_execute(
+        struct AP_Render_Queue *queue,
+        const struct AP_Render_Backend *backend)
+{
+        if (queue == NULL || backend == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        int ret = ap_render_queue_sort(queue);
+        if (ret != 0) {
+                return ret;
+        }
+
+        // the state may be changed by others since last time
+        ap_render_queue_reset_state(queue);
+        struct AP_Render_Command *commands =
+                ap_vector_command_data(&queue->commands);
+        struct AP_Render_Sort_Item *items =
+                ap_vector_sort_item_data(&queue->items);
+        const float *matrices = (const float*) queue->matrices.data;
+        for (size_t i = 0; i < queue->items.length; ++i) {
+                struct AP_Render_Command *c = &commands[items[i].index];
+                if (c->program != queue->program) {
+                        backend->use_program(c->program);
+                        queue->program = c->program;
+                        queue->state_changes++;
+                }
+                for (int t = 0; t < c->texture_num; ++t) {
+                        if (c->textures[t] == queue->textures[t]) {
+                                continue;
+                        }
+                        backend->bind_texture(t, c->textures[t]);
+                        queue->textures[t] = c->textures[t];
+                        queue->state_changes++;
+                }
+                if (c->vao != queue->vao) {
+                        backend->bind_vertex_array(c->vao);
+                        queue->vao = c->vao;
+                        queue->state_changes++;
+                }
+                if (c->instance_count == 0 && c->matrix != queue->matrix) {
+                        backend->set_matrix(c->model_location,
+                                matrices + 16 * c->matrix);
+                        queue->matrix = c->matrix;
+                        queue->state_changes++;
+                }
+                backend->draw_elements(c->index_type, c->index_count,
+                        c->instance_count);
+                if (c->instance_count > 0) {
+                        // the current value of the matrix attribute is
+                        // undefined after drawing with its array enabled
+                        queue->matrix = AP_RENDER_STATE_UNKNOWN;
+                }
+                queue->draw_calls++;
+        }
+        if (backend->finish) {
+                backend->finish();
+        }
+
+        return ap_render_queue_clear(queue);
+}
+
+int ap_render_queue_clear(struct AP_Render_Queue *queue)
+{
+        if (queue == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        queue->commands.length = 0;
+        queue->matrices.length = 0;
+        queue->items.length = 0;
+
+        return 0;
+}
+
+static void ap_render_gl_use_program(unsigned int program)
+{
+        // through ap_shader_use to keep the current shader known
+        ap_shader_use(program);
+}
+
+static void ap_render_gl_bind_texture(int unit, unsigned int texture)
+{
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+static void ap_render_gl_bind_vertex_array(unsigned int vao)
+{
+        glBindVertexArray(vao);
+}
+
+static void ap_render_gl_set_matrix(int location, const float *mat)
+{
+        // the matrix attribute takes 4 locations, one for each column
+        for (int i = 0; i < 4; ++i) {
+                glVertexAttrib4fv(location + i, mat + 4 * i);
+        }
+}
+
+static void ap_render_gl_draw_elements(
+        unsigned int index_type, int index_count, int instance_count)
+{
+        if (instance_count > 0) {
+                glDrawElementsInstanced(GL_TRIANGLES, index_count,
+                        index_type, 0, instance_count);
+                return;
+        }
+        glDrawElements(GL_TRIANGLES, index_count, index_type, 0);
+}
+
+static void ap_render_gl_finish()
+{
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+}
+
+static const struct AP_Render_Backend gl_backend = {
+        .use_program = ap_render_gl_use_program,
+        .bind_texture = ap_render_gl_bind_texture,
+        .bind_vertex_array = ap_render_gl_bind_vertex_array,
+        .set_matrix = ap_render_gl_set_matrix,
+        .draw_elements = ap_render_gl_draw_elements,
+        .finish = ap_render_gl_finish,
+};
+
+const struct AP_Render_Backend *ap_render_queue_gl_backend()
+{
+        return &gl_backend;
+}
@@ -1,16 +1,39 @@
-
-
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
 
 #include "ap_cvector.h"
+#include "ap_hashmap.h"
 #include "ap_shader.h"
 #include "ap_utils.h"
 
-// vector stores openGL (shader) program ID
-static struct AP_Vector shader_vector = { 0, 0, 0, 0 };
+// location of the uniforms whose names have the same hash,
+// these are looked up by the driver
+#define AP_SHADER_LOCATION_COLLIDED -2
+
+struct AP_Shader_Uniform {
+        int location;
+        // offset of the name in names of the program
+        size_t name;
+};
+
+/**
+ * The active uniforms of a program are reflected after it is linked,
+ * so the locations are looked up without asking the driver.
+ */
+struct AP_Shader_Program {
+        GLuint id;
+        // hash of name to struct AP_Shader_Uniform
+        struct AP_Hashmap uniforms;
+        // names of the uniforms terminated by zero
+        struct AP_Vector names;
+};
+
+AP_VECTOR_DEFINE(program, struct AP_Shader_Program)
+
+// vector stores struct AP_Shader_Program
+static struct AP_Vector shader_vector = { 0, 0, 0, 0, 0 };
 // openGL (shader) program ID
 static unsigned int shader_using = 0;
 
@@ -42,6 +65,106 @@ GLuint ap_compile_shader(
     const char *const shader_src
 );
 
+static struct AP_Shader_Program *ap_shader_find(GLuint id)
+{
+        struct AP_Shader_Program *programs =
+                ap_vector_program_data(&shader_vector);
+        for (size_t i = 0; i < shader_vector.length; ++i) {
+                if (programs[i].id == id) {
+                        return &programs[i];
+                }
+        }
+        return NULL;
+}
+
+static void ap_shader_program_free(struct AP_Shader_Program *program)
+{
+        glDeleteProgram(program->id);
+        ap_hashmap_free(&program->uniforms);
+        ap_vector_free(&program->names);
+}
+
+/**
+ * Add the location of uniform name to program
+ */
+static int ap_shader_add_uniform(
+        struct AP_Shader_Program *program,
+        const char *name)
+{
+        int location = glGetUniformLocation(program->id, name);
+        if (location < 0) {
+                // members of uniform blocks have no location
+                return 0;
+        }
+
+        unsigned int hash = ap_hash_str(name);
+        struct AP_Shader_Uniform *old =
+                ap_hashmap_get(&program->uniforms, hash);
+        if (old != NULL) {
+                if (strcmp(program->names.data + old->name, name) != 0) {
+                        old->location = AP_SHADER_LOCATION_COLLIDED;
+                }
+                return 0;
+        }
+
+        struct AP_Shader_Uniform uniform = {
+                .location = location,
+                .name = program->names.length,
+        };
+        int ret = ap_vector_append(&program->names, name, strlen(name) + 1);
+        if (ret != 0) {
+                return ret;
+        }
+        return ap_hashmap_insert(&program->uniforms, hash, &uniform);
+}
+
+/**
+ * Add the locations of the active uniforms of linked program,
+ * the elements of arrays are added one by one.
+ */
+static int ap_shader_reflect(struct AP_Shader_Program *program)
+{
+        GLint count = 0;
+        GLint max_length = 0;
+        glGetProgramiv(program->id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program->id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+        // room for the index of array elements
+        size_t buffer_size = max_length + 16;
+        char *name = AP_MALLOC_TAG(buffer_size, AP_MEMORY_TAG_SHADER);
+        if (name == NULL) {
+                LOGE("failed to reflect uniforms: malloc failed");
+                return AP_ERROR_MALLOC_FAILED;
+        }
+
+        int ret = 0;
+        for (GLint i = 0; i < count && ret == 0; ++i) {
+                GLsizei length = 0;
+                GLint size = 0;
+                GLenum type = 0;
+                glGetActiveUniform(program->id, i, max_length,
+                        &length, &size, &type, name);
+                // arrays of basic types are reported once as "name[0]",
+                // the name without "[0]" is the first element as well
+                if (length <= 3 || strcmp(name + length - 3, "[0]") != 0) {
+                        ret = ap_shader_add_uniform(program, name);
+                        continue;
+                }
+                name[length - 3] = '\0';
+                ret = ap_shader_add_uniform(program, name);
+                for (GLint j = 0; j < size && ret == 0; ++j) {
+                        snprintf(name + length - 3, buffer_size - length + 3,
+                                "[%d]", j);
+                        ret = ap_shader_add_uniform(program, name);
+                }
+        }
+        AP_FREE(name);
+        if (ret != 0) {
+                LOGE("failed to reflect uniforms of program %u", program->id);
+        }
+
+        return ret;
+}
+
 int ap_shader_generate(
         const char* vshader_path,
         const char* fshader_path,
@@ -53,7 +176,8 @@ int ap_shader_generate(
 
         // initialize vector when first use
         if (shader_vector.data == NULL) {
-                ap_vector_init(&shader_vector, AP_VECTOR_UINT);
+                ap_vector_init_size(&shader_vector,
+                        sizeof(struct AP_Shader_Program));
         }
 
         GLuint gl_shader_id = 0;
@@ -61,7 +185,18 @@ int ap_shader_generate(
         if (gl_shader_id == 0) {
                 return AP_ERROR_SHADER_LOAD_FAILED;
         }
-        ap_vector_push_back(&shader_vector, (const char*) &gl_shader_id);
+
+        struct AP_Shader_Program program = { .id = gl_shader_id };
+        ap_hashmap_init(&program.uniforms, sizeof(struct AP_Shader_Uniform));
+        ap_vector_init(&program.names, AP_VECTOR_CHAR);
+        int ret = ap_shader_reflect(&program);
+        if (ret == 0) {
+                ret = ap_vector_program_push_back(&shader_vector, program);
+        }
+        if (ret != 0) {
+                ap_shader_program_free(&program);
+                return ret;
+        }
         *shader_id = gl_shader_id;
 
         return 0;
@@ -74,15 +209,7 @@ int ap_shader_use(unsigned shader_program_id)
                 return 0;
         }
 
-        unsigned int *program_id_array = (unsigned*) shader_vector.data;
-        bool found = false;
-        for (int i = 0; i < shader_vector.length; ++i) {
-                if (program_id_array[i] == shader_program_id) {
-                        found = true;
-                }
-        }
-
-        if (found) {
+        if (ap_shader_find(shader_program_id) != NULL) {
                 shader_using = shader_program_id;
                 glUseProgram(shader_program_id);
         } else {
@@ -96,9 +223,10 @@ int ap_shader_free()
 {
         shader_using = 0;    // for safety purpose
         glUseProgram(0);
-        unsigned int *program_ptr = (unsigned*) shader_vector.data;
-        for (int i = 0; i < shader_vector.length; ++i) {
-                glDeleteProgram(program_ptr[i]);
+        struct AP_Shader_Program *programs =
+                ap_vector_program_data(&shader_vector);
+        for (size_t i = 0; i < shader_vector.length; ++i) {
+                ap_shader_program_free(&programs[i]);
         }
         ap_vector_free(&shader_vector);
 
@@ -125,7 +253,8 @@ GLuint ap_compile_shader(
         if (!compiled) {
                 GLint info_len = 0;
                 glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_len);
-                char *info = (char*) AP_MALLOC(info_len);
+                char *info = (char*) AP_MALLOC_TAG(
+                        info_len, AP_MEMORY_TAG_SHADER);
                 if (info == NULL) {
                         LOGE("Malloc error.");
                         glDeleteShader(shader);
@@ -163,7 +292,7 @@ GLuint ap_shader_load(GLenum type, const char *const shader_path)
                 return 0;
         }
         length = AAsset_getLength(mAsset);
-        buffer = AP_MALLOC(sizeof(char) * length);
+        buffer = AP_MALLOC_TAG(sizeof(char) * length, AP_MEMORY_TAG_SHADER);
         if (buffer == NULL) {
                 LOGE("MALLOG FAILED.");
                 return 0;
@@ -183,7 +312,7 @@ GLuint ap_shader_load(GLenum type, const char *const shader_path)
         fseek(fp, 0l, SEEK_END);
         length = ftell(fp);
         rewind(fp);
-        if (!(buffer = (char*) AP_MALLOC(length))) {
+        if (!(buffer = (char*) AP_MALLOC_TAG(length, AP_MEMORY_TAG_SHADER))) {
                 LOGE("Malloc Error");
                 fclose(fp);
                 return 1;
@@ -239,57 +368,137 @@ GLuint ap_shader_load_program(
         return program;
 }
 
+int ap_shader_get_location(GLuint program, const char *const name)
+{
+        struct AP_Shader_Program *p = ap_shader_find(program);
+        if (p == NULL) {
+                // not generated by ap_shader_generate
+                return glGetUniformLocation(program, name);
+        }
+
+        struct AP_Shader_Uniform *uniform =
+                ap_hashmap_get(&p->uniforms, ap_hash_str(name));
+        if (uniform == NULL) {
+                return -1;
+        }
+        if (uniform->location == AP_SHADER_LOCATION_COLLIDED) {
+                return glGetUniformLocation(program, name);
+        }
+        if (strcmp(p->names.data + uniform->name, name) != 0) {
+                return -1;
+        }
+        return uniform->location;
+}
+
+int ap_shader_get_locations(
+        GLuint program,
+        const char *const format,
+        int count,
+        int *locations)
+{
+        if (format == NULL || locations == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        char buffer[AP_DEFAULT_BUFFER_SIZE];
+        for (int i = 0; i < count; ++i) {
+                snprintf(buffer, AP_DEFAULT_BUFFER_SIZE, format, i);
+                locations[i] = ap_shader_get_location(program, buffer);
+        }
+        return 0;
+}
+
 int ap_shader_set_float(GLuint program, const char *const name, float value)
 {
-        int location = glGetUniformLocation(program, name);
+        int location = ap_shader_get_location(program, name);
         if (location < 0) {
                 LOGD("shader failed to set float for %s %d", name, location);
                 return AP_ERROR_RENDER_FAILED;
         }
-        glUniform1f(location, value);
-        return 0;
+        return ap_shader_set_float_loc(location, value);
 }
 
 int ap_shader_set_int(GLuint program, const char *const name, GLuint value)
 {
-        int location = glGetUniformLocation(program, name);
+        int location = ap_shader_get_location(program, name);
         if (location < 0) {
                 LOGD("shader failed to set int for %s", name);
                 return AP_ERROR_RENDER_FAILED;
         }
-        glUniform1i(location, value);
-        return 0;
+        return ap_shader_set_int_loc(location, value);
 }
 
 int ap_shader_set_vec3(GLuint program, const char *const name, float *vec)
 {
-        int location = glGetUniformLocation(program, name);
+        int location = ap_shader_get_location(program, name);
         if (location < 0) {
                 LOGD("shader failed to set vec3 for %s", name);
                 return AP_ERROR_RENDER_FAILED;
         }
-        glUniform3fv(location, 1, vec);
-        return 0;
+        return ap_shader_set_vec3_loc(location, vec);
 }
 
 int ap_shader_set_vec4(GLuint program, const char *const name, float *vec)
 {
-        int location = glGetUniformLocation(program, name);
+        int location = ap_shader_get_location(program, name);
         if (location < 0) {
                 LOGD("shader failed to set vec4 for %s", name);
                 return AP_ERROR_RENDER_FAILED;
         }
-        glUniform4fv(location, 1, vec);
-        return 0;
+        return ap_shader_set_vec4_loc(location, vec);
 }
 
 int ap_shader_set_mat4(GLuint program, const char *const name, float* mat)
 {
-        int location = glGetUniformLocation(program, name);
+        int location = ap_shader_get_location(program, name);
         if (location < 0) {
                 LOGD("shader failed to set mat4 for %s", name);
                 return AP_ERROR_RENDER_FAILED;
         }
+        return ap_shader_set_mat4_loc(location, mat);
+}
+
+int ap_shader_set_float_loc(int location, float value)
+{
+        if (location < 0) {
+                return AP_ERROR_RENDER_FAILED;
+        }
+        glUniform1f(location, value);
+        return 0;
+}
+
+int ap_shader_set_int_loc(int location, GLuint value)
+{
+        if (location < 0) {
+                return AP_ERROR_RENDER_FAILED;
+        }
+        glUniform1i(location, value);
+        return 0;
+}
+
+int ap_shader_set_vec3_loc(int location, float *vec)
+{
+        if (location < 0) {
+                return AP_ERROR_RENDER_FAILED;
+        }
+        glUniform3fv(location, 1, vec);
+        return 0;
+}
+
+int ap_shader_set_vec4_loc(int location, float *vec)
+{
+        if (location < 0) {
+                return AP_ERROR_RENDER_FAILED;
+        }
+        glUniform4fv(location, 1, vec);
+        return 0;
+}
+
+int ap_shader_set_mat4_loc(int location, float *mat)
+{
+        if (location < 0) {
+                return AP_ERROR_RENDER_FAILED;
+        }
         glUniformMatrix4fv(location, 1, GL_FALSE, mat);
         return 0;
 }
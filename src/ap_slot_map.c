@@ -0,0 +1,192 @@
+#include "ap_utils.h"
+#include "ap_slot_map.h"
+
+struct AP_Slot {
+        // dense index of the element when the slot is used,
+        // next free slot + 1 when the slot is free
+        unsigned int index;
+        // generation of the handle which owns the slot
+        unsigned int generation;
+};
+
+AP_VECTOR_DEFINE(slot, struct AP_Slot)
+
+static inline unsigned int ap_slot_handle(
+        unsigned int index, unsigned int generation)
+{
+        return (generation << AP_SLOT_INDEX_BITS) | index;
+}
+
+static inline unsigned int ap_slot_index(unsigned int handle)
+{
+        return handle & AP_SLOT_INDEX_MASK;
+}
+
+static inline unsigned int ap_slot_generation(unsigned int handle)
+{
+        return handle >> AP_SLOT_INDEX_BITS;
+}
+
+/**
+ * Get the slot of handle, NULL if the handle is out of date
+ */
+static struct AP_Slot *ap_slot_map_find(
+        struct AP_Slot_Map *map, unsigned int handle)
+{
+        // generation 0 is never given out, it marks the retired slots
+        unsigned int index = ap_slot_index(handle);
+        if (ap_slot_generation(handle) == 0 || index >= map->slots.length) {
+                return NULL;
+        }
+        struct AP_Slot *slot = ap_vector_slot_at(&map->slots, index);
+        if (slot->generation != ap_slot_generation(handle)) {
+                return NULL;
+        }
+        return slot;
+}
+
+int ap_slot_map_init(struct AP_Slot_Map *map, size_t elem_size)
+{
+        if (map == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        int ret = ap_vector_init_size(&map->data, elem_size);
+        if (ret != 0) {
+                return ret;
+        }
+        ret = ap_vector_init(&map->handles, AP_VECTOR_UINT);
+        if (ret == 0) {
+                ret = ap_vector_init_size(&map->slots, sizeof(struct AP_Slot));
+        }
+        if (ret != 0) {
+                ap_vector_free(&map->data);
+                ap_vector_free(&map->handles);
+                return ret;
+        }
+        map->free_head = 0;
+
+        return 0;
+}
+
+int ap_slot_map_free(struct AP_Slot_Map *map)
+{
+        if (map == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        ap_vector_free(&map->data);
+        ap_vector_free(&map->handles);
+        ap_vector_free(&map->slots);
+        map->free_head = 0;
+
+        return 0;
+}
+
+int ap_slot_map_insert(
+        struct AP_Slot_Map *map,
+        const void *elem,
+        unsigned int *handle)
+{
+        if (map == NULL || handle == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        *handle = 0;
+        unsigned int index = 0;
+        struct AP_Slot *slot = NULL;
+        if (map->free_head) {
+                index = map->free_head - 1;
+                slot = ap_vector_slot_at(&map->slots, index);
+        } else {
+                if (map->slots.length >= AP_SLOT_INDEX_MASK) {
+                        LOGE("ap_slot_map: too many elements");
+                        return AP_ERROR_INVALID_PARAMETER;
+                }
+                struct AP_Slot empty = { 0, 1 };
+                int ret = ap_vector_slot_push_back(&map->slots, empty);
+                if (ret != 0) {
+                        return ret;
+                }
+                index = map->slots.length - 1;
+                slot = ap_vector_slot_at(&map->slots, index);
+                // link the new slot as free, it is taken below
+                slot->index = 0;
+                map->free_head = index + 1;
+        }
+
+        size_t length = map->data.length;
+        int ret = ap_vector_resize(&map->data, length + 1);
+        if (ret != 0) {
+                return ret;
+        }
+        unsigned int new_handle = ap_slot_handle(index, slot->generation);
+        ret = ap_vector_uint_push_back(&map->handles, new_handle);
+        if (ret != 0) {
+                ap_vector_resize(&map->data, length);
+                return ret;
+        }
+        if (elem) {
+                memcpy(map->data.data + map->data.elem_size * length,
+                        elem, map->data.elem_size);
+        }
+
+        map->free_head = slot->index;
+        slot->index = length;
+        *handle = new_handle;
+
+        return 0;
+}
+
+void *ap_slot_map_get(struct AP_Slot_Map *map, unsigned int handle)
+{
+        if (map == NULL) {
+                return NULL;
+        }
+        struct AP_Slot *slot = ap_slot_map_find(map, handle);
+        if (slot == NULL) {
+                return NULL;
+        }
+        return map->data.data + map->data.elem_size * slot->index;
+}
+
+int ap_slot_map_remove(struct AP_Slot_Map *map, unsigned int handle)
+{
+        if (map == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        struct AP_Slot *slot = ap_slot_map_find(map, handle);
+        if (slot == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        // move the last element into the hole to keep data dense
+        size_t elem_size = map->data.elem_size;
+        unsigned int index = slot->index;
+        unsigned int last = map->data.length - 1;
+        unsigned int *handles = ap_vector_uint_data(&map->handles);
+        if (index != last) {
+                memcpy(map->data.data + elem_size * index,
+                        map->data.data + elem_size * last, elem_size);
+                handles[index] = handles[last];
+                struct AP_Slot *moved = ap_vector_slot_at(
+                        &map->slots, ap_slot_index(handles[index]));
+                moved->index = index;
+        }
+        map->data.length--;
+        map->handles.length--;
+
+        // out date the handles of this slot. The generation never wraps,
+        // a slot is retired when its generation is used up: generation 0
+        // matches no handle and the slot is not put back to the free list
+        if (slot->generation >= AP_SLOT_GENERATION_MASK) {
+                slot->generation = 0;
+                slot->index = 0;
+                return 0;
+        }
+        slot->generation++;
+        slot->index = map->free_head;
+        map->free_head = ap_slot_index(handle) + 1;
+
+        return 0;
+}
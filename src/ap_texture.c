@@ -1,11 +1,205 @@
+// realpath is a part of X/Open, not C11
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+
 #include "ap_texture.h"
 #include "ap_utils.h"
 #include "ap_cvector.h"
+#include "ap_arena.h"
+#include "ap_pool.h"
+#include "ap_slot_map.h"
+#include "ap_hashmap.h"
+#include "ap_render.h"
+#include "ap_thread.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb/stb_image.h"
 
-struct AP_Vector texture_vector = { 0, 0, 0, 0 };
+/**
+ * Texture stored in pool, the texture is the first member so the
+ * pointers given out can be cast back
+ */
+struct AP_Texture_Entry {
+        struct AP_Texture texture;
+        // normalized absolute path of the image, NULL for color textures
+        char *resolved;
+        // quantized color of the color textures
+        unsigned int color;
+        // next texture of the same path hash, 0 for the last one
+        unsigned int next;
+        int ref_count;
+};
+
+// textures are stored in pool, the slot map holds their pointers,
+// the handles of slot map are given out as texture IDs
+static struct AP_Pool texture_pool;
+static struct AP_Slot_Map texture_map;
+// hash of resolved path to the first texture of the hash, the textures
+// of the same hash are chained by next;
+// quantized color, which is unique for each color, to texture ID
+static struct AP_Hashmap path_map;
+static struct AP_Hashmap color_map;
+static bool texture_initialized = false;
+
+static void ap_texture_initialize()
+{
+        if (texture_initialized) {
+                return;
+        }
+        ap_pool_init(&texture_pool, sizeof(struct AP_Texture_Entry),
+                0, AP_MEMORY_TAG_TEXTURE);
+        ap_slot_map_init(&texture_map, sizeof(struct AP_Texture*));
+        ap_hashmap_init(&path_map, sizeof(unsigned int));
+        ap_hashmap_init(&color_map, sizeof(unsigned int));
+        texture_initialized = true;
+}
+
+/**
+ * Get a zero filled texture object from pool and store it in slot map
+ * with one reference
+ * @param handle [out] handle of the texture
+ */
+static struct AP_Texture_Entry *ap_texture_new(unsigned int *handle)
+{
+        ap_texture_initialize();
+        struct AP_Texture_Entry *entry = ap_pool_alloc(&texture_pool);
+        if (entry == NULL) {
+                return NULL;
+        }
+        struct AP_Texture *texture = &entry->texture;
+        if (ap_slot_map_insert(&texture_map, &texture, handle) != 0) {
+                ap_pool_release(&texture_pool, entry);
+                return NULL;
+        }
+        texture->handle = *handle;
+        entry->ref_count = 1;
+        return entry;
+}
+
+/**
+ * Join directory and path and normalize it to an absolute path,
+ * the joined path is used if it can not be resolved
+ * @return string need AP_FREE, NULL if malloc failed
+ */
+static char *ap_texture_resolve_path(const char *path, const char *directory)
+{
+        size_t length = strlen(path) + strlen(directory) + 1;
+        char *joined = AP_MALLOC_TAG(length, AP_MEMORY_TAG_TEXTURE);
+        if (joined == NULL) {
+                return NULL;
+        }
+        sprintf(joined, "%s%s", directory, path);
+
+#if AP_PLATFORM_LINUX || AP_PLATFORM_UNIX || AP_PLATFORM_MACOS
+        // follows the links and removes "./" and "../"
+        char *real = realpath(joined, NULL);
+        if (real == NULL) {
+                return joined;
+        }
+        char *resolved = AP_MALLOC_TAG(
+                strlen(real) + 1, AP_MEMORY_TAG_TEXTURE);
+        if (resolved) {
+                strcpy(resolved, real);
+                AP_FREE(joined);
+                joined = resolved;
+        }
+        free(real);
+#endif
+
+        return joined;
+}
+
+/**
+ * Quantize color to the bytes uploaded by ap_texture_from_RGBA,
+ * the colors of the same bytes share a texture
+ */
+static unsigned int ap_texture_quantize(const float color[4])
+{
+        unsigned int key = 0;
+        for (int i = 0; i < 4; ++i) {
+                float c = color[i] < 0.0f ? 0.0f
+                        : (color[i] > 1.0f ? 1.0f : color[i]);
+                key = (key << 8) | (unsigned char) (c * 255);
+        }
+        return key;
+}
+
+/**
+ * Texture of resolved path, NULL if not generated
+ */
+static struct AP_Texture_Entry *ap_texture_find_resolved(
+        const char *resolved)
+{
+        if (!texture_initialized) {
+                return NULL;
+        }
+        unsigned int *id = ap_hashmap_get(&path_map, ap_hash_str(resolved));
+        struct AP_Texture_Entry *entry = id
+                ? (struct AP_Texture_Entry *) ap_texture_get_ptr(*id) : NULL;
+        while (entry && strcmp(entry->resolved, resolved) != 0) {
+                entry = (struct AP_Texture_Entry *)
+                        ap_texture_get_ptr(entry->next);
+        }
+        return entry;
+}
+
+/**
+ * Put the texture of path at the head of the chain of its hash
+ */
+static int ap_texture_link_path(struct AP_Texture_Entry *entry)
+{
+        unsigned int hash = ap_hash_str(entry->resolved);
+        unsigned int *head = ap_hashmap_get(&path_map, hash);
+        entry->next = head ? *head : 0;
+        return ap_hashmap_insert(&path_map, hash, &entry->texture.handle);
+}
+
+/**
+ * Remove the texture of path from the chain of its hash
+ */
+static void ap_texture_unlink_path(struct AP_Texture_Entry *entry)
+{
+        unsigned int hash = ap_hash_str(entry->resolved);
+        unsigned int *head = ap_hashmap_get(&path_map, hash);
+        if (head == NULL) {
+                return;
+        }
+        if (*head == entry->texture.handle) {
+                if (entry->next) {
+                        *head = entry->next;
+                } else {
+                        ap_hashmap_remove(&path_map, hash);
+                }
+                return;
+        }
+        struct AP_Texture_Entry *prev =
+                (struct AP_Texture_Entry *) ap_texture_get_ptr(*head);
+        while (prev && prev->next != entry->texture.handle) {
+                prev = (struct AP_Texture_Entry *)
+                        ap_texture_get_ptr(prev->next);
+        }
+        if (prev) {
+                prev->next = entry->next;
+        }
+}
+
+/**
+ * Texture of quantized color, NULL if not generated
+ */
+static struct AP_Texture_Entry *ap_texture_find_color(unsigned int color)
+{
+        if (!texture_initialized) {
+                return NULL;
+        }
+        unsigned int *id = ap_hashmap_get(&color_map, color);
+        struct AP_Texture_Entry *entry = id
+                ? (struct AP_Texture_Entry *) ap_texture_get_ptr(*id) : NULL;
+        if (entry == NULL || entry->resolved || entry->color != color) {
+                return NULL;
+        }
+        return entry;
+}
 
 int ap_texture_generate(
         unsigned int *texture_id,
@@ -14,26 +208,174 @@ int ap_texture_generate(
         const char *directory,
         bool gamma)
 {
+        if (texture_id == NULL || path == NULL || directory == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        *texture_id = 0;
+        // the image is not decoded again if the file is generated
+        char *resolved = ap_texture_resolve_path(path, directory);
+        if (resolved == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        struct AP_Texture_Entry *entry = ap_texture_find_resolved(resolved);
+        AP_FREE(resolved);
+        if (entry) {
+                entry->ref_count++;
+                *texture_id = entry->texture.handle;
+                return 0;
+        }
+
+        struct AP_Texture_Image image;
+        int ret = ap_texture_image_load(path, directory, &image);
+        if (ret != 0) {
+                return ret;
+        }
+        ret = ap_texture_generate_image(
+                texture_id, type, path, directory, &image);
+        ap_texture_image_free(&image);
+
+        return ret;
+}
+
+int ap_texture_generate_image(
+        unsigned int *texture_id,
+        int type,
+        const char *path,
+        const char *directory,
+        const struct AP_Texture_Image *image)
+{
+        if (texture_id == NULL || path == NULL || directory == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
         *texture_id = 0;
-        if (texture_vector.data == NULL) {
-                ap_vector_init(&texture_vector, AP_VECTOR_TEXTURE);
+        char *resolved = ap_texture_resolve_path(path, directory);
+        if (resolved == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
         }
-        unsigned int id = ap_texture_from_file(path, directory, gamma);
+        // the same file may be generated while the image was decoded
+        struct AP_Texture_Entry *entry = ap_texture_find_resolved(resolved);
+        if (entry) {
+                AP_FREE(resolved);
+                entry->ref_count++;
+                *texture_id = entry->texture.handle;
+                return 0;
+        }
+
+        unsigned int id = ap_texture_from_image(image);
         if (id == 0) {
+                AP_FREE(resolved);
                 return AP_ERROR_TEXTURE_FAILED;
         }
+        entry = ap_texture_new(texture_id);
+        if (entry == NULL) {
+                AP_FREE(resolved);
+                glDeleteTextures(1, &id);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        entry->texture.id = id;
+        entry->texture.type = type;
+        ap_texture_set_path(&entry->texture, path);
+        entry->resolved = resolved;
+        if (ap_texture_link_path(entry) != 0) {
+                // not shared, but still a valid texture
+                LOGW("failed to cache texture %s", resolved);
+        }
 
-        struct AP_Texture texture;
-        memset(&texture, 0, sizeof(struct AP_Texture));
+        return 0;
+}
 
-        texture.id = id;
-        texture.type = type;
-        ap_texture_set_path(&texture, path);
+/**
+ * Texture loaded by ap_texture_generate_async
+ */
+struct AP_Texture_Load {
+        char *path;
+        char *directory;
+        int type;
+        ap_callback_func_t cb;
+        struct AP_Texture_Image image;
+        int ret;
+};
+
+static int ap_texture_load_free(struct AP_Texture_Load *load)
+{
+        ap_texture_image_free(&load->image);
+        AP_FREE(load->path);
+        AP_FREE(load->directory);
+        AP_FREE(load);
+        return 0;
+}
 
-        ap_vector_push_back(&texture_vector, (const char*) &texture);
-        *texture_id = id;
+/**
+ * Render thread, create the texture from the decoded image
+ */
+static bool ap_texture_upload_func(void *param)
+{
+        struct AP_Texture_Load *load = param;
+        struct AP_Texture_Thread_Param thread_param = { load->path, 0 };
+        // shared if the same file is loaded by someone else while decoding
+        load->ret = ap_texture_generate_image(&thread_param.id, load->type,
+                load->path, load->directory, &load->image);
+        if (load->cb) {
+                load->cb(&thread_param, load->ret);
+        }
+        ap_texture_load_free(load);
 
-        return 0;
+        return true;
+}
+
+/**
+ * Worker thread, decode the image
+ */
+static void ap_texture_load_job(void *param)
+{
+        struct AP_Texture_Load *load = param;
+        load->ret = ap_texture_image_load(
+                load->path, load->directory, &load->image);
+        // reserved by ap_texture_generate_async, does not fail
+        ap_render_queue_upload_reserved(ap_texture_upload_func, load);
+}
+
+int ap_texture_generate_async(
+        const char *path,
+        const char *directory,
+        int type,
+        ap_callback_func_t cb)
+{
+        if (path == NULL || directory == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        struct AP_Texture_Load *load = AP_MALLOC_TAG(
+                sizeof(struct AP_Texture_Load), AP_MEMORY_TAG_TEXTURE);
+        if (load == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        memset(load, 0, sizeof(struct AP_Texture_Load));
+        load->path = AP_MALLOC_TAG(strlen(path) + 1, AP_MEMORY_TAG_TEXTURE);
+        load->directory = AP_MALLOC_TAG(
+                strlen(directory) + 1, AP_MEMORY_TAG_TEXTURE);
+        if (load->path == NULL || load->directory == NULL) {
+                ap_texture_load_free(load);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        strcpy(load->path, path);
+        strcpy(load->directory, directory);
+        load->type = type;
+        load->cb = cb;
+
+        // the room of the upload is reserved before the job starts,
+        // so that the result always reaches cb on the render thread
+        int ret = ap_render_reserve_upload();
+        if (ret != 0) {
+                ap_texture_load_free(load);
+                return ret;
+        }
+        ret = ap_thread_run(ap_texture_load_job, load, NULL);
+        if (ret != 0) {
+                ap_render_cancel_upload();
+                ap_texture_load_free(load);
+        }
+        return ret;
 }
 
 int ap_texture_generate_RGBA(
@@ -42,13 +384,20 @@ int ap_texture_generate_RGBA(
         int size,
         int type)
 {
-        if (color == NULL || size <= 0 || size >= 10000) {
+        if (texture_id == NULL || color == NULL
+                || size <= 0 || size >= 10000)
+        {
                 return AP_ERROR_INVALID_PARAMETER;
         }
-
-        if (texture_vector.data == NULL) {
-                ap_vector_init(&texture_vector, AP_VECTOR_TEXTURE);
+        *texture_id = 0;
+        unsigned int key = ap_texture_quantize(color);
+        struct AP_Texture_Entry *entry = ap_texture_find_color(key);
+        if (entry) {
+                entry->ref_count++;
+                *texture_id = entry->texture.handle;
+                return 0;
         }
+
         unsigned int id = ap_texture_from_RGBA(color, size);
         if (id == 0) {
                 LOGW("failed to load texture from color (%.1f,%.1f,%.1f,%.1f)",
@@ -56,70 +405,103 @@ int ap_texture_generate_RGBA(
                 );
                 return AP_ERROR_TEXTURE_FAILED;
         }
-        struct AP_Texture texture;
-        memset(&texture, 0, sizeof(struct AP_Texture));
+        entry = ap_texture_new(texture_id);
+        if (entry == NULL) {
+                glDeleteTextures(1, &id);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        entry->texture.id = id;
+        entry->texture.type = type;
+        memcpy(entry->texture.RGBA, color, sizeof(float) * 4);
+        entry->color = key;
+        ap_hashmap_insert(&color_map, key, texture_id);
 
-        texture.id = id;
-        texture.type = type;
-        memcpy(&texture.RGBA, color, sizeof(float) * 4);
-        // texture.diffuse
-        ap_vector_push_back(&texture_vector, (char*) &texture);
-        *texture_id = id;
+        return 0;
+}
+
+int ap_texture_ref(unsigned int id)
+{
+        struct AP_Texture_Entry *entry =
+                (struct AP_Texture_Entry *) ap_texture_get_ptr(id);
+        if (entry == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        entry->ref_count++;
 
         return 0;
 }
 
-struct AP_Texture *ap_texture_get_ptr(unsigned int id)
+int ap_texture_release(unsigned int id)
 {
-        if (id == 0 || texture_vector.data == NULL) {
-                // INVALID_PARAMETER
-                return NULL;
+        struct AP_Texture_Entry *entry =
+                (struct AP_Texture_Entry *) ap_texture_get_ptr(id);
+        if (entry == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        if (--entry->ref_count > 0) {
+                return 0;
         }
 
-        struct AP_Texture *ptr = (struct AP_Texture*) texture_vector.data;
-        for (int i = 0; i < texture_vector.length; ++i) {
-                if (id == ptr[i].id) {
-                        return ptr + i;
+        unsigned int *shared = NULL;
+        if (entry->resolved) {
+                ap_texture_unlink_path(entry);
+        } else {
+                shared = ap_hashmap_get(&color_map, entry->color);
+                if (shared && *shared == id) {
+                        ap_hashmap_remove(&color_map, entry->color);
                 }
         }
+        glDeleteTextures(1, &entry->texture.id);
+        AP_FREE(entry->texture.path);
+        AP_FREE(entry->resolved);
+        ap_slot_map_remove(&texture_map, id);
+        ap_pool_release(&texture_pool, entry);
+
+        return 0;
+}
+
+struct AP_Texture *ap_texture_get_ptr(unsigned int id)
+{
+        if (id == 0 || !texture_initialized) {
+                // INVALID_PARAMETER
+                return NULL;
+        }
 
-        return NULL;
+        struct AP_Texture **ptr = ap_slot_map_get(&texture_map, id);
+        return ptr ? *ptr : NULL;
 }
 
-struct AP_Texture *ap_texture_get_ptr_by_path(const char *path)
+struct AP_Texture *ap_texture_get_ptr_by_path(
+        const char *path,
+        const char *directory)
 {
-        if (path == NULL || texture_vector.data == NULL) {
+        if (path == NULL || directory == NULL) {
                 LOGE("ap_texture_get_ptr_by_path: INVALID PARAM");
                 return NULL;
         }
+        if (!texture_initialized) {
+                return NULL;
+        }
 
-        struct AP_Texture *ptr = (struct AP_Texture*) texture_vector.data;
-        for (int i = 0; i < texture_vector.length; ++i) {
-                if (ptr[i].path && strcmp(path, ptr[i].path) == 0) {
-                        return ptr + i;
-                }
+        char *resolved = ap_texture_resolve_path(path, directory);
+        if (resolved == NULL) {
+                return NULL;
         }
-        return NULL;
+        struct AP_Texture_Entry *entry = ap_texture_find_resolved(resolved);
+        AP_FREE(resolved);
+        return entry ? &entry->texture : NULL;
 }
 
 struct AP_Texture *ap_texture_get_ptr_by_RGBA(float color[4])
 {
-        if (color == NULL || texture_vector.data == NULL) {
+        if (color == NULL) {
                 LOGE("ap_texture_get_ptr_by_RGBA: INVALID PARAM");
                 return NULL;
         }
 
-        struct AP_Texture *ptr = (struct AP_Texture*) texture_vector.data;
-        for (int i = 0; i < texture_vector.length; ++i) {
-                if (EQUAL(color[0], ptr[i].RGBA[0])
-                   && EQUAL(color[1], ptr[i].RGBA[1])
-                   && EQUAL(color[2], ptr[i].RGBA[2])
-                   && EQUAL(color[3], ptr[i].RGBA[3]) )
-                {
-                        return ptr + i;
-                }
-        }
-        return NULL;
+        struct AP_Texture_Entry *entry =
+                ap_texture_find_color(ap_texture_quantize(color));
+        return entry ? &entry->texture : NULL;
 }
 
 int ap_texture_get_type(unsigned int id)
@@ -132,28 +514,28 @@ int ap_texture_get_type(unsigned int id)
         return ptr->type;
 }
 
-unsigned int ap_texture_from_file(
+int ap_texture_image_load(
         const char *path,
         const char *directory,
-        bool gamma)
+        struct AP_Texture_Image *image)
 {
-        // stbi_set_flip_vertically_on_load(true);
-        unsigned int texture_id;
-        glGenTextures(1, &texture_id);
-        if (texture_id == 0) {
-                LOGW("glGenTextures failed");
+        if (path == NULL || directory == NULL || image == NULL) {
+                return AP_ERROR_INVALID_POINTER;
         }
+        memset(image, 0, sizeof(struct AP_Texture_Image));
 
-        int width, height, nr_components;
+        // stbi_set_flip_vertically_on_load(true);
         int buffer_length = strlen(path) + strlen(directory) + 1;
-        char *path_buffer = AP_MALLOC(sizeof(char) * buffer_length);
+        char *path_buffer = AP_MALLOC_TAG(
+                sizeof(char) * buffer_length, AP_MEMORY_TAG_TEXTURE);
         if (path_buffer == NULL) {
                 LOGE("malloc failed");
-                return 0;
+                return AP_ERROR_MALLOC_FAILED;
         }
         sprintf(path_buffer, "%s%s", directory, path);
 
         unsigned char *data = NULL;
+        int width, height, nr_components;
 
 #if AP_PLATFORM_ANDROID
 
@@ -166,7 +548,7 @@ unsigned int ap_texture_from_file(
                 LOGE("Failed to load texture from file: %s", path_buffer);
                 AP_FREE(path_buffer);
                 path_buffer = NULL;
-                return 0;
+                return AP_ERROR_TEXTURE_FAILED;
         }
         file_length = AAsset_getLength(path_asset);
 
@@ -185,25 +567,59 @@ unsigned int ap_texture_from_file(
 
         if (!data) {
                 LOGE("Failed to load texture: %s", path_buffer);
-                glDeleteTextures(1, &texture_id);
                 AP_FREE(path_buffer);
                 path_buffer = NULL;
+                return AP_ERROR_TEXTURE_FAILED;
+        }
+        AP_FREE(path_buffer);
+        path_buffer = NULL;
+
+        image->data = data;
+        image->width = width;
+        image->height = height;
+        image->channels = nr_components;
+
+        return 0;
+}
+
+int ap_texture_image_free(struct AP_Texture_Image *image)
+{
+        if (image == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        if (image->data) {
+                stbi_image_free(image->data);
+        }
+        memset(image, 0, sizeof(struct AP_Texture_Image));
+
+        return 0;
+}
+
+unsigned int ap_texture_from_image(const struct AP_Texture_Image *image)
+{
+        if (image == NULL || image->data == NULL) {
                 return 0;
         }
 
+        unsigned int texture_id;
+        glGenTextures(1, &texture_id);
+        if (texture_id == 0) {
+                LOGW("glGenTextures failed");
+        }
+
         int format = 0;
-        if (nr_components == 1) {
+        if (image->channels == 1) {
                 format = GL_RED;
-        } else if (nr_components == 3) {
+        } else if (image->channels == 3) {
                 format = GL_RGB;
-        } else if (nr_components == 4) {
+        } else if (image->channels == 4) {
                 format = GL_RGBA;
         }
 
         glBindTexture(GL_TEXTURE_2D, texture_id);
         glTexImage2D(
-                GL_TEXTURE_2D, 0, format, width, height, 0,
-                format, GL_UNSIGNED_BYTE, data
+                GL_TEXTURE_2D, 0, format, image->width, image->height, 0,
+                format, GL_UNSIGNED_BYTE, image->data
         );
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -220,18 +636,31 @@ unsigned int ap_texture_from_file(
                 GL_NEAREST
         );
 
-        stbi_image_free(data);
-        AP_FREE(path_buffer);
-        path_buffer = NULL;
+        return texture_id;
+}
+
+unsigned int ap_texture_from_file(
+        const char *path,
+        const char *directory,
+        bool gamma)
+{
+        struct AP_Texture_Image image;
+        if (ap_texture_image_load(path, directory, &image) != 0) {
+                return 0;
+        }
+        unsigned int texture_id = ap_texture_from_image(&image);
+        ap_texture_image_free(&image);
+
         return texture_id;
 }
 
 unsigned int ap_texture_from_RGBA(vec4 color, int size)
 {
-        unsigned char* data = (unsigned char*) AP_MALLOC(
-                4 * size * size * sizeof(unsigned char)
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        unsigned char* data = (unsigned char*) ap_arena_alloc(
+                arena, 4 * size * size * sizeof(unsigned char)
         );
-        memset(data, 0, 4 * size * size * sizeof(unsigned char));
         if (data == NULL) {
                 LOGE("malloc failed");
                 return 0;
@@ -268,7 +697,7 @@ unsigned int ap_texture_from_RGBA(vec4 color, int size)
         glGenerateMipmap(GL_TEXTURE_2D);
         glBindTexture(GL_TEXTURE_2D, 0);
 
-        AP_FREE(data);
+        ap_arena_rewind(arena, marker);
 
         return texture;
 }
@@ -320,17 +749,24 @@ int ap_texture_init(struct AP_Texture *texture)
 
 int ap_texture_free()
 {
-        if (texture_vector.data == NULL) {
+        if (!texture_initialized) {
                 return 0;
         }
 
-        struct AP_Texture *ptr = (struct AP_Texture*) texture_vector.data;
-        for (int i = 0; i < texture_vector.length; ++i) {
-                glDeleteTextures(1, &(ptr[i].id));
-                AP_FREE(ptr[i].path);
+        struct AP_Texture **ptr = ap_slot_map_data(&texture_map);
+        for (size_t i = 0; i < ap_slot_map_length(&texture_map); ++i) {
+                struct AP_Texture_Entry *entry =
+                        (struct AP_Texture_Entry *) ptr[i];
+                glDeleteTextures(1, &(entry->texture.id));
+                AP_FREE(entry->texture.path);
+                AP_FREE(entry->resolved);
         }
 
-        ap_vector_free(&texture_vector);
+        ap_hashmap_free(&path_map);
+        ap_hashmap_free(&color_map);
+        ap_slot_map_free(&texture_map);
+        ap_pool_free(&texture_pool);
+        texture_initialized = false;
         return 0;
 }
 
@@ -345,7 +781,8 @@ int ap_texture_set_path(struct AP_Texture *texture, const char *pathName)
                 AP_FREE(texture->path);
                 texture->path = NULL;
         }
-        texture->path = AP_MALLOC(sizeof(char) * (strlen(pathName) + 1) );
+        texture->path = AP_MALLOC_TAG(
+                sizeof(char) * (strlen(pathName) + 1), AP_MEMORY_TAG_TEXTURE);
         strcpy(texture->path, pathName);
         return 0;
 }
\ No newline at end of file
@@ -1,7 +1,515 @@
+// sysconf is not a part of C11
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include <stdint.h>
+#include <sched.h>
+#include <stdbool.h>
+
 #include "ap_thread.h"
 #include "ap_utils.h"
+#include "ap_arena.h"
+
+struct AP_Job {
+        ap_job_func_t func;
+        void *param;
+        struct AP_Job_Counter *counter;
+};
+
+struct AP_Job_Continuation {
+        struct AP_Job job;
+        struct AP_Job_Continuation *next;
+};
+
+/**
+ * Ring buffer of jobs, the owner pushes and pops at the tail,
+ * other threads steal from the head (the oldest jobs).
+ * head and tail only increase, capacity is power of two.
+ */
+struct AP_Job_Deque {
+        pthread_mutex_t lock;
+        struct AP_Job *data;
+        unsigned int capacity;
+        unsigned int head;
+        unsigned int tail;
+        // tail - head, read without lock to skip empty deques
+        atomic_int length;
+};
+
+struct AP_Job_System {
+        pthread_t threads[AP_THREAD_MAX_NUM];
+        // deques[0] is shared by the threads which are not workers,
+        // deques[i + 1] belongs to worker i
+        struct AP_Job_Deque deques[AP_THREAD_MAX_NUM + 1];
+        int thread_num;
+        atomic_bool running;
+        // jobs queued but not taken yet
+        atomic_int pending;
+        // workers waiting for sleep_cond
+        atomic_int sleeping;
+        pthread_mutex_t sleep_lock;
+        pthread_cond_t sleep_cond;
+};
+
+struct AP_Job_Range {
+        ap_job_range_func_t func;
+        void *param;
+        int begin;
+        int end;
+};
+
+static struct AP_Job_System job_system;
+static _Thread_local int worker_index = -1;
+
+static int ap_job_deque_init(struct AP_Job_Deque *deque)
+{
+        deque->data = AP_MALLOC(
+                sizeof(struct AP_Job) * AP_THREAD_DEQUE_CAPACITY);
+        if (deque->data == NULL) {
+                LOGE("ap_thread: malloc failed");
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        pthread_mutex_init(&deque->lock, NULL);
+        deque->capacity = AP_THREAD_DEQUE_CAPACITY;
+        deque->head = 0;
+        deque->tail = 0;
+        atomic_init(&deque->length, 0);
+        return 0;
+}
+
+static void ap_job_deque_free(struct AP_Job_Deque *deque)
+{
+        pthread_mutex_destroy(&deque->lock);
+        AP_FREE(deque->data);
+        deque->data = NULL;
+}
+
+/**
+ * Double the capacity and unwrap the ring, called with lock held
+ */
+static int ap_job_deque_grow(struct AP_Job_Deque *deque)
+{
+        unsigned int capacity = deque->capacity * 2;
+        struct AP_Job *data = AP_MALLOC(sizeof(struct AP_Job) * capacity);
+        if (data == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        unsigned int length = deque->tail - deque->head;
+        for (unsigned int i = 0; i < length; ++i) {
+                data[i] = deque->data[(deque->head + i)
+                        & (deque->capacity - 1)];
+        }
+        AP_FREE(deque->data);
+        deque->data = data;
+        deque->capacity = capacity;
+        deque->head = 0;
+        deque->tail = length;
+        return 0;
+}
+
+static int ap_job_deque_push(struct AP_Job_Deque *deque, struct AP_Job *job)
+{
+        pthread_mutex_lock(&deque->lock);
+        if (deque->tail - deque->head == deque->capacity
+                && ap_job_deque_grow(deque) != 0)
+        {
+                pthread_mutex_unlock(&deque->lock);
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        deque->data[deque->tail & (deque->capacity - 1)] = *job;
+        deque->tail++;
+        atomic_fetch_add(&deque->length, 1);
+        pthread_mutex_unlock(&deque->lock);
+        return 0;
+}
+
+/**
+ * Take the newest job (owner) or the oldest job (thief)
+ */
+static bool ap_job_deque_take(
+        struct AP_Job_Deque *deque, struct AP_Job *job, bool steal)
+{
+        if (atomic_load(&deque->length) == 0) {
+                return false;
+        }
+        bool found = false;
+        pthread_mutex_lock(&deque->lock);
+        if (deque->tail != deque->head) {
+                if (steal) {
+                        *job = deque->data[deque->head
+                                & (deque->capacity - 1)];
+                        deque->head++;
+                } else {
+                        deque->tail--;
+                        *job = deque->data[deque->tail
+                                & (deque->capacity - 1)];
+                }
+                atomic_fetch_sub(&deque->length, 1);
+                found = true;
+        }
+        pthread_mutex_unlock(&deque->lock);
+        return found;
+}
+
+/**
+ * Deque of the calling thread
+ */
+static inline int ap_thread_deque_index()
+{
+        return worker_index + 1;
+}
 
-void* ap_thread_func(void* param)
+/**
+ * Pop a job from the deque of calling thread, or steal one from others
+ */
+static bool ap_thread_get_job(struct AP_Job *job)
 {
+        int self = ap_thread_deque_index();
+        int deque_num = job_system.thread_num + 1;
+        bool found = ap_job_deque_take(&job_system.deques[self], job, false);
+        for (int i = 1; !found && i < deque_num; ++i) {
+                int victim = (self + i) % deque_num;
+                found = ap_job_deque_take(
+                        &job_system.deques[victim], job, true);
+        }
+        if (found) {
+                atomic_fetch_sub(&job_system.pending, 1);
+        }
+        return found;
+}
+
+static void ap_thread_push(struct AP_Job *job);
+
+/**
+ * Decrease counter, start the waiting jobs if it reaches zero
+ */
+static void ap_job_counter_done(struct AP_Job_Counter *counter)
+{
+        atomic_fetch_add(&counter->releasing, 1);
+        if (atomic_fetch_sub(&counter->value, 1) == 1) {
+                pthread_mutex_lock(&counter->lock);
+                struct AP_Job_Continuation *list = counter->waiting;
+                counter->waiting = NULL;
+                pthread_mutex_unlock(&counter->lock);
+                while (list) {
+                        struct AP_Job_Continuation *next = list->next;
+                        ap_thread_push(&list->job);
+                        AP_FREE(list);
+                        list = next;
+                }
+        }
+        atomic_fetch_sub(&counter->releasing, 1);
+}
+
+static void ap_thread_execute(struct AP_Job *job)
+{
+        job->func(job->param);
+        if (job->counter) {
+                ap_job_counter_done(job->counter);
+        }
+}
+
+/**
+ * Queue a job whose counter is already increased
+ */
+static void ap_thread_push(struct AP_Job *job)
+{
+        if (!atomic_load(&job_system.running)) {
+                ap_thread_execute(job);
+                return;
+        }
+
+        // count it first, so that the workers never sleep with
+        // a job in the deques
+        atomic_fetch_add(&job_system.pending, 1);
+        int ret = ap_job_deque_push(
+                &job_system.deques[ap_thread_deque_index()], job);
+        if (ret != 0) {
+                atomic_fetch_sub(&job_system.pending, 1);
+                LOGW("ap_thread: failed to queue job, run it directly");
+                ap_thread_execute(job);
+                return;
+        }
+        if (atomic_load(&job_system.sleeping) > 0) {
+                pthread_mutex_lock(&job_system.sleep_lock);
+                pthread_cond_signal(&job_system.sleep_cond);
+                pthread_mutex_unlock(&job_system.sleep_lock);
+        }
+}
+
+static void *ap_thread_worker(void *param)
+{
+        worker_index = (int) (intptr_t) param;
+        struct AP_Job job;
+        while (true) {
+                if (ap_thread_get_job(&job)) {
+                        ap_thread_execute(&job);
+                        continue;
+                }
+
+                pthread_mutex_lock(&job_system.sleep_lock);
+                atomic_fetch_add(&job_system.sleeping, 1);
+                while (atomic_load(&job_system.pending) == 0
+                        && atomic_load(&job_system.running))
+                {
+                        pthread_cond_wait(&job_system.sleep_cond,
+                                &job_system.sleep_lock);
+                }
+                atomic_fetch_sub(&job_system.sleeping, 1);
+                pthread_mutex_unlock(&job_system.sleep_lock);
+
+                // finish all the queued jobs before exit
+                if (!atomic_load(&job_system.running)
+                        && atomic_load(&job_system.pending) == 0)
+                {
+                        break;
+                }
+        }
+        ap_arena_free(ap_arena_frame());
+
         return NULL;
-}
\ No newline at end of file
+}
+
+int ap_thread_init(int thread_num)
+{
+        if (atomic_load(&job_system.running)) {
+                LOGW("ap_thread: job system is already started");
+                return 0;
+        }
+        if (thread_num <= 0) {
+                long cores = sysconf(_SC_NPROCESSORS_ONLN);
+                thread_num = cores > 0 ? (int) cores : 1;
+        }
+        if (thread_num > AP_THREAD_MAX_NUM) {
+                thread_num = AP_THREAD_MAX_NUM;
+        }
+
+        for (int i = 0; i <= thread_num; ++i) {
+                int ret = ap_job_deque_init(&job_system.deques[i]);
+                if (ret != 0) {
+                        while (--i >= 0) {
+                                ap_job_deque_free(&job_system.deques[i]);
+                        }
+                        return ret;
+                }
+        }
+        atomic_init(&job_system.pending, 0);
+        atomic_init(&job_system.sleeping, 0);
+        pthread_mutex_init(&job_system.sleep_lock, NULL);
+        pthread_cond_init(&job_system.sleep_cond, NULL);
+        job_system.thread_num = thread_num;
+        atomic_store(&job_system.running, true);
+
+        for (int i = 0; i < thread_num; ++i) {
+                if (pthread_create(&job_system.threads[i], NULL,
+                        ap_thread_worker, (void*) (intptr_t) i) != 0)
+                {
+                        LOGE("ap_thread: failed to create worker %d", i);
+                        // the started workers keep running
+                        job_system.thread_num = i;
+                        break;
+                }
+        }
+        LOGI("ap_thread: started %d workers", job_system.thread_num);
+
+        return 0;
+}
+
+int ap_thread_free()
+{
+        if (!atomic_load(&job_system.running)) {
+                return 0;
+        }
+
+        pthread_mutex_lock(&job_system.sleep_lock);
+        atomic_store(&job_system.running, false);
+        pthread_cond_broadcast(&job_system.sleep_cond);
+        pthread_mutex_unlock(&job_system.sleep_lock);
+        for (int i = 0; i < job_system.thread_num; ++i) {
+                pthread_join(job_system.threads[i], NULL);
+        }
+
+        // jobs queued after the workers exited
+        struct AP_Job job;
+        while (ap_thread_get_job(&job)) {
+                ap_thread_execute(&job);
+        }
+        for (int i = 0; i <= job_system.thread_num; ++i) {
+                ap_job_deque_free(&job_system.deques[i]);
+        }
+        pthread_mutex_destroy(&job_system.sleep_lock);
+        pthread_cond_destroy(&job_system.sleep_cond);
+        job_system.thread_num = 0;
+
+        return 0;
+}
+
+int ap_thread_num()
+{
+        return job_system.thread_num;
+}
+
+int ap_thread_worker_index()
+{
+        return worker_index;
+}
+
+int ap_job_counter_init(struct AP_Job_Counter *counter)
+{
+        if (counter == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        atomic_init(&counter->value, 0);
+        atomic_init(&counter->releasing, 0);
+        pthread_mutex_init(&counter->lock, NULL);
+        counter->waiting = NULL;
+        return 0;
+}
+
+int ap_job_counter_free(struct AP_Job_Counter *counter)
+{
+        if (counter == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+        // the last job may still be releasing the counter
+        while (atomic_load(&counter->releasing)) {
+                sched_yield();
+        }
+        pthread_mutex_destroy(&counter->lock);
+        return 0;
+}
+
+int ap_thread_run(
+        ap_job_func_t func,
+        void *param,
+        struct AP_Job_Counter *counter)
+{
+        if (func == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        if (counter) {
+                atomic_fetch_add(&counter->value, 1);
+        }
+        struct AP_Job job = { func, param, counter };
+        ap_thread_push(&job);
+        return 0;
+}
+
+int ap_thread_run_after(
+        struct AP_Job_Counter *dependency,
+        ap_job_func_t func,
+        void *param,
+        struct AP_Job_Counter *counter)
+{
+        if (dependency == NULL) {
+                return ap_thread_run(func, param, counter);
+        }
+        if (func == NULL) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        struct AP_Job_Continuation *cont = AP_MALLOC(
+                sizeof(struct AP_Job_Continuation));
+        if (cont == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+        if (counter) {
+                atomic_fetch_add(&counter->value, 1);
+        }
+        cont->job.func = func;
+        cont->job.param = param;
+        cont->job.counter = counter;
+
+        pthread_mutex_lock(&dependency->lock);
+        if (atomic_load(&dependency->value) != 0) {
+                // started by the last job of dependency
+                cont->next = dependency->waiting;
+                dependency->waiting = cont;
+                cont = NULL;
+        }
+        pthread_mutex_unlock(&dependency->lock);
+
+        if (cont) {
+                ap_thread_push(&cont->job);
+                AP_FREE(cont);
+        }
+        return 0;
+}
+
+int ap_thread_wait(struct AP_Job_Counter *counter)
+{
+        if (counter == NULL) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        struct AP_Job job;
+        while (atomic_load(&counter->value) != 0
+                || atomic_load(&counter->releasing) != 0)
+        {
+                // help the workers instead of blocking
+                if (atomic_load(&job_system.running)
+                        && ap_thread_get_job(&job))
+                {
+                        ap_thread_execute(&job);
+                } else {
+                        sched_yield();
+                }
+        }
+        return 0;
+}
+
+static void ap_thread_range_func(void *param)
+{
+        struct AP_Job_Range *range = param;
+        range->func(range->param, range->begin, range->end);
+}
+
+int ap_thread_parallel_for(
+        int length,
+        int batch_size,
+        ap_job_range_func_t func,
+        void *param)
+{
+        if (func == NULL || length < 0 || batch_size < 0) {
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+        if (length == 0) {
+                return 0;
+        }
+        if (batch_size == 0) {
+                // a few batches per worker so that stealing can
+                // balance the uneven ones
+                int batch_num = (job_system.thread_num + 1) * 4;
+                batch_size = (length + batch_num - 1) / batch_num;
+        }
+        int batch_num = (length + batch_size - 1) / batch_size;
+        if (batch_num == 1 || !atomic_load(&job_system.running)) {
+                func(param, 0, length);
+                return 0;
+        }
+
+        // the ranges live until all of the jobs finished
+        struct AP_Arena *arena = ap_arena_frame();
+        struct AP_Arena_Marker marker = ap_arena_mark(arena);
+        struct AP_Job_Range *ranges = ap_arena_alloc(
+                arena, sizeof(struct AP_Job_Range) * batch_num);
+        if (ranges == NULL) {
+                return AP_ERROR_MALLOC_FAILED;
+        }
+
+        struct AP_Job_Counter counter;
+        ap_job_counter_init(&counter);
+        for (int i = 0; i < batch_num; ++i) {
+                ranges[i].func = func;
+                ranges[i].param = param;
+                ranges[i].begin = i * batch_size;
+                ranges[i].end = (i == batch_num - 1)
+                        ? length : (i + 1) * batch_size;
+                ap_thread_run(ap_thread_range_func, ranges + i, &counter);
+        }
+        ap_thread_wait(&counter);
+        ap_job_counter_free(&counter);
+        ap_arena_rewind(arena, marker);
+
+        return 0;
+}
@@ -165,3 +165,58 @@ double ap_get_time()
         double time = (now.tv_sec - start.tv_sec) + (now.tv_usec) / 1e6;
         return time;
 }
+
+int ap_utf8_decode(const char *text, unsigned int *code)
+{
+        const unsigned char *s = (const unsigned char *) text;
+        unsigned int c = s[0];
+        int length = 0;
+        unsigned int min = 0;
+        if (c < 0x80) {
+                *code = c;
+                return 1;
+        } else if ((c & 0xE0) == 0xC0) {
+                length = 2;
+                min = 0x80;
+                c &= 0x1F;
+        } else if ((c & 0xF0) == 0xE0) {
+                length = 3;
+                min = 0x800;
+                c &= 0x0F;
+        } else if ((c & 0xF8) == 0xF0) {
+                length = 4;
+                min = 0x10000;
+                c &= 0x07;
+        } else {
+                *code = AP_UTF8_REPLACEMENT;
+                return 1;
+        }
+
+        // the terminating zero is not a continuation byte,
+        // so a truncated sequence never reads past the string
+        for (int i = 1; i < length; ++i) {
+                if ((s[i] & 0xC0) != 0x80) {
+                        *code = AP_UTF8_REPLACEMENT;
+                        return 1;
+                }
+                c = (c << 6) | (s[i] & 0x3F);
+        }
+        // overlong encoding, surrogate or out of unicode range
+        if (c < min || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+                *code = AP_UTF8_REPLACEMENT;
+                return 1;
+        }
+        *code = c;
+
+        return length;
+}
+
+unsigned int ap_hash_str(const char *str)
+{
+        unsigned int hash = 2166136261u;
+        for (const unsigned char *c = (const unsigned char*) str; *c; ++c) {
+                hash ^= *c;
+                hash *= 16777619u;
+        }
+        return hash;
+}
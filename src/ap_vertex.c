@@ -1 +1,217 @@
+#include <math.h>
+
+#if AP_PLATFORM_ANDROID
+#include <GLES3/gl3.h>
+#else
+#include "glad/glad.h"
+#endif
+
+#include "ap_utils.h"
 #include "ap_vertex.h"
+
+struct AP_Vertex_Packed {
+        uint16_t position[4];   // the 4th is padding, always 0
+        int8_t normal[4];       // octahedral xy, z and w are 0
+        uint16_t tex_coords[2];
+};
+
+_Static_assert(sizeof(struct AP_Vertex_Packed) == 16,
+        "packed vertex should be 16 bytes");
+
+/**
+ * The normal attribute of the shader is a vec4, w is 1 by default for
+ * the normals of 3 floats and 0 for the octahedral encoded normals
+ */
+static const struct AP_Vertex_Layout vertex_layouts[] = {
+        [AP_VERTEX_FORMAT_FLOAT] = {
+                .stride = sizeof(float) * 8,
+                .attribute_num = 3,
+                .attributes = {
+                        { 0, 3, GL_FLOAT, false, 0 },
+                        { 1, 3, GL_FLOAT, false, sizeof(float) * 3 },
+                        { 2, 2, GL_FLOAT, false, sizeof(float) * 6 },
+                },
+        },
+        [AP_VERTEX_FORMAT_PACKED] = {
+                .stride = sizeof(struct AP_Vertex_Packed),
+                .attribute_num = 3,
+                .attributes = {
+                        { 0, 3, GL_HALF_FLOAT, false,
+                                offsetof(struct AP_Vertex_Packed, position) },
+                        { 1, 4, GL_BYTE, true,
+                                offsetof(struct AP_Vertex_Packed, normal) },
+                        { 2, 2, GL_HALF_FLOAT, false,
+                                offsetof(struct AP_Vertex_Packed,
+                                        tex_coords) },
+                },
+        },
+};
+
+const struct AP_Vertex_Layout *ap_vertex_get_layout(int format)
+{
+        if (format < 0 || format >= AP_VERTEX_FORMAT_LENGTH) {
+                return NULL;
+        }
+        return &vertex_layouts[format];
+}
+
+int ap_vertex_pack(
+        int format,
+        const struct AP_Vertex *vertices,
+        int num,
+        void *out)
+{
+        if (num > 0 && (vertices == NULL || out == NULL)) {
+                return AP_ERROR_INVALID_POINTER;
+        }
+
+        switch (format) {
+        case AP_VERTEX_FORMAT_FLOAT:
+        {
+                float *v = out;
+                for (int i = 0; i < num; ++i, v += 8) {
+                        memcpy(v, vertices[i].position, sizeof(float) * 3);
+                        memcpy(v + 3, vertices[i].normal, sizeof(float) * 3);
+                        memcpy(v + 6, vertices[i].tex_coords,
+                                sizeof(float) * 2);
+                }
+                break;
+        }
+        case AP_VERTEX_FORMAT_PACKED:
+        {
+                struct AP_Vertex_Packed *v = out;
+                for (int i = 0; i < num; ++i) {
+                        memset(&v[i], 0, sizeof(struct AP_Vertex_Packed));
+                        for (int j = 0; j < 3; ++j) {
+                                v[i].position[j] = ap_vertex_float_to_half(
+                                        vertices[i].position[j]);
+                        }
+                        ap_vertex_oct_encode(vertices[i].normal,
+                                v[i].normal);
+                        for (int j = 0; j < 2; ++j) {
+                                v[i].tex_coords[j] = ap_vertex_float_to_half(
+                                        vertices[i].tex_coords[j]);
+                        }
+                }
+                break;
+        }
+        default:
+                return AP_ERROR_INVALID_PARAMETER;
+        }
+
+        return 0;
+}
+
+uint16_t ap_vertex_float_to_half(float f)
+{
+        union {
+                float f;
+                uint32_t u;
+        } v = { f };
+        uint32_t sign = (v.u >> 16) & 0x8000;
+        uint32_t abs = v.u & 0x7FFFFFFF;
+
+        if (abs >= 0x7F800000) {
+                // inf or NaN
+                return sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 : 0);
+        }
+        if (abs >= 0x477FF000) {
+                // rounded to a number larger than the max half 65504
+                return sign | 0x7C00;
+        }
+        if (abs < 0x38800000) {
+                // subnormal half, shift the mantissa with the implicit 1
+                if (abs < 0x33000000) {
+                        return sign;
+                }
+                int shift = 126 - (abs >> 23);
+                uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+                uint32_t half = mantissa >> shift;
+                uint32_t rest = mantissa & ((1u << shift) - 1);
+                uint32_t middle = 1u << (shift - 1);
+                if (rest > middle || (rest == middle && (half & 1))) {
+                        half++;
+                }
+                return sign | half;
+        }
+        // rebias the exponent, round the 13 bits dropped to nearest even
+        uint32_t half = (abs - 0x38000000) >> 13;
+        uint32_t rest = abs & 0x1FFF;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+                half++;
+        }
+        return sign | half;
+}
+
+float ap_vertex_half_to_float(uint16_t h)
+{
+        uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+        uint32_t exponent = (h >> 10) & 0x1F;
+        uint32_t mantissa = h & 0x3FF;
+        union {
+                uint32_t u;
+                float f;
+        } v;
+
+        if (exponent == 0) {
+                // zero or subnormal, mantissa * 2^-24
+                v.f = mantissa / 16777216.0f;
+                v.u |= sign;
+                return v.f;
+        }
+        if (exponent == 0x1F) {
+                v.u = sign | 0x7F800000 | (mantissa << 13);
+                return v.f;
+        }
+        v.u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        return v.f;
+}
+
+static inline float ap_vertex_sign(float f)
+{
+        return f >= 0.0f ? 1.0f : -1.0f;
+}
+
+static inline int8_t ap_vertex_snorm8(float f)
+{
+        f = f < -1.0f ? -1.0f : (f > 1.0f ? 1.0f : f);
+        return (int8_t) roundf(f * 127.0f);
+}
+
+void ap_vertex_oct_encode(const float *normal, int8_t *oct)
+{
+        float sum = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+        if (sum == 0.0f) {
+                oct[0] = oct[1] = 0;
+                return;
+        }
+        // project to the octahedron, fold the lower half over the diagonals
+        float x = normal[0] / sum;
+        float y = normal[1] / sum;
+        if (normal[2] < 0.0f) {
+                float fx = (1.0f - fabsf(y)) * ap_vertex_sign(x);
+                float fy = (1.0f - fabsf(x)) * ap_vertex_sign(y);
+                x = fx;
+                y = fy;
+        }
+        oct[0] = ap_vertex_snorm8(x);
+        oct[1] = ap_vertex_snorm8(y);
+}
+
+void ap_vertex_oct_decode(const int8_t *oct, float *normal)
+{
+        // same as the vertex shader
+        float x = oct[0] < -127 ? -1.0f : oct[0] / 127.0f;
+        float y = oct[1] < -127 ? -1.0f : oct[1] / 127.0f;
+        float z = 1.0f - fabsf(x) - fabsf(y);
+        if (z < 0.0f) {
+                float fx = (1.0f - fabsf(y)) * ap_vertex_sign(x);
+                float fy = (1.0f - fabsf(x)) * ap_vertex_sign(y);
+                x = fx;
+                y = fy;
+        }
+        float length = sqrtf(x * x + y * y + z * z);
+        normal[0] = x / length;
+        normal[1] = y / length;
+        normal[2] = z / length;
+}
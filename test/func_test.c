@@ -4,27 +4,84 @@
 #include "ap_mesh.h"
 #include "ap_model.h"
 #include "ap_memory.h"
+#include "ap_arena.h"
+#include "ap_pool.h"
+#include "ap_slot_map.h"
+#include "ap_hashmap.h"
+#include "ap_thread.h"
 #include "ap_utils.h"
 #include "ap_model.h"
 #include <pthread.h>
 #include "ap_audio.h"
 #include "ap_decode.h"
 #include "ap_sqlite.h"
+#include "ap_render.h"
+#include "ap_cluster.h"
+#include "ap_render_queue.h"
+#include "ap_frustum.h"
+#include "ap_instance.h"
+#include "ap_optimize.h"
+#include "ap_model_cache.h"
+#include "ap_shader.h"
+#include <assimp/cimport.h>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <math.h>
 
 void print_vector(struct AP_Vector *vector);
 void print_vertex(struct AP_Vertex *pVertex);
 void print_mesh(struct AP_Mesh *mesh);
 void print_model(struct AP_Model *model);
 
+// hidden window with the renderer initialized, NULL on failure
+static GLFWwindow *test_gl_context_create()
+{
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        GLFWwindow *window = glfwCreateWindow(800, 600, "test", NULL, NULL);
+        if (window == NULL) {
+                LOGE("Failed to create GLFW window.");
+                glfwTerminate();
+                return NULL;
+        }
+        glfwMakeContextCurrent(window);
+        ap_set_context_ptr(window);
+        if (ap_render_general_initialize() != 0) {
+                LOGE("Failed to initialize the renderer.");
+                ap_thread_free();
+                ap_set_context_ptr(NULL);
+                glfwDestroyWindow(window);
+                glfwTerminate();
+                return NULL;
+        }
+        return window;
+}
+
+static void test_gl_context_destroy(GLFWwindow *window)
+{
+        ap_render_finish();
+        ap_set_context_ptr(NULL);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+}
+
 void print_vector(struct AP_Vector *vector)
 {
         if (!vector) {
                 return;
         }
 
-        printf("current length:   %d\n", vector->length);
-        printf("current capacity: %d\n", vector->capacity);
+        printf("current length:   %zu\n", vector->length);
+        printf("current capacity: %zu\n", vector->capacity);
         printf("current type:     %d\n", vector->type);
         printf("current pdata:    %p\n", vector->data);
         printf("current data: ");
@@ -117,11 +174,13 @@ void print_model(struct AP_Model *p)
         if (!p) {
                 return;
         }
-        printf("texture:       %p\n", p->texture);
-        printf("texture_length: %d\n", p->texture_length);
-        printf("mesh:              %p\n", p->mesh);
-        printf("mesh_length:          %d\n", p->mesh_length);
-        printf("directory:           %p\n", p->directory);
+        struct AP_Model_Resource *r = p->resource;
+        printf("texture:       %p\n", r->texture);
+        printf("texture_length: %d\n", r->texture_length);
+        printf("mesh:              %p\n", r->mesh);
+        printf("mesh_length:          %d\n", r->mesh_length);
+        printf("directory:           %p\n", r->directory);
+        printf("ref_count:           %d\n", r->ref_count);
 }
 
 void test_vector_char()
@@ -289,6 +348,106 @@ void test_vector_int()
         printf("------AP_Vector INT finished--------\n\n");
 }
 
+struct test_vector_elem {
+        float pos[3];
+        int id;
+};
+
+void test_vector_bulk()
+{
+        LOGI("-------AP_Vector bulk test-------");
+
+        struct AP_Vector vector = { 0, 0, 0, 0 };
+        ap_vector_init_size(&vector, sizeof(struct test_vector_elem));
+        struct test_vector_elem elems[16];
+        for (int i = 0; i < 16; ++i) {
+                elems[i].id = i;
+        }
+        ap_vector_append(&vector, elems, 16);
+        ap_vector_resize(&vector, 20);
+        struct test_vector_elem *data = (void*) vector.data;
+        LOGI("append and resize: %s",
+                vector.length == 20 && data[15].id == 15 && data[19].id == 0
+                ? "PASS" : "FAILED");
+
+        // remove elements [2, 5)
+        size_t size = 3 * sizeof(struct test_vector_elem);
+        ap_vector_remove_data(&vector, (char*) (data + 2),
+                (char*) (data + 5), size);
+        LOGI("remove data: %s",
+                vector.length == 17 && data[2].id == 5 && data[12].id == 15
+                ? "PASS" : "FAILED");
+        ap_vector_free(&vector);
+
+        const int num = 10000000;
+        double start = ap_get_time();
+        ap_vector_init(&vector, AP_VECTOR_UINT);
+        for (int i = 0; i < num; ++i) {
+                ap_vector_push_back(&vector, (char*) &i);
+        }
+        double generic = ap_get_time() - start;
+        ap_vector_free(&vector);
+
+        start = ap_get_time();
+        ap_vector_init(&vector, AP_VECTOR_UINT);
+        for (int i = 0; i < num; ++i) {
+                ap_vector_uint_push_back(&vector, i);
+        }
+        double typed = ap_get_time() - start;
+        unsigned int *array = (unsigned int*) vector.data;
+
+        struct AP_Vector copy = { 0, 0, 0, 0 };
+        start = ap_get_time();
+        ap_vector_init(&copy, AP_VECTOR_UINT);
+        ap_vector_reserve(&copy, num);
+        ap_vector_append(&copy, array, num);
+        double bulk = ap_get_time() - start;
+        LOGI("typed data: %s",
+                array[num - 1] == (unsigned) num - 1
+                && memcmp(copy.data, array, num * sizeof(int)) == 0
+                ? "PASS" : "FAILED");
+        ap_vector_free(&vector);
+        ap_vector_free(&copy);
+
+        LOGI("%d uint: push_back %.3lfs, typed push_back %.3lfs, "
+                "append %.3lfs", num, generic, typed, bulk);
+
+        printf("------AP_Vector bulk test finished--------\n\n");
+}
+
+void test_vector_growth()
+{
+        LOGI("-------AP_Vector growth test-------");
+
+        struct AP_Vector vector = { 0, 0, 0, 0 };
+        ap_vector_init(&vector, AP_VECTOR_CHAR);
+
+        // a bulk append grows to the next power of two in one realloc
+        static char buffer[1000 * 1000];
+        memset(buffer, 'a', sizeof(buffer));
+        ap_vector_append(&vector, buffer, sizeof(buffer));
+        LOGI("grow to power of two: %s",
+                vector.length == sizeof(buffer)
+                && vector.capacity == 1024 * 1024
+                ? "PASS" : "FAILED");
+
+        ap_vector_shrink_to_fit(&vector);
+        LOGI("shrink to fit: %s",
+                vector.capacity == vector.length
+                && memcmp(vector.data, buffer, sizeof(buffer)) == 0
+                ? "PASS" : "FAILED");
+
+        ap_vector_resize(&vector, 0);
+        ap_vector_shrink_to_fit(&vector);
+        ap_vector_push_back(&vector, "b");
+        LOGI("shrink empty vector: %s",
+                vector.length == 1 && vector.data[0] == 'b'
+                ? "PASS" : "FAILED");
+        ap_vector_free(&vector);
+
+        printf("------AP_Vector growth test finished--------\n\n");
+}
+
 void test_ap_memory()
 {
         char *str = AP_MALLOC(10 * sizeof(char));
@@ -312,6 +471,1929 @@ void test_ap_memory()
         return;
 }
 
+void test_ap_memory_stat()
+{
+        LOGI("-------AP_Memory stat test-------");
+
+        struct AP_Memory_Stat mesh_before, font_before;
+        ap_memory_get_stat(AP_MEMORY_TAG_MESH, &mesh_before);
+        ap_memory_get_stat(AP_MEMORY_TAG_FONT, &font_before);
+        char *mesh = AP_MALLOC_TAG(1024, AP_MEMORY_TAG_MESH);
+        char *texture = AP_MALLOC_TAG(256, AP_MEMORY_TAG_TEXTURE);
+        mesh = AP_REALLOC(mesh, 4096);
+        ap_memory_set_tag(texture, AP_MEMORY_TAG_FONT);
+        ap_memory_set_budget(AP_MEMORY_TAG_MESH, 2048);
+        mesh = AP_REALLOC(mesh, 8192);
+        ap_memory_print_stat();
+
+        struct AP_Memory_Stat stat;
+        ap_memory_get_stat(AP_MEMORY_TAG_MESH, &stat);
+        LOGI("MESH live %zu bytes, peak %zu bytes, %d allocs",
+                stat.live_bytes, stat.peak_bytes, stat.live_count);
+        // reallocating and retagging are not counted as allocations
+        struct AP_Memory_Stat font;
+        ap_memory_get_stat(AP_MEMORY_TAG_FONT, &font);
+        LOGI("total count: %s",
+                stat.total_count - mesh_before.total_count == 1
+                && font.total_count == font_before.total_count
+                && font.live_count == font_before.live_count + 1
+                ? "PASS" : "FAILED");
+
+        AP_FREE(mesh);
+        AP_FREE(texture);
+        ap_memory_set_budget(AP_MEMORY_TAG_MESH, 0);
+        ap_memory_get_stat(AP_MEMORY_TAG_MESH, &stat);
+        LOGI("MESH live %zu bytes after free", stat.live_bytes);
+
+        printf("------AP_Memory stat test finished--------\n\n");
+}
+
+void test_ap_memory_benchmark()
+{
+        LOGI("-------AP_Memory benchmark-------");
+
+        // churn 1M allocations with 64K blocks alive at the same time
+        const int total = 1000000;
+        const int live = 65536;
+        char **ptr_arr = malloc(live * sizeof(char*));
+        memset(ptr_arr, 0, live * sizeof(char*));
+
+        srand(0);
+        double start = ap_get_time();
+        for (int i = 0; i < total; ++i) {
+                int slot = rand() % live;
+                AP_FREE(ptr_arr[slot]);
+                ptr_arr[slot] = AP_MALLOC(16 + rand() % 256);
+        }
+        double churn = ap_get_time() - start;
+        LOGI("unreleased after churn: %d", ap_memory_unreleased_num());
+
+        start = ap_get_time();
+        for (int i = 0; i < live; ++i) {
+                AP_FREE(ptr_arr[i]);
+                ptr_arr[i] = NULL;
+        }
+        double teardown = ap_get_time() - start;
+        free(ptr_arr);
+
+        LOGI("%d alloc/free: %.3lfs, teardown %d blocks: %.3lfs",
+                total, churn, live, teardown);
+        LOGI("unreleased: %d", ap_memory_unreleased_num());
+
+        printf("------AP_Memory benchmark finished--------\n\n");
+}
+
+struct test_memory_thread_param {
+        _Atomic(char*) *slots;
+        int slot_num;
+        int ops;
+        unsigned int seed;
+};
+
+static void *test_memory_thread_func(void *arg)
+{
+        struct test_memory_thread_param *param = arg;
+        unsigned int x = param->seed;
+        for (int i = 0; i < param->ops; ++i) {
+                // xorshift, rand() is not thread safe
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                char *ptr = AP_MALLOC(16 + x % 256);
+                ptr[0] = (char) i;
+                // the old pointer may be allocated by another thread
+                char *old = atomic_exchange(
+                        &param->slots[x % param->slot_num], ptr);
+                AP_FREE(old);
+        }
+        return NULL;
+}
+
+void test_ap_memory_threads()
+{
+        LOGI("-------AP_Memory thread stress test-------");
+
+        const int slot_num = 65536;
+        const int ops = 500000;         // per thread
+        const int max_threads = 8;
+        _Atomic(char*) *slots = malloc(slot_num * sizeof(_Atomic(char*)));
+        pthread_t threads[max_threads];
+        struct test_memory_thread_param params[max_threads];
+
+        for (int n = 1; n <= max_threads; n *= 2) {
+                for (int i = 0; i < slot_num; ++i) {
+                        atomic_init(&slots[i], NULL);
+                }
+                double start = ap_get_time();
+                for (int t = 0; t < n; ++t) {
+                        params[t].slots = slots;
+                        params[t].slot_num = slot_num;
+                        params[t].ops = ops;
+                        params[t].seed = 2463534242u + t * 7919;
+                        pthread_create(&threads[t], NULL,
+                                test_memory_thread_func, &params[t]);
+                }
+                for (int t = 0; t < n; ++t) {
+                        pthread_join(threads[t], NULL);
+                }
+                double time = ap_get_time() - start;
+                for (int i = 0; i < slot_num; ++i) {
+                        AP_FREE(atomic_load(&slots[i]));
+                }
+
+                struct AP_Memory_Stat stat;
+                ap_memory_get_stat(AP_MEMORY_TAG_UNKNOWN, &stat);
+                bool pass = ap_memory_unreleased_num() == 0
+                        && stat.live_bytes == 0 && stat.live_count == 0;
+                LOGI("%d threads * %d alloc/free: %.3lfs, %.1lf Mops/s, %s",
+                        n, ops, time, n * ops / time / 1e6,
+                        pass ? "PASS" : "FAILED");
+        }
+        free(slots);
+
+        printf("------AP_Memory thread stress test finished--------\n\n");
+}
+
+void test_ap_arena()
+{
+        LOGI("-------AP_Arena test-------");
+
+        struct AP_Arena arena;
+        ap_arena_init(&arena, 1024);
+        char *a = ap_arena_alloc(&arena, 100);
+        memset(a, 'a', 100);
+
+        // nested scopes
+        struct AP_Arena_Marker outer = ap_arena_mark(&arena);
+        char *b = ap_arena_alloc(&arena, 800);
+        struct AP_Arena_Marker inner = ap_arena_mark(&arena);
+        // larger than the block, a new block is chained
+        char *c = ap_arena_alloc(&arena, 4096);
+        memset(c, 'c', 4096);
+        LOGI("used in inner scope: %zu", arena.used);
+        ap_arena_rewind(&arena, inner);
+        char *d = ap_arena_alloc(&arena, 16);
+        LOGI("rewind inner scope: %s", d == b + 800 ? "PASS" : "FAILED");
+        ap_arena_rewind(&arena, outer);
+        LOGI("rewind outer scope: %s",
+                ap_arena_alloc(&arena, 1) == b ? "PASS" : "FAILED");
+        LOGI("memory of outer scope kept: %s",
+                a[0] == 'a' && a[99] == 'a' ? "PASS" : "FAILED");
+
+        // reset merges the blocks into one which fits the peak usage
+        ap_arena_alloc(&arena, 2048);
+        ap_arena_reset(&arena);
+        LOGI("used %zu, peak %zu, block size %zu",
+                arena.used, arena.peak, arena.block_size);
+        ap_arena_free(&arena);
+        LOGI("unreleased: %d", ap_memory_unreleased_num());
+
+        printf("------AP_Arena test finished--------\n\n");
+}
+
+// same as the flags of ap_model_generate
+#define TEST_MODEL_IMPORT_FLAGS (aiProcess_Triangulate \
+        | aiProcess_GenSmoothNormals | aiProcess_FlipUVs \
+        | aiProcess_CalcTangentSpace)
+
+/**
+ * Convert mesh the way ap_model_process_mesh did before the vertices were
+ * extracted directly: each vertex is built field by field and staged,
+ * then copied again by ap_mesh_init_data. Kept as the baseline of the
+ * model loading benchmarks, the meshes are optimized like the current
+ * path so that only the staging differs.
+ * @param arena the staging buffers are allocated from arena,
+ *        NULL to push the vertices and indices one by one to AP_Vector
+ */
+static int test_model_convert_staged(
+        const struct aiMesh *mesh,
+        struct AP_Arena *arena,
+        struct AP_Mesh *mesh_new)
+{
+        unsigned int indices_length = 0;
+        for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
+                indices_length += mesh->mFaces[i].mNumIndices;
+        }
+        struct AP_Vector vec_vertices;
+        struct AP_Vector vec_indices;
+        struct AP_Arena_Marker marker = { 0 };
+        struct AP_Vertex *vertices = NULL;
+        unsigned int *indices = NULL;
+        if (arena) {
+                marker = ap_arena_mark(arena);
+                vertices = ap_arena_alloc(arena,
+                        sizeof(struct AP_Vertex) * mesh->mNumVertices);
+                indices = ap_arena_alloc(arena,
+                        sizeof(unsigned int) * indices_length);
+                if (vertices == NULL || indices == NULL) {
+                        ap_arena_rewind(arena, marker);
+                        return AP_ERROR_MALLOC_FAILED;
+                }
+        } else {
+                ap_vector_init(&vec_vertices, AP_VECTOR_VERTEX);
+                ap_vector_init(&vec_indices, AP_VECTOR_UINT);
+        }
+
+        for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
+                struct AP_Vertex vertex = { 0 };
+                vertex.position[0] = mesh->mVertices[i].x;
+                vertex.position[1] = mesh->mVertices[i].y;
+                vertex.position[2] = mesh->mVertices[i].z;
+                if (mesh->mNormals) {
+                        vertex.normal[0] = mesh->mNormals[i].x;
+                        vertex.normal[1] = mesh->mNormals[i].y;
+                        vertex.normal[2] = mesh->mNormals[i].z;
+                }
+                if (mesh->mTextureCoords[0]) {
+                        vertex.tex_coords[0] = mesh->mTextureCoords[0][i].x;
+                        vertex.tex_coords[1] = mesh->mTextureCoords[0][i].y;
+                }
+                if (mesh->mTangents) {
+                        vertex.tangent[0] = mesh->mTangents[i].x;
+                        vertex.tangent[1] = mesh->mTangents[i].y;
+                        vertex.tangent[2] = mesh->mTangents[i].z;
+                        vertex.big_tangent[0] = mesh->mBitangents[i].x;
+                        vertex.big_tangent[1] = mesh->mBitangents[i].y;
+                        vertex.big_tangent[2] = mesh->mBitangents[i].z;
+                }
+                if (arena) {
+                        vertices[i] = vertex;
+                } else {
+                        ap_vector_push_back(&vec_vertices,
+                                (const char *) &vertex);
+                }
+        }
+        unsigned int index = 0;
+        for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
+                struct aiFace face = mesh->mFaces[i];
+                for (unsigned int j = 0; j < face.mNumIndices; ++j) {
+                        if (arena) {
+                                indices[index++] = face.mIndices[j];
+                        } else {
+                                ap_vector_push_back(&vec_indices,
+                                        (const char *) &face.mIndices[j]);
+                        }
+                }
+        }
+        if (!arena) {
+                vertices = (struct AP_Vertex *) vec_vertices.data;
+                indices = (unsigned int *) vec_indices.data;
+        }
+
+        ap_optimize_vertex_cache(indices, indices_length, mesh->mNumVertices);
+        ap_optimize_vertex_fetch(vertices, indices, indices_length,
+                mesh->mNumVertices);
+        int ret = ap_mesh_init(mesh_new, vertices, mesh->mNumVertices,
+                indices, indices_length, NULL, 0);
+
+        if (arena) {
+                ap_arena_rewind(arena, marker);
+        } else {
+                ap_vector_free(&vec_vertices);
+                ap_vector_free(&vec_indices);
+        }
+        return ret;
+}
+
+/**
+ * Import path and create its meshes by test_model_convert_staged,
+ * the meshes are released after created and the materials are not loaded
+ * @return number of triangles, -1 on error
+ */
+static int test_model_load_staged(const char *path, struct AP_Arena *arena)
+{
+        const struct aiScene *scene = aiImportFileEx(
+                path, TEST_MODEL_IMPORT_FLAGS, NULL);
+        if (scene == NULL) {
+                LOGE("failed to import %s", path);
+                return -1;
+        }
+        int triangles = 0;
+        for (unsigned int i = 0; i < scene->mNumMeshes; ++i) {
+                struct AP_Mesh mesh;
+                if (test_model_convert_staged(
+                        scene->mMeshes[i], arena, &mesh) != 0)
+                {
+                        triangles = -1;
+                        break;
+                }
+                triangles += mesh.indices_length / 3;
+                ap_mesh_delete_buffers(&mesh);
+                ap_mesh_free(&mesh);
+        }
+        aiReleaseImport(scene);
+        return triangles;
+}
+
+void test_ap_arena_benchmark()
+{
+        LOGI("-------AP_Arena benchmark-------");
+
+        // the larger model, a grid of 256 x 256 quads
+        const char *grid = "test_arena_grid.obj";
+        const int size = 256;
+        FILE *fp = fopen(grid, "w");
+        if (fp == NULL) {
+                LOGE("failed to write %s", grid);
+                return;
+        }
+        for (int y = 0; y <= size; ++y) {
+                for (int x = 0; x <= size; ++x) {
+                        fprintf(fp, "v %d %d 0\n", x, y);
+                }
+        }
+        fprintf(fp, "vn 0 0 1\n");
+        for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                        int v = y * (size + 1) + x + 1;
+                        int w = v + size + 1;
+                        fprintf(fp, "f %d//1 %d//1 %d//1\n", v, v + 1, w);
+                        fprintf(fp, "f %d//1 %d//1 %d//1\n",
+                                v + 1, w + 1, w);
+                }
+        }
+        fclose(fp);
+
+        GLFWwindow *window = test_gl_context_create();
+        if (window == NULL) {
+                remove(grid);
+                return;
+        }
+
+        // the meshes staged in AP_Vector pushed one by one first,
+        // then in the frame arena
+        const char *paths[] = { AP_MODEL_CUBE_PATH, AP_MODEL_BALL_PATH, grid };
+        const int runs = 10;
+        for (int i = 0; i < 3; ++i) {
+                double elapsed[2] = { 0.0, 0.0 };
+                int triangles[2] = { 0, 0 };
+                for (int a = 0; a < 2; ++a) {
+                        struct AP_Arena *arena = a ? ap_arena_frame() : NULL;
+                        for (int r = 0; r < runs; ++r) {
+                                double start = ap_get_time();
+                                triangles[a] = test_model_load_staged(
+                                        paths[i], arena);
+                                glFinish();
+                                elapsed[a] += ap_get_time() - start;
+                        }
+                }
+                LOGI("%s: vector %.3lfms, arena %.3lfms (%.2lfx), %s",
+                        paths[i], elapsed[0] * 1000 / runs,
+                        elapsed[1] * 1000 / runs, elapsed[0] / elapsed[1],
+                        triangles[0] > 0 && triangles[0] == triangles[1]
+                                ? "PASS" : "FAILED");
+        }
+
+        test_gl_context_destroy(window);
+        remove(grid);
+        LOGI("unreleased: %d", ap_memory_unreleased_num());
+
+        printf("------AP_Arena benchmark finished--------\n\n");
+}
+
+struct test_pool_object {
+        unsigned int id;
+        float pos[3];
+        float size[3];
+};
+
+void test_ap_pool()
+{
+        LOGI("-------AP_Pool test-------");
+
+        const int num = 100000;
+        struct AP_Pool pool;
+        ap_pool_init(&pool, sizeof(struct test_pool_object),
+                0, AP_MEMORY_TAG_PHYSIC);
+        struct test_pool_object **ptr_arr =
+                malloc(num * sizeof(struct test_pool_object*));
+
+        double start = ap_get_time();
+        for (int i = 0; i < num; ++i) {
+                ptr_arr[i] = ap_pool_alloc(&pool);
+                ptr_arr[i]->id = i;
+        }
+        double alloc_time = ap_get_time() - start;
+
+        // objects are never moved when pool grows
+        bool stable = true;
+        for (int i = 0; i < num; ++i) {
+                if (ptr_arr[i]->id != (unsigned int) i) {
+                        stable = false;
+                }
+        }
+        LOGI("stable address: %s", stable ? "PASS" : "FAILED");
+
+        // released objects are reused without growing
+        int capacity = pool.capacity;
+        for (int i = 0; i < num; i += 2) {
+                ap_pool_release(&pool, ptr_arr[i]);
+        }
+        for (int i = 0; i < num; i += 2) {
+                ptr_arr[i] = ap_pool_alloc(&pool);
+        }
+        LOGI("reuse released objects: %s",
+                capacity == pool.capacity && pool.length == num
+                ? "PASS" : "FAILED");
+
+        start = ap_get_time();
+        for (int i = 0; i < num; ++i) {
+                ap_pool_release(&pool, ptr_arr[i]);
+                ptr_arr[i] = ap_pool_alloc(&pool);
+        }
+        double churn_pool = ap_get_time() - start;
+        ap_pool_free(&pool);
+
+        for (int i = 0; i < num; ++i) {
+                ptr_arr[i] = AP_MALLOC(sizeof(struct test_pool_object));
+        }
+        start = ap_get_time();
+        for (int i = 0; i < num; ++i) {
+                AP_FREE(ptr_arr[i]);
+                ptr_arr[i] = AP_MALLOC(sizeof(struct test_pool_object));
+        }
+        double churn_malloc = ap_get_time() - start;
+        for (int i = 0; i < num; ++i) {
+                AP_FREE(ptr_arr[i]);
+        }
+        free(ptr_arr);
+
+        LOGI("%d objects: alloc %.4lfs, release/alloc pool %.4lfs, "
+                "AP_MALLOC %.4lfs", num, alloc_time,
+                churn_pool, churn_malloc);
+        LOGI("unreleased: %d", ap_memory_unreleased_num());
+
+        printf("------AP_Pool test finished--------\n\n");
+}
+
+void test_ap_slot_map()
+{
+        LOGI("-------AP_Slot_Map test-------");
+
+        const int num = 10000;
+        struct AP_Slot_Map map;
+        ap_slot_map_init(&map, sizeof(int));
+        unsigned int *handles = malloc(num * sizeof(unsigned int));
+        for (int i = 0; i < num; ++i) {
+                ap_slot_map_insert(&map, &i, &handles[i]);
+        }
+
+        bool found = true;
+        for (int i = 0; i < num; ++i) {
+                int *value = ap_slot_map_get(&map, handles[i]);
+                if (value == NULL || *value != i) {
+                        found = false;
+                }
+        }
+        LOGI("get by handle: %s", found ? "PASS" : "FAILED");
+
+        // the removed slot is reused with a new generation
+        unsigned int removed = handles[num / 2];
+        ap_slot_map_remove(&map, removed);
+        int value = -1;
+        ap_slot_map_insert(&map, &value, &handles[num / 2]);
+        LOGI("stale handle rejected: %s",
+                ap_slot_map_get(&map, removed) == NULL
+                && handles[num / 2] != removed
+                && *(int*) ap_slot_map_get(&map, handles[num / 2]) == -1
+                ? "PASS" : "FAILED");
+
+        // the generation of a slot is used up by churning it,
+        // the slot is retired and the first handle stays stale
+        struct AP_Slot_Map churn;
+        ap_slot_map_init(&churn, sizeof(int));
+        unsigned int kept = 0, first = 0, handle = 0;
+        // slot 0 is kept, slot 1 is churned
+        ap_slot_map_insert(&churn, &value, &kept);
+        ap_slot_map_insert(&churn, &value, &first);
+        handle = first;
+        bool retired = true;
+        for (unsigned int i = 0; i <= AP_SLOT_GENERATION_MASK; ++i) {
+                ap_slot_map_remove(&churn, handle);
+                ap_slot_map_insert(&churn, &value, &handle);
+                if (ap_slot_map_get(&churn, first) != NULL) {
+                        retired = false;
+                }
+        }
+        // a handle of generation 0, such as a plain index, does not
+        // find the retired slot 1
+        unsigned int plain = first & AP_SLOT_INDEX_MASK;
+        retired = retired && plain == 1
+                && ap_slot_map_get(&churn, plain) == NULL
+                && ap_slot_map_remove(&churn, plain) != 0
+                && ap_slot_map_get(&churn, kept) != NULL;
+        LOGI("generation never wraps: %s",
+                retired && churn.slots.length == 3 ? "PASS" : "FAILED");
+        ap_slot_map_free(&churn);
+
+        // remove every other element, the rest are still dense
+        for (int i = 0; i < num; i += 2) {
+                ap_slot_map_remove(&map, handles[i]);
+        }
+        bool dense = ap_slot_map_length(&map) == (size_t) num / 2;
+        int *data = ap_slot_map_data(&map);
+        for (size_t i = 0; i < ap_slot_map_length(&map); ++i) {
+                int *p = ap_slot_map_get(&map, ap_slot_map_handle_at(&map, i));
+                if (p != data + i || data[i] % 2 != 1) {
+                        dense = false;
+                }
+        }
+        LOGI("dense iteration: %s", dense ? "PASS" : "FAILED");
+
+        // lookup cost does not depend on the number of elements
+        double start = ap_get_time();
+        long sum = 0;
+        for (int n = 0; n < 100; ++n) {
+                for (int i = 1; i < num; i += 2) {
+                        sum += *(int*) ap_slot_map_get(&map, handles[i]);
+                }
+        }
+        double lookup = ap_get_time() - start;
+        LOGI("%d lookups of %zu elements: %.4lfs (%ld)",
+                100 * num / 2, ap_slot_map_length(&map), lookup, sum);
+
+        ap_slot_map_free(&map);
+        free(handles);
+
+        printf("------AP_Slot_Map test finished--------\n\n");
+}
+
+void test_ap_hashmap()
+{
+        LOGI("-------AP_Hashmap test-------");
+
+        const int num = 100000;
+        struct AP_Hashmap map;
+        ap_hashmap_init(&map, sizeof(int));
+        for (int i = 0; i < num; ++i) {
+                int value = i * 2;
+                ap_hashmap_insert(&map, i * 7u, &value);
+        }
+        bool found = ap_hashmap_length(&map) == (size_t) num;
+        for (int i = 0; i < num; ++i) {
+                int *value = ap_hashmap_get(&map, i * 7u);
+                if (value == NULL || *value != i * 2) {
+                        found = false;
+                }
+        }
+        LOGI("insert and get: %s", found ? "PASS" : "FAILED");
+
+        // insert an existing key replaces its value
+        int value = -1;
+        ap_hashmap_insert(&map, 7, &value);
+        LOGI("replace: %s", *(int*) ap_hashmap_get(&map, 7) == -1
+                && ap_hashmap_length(&map) == (size_t) num
+                ? "PASS" : "FAILED");
+
+        // the elements after the removed ones are still found
+        for (int i = 0; i < num; i += 2) {
+                ap_hashmap_remove(&map, i * 7u);
+        }
+        bool removed = ap_hashmap_length(&map) == (size_t) num / 2;
+        for (int i = 0; i < num; ++i) {
+                int *p = ap_hashmap_get(&map, i * 7u);
+                if ((i % 2 == 0) != (p == NULL)) {
+                        removed = false;
+                }
+        }
+        removed = removed && ap_hashmap_remove(&map, 0) != 0
+                && ap_hashmap_get(&map, 1) == NULL;
+        LOGI("remove: %s", removed ? "PASS" : "FAILED");
+
+        double start = ap_get_time();
+        long sum = 0;
+        for (int n = 0; n < 10; ++n) {
+                for (int i = 0; i < num; ++i) {
+                        int *p = ap_hashmap_get(&map, i * 7u);
+                        sum += p ? *p : 0;
+                }
+        }
+        double lookup = ap_get_time() - start;
+        LOGI("%d lookups of %zu elements: %.4lfs (%ld)",
+                10 * num, ap_hashmap_length(&map), lookup, sum);
+
+        ap_hashmap_clear(&map);
+        LOGI("clear: %s", ap_hashmap_length(&map) == 0
+                && ap_hashmap_get(&map, 7) == NULL ? "PASS" : "FAILED");
+        ap_hashmap_free(&map);
+
+        printf("------AP_Hashmap test finished--------\n\n");
+}
+
+void test_utf8_decode()
+{
+        LOGI("-------UTF-8 decode test-------");
+
+        // A, e with acute, CJK, emoji
+        const char *text = "A\xC3\xA9\xE4\xB8\xAD\xF0\x9F\x98\x80";
+        unsigned int expected[] = { 0x41, 0xE9, 0x4E2D, 0x1F600 };
+        int lengths[] = { 1, 2, 3, 4 };
+        bool pass = true;
+        const char *p = text;
+        for (int i = 0; i < 4; ++i) {
+                unsigned int code = 0;
+                int length = ap_utf8_decode(p, &code);
+                if (code != expected[i] || length != lengths[i]) {
+                        pass = false;
+                }
+                p += length;
+        }
+        LOGI("valid sequences: %s", pass ? "PASS" : "FAILED");
+
+        // overlong, surrogate, truncated, stray continuation byte
+        const char *invalid[] = {
+                "\xC0\xAF", "\xED\xA0\x80", "\xE4\xB8", "\x80",
+        };
+        pass = true;
+        for (int i = 0; i < 4; ++i) {
+                unsigned int code = 0;
+                int length = ap_utf8_decode(invalid[i], &code);
+                if (code != AP_UTF8_REPLACEMENT || length != 1) {
+                        pass = false;
+                }
+        }
+        LOGI("invalid sequences: %s", pass ? "PASS" : "FAILED");
+
+        printf("------UTF-8 decode test finished--------\n\n");
+}
+
+static bool test_cluster_has(
+        struct AP_Cluster_Grid *grid, int cluster, unsigned int light)
+{
+        unsigned int offset = grid->clusters[2 * cluster];
+        unsigned int count = grid->clusters[2 * cluster + 1];
+        for (unsigned int i = 0; i < count; ++i) {
+                if (grid->indices[offset + i] == light) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+void test_light_cluster()
+{
+        LOGI("-------Light cluster test-------");
+
+        // perspective projection, fovy 90 degree, aspect 16:9
+        float near = 0.1f;
+        float far = 100.0f;
+        float projection[16] = { 0 };
+        projection[0] = 9.0f / 16.0f;
+        projection[5] = 1.0f;
+        projection[10] = -(far + near) / (far - near);
+        projection[11] = -1.0f;
+        projection[14] = -2.0f * far * near / (far - near);
+        float view[16] = {
+                1.0f, 0.0f, 0.0f, 0.0f,
+                0.0f, 1.0f, 0.0f, 0.0f,
+                0.0f, 0.0f, 1.0f, 0.0f,
+                0.0f, 0.0f, 0.0f, 1.0f,
+        };
+        // in front of the camera, behind the camera, never fades out
+        struct AP_Cluster_Light lights[3] = {
+                { { 0.0f, 0.0f, -10.0f }, 1.0f },
+                { { 0.0f, 0.0f, 10.0f }, 1.0f },
+                { { 0.0f, 0.0f, 0.0f }, -1.0f },
+        };
+
+        struct AP_Cluster_Grid grid;
+        ap_cluster_init(&grid);
+        ap_cluster_setup(&grid, projection, near, far);
+        ap_cluster_bin(&grid, view, lights, 3);
+
+        int slice = ap_cluster_slice(&grid, 10.0f);
+        int center = ap_cluster_index(AP_CLUSTER_X / 2, AP_CLUSTER_Y / 2,
+                slice);
+        int corner = ap_cluster_index(0, 0, slice);
+        bool pass = test_cluster_has(&grid, center, 0)
+                && !test_cluster_has(&grid, corner, 0);
+        int light_0 = 0;
+        for (int c = 0; c < AP_CLUSTER_NUM; ++c) {
+                if (test_cluster_has(&grid, c, 1)
+                        || !test_cluster_has(&grid, c, 2))
+                {
+                        pass = false;
+                }
+                light_0 += test_cluster_has(&grid, c, 0);
+        }
+        if (grid.index_num != (size_t) (light_0 + AP_CLUSTER_NUM)) {
+                pass = false;
+        }
+        LOGI("light 0 in %d clusters, %zu indices", light_0, grid.index_num);
+        LOGI("binning: %s", pass ? "PASS" : "FAILED");
+
+        // the slices binned by the workers give the same clusters
+        unsigned int *clusters = AP_MALLOC(
+                sizeof(unsigned int) * 2 * AP_CLUSTER_NUM);
+        memcpy(clusters, grid.clusters,
+                sizeof(unsigned int) * 2 * AP_CLUSTER_NUM);
+        ap_thread_init(4);
+        ap_cluster_bin(&grid, view, lights, 3);
+        ap_thread_free();
+        pass = memcmp(clusters, grid.clusters,
+                sizeof(unsigned int) * 2 * AP_CLUSTER_NUM) == 0;
+        LOGI("parallel binning: %s", pass ? "PASS" : "FAILED");
+        AP_FREE(clusters);
+
+        // attenuation at the radius is 1/256
+        float r = ap_cluster_light_radius(1.0f, 1.0f, 0.09f, 0.032f);
+        float att = 1.0f + 0.09f * r + 0.032f * r * r;
+        LOGI("light radius %f: %s", r,
+                fabsf(att - 256.0f) < 0.01f ? "PASS" : "FAILED");
+
+        ap_cluster_free(&grid);
+        printf("------Light cluster test finished--------\n\n");
+}
+
+void test_frustum_cull()
+{
+        LOGI("-------Frustum culling test-------");
+
+        // camera at the origin looking at -z
+        mat4 projection, view, view_projection;
+        glm_perspective(glm_rad(45.0f), 16.0f / 9.0f, 0.1f, 100.0f,
+                projection);
+        glm_lookat((vec3) { 0.0f, 0.0f, 0.0f }, (vec3) { 0.0f, 0.0f, -1.0f },
+                (vec3) { 0.0f, 1.0f, 0.0f }, view);
+        glm_mat4_mul(projection, view, view_projection);
+        struct AP_Frustum frustum;
+        ap_frustum_extract(&frustum, view_projection[0]);
+
+        const float spheres[][4] = {
+                { 0.0f, 0.0f, -10.0f, 1.0f },   // in front
+                { 0.0f, 0.0f, 10.0f, 1.0f },    // behind
+                { 0.0f, 0.0f, 1.0f, 2.0f },     // around the camera
+                { 0.0f, 0.0f, -200.0f, 1.0f },  // further than far
+                { 50.0f, 0.0f, -10.0f, 1.0f },  // at right
+        };
+        const bool expected[] = { true, false, true, false, false };
+        bool visible[5];
+        struct AP_Cull_Stats stats = { 0 };
+        ap_frustum_test_spheres(&frustum, spheres[0], 5, visible, &stats);
+        bool pass = stats.tested == 5 && stats.visible == 2;
+        for (int i = 0; i < 5; ++i) {
+                pass = pass && visible[i] == expected[i];
+        }
+        LOGI("spheres: %s", pass ? "PASS" : "FAILED");
+
+        // a box moved by the model matrix
+        float aabb[6] = { -1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+        float sphere[4] = { 0.0f, 0.0f, 0.0f, sqrtf(3.0f) };
+        float aabb_out[6], sphere_out[4];
+        mat4 model;
+        glm_mat4_identity(model);
+        glm_translate(model, (vec3) { 0.0f, 0.0f, -20.0f });
+        ap_frustum_transform_bounds(model[0], aabb, sphere,
+                aabb_out, sphere_out);
+        pass = ap_frustum_test_aabb(&frustum, aabb_out)
+                && ap_frustum_test_sphere(&frustum, sphere_out);
+        glm_translate(model, (vec3) { 0.0f, 0.0f, 40.0f });
+        ap_frustum_transform_bounds(model[0], aabb, sphere,
+                aabb_out, sphere_out);
+        pass = pass && !ap_frustum_test_aabb(&frustum, aabb_out)
+                && !ap_frustum_test_sphere(&frustum, sphere_out);
+        LOGI("boxes: %s", pass ? "PASS" : "FAILED");
+
+        // the batch test agrees with the test of one sphere
+        const int num = 100003;
+        float *random = AP_MALLOC(sizeof(float) * 4 * num);
+        bool *result = AP_MALLOC(sizeof(bool) * num);
+        for (int i = 0; i < num; ++i) {
+                for (int j = 0; j < 3; ++j) {
+                        random[4 * i + j] =
+                                (float) rand() / RAND_MAX * 200.0f - 100.0f;
+                }
+                random[4 * i + 3] = (float) rand() / RAND_MAX * 5.0f;
+        }
+        memset(&stats, 0, sizeof(stats));
+        double start = ap_get_time();
+        ap_frustum_test_spheres(&frustum, random, num, result, &stats);
+        double elapsed = ap_get_time() - start;
+        pass = true;
+        for (int i = 0; i < num; ++i) {
+                if (result[i] != ap_frustum_test_sphere(
+                        &frustum, random + 4 * i))
+                {
+                        pass = false;
+                }
+        }
+        LOGI("batch of %d spheres: %d visible, %.3f ms, %s", stats.tested,
+                stats.visible, elapsed * 1000.0, pass ? "PASS" : "FAILED");
+        AP_FREE(random);
+        AP_FREE(result);
+
+        printf("------Frustum culling test finished--------\n\n");
+}
+
+void test_vertex_format()
+{
+        LOGI("-------Vertex format test-------");
+
+        // every half float is converted back to itself
+        bool pass = true;
+        for (unsigned int h = 0; h < 0x10000; ++h) {
+                bool nan = ((h >> 10) & 0x1F) == 0x1F && (h & 0x3FF);
+                float f = ap_vertex_half_to_float(h);
+                if (!nan && ap_vertex_float_to_half(f) != h) {
+                        pass = false;
+                }
+        }
+        LOGI("half float: %s", pass ? "PASS" : "FAILED");
+
+        const int num = 100000;
+        struct AP_Vertex *vertices = AP_MALLOC(sizeof(struct AP_Vertex) * num);
+        for (int i = 0; i < num; ++i) {
+                float *n = vertices[i].normal;
+                for (int j = 0; j < 3; ++j) {
+                        vertices[i].position[j] =
+                                (float) rand() / RAND_MAX * 20.0f - 10.0f;
+                        n[j] = (float) rand() / RAND_MAX * 2.0f - 1.0f;
+                }
+                glm_vec3_normalize(n);
+                vertices[i].tex_coords[0] = (float) rand() / RAND_MAX;
+                vertices[i].tex_coords[1] = (float) rand() / RAND_MAX;
+        }
+
+        for (int format = 0; format < AP_VERTEX_FORMAT_LENGTH; ++format) {
+                const struct AP_Vertex_Layout *layout =
+                        ap_vertex_get_layout(format);
+                void *out = AP_MALLOC(layout->stride * num);
+                double start = ap_get_time();
+                ap_vertex_pack(format, vertices, num, out);
+                double elapsed = ap_get_time() - start;
+                LOGI("format %d: %d bytes per vertex (%.0f%% of %zu), "
+                        "packed %d vertices in %.3f ms", format,
+                        layout->stride,
+                        100.0f * layout->stride / sizeof(struct AP_Vertex),
+                        sizeof(struct AP_Vertex), num, elapsed * 1000.0);
+                AP_FREE(out);
+        }
+
+        // error of the packed attributes
+        float position_error = 0.0f;
+        float normal_error = 0.0f;
+        for (int i = 0; i < num; ++i) {
+                for (int j = 0; j < 3; ++j) {
+                        float p = vertices[i].position[j];
+                        float e = fabsf(ap_vertex_half_to_float(
+                                ap_vertex_float_to_half(p)) - p);
+                        position_error = e > position_error
+                                ? e : position_error;
+                }
+                int8_t oct[2];
+                float normal[3];
+                ap_vertex_oct_encode(vertices[i].normal, oct);
+                ap_vertex_oct_decode(oct, normal);
+                float cos = glm_vec3_dot(normal, vertices[i].normal);
+                float angle = glm_deg(acosf(cos > 1.0f ? 1.0f : cos));
+                normal_error = angle > normal_error ? angle : normal_error;
+        }
+        pass = position_error <= 0.004f && normal_error < 1.0f;
+        LOGI("packed position error %f, normal error %f degree: %s",
+                position_error, normal_error, pass ? "PASS" : "FAILED");
+        AP_FREE(vertices);
+
+        printf("------Vertex format test finished--------\n\n");
+}
+
+void test_vertex_cache()
+{
+        LOGI("-------Vertex cache test-------");
+
+        // grid of 128 x 128 quads with the triangles shuffled
+        const int size = 128;
+        const int vertex_num = (size + 1) * (size + 1);
+        const int index_num = size * size * 6;
+        struct AP_Vertex *vertices = AP_MALLOC(
+                sizeof(struct AP_Vertex) * vertex_num);
+        unsigned int *indices = AP_MALLOC(sizeof(unsigned int) * index_num);
+        memset(vertices, 0, sizeof(struct AP_Vertex) * vertex_num);
+        for (int i = 0; i < vertex_num; ++i) {
+                vertices[i].position[0] = i % (size + 1);
+                vertices[i].position[1] = i / (size + 1);
+        }
+        for (int y = 0, n = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                        unsigned int v = y * (size + 1) + x;
+                        unsigned int quad[6] = {
+                                v, v + 1, v + size + 1,
+                                v + 1, v + size + 2, v + size + 1,
+                        };
+                        memcpy(indices + n, quad, sizeof(quad));
+                        n += 6;
+                }
+        }
+        for (int t = index_num / 3 - 1; t > 0; --t) {
+                int r = rand() % (t + 1);
+                unsigned int tmp[3];
+                memcpy(tmp, indices + 3 * t, sizeof(tmp));
+                memcpy(indices + 3 * t, indices + 3 * r, sizeof(tmp));
+                memcpy(indices + 3 * r, tmp, sizeof(tmp));
+        }
+
+        // positions of the triangles are kept by the reordering
+        double sum = 0.0;
+        for (int i = 0; i < index_num; ++i) {
+                sum += vertices[indices[i]].position[0] * 3
+                        + vertices[indices[i]].position[1] * 7;
+        }
+        float before = ap_optimize_acmr(indices, index_num, vertex_num,
+                AP_OPTIMIZE_FIFO_SIZE);
+        double start = ap_get_time();
+        ap_optimize_vertex_cache(indices, index_num, vertex_num);
+        double elapsed = ap_get_time() - start;
+        ap_optimize_vertex_fetch(vertices, indices, index_num, vertex_num);
+        float after = ap_optimize_acmr(indices, index_num, vertex_num,
+                AP_OPTIMIZE_FIFO_SIZE);
+
+        double sum_after = 0.0;
+        bool ordered = true;
+        unsigned int next = 0;
+        for (int i = 0; i < index_num; ++i) {
+                sum_after += vertices[indices[i]].position[0] * 3
+                        + vertices[indices[i]].position[1] * 7;
+                // vertices are in the order of first use
+                if (indices[i] > next) {
+                        ordered = false;
+                } else if (indices[i] == next) {
+                        next++;
+                }
+        }
+        bool pass = sum == sum_after && ordered && after < 0.8f;
+        LOGI("%d triangles: ACMR %.3f -> %.3f in %.3f ms, %s",
+                index_num / 3, before, after, elapsed * 1000.0,
+                pass ? "PASS" : "FAILED");
+
+        AP_FREE(vertices);
+        AP_FREE(indices);
+        printf("------Vertex cache test finished--------\n\n");
+}
+
+void test_model_cache()
+{
+        LOGI("-------Model cache test-------");
+
+        struct AP_Vertex vertices[4];
+        memset(vertices, 0, sizeof(vertices));
+        for (int i = 0; i < 4; ++i) {
+                vertices[i].position[0] = i % 2;
+                vertices[i].position[1] = i / 2;
+                vertices[i].normal[2] = 1.0f;
+                vertices[i].tex_coords[0] = i % 2;
+                vertices[i].tex_coords[1] = i / 2;
+        }
+        unsigned int indices[6] = { 0, 1, 2, 1, 3, 2 };
+        struct AP_Texture textures[2];
+        ap_texture_init(&textures[0]);
+        ap_texture_init(&textures[1]);
+        textures[0].type = AP_TEXTURE_TYPE_DIFFUSE;
+        textures[0].path = "quad.png";
+        textures[1].type = AP_TEXTURE_TYPE_DIFFUSE;
+        textures[1].RGBA[0] = 0.5f;
+        textures[1].RGBA[3] = 1.0f;
+        struct AP_Mesh mesh;
+        ap_mesh_init_data(&mesh, vertices, 4, indices, 6, textures, 2);
+        mesh.vertex_format = AP_VERTEX_FORMAT_PACKED;
+
+        const char *source = "res/quad.obj";
+        char path[AP_MODEL_CACHE_PATH_LENGTH];
+        ap_model_cache_path(AP_MODEL_CACHE_DIR, source, path, sizeof(path));
+        struct AP_Model_Cache_Key key = {
+                .mtime = 1, .size = 2, .import_flags = 3,
+                .vertex_format = AP_VERTEX_FORMAT_PACKED,
+        };
+        struct AP_Model_Cache cache;
+        bool pass = ap_model_cache_write(path, source, &key, &mesh, 1) == 0
+                && ap_model_cache_open(path, source, &key, &cache) == 0;
+        if (pass) {
+                const struct AP_Model_Cache_Mesh *m = &cache.meshes[0];
+                char packed[sizeof(vertices)];
+                ap_vertex_pack(AP_VERTEX_FORMAT_PACKED, vertices, 4, packed);
+                const uint16_t *short_indices =
+                        ap_model_cache_blob(&cache, m->index_offset);
+                const struct AP_Model_Cache_Texture *t = cache.textures;
+                pass = cache.header->mesh_num == 1
+                        && m->vertex_num == 4 && m->index_num == 6
+                        && m->index_size == 2
+                        && m->vertex_offset % AP_MODEL_CACHE_ALIGN == 0
+                        && memcmp(ap_model_cache_blob(&cache,
+                                m->vertex_offset), packed,
+                                4 * ap_vertex_get_layout(
+                                        AP_VERTEX_FORMAT_PACKED)->stride) == 0
+                        && short_indices[4] == 3
+                        && m->texture_num == 2
+                        && strcmp(ap_model_cache_texture_path(&cache, &t[0]),
+                                "quad.png") == 0
+                        && ap_model_cache_texture_path(&cache, &t[1]) == NULL
+                        && t[1].RGBA[0] == 0.5f
+                        && m->sphere[3] == mesh.sphere[3];
+                ap_model_cache_close(&cache);
+        }
+        LOGI("write and map: %s", pass ? "PASS" : "FAILED");
+
+        // a changed source or another path using the file is not loaded
+        struct AP_Model_Cache_Key stale = key;
+        stale.mtime = 4;
+        bool rejected = ap_model_cache_open(path, source, &stale, &cache) != 0
+                && ap_model_cache_open(path, "res/other.obj",
+                        &key, &cache) != 0;
+        LOGI("stale cache rejected: %s", rejected ? "PASS" : "FAILED");
+
+        remove(path);
+        ap_mesh_free(&mesh);
+        printf("------Model cache test finished--------\n\n");
+}
+
+void test_model_cache_benchmark()
+{
+        printf("------Model cache benchmark------\n");
+        GLFWwindow *window = test_gl_context_create();
+        if (window == NULL) {
+                return;
+        }
+
+        const char *paths[] = { AP_MODEL_CUBE_PATH, AP_MODEL_BALL_PATH };
+        const int runs = 10;
+        for (int i = 0; i < 2; ++i) {
+                char cache_path[AP_MODEL_CACHE_PATH_LENGTH];
+                ap_model_cache_path(AP_MODEL_CACHE_DIR, paths[i],
+                        cache_path, sizeof(cache_path));
+                remove(cache_path);
+
+                // cold: imported by assimp and the cache is written
+                unsigned int id = 0;
+                struct AP_Model *model = NULL;
+                double start = ap_get_time();
+                ap_model_generate(paths[i], &id);
+                glFinish();
+                double cold = ap_get_time() - start;
+                ap_model_get_ptr(id, &model);
+                int cold_meshes = model ? model->resource->mesh_length : -1;
+                ap_model_free();
+
+                // warm: mapped from the cache
+                double warm = 0.0;
+                int warm_meshes = -1;
+                for (int r = 0; r < runs; ++r) {
+                        model = NULL;
+                        start = ap_get_time();
+                        ap_model_generate(paths[i], &id);
+                        glFinish();
+                        warm += ap_get_time() - start;
+                        ap_model_get_ptr(id, &model);
+                        warm_meshes = model
+                                ? model->resource->mesh_length : -1;
+                        ap_model_free();
+                }
+                warm /= runs;
+                LOGI("%s: %d meshes, cold %.3lfms, warm %.3lfms (%.1fx), %s",
+                        paths[i], cold_meshes, cold * 1000, warm * 1000,
+                        cold / warm, cold_meshes == warm_meshes
+                                ? "PASS" : "FAILED");
+        }
+
+        test_gl_context_destroy(window);
+
+        printf("------Model cache benchmark finished------\n\n");
+}
+
+void test_model_shared()
+{
+        printf("------Shared model test------\n");
+        GLFWwindow *window = test_gl_context_create();
+        if (window == NULL) {
+                return;
+        }
+        // measure the import, not the model cache
+        ap_model_set_cache_dir(NULL);
+
+        // the first model imports the file, the others share it
+        const int num = 50;
+        unsigned int ids[50] = { 0 };
+        double start = ap_get_time();
+        ap_model_generate(AP_MODEL_BALL_PATH, &ids[0]);
+        double first = ap_get_time() - start;
+        start = ap_get_time();
+        for (int i = 1; i < num; ++i) {
+                ap_model_generate(AP_MODEL_BALL_PATH, &ids[i]);
+        }
+        double others = (ap_get_time() - start) / (num - 1);
+
+        struct AP_Model *a = NULL;
+        struct AP_Model *b = NULL;
+        ap_model_get_ptr(ids[0], &a);
+        ap_model_get_ptr(ids[num - 1], &b);
+        bool pass = a && b && a != b && a->resource == b->resource
+                && a->resource->ref_count == num;
+        LOGI("%d models: first %.3lfms, others %.3lfms each, %s", num,
+                first * 1000, others * 1000, pass ? "PASS" : "FAILED");
+
+        // the resource is kept until its last model is released
+        for (int i = 0; i < num - 1; ++i) {
+                ap_model_release(ids[i]);
+        }
+        pass = ap_model_get_ptr(ids[0], &a) != 0
+                && ap_model_get_ptr(ids[num - 1], &b) == 0
+                && b->resource->ref_count == 1
+                && b->resource->mesh_length > 0;
+        ap_model_release(ids[num - 1]);
+        pass = pass && ap_model_get_ptr(ids[num - 1], &b) != 0;
+        LOGI("release: %s", pass ? "PASS" : "FAILED");
+
+        // the meshes of another vertex format are not shared
+        unsigned int packed = 0;
+        ap_model_generate(AP_MODEL_BALL_PATH, &ids[0]);
+        ap_model_set_vertex_format(AP_VERTEX_FORMAT_PACKED);
+        ap_model_generate(AP_MODEL_BALL_PATH, &packed);
+        ap_model_set_vertex_format(AP_VERTEX_FORMAT_FLOAT);
+        ap_model_generate(AP_MODEL_BALL_PATH, &ids[1]);
+        struct AP_Model *c = NULL;
+        pass = ap_model_get_ptr(ids[0], &a) == 0
+                && ap_model_get_ptr(packed, &b) == 0
+                && ap_model_get_ptr(ids[1], &c) == 0
+                && a->resource != b->resource && a->resource == c->resource
+                && b->resource->vertex_format == AP_VERTEX_FORMAT_PACKED
+                && b->resource->mesh[0].vertex_format
+                        == AP_VERTEX_FORMAT_PACKED;
+        ap_model_release(ids[0]);
+        ap_model_release(ids[1]);
+        ap_model_release(packed);
+        LOGI("vertex format: %s", pass ? "PASS" : "FAILED");
+
+        ap_model_set_cache_dir(AP_MODEL_CACHE_DIR);
+        test_gl_context_destroy(window);
+
+        printf("------Shared model test finished------\n\n");
+}
+
+void test_model_import_benchmark()
+{
+        printf("------Model import benchmark------\n");
+        // grid of 708 x 708 quads, about 1M triangles
+        const char *path = "test_grid.obj";
+        const int size = 708;
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+                LOGE("failed to write %s", path);
+                return;
+        }
+        for (int y = 0; y <= size; ++y) {
+                for (int x = 0; x <= size; ++x) {
+                        fprintf(fp, "v %d %d 0\nvt %f %f\n", x, y,
+                                (float) x / size, (float) y / size);
+                }
+        }
+        fprintf(fp, "vn 0 0 1\n");
+        for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                        int v = y * (size + 1) + x + 1;
+                        int w = v + size + 1;
+                        fprintf(fp, "f %d/%d/1 %d/%d/1 %d/%d/1\n",
+                                v, v, v + 1, v + 1, w, w);
+                        fprintf(fp, "f %d/%d/1 %d/%d/1 %d/%d/1\n",
+                                v + 1, v + 1, w + 1, w + 1, w, w);
+                }
+        }
+        fclose(fp);
+
+        GLFWwindow *window = test_gl_context_create();
+        if (window == NULL) {
+                remove(path);
+                return;
+        }
+        ap_model_set_cache_dir(NULL);
+
+        // staged in the frame arena and copied by ap_mesh_init as before
+        double start = ap_get_time();
+        int staged_triangles = test_model_load_staged(path, ap_arena_frame());
+        glFinish();
+        double staged = ap_get_time() - start;
+
+        unsigned int id = 0;
+        struct AP_Model *model = NULL;
+        start = ap_get_time();
+        int ret = ap_model_generate(path, &id);
+        glFinish();
+        double elapsed = ap_get_time() - start;
+        ap_model_get_ptr(id, &model);
+        int triangles = 0;
+        for (int i = 0; model && i < model->resource->mesh_length; ++i) {
+                triangles += model->resource->mesh[i].indices_length / 3;
+        }
+        ap_model_release(id);
+        LOGI("%d triangles: staged %.3lfms, direct %.3lfms (%.2lfx), %s",
+                triangles, staged * 1000, elapsed * 1000, staged / elapsed,
+                ret == 0 && triangles == 2 * size * size
+                        && staged_triangles == triangles
+                        ? "PASS" : "FAILED");
+
+        ap_model_set_cache_dir(AP_MODEL_CACHE_DIR);
+        test_gl_context_destroy(window);
+        remove(path);
+
+        printf("------Model import benchmark finished------\n\n");
+}
+
+void test_model_import_parallel()
+{
+        printf("------Model parallel import test------\n");
+        // 128 objects of 48 x 48 quads, each one is a mesh
+        const char *path = "test_meshes.obj";
+        const int object_num = 128;
+        const int size = 48;
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+                LOGE("failed to write %s", path);
+                return;
+        }
+        fprintf(fp, "vn 0 0 1\n");
+        int base = 0;
+        for (int o = 0; o < object_num; ++o) {
+                fprintf(fp, "o mesh_%d\n", o);
+                for (int y = 0; y <= size; ++y) {
+                        for (int x = 0; x <= size; ++x) {
+                                fprintf(fp, "v %d %d %d\n", x, y, o);
+                        }
+                }
+                for (int y = 0; y < size; ++y) {
+                        for (int x = 0; x < size; ++x) {
+                                int v = base + y * (size + 1) + x + 1;
+                                int w = v + size + 1;
+                                fprintf(fp, "f %d//1 %d//1 %d//1\n",
+                                        v, v + 1, w);
+                                fprintf(fp, "f %d//1 %d//1 %d//1\n",
+                                        v + 1, w + 1, w);
+                        }
+                }
+                base += (size + 1) * (size + 1);
+        }
+        fclose(fp);
+
+        GLFWwindow *window = test_gl_context_create();
+        if (window == NULL) {
+                remove(path);
+                return;
+        }
+        ap_model_set_cache_dir(NULL);
+        // the renderer starts the job system, stop it for the serial run
+        ap_thread_free();
+
+        // imported on one thread first, then by the job system,
+        // the meshes are expected in the same order
+        float (*aabb)[6] = AP_MALLOC(sizeof(float) * 6 * object_num);
+        double serial = 0.0;
+        bool passed = aabb != NULL;
+        for (int run = 0; passed && run < 2; ++run) {
+                if (run == 1) {
+                        ap_thread_init(0);
+                }
+                unsigned int id = 0;
+                struct AP_Model *model = NULL;
+                double start = ap_get_time();
+                ap_model_generate(path, &id);
+                glFinish();
+                double elapsed = ap_get_time() - start;
+                ap_model_get_ptr(id, &model);
+                if (model == NULL
+                        || model->resource->mesh_length != object_num)
+                {
+                        passed = false;
+                        break;
+                }
+                for (int i = 0; i < object_num; ++i) {
+                        struct AP_Mesh *mesh = &model->resource->mesh[i];
+                        if (run == 0) {
+                                memcpy(aabb[i], mesh->aabb, sizeof(aabb[i]));
+                        } else if (memcmp(aabb[i], mesh->aabb,
+                                sizeof(aabb[i])) != 0)
+                        {
+                                passed = false;
+                        }
+                }
+                ap_model_release(id);
+                if (run == 0) {
+                        serial = elapsed;
+                        LOGI("1 thread: %.3lfms", elapsed * 1000);
+                } else {
+                        LOGI("%d threads: %.3lfms, speedup %.2lfx",
+                                ap_thread_num(), elapsed * 1000,
+                                serial / elapsed);
+                        ap_thread_free();
+                }
+        }
+        AP_FREE(aabb);
+        LOGI("mesh order: %s", passed ? "PASS" : "FAILED");
+
+        ap_model_set_cache_dir(AP_MODEL_CACHE_DIR);
+        test_gl_context_destroy(window);
+        remove(path);
+
+        printf("------Model parallel import test finished------\n\n");
+}
+
+void test_texture_cache()
+{
+        printf("------Texture cache test------\n");
+        // 2x2 gray image
+        const char *path = "test_texture.ppm";
+        FILE *fp = fopen(path, "wb");
+        if (fp == NULL) {
+                LOGE("failed to write %s", path);
+                return;
+        }
+        fprintf(fp, "P6\n2 2\n255\n");
+        for (int i = 0; i < 12; ++i) {
+                fputc(128, fp);
+        }
+        fclose(fp);
+
+        GLFWwindow *window = test_gl_context_create();
+        if (window == NULL) {
+                remove(path);
+                return;
+        }
+
+        bool passed = true;
+        // the same file through different directories
+        unsigned int a = 0, b = 0;
+        ap_texture_generate(&a, AP_TEXTURE_TYPE_DIFFUSE, path, "./", false);
+        ap_texture_generate(&b, AP_TEXTURE_TYPE_DIFFUSE, path, "", false);
+        passed = passed && a != 0 && a == b
+                && ap_texture_get_ptr_by_path(path, "./")
+                        == ap_texture_get_ptr(a);
+
+        // colors of the same 8 bit RGBA
+        float gray[4] = { 0.5f, 0.5f, 0.5f, 1.0f };
+        float near[4] = { 0.5001f, 0.5f, 0.5f, 1.0f };
+        float red[4] = { 1.0f, 0.0f, 0.0f, 1.0f };
+        unsigned int c = 0, d = 0, e = 0;
+        ap_texture_generate_RGBA(&c, gray, 16, AP_TEXTURE_TYPE_DIFFUSE);
+        ap_texture_generate_RGBA(&d, near, 16, AP_TEXTURE_TYPE_DIFFUSE);
+        ap_texture_generate_RGBA(&e, red, 16, AP_TEXTURE_TYPE_DIFFUSE);
+        passed = passed && c != 0 && c == d && c != e
+                && ap_texture_get_ptr_by_RGBA(gray) == ap_texture_get_ptr(c);
+
+        // released with the last reference
+        ap_texture_release(a);
+        passed = passed && ap_texture_get_ptr(a) != NULL;
+        ap_texture_release(b);
+        passed = passed && ap_texture_get_ptr(a) == NULL
+                && ap_texture_get_ptr_by_path(path, "./") == NULL;
+        ap_texture_release(c);
+        ap_texture_release(d);
+        ap_texture_release(e);
+        passed = passed && ap_texture_get_ptr_by_RGBA(gray) == NULL
+                && ap_texture_get_ptr_by_RGBA(red) == NULL;
+        LOGI("texture cache: %s", passed ? "PASS" : "FAILED");
+
+        // two paths of the same hash, which do not exist so that they are
+        // not resolved, are different textures
+        const char *dir = "/ap_test_textures/";
+        char name[2][32] = { "", "" };
+        int found = -1;
+        struct AP_Hashmap names;
+        ap_hashmap_init(&names, sizeof(int));
+        for (int i = 0; found < 0 && i < 1000000; ++i) {
+                char joined[64];
+                sprintf(joined, "%s%d.png", dir, i);
+                unsigned int hash = ap_hash_str(joined);
+                int *other = ap_hashmap_get(&names, hash);
+                if (other) {
+                        sprintf(name[0], "%d.png", *other);
+                        sprintf(name[1], "%d.png", i);
+                        found = i;
+                } else {
+                        ap_hashmap_insert(&names, hash, &i);
+                }
+        }
+        ap_hashmap_free(&names);
+        passed = found >= 0;
+        unsigned char pixel[4] = { 255, 255, 255, 255 };
+        struct AP_Texture_Image image = { pixel, 1, 1, 4 };
+        unsigned int f = 0, g = 0;
+        if (passed) {
+                ap_texture_generate_image(&f, AP_TEXTURE_TYPE_DIFFUSE,
+                        name[0], dir, &image);
+                ap_texture_generate_image(&g, AP_TEXTURE_TYPE_DIFFUSE,
+                        name[1], dir, &image);
+                passed = f != 0 && g != 0 && f != g
+                        && ap_texture_get_ptr_by_path(name[0], dir)
+                                == ap_texture_get_ptr(f)
+                        && ap_texture_get_ptr_by_path(name[1], dir)
+                                == ap_texture_get_ptr(g);
+                // the first one is behind the second one in the chain
+                ap_texture_release(f);
+                passed = passed && ap_texture_get_ptr_by_path(name[0], dir)
+                        == NULL && ap_texture_get_ptr_by_path(name[1], dir)
+                                == ap_texture_get_ptr(g);
+                ap_texture_release(g);
+        }
+        LOGI("hash collision %s %s: %s", name[0], name[1],
+                passed ? "PASS" : "FAILED");
+
+        test_gl_context_destroy(window);
+        remove(path);
+
+        printf("------Texture cache test finished------\n\n");
+}
+
+// calls recorded by the render queue test backend
+static int test_queue_programs;
+static int test_queue_textures;
+static int test_queue_vaos;
+static int test_queue_matrices;
+static int test_queue_draws;
+static int test_queue_instances;
+static unsigned int test_queue_last_program;
+static bool test_queue_grouped;
+
+static void test_queue_use_program(unsigned int program)
+{
+        // a program is never used again after the next one
+        if (program < test_queue_last_program) {
+                test_queue_grouped = false;
+        }
+        test_queue_last_program = program;
+        test_queue_programs++;
+}
+
+static void test_queue_bind_texture(int unit, unsigned int texture)
+{
+        test_queue_textures++;
+}
+
+static void test_queue_bind_vertex_array(unsigned int vao)
+{
+        test_queue_vaos++;
+}
+
+static void test_queue_set_matrix(int location, const float *mat)
+{
+        test_queue_matrices++;
+}
+
+static void test_queue_draw_elements(
+        unsigned int index_type, int index_count, int instance_count)
+{
+        test_queue_draws++;
+        test_queue_instances += instance_count;
+}
+
+void test_render_queue()
+{
+        LOGI("-------Render queue test-------");
+
+        struct AP_Render_Backend backend = {
+                .use_program = test_queue_use_program,
+                .bind_texture = test_queue_bind_texture,
+                .bind_vertex_array = test_queue_bind_vertex_array,
+                .set_matrix = test_queue_set_matrix,
+                .draw_elements = test_queue_draw_elements,
+        };
+        struct AP_Render_Queue queue;
+        ap_render_queue_init(&queue);
+
+        // 2 programs, 4 textures and 8 vertex arrays submitted interleaved
+        const int num = 64;
+        float mat[16] = { 0 };
+        unsigned int matrix = 0;
+        ap_render_queue_push_matrix(&queue, mat, &matrix);
+        for (int i = 0; i < num; ++i) {
+                struct AP_Render_Command command = {
+                        .program = 1 + i % 2,
+                        .vao = 1 + i % 8,
+                        .matrix = matrix,
+                        .index_count = 3,
+                        .texture_num = 1,
+                        .textures = { 1 + i % 4 },
+                };
+                ap_render_queue_submit(&queue, &command, (float) i);
+        }
+        test_queue_grouped = true;
+        ap_render_queue_execute(&queue, &backend);
+        bool pass = test_queue_draws == num && test_queue_programs == 2
+                && test_queue_grouped && test_queue_matrices == 1
+                && test_queue_textures == 4 && test_queue_vaos == 8
+                && ap_render_queue_length(&queue) == 0;
+        LOGI("programs %d, textures %d, vertex arrays %d, draws %d",
+                test_queue_programs, test_queue_textures,
+                test_queue_vaos, test_queue_draws);
+        LOGI("redundant state filter: %s", pass ? "PASS" : "FAILED");
+
+        // instanced commands need no matrix
+        struct AP_Render_Command instanced = {
+                .program = 1,
+                .vao = 9,
+                .index_count = 3,
+                .instance_count = 100,
+        };
+        test_queue_matrices = 0;
+        test_queue_draws = 0;
+        pass = ap_render_queue_submit(&queue, &instanced, 0.0f) == 0;
+        ap_render_queue_execute(&queue, &backend);
+        pass = pass && test_queue_draws == 1 && test_queue_matrices == 0
+                && test_queue_instances == 100;
+        LOGI("instanced command: %s", pass ? "PASS" : "FAILED");
+
+        // sorted keys are in order
+        ap_render_queue_push_matrix(&queue, mat, &matrix);
+        for (int i = 0; i < 100000; ++i) {
+                struct AP_Render_Command command = {
+                        .program = rand() % 8,
+                        .vao = rand(),
+                        .texture_num = 1,
+                        .textures = { rand() },
+                };
+                ap_render_queue_submit(&queue, &command,
+                        (float) rand() / RAND_MAX * 1000.0f);
+        }
+        double start = ap_get_time();
+        ap_render_queue_sort(&queue);
+        double elapsed = ap_get_time() - start;
+        struct AP_Render_Command *commands =
+                (struct AP_Render_Command*) queue.commands.data;
+        struct AP_Render_Sort_Item *items =
+                (struct AP_Render_Sort_Item*) queue.items.data;
+        pass = true;
+        for (size_t i = 1; i < queue.items.length; ++i) {
+                if (commands[items[i].index].key
+                        < commands[items[i - 1].index].key)
+                {
+                        pass = false;
+                }
+        }
+        LOGI("radix sort of %zu commands: %.3f ms, %s",
+                queue.items.length, elapsed * 1000.0,
+                pass ? "PASS" : "FAILED");
+
+        ap_render_queue_free(&queue);
+        printf("------Render queue test finished--------\n\n");
+}
+
+// uniforms of the program of the shader reflection test GL stubs
+struct test_shader_uniform {
+        const char *name;
+        int size;
+        int location;
+};
+
+static char test_shader_collided[2][16];
+static struct test_shader_uniform test_shader_active[] = {
+        { "view", 1, 0 },
+        { "light[0]", 3, 1 },
+        // members of uniform blocks have no location
+        { "Lights.color", 1, -1 },
+        { test_shader_collided[0], 1, 4 },
+        { test_shader_collided[1], 1, 5 },
+};
+static int test_shader_location_calls;
+
+static GLuint APIENTRY test_shader_create_shader(GLenum type)
+{
+        return 1;
+}
+
+static void APIENTRY test_shader_source(GLuint shader, GLsizei count,
+        const GLchar *const *string, const GLint *length)
+{
+}
+
+static void APIENTRY test_shader_compile(GLuint shader)
+{
+}
+
+static void APIENTRY test_shader_get_shader_iv(
+        GLuint shader, GLenum pname, GLint *params)
+{
+        *params = 1;
+}
+
+static GLuint APIENTRY test_shader_create_program()
+{
+        return 7;
+}
+
+static void APIENTRY test_shader_attach(GLuint program, GLuint shader)
+{
+}
+
+static void APIENTRY test_shader_link(GLuint program)
+{
+}
+
+static void APIENTRY test_shader_delete_shader(GLuint shader)
+{
+}
+
+static void APIENTRY test_shader_get_program_iv(
+        GLuint program, GLenum pname, GLint *params)
+{
+        switch (pname)
+        {
+        case GL_ACTIVE_UNIFORMS:
+                *params = sizeof(test_shader_active)
+                        / sizeof(test_shader_active[0]);
+                break;
+        case GL_ACTIVE_UNIFORM_MAX_LENGTH:
+                *params = 16;
+                break;
+        default:
+                *params = 1;
+                break;
+        }
+}
+
+static void APIENTRY test_shader_get_active_uniform(GLuint program,
+        GLuint index, GLsizei buffer_size, GLsizei *length, GLint *size,
+        GLenum *type, GLchar *name)
+{
+        snprintf(name, buffer_size, "%s", test_shader_active[index].name);
+        *length = strlen(name);
+        *size = test_shader_active[index].size;
+        *type = GL_FLOAT;
+}
+
+static GLint APIENTRY test_shader_get_location(
+        GLuint program, const GLchar *name)
+{
+        ++test_shader_location_calls;
+        int num = sizeof(test_shader_active) / sizeof(test_shader_active[0]);
+        for (int i = 0; i < num; ++i) {
+                const char *active = test_shader_active[i].name;
+                size_t length = strlen(active);
+                if (strcmp(active, name) == 0) {
+                        return test_shader_active[i].location;
+                }
+                // elements of array, "light" is "light[0]"
+                if (length > 3 && strcmp(active + length - 3, "[0]") == 0
+                        && strncmp(active, name, length - 3) == 0)
+                {
+                        int index = 0;
+                        if (name[length - 3] == '\0') {
+                                return test_shader_active[i].location;
+                        }
+                        if (sscanf(name + length - 3, "[%d]", &index) == 1
+                                && index < test_shader_active[i].size)
+                        {
+                                return test_shader_active[i].location
+                                        + index;
+                        }
+                }
+        }
+        return -1;
+}
+
+static void APIENTRY test_shader_use_program(GLuint program)
+{
+}
+
+static void APIENTRY test_shader_delete_program(GLuint program)
+{
+}
+
+void test_shader_reflect()
+{
+        LOGI("-------Shader reflection test-------");
+
+        // two uniform names of the same hash
+        struct AP_Hashmap names;
+        ap_hashmap_init(&names, sizeof(int));
+        bool found = false;
+        for (int i = 0; !found && i < 1000000; ++i) {
+                char name[16];
+                sprintf(name, "u%d", i);
+                unsigned int hash = ap_hash_str(name);
+                int *other = ap_hashmap_get(&names, hash);
+                if (other) {
+                        sprintf(test_shader_collided[0], "u%d", *other);
+                        strcpy(test_shader_collided[1], name);
+                        found = true;
+                } else {
+                        ap_hashmap_insert(&names, hash, &i);
+                }
+        }
+        ap_hashmap_free(&names);
+
+        const char *path = "test_shader.glsl";
+        FILE *fp = fopen(path, "w");
+        if (!found || fp == NULL) {
+                LOGE("failed to setup shader reflection test");
+                if (fp) {
+                        fclose(fp);
+                }
+                return;
+        }
+        fprintf(fp, "void main() {}\n");
+        fclose(fp);
+
+        // the GL functions used by ap_shader are replaced by the stubs
+        PFNGLCREATESHADERPROC create_shader = glad_glCreateShader;
+        PFNGLSHADERSOURCEPROC shader_source = glad_glShaderSource;
+        PFNGLCOMPILESHADERPROC compile_shader = glad_glCompileShader;
+        PFNGLGETSHADERIVPROC get_shader_iv = glad_glGetShaderiv;
+        PFNGLCREATEPROGRAMPROC create_program = glad_glCreateProgram;
+        PFNGLATTACHSHADERPROC attach_shader = glad_glAttachShader;
+        PFNGLLINKPROGRAMPROC link_program = glad_glLinkProgram;
+        PFNGLDELETESHADERPROC delete_shader = glad_glDeleteShader;
+        PFNGLGETPROGRAMIVPROC get_program_iv = glad_glGetProgramiv;
+        PFNGLGETACTIVEUNIFORMPROC get_active_uniform =
+                glad_glGetActiveUniform;
+        PFNGLGETUNIFORMLOCATIONPROC get_location = glad_glGetUniformLocation;
+        PFNGLUSEPROGRAMPROC use_program = glad_glUseProgram;
+        PFNGLDELETEPROGRAMPROC delete_program = glad_glDeleteProgram;
+        glad_glCreateShader = test_shader_create_shader;
+        glad_glShaderSource = test_shader_source;
+        glad_glCompileShader = test_shader_compile;
+        glad_glGetShaderiv = test_shader_get_shader_iv;
+        glad_glCreateProgram = test_shader_create_program;
+        glad_glAttachShader = test_shader_attach;
+        glad_glLinkProgram = test_shader_link;
+        glad_glDeleteShader = test_shader_delete_shader;
+        glad_glGetProgramiv = test_shader_get_program_iv;
+        glad_glGetActiveUniform = test_shader_get_active_uniform;
+        glad_glGetUniformLocation = test_shader_get_location;
+        glad_glUseProgram = test_shader_use_program;
+        glad_glDeleteProgram = test_shader_delete_program;
+
+        unsigned int program = 0;
+        bool pass = ap_shader_generate(path, path, &program) == 0
+                && program == 7;
+
+        // reflected, the driver is not asked
+        int locations[3] = { 0 };
+        test_shader_location_calls = 0;
+        ap_shader_get_locations(program, "light[%d]", 3, locations);
+        pass = pass && ap_shader_get_location(program, "view") == 0
+                && ap_shader_get_location(program, "light") == 1
+                && locations[0] == 1 && locations[1] == 2
+                && locations[2] == 3
+                && ap_shader_get_location(program, "light[3]") == -1
+                && ap_shader_get_location(program, "Lights.color") == -1
+                && ap_shader_get_location(program, "missing") == -1
+                && test_shader_location_calls == 0;
+        LOGI("reflected locations: %s", pass ? "PASS" : "FAILED");
+
+        // the names of the same hash are looked up by the driver
+        pass = ap_shader_get_location(program, test_shader_collided[0]) == 4
+                && ap_shader_get_location(program,
+                        test_shader_collided[1]) == 5
+                && test_shader_location_calls == 2;
+        LOGI("hash collision %s %s: %s", test_shader_collided[0],
+                test_shader_collided[1], pass ? "PASS" : "FAILED");
+
+        ap_shader_free();
+        glad_glCreateShader = create_shader;
+        glad_glShaderSource = shader_source;
+        glad_glCompileShader = compile_shader;
+        glad_glGetShaderiv = get_shader_iv;
+        glad_glCreateProgram = create_program;
+        glad_glAttachShader = attach_shader;
+        glad_glLinkProgram = link_program;
+        glad_glDeleteShader = delete_shader;
+        glad_glGetProgramiv = get_program_iv;
+        glad_glGetActiveUniform = get_active_uniform;
+        glad_glGetUniformLocation = get_location;
+        glad_glUseProgram = use_program;
+        glad_glDeleteProgram = delete_program;
+        remove(path);
+        LOGI("unreleased: %d", ap_memory_unreleased_num());
+
+        printf("------Shader reflection test finished--------\n\n");
+}
+
+static atomic_int test_thread_count;
+static atomic_int test_thread_stage;
+static float *test_thread_array;
+
+static void test_thread_count_job(void *param)
+{
+        atomic_fetch_add(&test_thread_count, 1);
+}
+
+static void test_thread_stage_job(void *param)
+{
+        int stage = (int) (intptr_t) param;
+        // the job of stage n starts after all jobs of stage n - 1
+        if (atomic_load(&test_thread_count) < stage * 100) {
+                atomic_store(&test_thread_stage, -1);
+        }
+}
+
+static void test_thread_range(void *param, int begin, int end)
+{
+        for (int i = begin; i < end; ++i) {
+                float v = (float) i;
+                for (int j = 0; j < 64; ++j) {
+                        v = v * 0.999f + 1.0f;
+                }
+                test_thread_array[i] = v;
+        }
+}
+
+void test_ap_thread()
+{
+        LOGI("-------AP_Thread test-------");
+
+        ap_thread_init(4);
+        struct AP_Job_Counter counter;
+        ap_job_counter_init(&counter);
+        atomic_store(&test_thread_count, 0);
+        for (int i = 0; i < 10000; ++i) {
+                ap_thread_run(test_thread_count_job, NULL, &counter);
+        }
+        ap_thread_wait(&counter);
+        LOGI("run and wait: %s",
+                atomic_load(&test_thread_count) == 10000
+                ? "PASS" : "FAILED");
+
+        // three stages, each stage depends on the previous one
+        struct AP_Job_Counter stages[3];
+        atomic_store(&test_thread_count, 0);
+        atomic_store(&test_thread_stage, 0);
+        for (int s = 0; s < 3; ++s) {
+                ap_job_counter_init(&stages[s]);
+        }
+        for (int s = 0; s < 3; ++s) {
+                for (int i = 0; i < 100; ++i) {
+                        struct AP_Job_Counter *dep = s ? &stages[s - 1] : NULL;
+                        ap_thread_run_after(dep, test_thread_stage_job,
+                                (void*) (intptr_t) s, &counter);
+                        ap_thread_run_after(dep, test_thread_count_job,
+                                NULL, &stages[s]);
+                }
+        }
+        ap_thread_wait(&stages[2]);
+        ap_thread_wait(&counter);
+        LOGI("job dependencies: %s",
+                atomic_load(&test_thread_stage) == 0
+                && atomic_load(&test_thread_count) == 300
+                ? "PASS" : "FAILED");
+        for (int s = 0; s < 3; ++s) {
+                ap_job_counter_free(&stages[s]);
+        }
+        ap_job_counter_free(&counter);
+
+        const int length = 100000;
+        test_thread_array = malloc(length * sizeof(float));
+        float *expect = malloc(length * sizeof(float));
+        test_thread_range(NULL, 0, length);
+        memcpy(expect, test_thread_array, length * sizeof(float));
+        memset(test_thread_array, 0, length * sizeof(float));
+        ap_thread_parallel_for(length, 0, test_thread_range, NULL);
+        LOGI("parallel for: %s",
+                memcmp(expect, test_thread_array, length * sizeof(float)) == 0
+                ? "PASS" : "FAILED");
+        free(expect);
+        free(test_thread_array);
+        ap_thread_free();
+
+        printf("------AP_Thread test finished--------\n\n");
+}
+
+void test_ap_thread_benchmark()
+{
+        LOGI("-------AP_Thread benchmark-------");
+
+        const int job_num = 1000000;
+        const int length = 4000000;
+        test_thread_array = malloc(length * sizeof(float));
+        ap_thread_init(0);
+        int cores = ap_thread_num();
+        ap_thread_free();
+        double single = 0.0;
+        // powers of two, the number of cores is always the last one
+        for (int n = 1; n <= cores || n == 1;
+                n = (n < cores && n * 2 > cores) ? cores : n * 2)
+        {
+                ap_thread_init(n);
+                struct AP_Job_Counter counter;
+                ap_job_counter_init(&counter);
+                atomic_store(&test_thread_count, 0);
+                double start = ap_get_time();
+                for (int i = 0; i < job_num; ++i) {
+                        ap_thread_run(test_thread_count_job, NULL, &counter);
+                }
+                ap_thread_wait(&counter);
+                double jobs_time = ap_get_time() - start;
+                ap_job_counter_free(&counter);
+
+                start = ap_get_time();
+                ap_thread_parallel_for(length, 0, test_thread_range, NULL);
+                double for_time = ap_get_time() - start;
+                if (n == 1) {
+                        single = for_time;
+                }
+                ap_thread_free();
+
+                LOGI("%2d threads: %.2lfM jobs/s, parallel for %.4lfs, "
+                        "scaling %.2lfx", n, job_num / jobs_time / 1e6,
+                        for_time, single / for_time);
+        }
+        free(test_thread_array);
+
+        printf("------AP_Thread benchmark finished--------\n\n");
+}
+
 // int model_generated = 0;
 // unsigned model_id = 0;
 
@@ -320,11 +2402,10 @@ void test_ap_memory()
 //         model_generated = 1;
 //         struct AP_Model_Thread_Param *param = data;
 
+//         // param is owned by the loader, only valid in the callback
 //         LOGD("generated model %s", param->path);
 //         LOGD("model id %u", param->id);
-//         model_generated = param->id;
-//         AP_FREE(param->path);
-//         AP_FREE(param);
+//         model_id = param->id;
 //         return 0;
 // }
 
@@ -358,20 +2439,169 @@ void test_ap_memory()
 //         glfwMakeContextCurrent(window);
 
 //         ap_set_context_ptr(window);
+//         ap_thread_init(0);
 //         const char *test_path = "backpack/backpack.obj";
 //         ap_model_generate_async(test_path, ap_model_thread_cb);
 //         while (!glfwWindowShouldClose(window)) {
 //                 if (!model_generated) {
 //                         LOGD("waiting");
 //                 }
+//                 // textures and meshes are uploaded here
+//                 ap_render_process_uploads(AP_RENDER_UPLOAD_BUDGET);
 //                 // refresh
 //                 glfwSwapBuffers(window);
 //                 glfwPollEvents();
 //         }
 //         LOGI("generated model id %u", model_id);
+//         ap_thread_free();
 //         ap_memory_release();
 // }
 
+void test_render_text_benchmark()
+{
+        printf("------AP_Render text benchmark------\n");
+        // no font is shipped with the tests
+        const char *font = getenv("AP_TEST_FONT");
+        if (font == NULL) {
+                LOGW("SKIPPED: set AP_TEST_FONT to the path of a font file");
+                printf("------AP_Render text benchmark skipped------\n\n");
+                return;
+        }
+        GLFWwindow *window = test_gl_context_create();
+        if (window == NULL) {
+                return;
+        }
+        ap_render_resize_buffer(800, 600);
+        if (ap_render_init_font(font, 0) != 0) {
+                LOGE("SKIPPED: failed to load font %s", font);
+                test_gl_context_destroy(window);
+                printf("------AP_Render text benchmark skipped------\n\n");
+                return;
+        }
+
+        // debug HUD of 20 lines with 200 characters
+        const int line_num = 20;
+        const int frames = 100;
+        char line[201];
+        for (int i = 0; i < 200; ++i) {
+                line[i] = ' ' + i % 95;
+        }
+        line[200] = '\0';
+        float color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+        // the per glyph texture path is removed, it is emulated by one
+        // line for each glyph which costs the same GL calls
+        double start = ap_get_time();
+        for (int f = 0; f < frames; ++f) {
+                for (int l = 0; l < line_num; ++l) {
+                        float x = 0.0f;
+                        for (int i = 0; i < 200; ++i) {
+                                char c[2] = { line[i], '\0' };
+                                struct AP_Character *p = NULL;
+                                ap_render_get_font_ptr(line[i], &p);
+                                ap_render_text_line(
+                                        c, x, l * 24.0f, 0.5f, color);
+                                x += (p->advance >> 6) * 0.5f;
+                        }
+                }
+                glFinish();
+        }
+        double glyph_time = ap_get_time() - start;
+
+        start = ap_get_time();
+        for (int f = 0; f < frames; ++f) {
+                for (int l = 0; l < line_num; ++l) {
+                        ap_render_text_line(
+                                line, 0.0f, l * 24.0f, 0.5f, color);
+                }
+                glFinish();
+        }
+        double line_time = ap_get_time() - start;
+
+        LOGI("draw each glyph (emulated, a line per glyph): "
+                "%.3lfms per frame", glyph_time * 1000 / frames);
+        LOGI("draw each line:  %.3lfms per frame, %.2lfx faster",
+                line_time * 1000 / frames, glyph_time / line_time);
+
+        test_gl_context_destroy(window);
+
+        printf("------AP_Render text benchmark finished------\n\n");
+}
+
+void test_instance_benchmark()
+{
+        printf("------AP_Instance benchmark------\n");
+        GLFWwindow *window = test_gl_context_create();
+        if (window == NULL) {
+                return;
+        }
+        ap_render_resize_buffer(800, 600);
+        unsigned int model_id = 0;
+        unsigned int batch_id = 0;
+        if (ap_model_generate(AP_MODEL_CUBE_PATH, &model_id) != 0
+                || ap_instance_register(model_id, &batch_id) != 0)
+        {
+                LOGE("failed to load cube model");
+                test_gl_context_destroy(window);
+                return;
+        }
+
+        // cubes on a 100 x 100 grid in front of the camera
+        const int max_num = 10000;
+        const int frames = 10;
+        float (*positions)[3] = AP_MALLOC(sizeof(float) * 3 * max_num);
+        float *matrices = AP_MALLOC(sizeof(float) * 16 * max_num);
+        for (int i = 0; i < max_num; ++i) {
+                positions[i][0] = (i % 100) * 0.5f - 25.0f;
+                positions[i][1] = (i / 100) * 0.5f - 25.0f;
+                positions[i][2] = -40.0f;
+                mat4 mat;
+                glm_mat4_identity(mat);
+                glm_translate(mat, positions[i]);
+                memcpy(matrices + 16 * i, mat, sizeof(mat4));
+        }
+
+        for (int num = 1; num <= max_num; num *= 10) {
+                int model_calls = 0;
+                double start = ap_get_time();
+                for (int f = 0; f < frames; ++f) {
+                        ap_render_flush();
+                        ap_model_use(model_id);
+                        for (int i = 0; i < num; ++i) {
+                                ap_model_set_pos(positions[i]);
+                                ap_model_draw();
+                        }
+                        ap_render_draw_queue();
+                        glFinish();
+                }
+                double model_time = ap_get_time() - start;
+                ap_render_get_queue_stats(&model_calls, NULL);
+
+                int instance_calls = 0;
+                start = ap_get_time();
+                for (int f = 0; f < frames; ++f) {
+                        ap_render_flush();
+                        ap_instance_set_transforms(batch_id, matrices, num);
+                        ap_instance_draw(batch_id);
+                        ap_render_draw_queue();
+                        glFinish();
+                }
+                double instance_time = ap_get_time() - start;
+                ap_render_get_queue_stats(&instance_calls, NULL);
+
+                LOGI("%5d cubes: ap_model_draw %5d calls %.3lfms, "
+                        "instanced %d calls %.3lfms",
+                        num, model_calls, model_time * 1000 / frames,
+                        instance_calls, instance_time * 1000 / frames);
+        }
+
+        AP_FREE(positions);
+        AP_FREE(matrices);
+        test_gl_context_destroy(window);
+
+        printf("------AP_Instance benchmark finished------\n\n");
+}
+
 void test_audio()
 {
         LOGI("start init ap_audio");
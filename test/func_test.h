@@ -8,8 +8,35 @@ void test_vector_float();
 void test_vector_char();
 void test_vector_uint();
 void test_vector_int();
+void test_vector_bulk();
+void test_vector_growth();
 void test_ap_memory();
+void test_ap_memory_benchmark();
+void test_ap_memory_stat();
+void test_ap_memory_threads();
+void test_ap_arena();
+void test_ap_arena_benchmark();
+void test_ap_pool();
+void test_ap_slot_map();
+void test_ap_hashmap();
+void test_utf8_decode();
+void test_light_cluster();
+void test_render_queue();
+void test_shader_reflect();
+void test_frustum_cull();
+void test_instance_benchmark();
+void test_vertex_format();
+void test_vertex_cache();
+void test_model_cache();
+void test_model_cache_benchmark();
+void test_model_shared();
+void test_model_import_benchmark();
+void test_model_import_parallel();
+void test_texture_cache();
+void test_ap_thread();
+void test_ap_thread_benchmark();
 void test_model_async();
+void test_render_text_benchmark();
 void test_audio();
 void test_decode();
 void test_sqlite();
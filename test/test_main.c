@@ -12,6 +12,10 @@ int main(int argc, char **argv)
 
     // test_vector_int();
 
+    // test_vector_bulk();
+
+    // test_vector_growth();
+
     // LOGD("Debug msg");
     // LOGI("Info msg");
     // LOGW("Warn msg");
@@ -19,8 +23,58 @@ int main(int argc, char **argv)
 
     // test_ap_memory();
 
+    // test_ap_memory_benchmark();
+
+    // test_ap_memory_stat();
+
+    // test_ap_memory_threads();
+
+    // test_ap_arena();
+
+    // test_ap_arena_benchmark();
+
+    // test_ap_pool();
+
+    // test_ap_slot_map();
+
+    // test_ap_hashmap();
+
+    // test_utf8_decode();
+
+    // test_light_cluster();
+
+    // test_render_queue();
+
+    // test_shader_reflect();
+
+    // test_frustum_cull();
+
+    // test_instance_benchmark();
+
+    // test_vertex_format();
+
+    // test_vertex_cache();
+
+    // test_model_cache();
+
+    // test_model_cache_benchmark();
+
+    // test_model_shared();
+
+    // test_model_import_benchmark();
+
+    // test_model_import_parallel();
+
+    // test_texture_cache();
+
+    // test_ap_thread();
+
+    // test_ap_thread_benchmark();
+
     // // test_model_async();
 
+    // test_render_text_benchmark();
+
     // test_audio();
 
     // test_decode();